@@ -0,0 +1,263 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <linux/netlink.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include "BlockDeviceMonitor.h"
+#include "util.h"
+
+namespace {
+
+// Longest time to wait for an event before running the routine again anyway.
+constexpr auto c_recheckPeriod = std::chrono::seconds{1};
+
+constexpr int c_receiveBufferSize = 1024 * 1024;
+
+constexpr size_t c_maximumEventSize = 8192;
+
+} // namespace
+
+BlockDeviceMonitor::BlockDeviceMonitor()
+{
+    m_socket.reset(socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT));
+    if (!m_socket)
+    {
+        LOG_ERROR("socket(NETLINK_KOBJECT_UEVENT) failed {}, polling for block devices", errno);
+        return;
+    }
+
+    //
+    // The socket is only read while a caller is waiting, so give it room for the events that arrive
+    // in between.
+    //
+
+    setsockopt(m_socket.get(), SOL_SOCKET, SO_RCVBUFFORCE, &c_receiveBufferSize, sizeof(c_receiveBufferSize));
+
+    sockaddr_nl Address{};
+    Address.nl_family = AF_NETLINK;
+    Address.nl_groups = 1;
+    if (bind(m_socket.get(), reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) < 0)
+    {
+        LOG_ERROR("bind(NETLINK_KOBJECT_UEVENT) failed {}, polling for block devices", errno);
+        m_socket.reset();
+    }
+}
+
+/**
+ * @brief Look up the disk at a SCSI address in the disks that were added since the monitor was
+ * created. Disks that were present before aren't known, so callers fall back to sysfs.
+ *
+ * @param[in] ScsiAddress The SCSI address, for example 0:0:0:1.
+ *
+ * @return The device name (for example sdb), if known.
+ */
+std::optional<std::string> BlockDeviceMonitor::FindDisk(std::string_view ScsiAddress)
+{
+    std::lock_guard Guard{m_lock};
+    const auto Found = m_disks.find(ScsiAddress);
+    if (Found == m_disks.end())
+    {
+        return {};
+    }
+
+    return Found->second;
+}
+
+/**
+ * @brief Return the block device monitor of the calling process. A forked child creates its own
+ * monitor the first time it's used, since the parent and the child would otherwise consume each
+ * other's events.
+ */
+std::shared_ptr<BlockDeviceMonitor> BlockDeviceMonitor::Current()
+{
+    static std::mutex Lock;
+    static std::shared_ptr<BlockDeviceMonitor> Monitor;
+    static pid_t Owner = 0;
+
+    std::lock_guard Guard{Lock};
+    if (!Monitor || Owner != getpid())
+    {
+        Monitor = std::make_shared<BlockDeviceMonitor>();
+        Owner = getpid();
+    }
+
+    return Monitor;
+}
+
+uint64_t BlockDeviceMonitor::CurrentGeneration()
+{
+    std::lock_guard Guard{m_lock};
+    return m_generation;
+}
+
+/**
+ * @brief Wait until a block device event is received after a generation was read, or until the
+ * deadline.
+ *
+ * @param[in] Generation The generation read before the caller last looked for its device.
+ * @param[in] Deadline The time to stop waiting at.
+ */
+void BlockDeviceMonitor::WaitForChange(uint64_t Generation, std::chrono::steady_clock::time_point Deadline)
+{
+    if (!m_socket)
+    {
+        std::this_thread::sleep_for(
+            std::min<std::chrono::steady_clock::duration>(c_defaultRetryPeriod, Deadline - std::chrono::steady_clock::now()));
+        return;
+    }
+
+    const auto Recheck = std::min(Deadline, std::chrono::steady_clock::now() + c_recheckPeriod);
+    std::unique_lock Guard{m_lock};
+    while (m_generation == Generation)
+    {
+        const auto Now = std::chrono::steady_clock::now();
+        if (Now >= Recheck)
+        {
+            return;
+        }
+
+        //
+        // If another thread is reading the socket, wait for it to report an event.
+        //
+
+        if (m_reading)
+        {
+            m_changed.wait_until(Guard, Recheck);
+            continue;
+        }
+
+        m_reading = true;
+        Guard.unlock();
+
+        bool Changed = false;
+        pollfd PollDescriptor{m_socket.get(), POLLIN};
+        const auto Timeout = std::chrono::ceil<std::chrono::milliseconds>(Recheck - Now);
+        if (TEMP_FAILURE_RETRY(poll(&PollDescriptor, 1, static_cast<int>(Timeout.count()))) > 0)
+        {
+            std::vector<char> Buffer(c_maximumEventSize);
+            for (;;)
+            {
+                sockaddr_nl Sender{};
+                socklen_t SenderSize = sizeof(Sender);
+                const auto Size =
+                    recvfrom(m_socket.get(), Buffer.data(), Buffer.size(), 0, reinterpret_cast<sockaddr*>(&Sender), &SenderSize);
+                if (Size < 0)
+                {
+                    //
+                    // ENOBUFS means events were dropped, so the device may already be there.
+                    //
+
+                    if (errno == ENOBUFS)
+                    {
+                        Changed = true;
+                        continue;
+                    }
+                    else if (errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    break;
+                }
+
+                //
+                // Only events sent by the kernel are considered.
+                //
+
+                if (Sender.nl_pid == 0)
+                {
+                    Guard.lock();
+                    Changed |= ProcessEvent({Buffer.data(), static_cast<size_t>(Size)});
+                    Guard.unlock();
+                }
+            }
+        }
+
+        Guard.lock();
+        m_reading = false;
+        if (Changed)
+        {
+            m_generation += 1;
+        }
+
+        m_changed.notify_all();
+    }
+}
+
+/**
+ * @brief Update the disk map from a kernel uevent. The caller holds the lock.
+ *
+ * @param[in] Event The event, which is a header followed by KEY=VALUE fields, each terminated by a
+ * null character.
+ *
+ * @return true if the event is for a block device.
+ */
+bool BlockDeviceMonitor::ProcessEvent(std::string_view Event)
+{
+    std::string_view Action;
+    std::string_view Subsystem;
+    std::string_view DeviceType;
+    std::string_view DevicePath;
+    std::string_view DeviceName;
+    while (!Event.empty())
+    {
+        const auto End = std::min(Event.find('\0'), Event.size());
+        const auto Field = Event.substr(0, End);
+        Event.remove_prefix(std::min(End + 1, Event.size()));
+        const auto Separator = Field.find('=');
+        if (Separator == std::string_view::npos)
+        {
+            continue;
+        }
+
+        const auto Key = Field.substr(0, Separator);
+        const auto Value = Field.substr(Separator + 1);
+        if (Key == "ACTION")
+        {
+            Action = Value;
+        }
+        else if (Key == "SUBSYSTEM")
+        {
+            Subsystem = Value;
+        }
+        else if (Key == "DEVTYPE")
+        {
+            DeviceType = Value;
+        }
+        else if (Key == "DEVPATH")
+        {
+            DevicePath = Value;
+        }
+        else if (Key == "DEVNAME")
+        {
+            DeviceName = Value;
+        }
+    }
+
+    if (Subsystem != "block")
+    {
+        return false;
+    }
+
+    //
+    // The path of a SCSI disk ends with /<H:C:T:L>/block/<name>.
+    //
+
+    if (DeviceType == "disk" && !DeviceName.empty())
+    {
+        if (Action == "add")
+        {
+            const auto Block = DevicePath.rfind("/block/");
+            if (Block != std::string_view::npos && Block > 0)
+            {
+                const auto Parent = DevicePath.substr(0, Block);
+                m_disks.insert_or_assign(std::string{Parent.substr(Parent.rfind('/') + 1)}, std::string{DeviceName});
+            }
+        }
+        else if (Action == "remove")
+        {
+            std::erase_if(m_disks, [&](const auto& Entry) { return Entry.second == DeviceName; });
+        }
+    }
+
+    return true;
+}
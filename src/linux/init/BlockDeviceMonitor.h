@@ -0,0 +1,76 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include "common.h"
+
+// Waits for hot-added block devices by listening for kernel uevents instead of polling.
+//
+// The monitor opens a NETLINK_KOBJECT_UEVENT socket when it is created, so no event that follows
+// is missed. RetryWithTimeout() runs a routine that looks for a device, and if the routine fails,
+// waits for the next block device event (instead of a fixed retry period) before running it again.
+// One waiting thread at a time reads the socket and wakes the others. Disk add and remove events
+// also maintain a map from SCSI address (H:C:T:L) to device name, which is checked before sysfs.
+//
+// If the socket can't be opened, the routine is retried after the retry period like before. Waits
+// are also cut short if the kernel drops events, or if no event arrives for a while, so a device
+// that doesn't generate an event is still found.
+class BlockDeviceMonitor
+{
+public:
+    BlockDeviceMonitor();
+
+    BlockDeviceMonitor(const BlockDeviceMonitor&) = delete;
+    BlockDeviceMonitor& operator=(const BlockDeviceMonitor&) = delete;
+
+    std::optional<std::string> FindDisk(std::string_view ScsiAddress);
+
+    template <typename T, typename TTimeout>
+    T RetryWithTimeout(
+        const std::function<T()>& Routine,
+        TTimeout Timeout,
+        const std::function<bool()>& RetryPredicate = wsl::shared::retry::AlwaysRetry)
+    {
+        const auto Deadline = std::chrono::steady_clock::now() + Timeout;
+        for (;;)
+        {
+            const auto Generation = CurrentGeneration();
+            try
+            {
+                return Routine();
+            }
+            catch (...)
+            {
+                if (!RetryPredicate() || std::chrono::steady_clock::now() >= Deadline)
+                {
+                    throw;
+                }
+
+                WaitForChange(Generation, Deadline);
+            }
+        }
+    }
+
+    static std::shared_ptr<BlockDeviceMonitor> Current();
+
+private:
+    uint64_t CurrentGeneration();
+    void WaitForChange(uint64_t Generation, std::chrono::steady_clock::time_point Deadline);
+    bool ProcessEvent(std::string_view Event);
+
+    wil::unique_fd m_socket;
+    std::mutex m_lock;
+    std::condition_variable m_changed;
+    uint64_t m_generation{};
+    bool m_reading{};
+    std::map<std::string, std::string, std::less<>> m_disks;
+};
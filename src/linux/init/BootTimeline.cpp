@@ -0,0 +1,217 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <map>
+#include <set>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "common.h"
+#include "BootTimeline.h"
+#include "util.h"
+
+namespace {
+
+// Append a string to the trace as a JSON string literal.
+void AppendString(std::string& Json, const char* Value)
+{
+    Json += '"';
+    for (; *Value != '\0'; Value++)
+    {
+        const auto Character = static_cast<unsigned char>(*Value);
+        if (Character == '"' || Character == '\\')
+        {
+            Json += '\\';
+            Json += static_cast<char>(Character);
+        }
+        else if (Character < 0x20)
+        {
+            Json += std::format("\\u{:04x}", Character);
+        }
+        else
+        {
+            Json += static_cast<char>(Character);
+        }
+    }
+
+    Json += '"';
+}
+
+} // namespace
+
+BootTimeline::Region* BootTimeline::s_region = nullptr;
+int BootTimeline::s_descriptor = -1;
+uint32_t BootTimeline::s_written = 0;
+
+/**
+ * @brief Start recording the boot timeline. This is called by mini_init before any span is recorded.
+ */
+void BootTimeline::Enable() noexcept
+try
+{
+    wil::unique_fd Descriptor{memfd_create("boot-trace", MFD_CLOEXEC)};
+    THROW_LAST_ERROR_IF(!Descriptor);
+    THROW_LAST_ERROR_IF(ftruncate(Descriptor.get(), sizeof(Region)) < 0);
+
+    auto* Mapping = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, Descriptor.get(), 0);
+    THROW_LAST_ERROR_IF(Mapping == MAP_FAILED);
+
+    s_region = static_cast<Region*>(Mapping);
+    s_descriptor = Descriptor.release();
+}
+CATCH_LOG()
+
+/**
+ * @brief Record spans in the timeline of mini_init. This is called by the distribution init with
+ * the file descriptor that mini_init passed to it.
+ *
+ * @param[in] Descriptor The file descriptor of the timeline, as a string.
+ */
+void BootTimeline::Attach(const char* Descriptor) noexcept
+try
+{
+    wil::unique_fd File{std::stoi(Descriptor)};
+    auto* Mapping = mmap(nullptr, sizeof(Region), PROT_READ | PROT_WRITE, MAP_SHARED, File.get(), 0);
+    THROW_LAST_ERROR_IF(Mapping == MAP_FAILED);
+
+    s_region = static_cast<Region*>(Mapping);
+}
+CATCH_LOG()
+
+/**
+ * @brief Duplicate the file descriptor of the timeline, without the close-on-exec flag, so it can
+ * be passed to the distribution init.
+ *
+ * @return The file descriptor, or -1 if recording isn't enabled.
+ */
+int BootTimeline::Duplicate() noexcept
+{
+    if (s_descriptor < 0)
+    {
+        return -1;
+    }
+
+    return dup(s_descriptor);
+}
+
+/**
+ * @brief Write the spans recorded so far as a Chrome trace-event file. The file is replaced
+ * atomically, so readers never see a partial trace. mini_init and the distribution inits may write
+ * the trace concurrently, and pids are not unique across their pid namespaces, so each writer uses
+ * its own temporary file.
+ *
+ * Events are grouped by process, which is identified by its pid and pid namespace since mini_init
+ * and the distribution inits each run in their own pid namespace.
+ *
+ * @param[in] Path The path of the trace file.
+ */
+void BootTimeline::Write(const char* Path) noexcept
+try
+{
+    if (s_region == nullptr)
+    {
+        return;
+    }
+
+    const auto Count = std::min<uint32_t>(s_region->Count.load(std::memory_order_acquire), c_capacity);
+    uint32_t Complete = 0;
+    for (uint32_t Index = 0; Index < Count; Index++)
+    {
+        Complete += s_region->Events[Index].Complete.load(std::memory_order_acquire);
+    }
+
+    if (Complete == s_written)
+    {
+        return;
+    }
+
+    std::map<std::pair<uint64_t, int32_t>, size_t> Processes;
+    std::set<std::pair<size_t, int32_t>> Threads;
+    std::string Json = "{\"traceEvents\":[";
+    bool First = true;
+    auto AppendMetadata = [&](const char* Name, size_t Process, int32_t Thread, const std::string& Value) {
+        Json += std::format(
+            "{}{{\"name\":\"{}\",\"ph\":\"M\",\"pid\":{},\"tid\":{},\"args\":{{\"name\":",
+            First ? "" : ",",
+            Name,
+            Process,
+            Thread);
+        AppendString(Json, Value.c_str());
+        Json += "}}";
+        First = false;
+    };
+
+    for (uint32_t Index = 0; Index < Count; Index++)
+    {
+        const auto& Event = s_region->Events[Index];
+        if (Event.Complete.load(std::memory_order_acquire) == 0)
+        {
+            continue;
+        }
+
+        const auto [Process, NewProcess] = Processes.try_emplace({Event.Namespace, Event.Pid}, Processes.size() + 1);
+        if (NewProcess)
+        {
+            AppendMetadata("process_name", Process->second, 0, std::format("{} (pid {})", Event.Thread, Event.Pid));
+        }
+
+        if (Threads.emplace(Process->second, Event.Tid).second)
+        {
+            AppendMetadata(
+                "thread_name", Process->second, Event.Tid, std::format("{} (tid {})", Event.Thread, Event.Tid));
+        }
+
+        Json += ",{\"name\":";
+        AppendString(Json, Event.Name);
+        Json += std::format(
+            ",\"ph\":\"X\",\"ts\":{},\"dur\":{},\"pid\":{},\"tid\":{}}}",
+            Event.Start,
+            Event.End - Event.Start,
+            Process->second,
+            Event.Tid);
+    }
+
+    Json += "]}\n";
+
+    auto TemporaryPath = std::format("{}.XXXXXX", Path);
+    const wil::unique_fd File{mkostemp(TemporaryPath.data(), O_CLOEXEC)};
+    THROW_LAST_ERROR_IF(!File);
+
+    auto Remove = wil::scope_exit([&]() { unlink(TemporaryPath.c_str()); });
+    THROW_LAST_ERROR_IF(fchmod(File.get(), 0644) < 0);
+    THROW_LAST_ERROR_IF(UtilWriteStringView(File.get(), Json) < 0);
+    THROW_LAST_ERROR_IF(rename(TemporaryPath.c_str(), Path) < 0);
+    Remove.release();
+
+    s_written = Complete;
+}
+CATCH_LOG()
+
+uint64_t BootTimeline::Now() noexcept
+{
+    timespec Time{};
+    clock_gettime(CLOCK_BOOTTIME, &Time);
+    return static_cast<uint64_t>(Time.tv_sec) * 1000000 + Time.tv_nsec / 1000;
+}
+
+void BootTimeline::Record(const char* Name, uint64_t Start, uint64_t End) noexcept
+{
+    //
+    // Each event is written once; spans recorded after the region is full are dropped.
+    //
+
+    const auto Index = s_region->Count.fetch_add(1, std::memory_order_relaxed);
+    if (Index >= c_capacity)
+    {
+        return;
+    }
+
+    auto& Event = s_region->Events[Index];
+    struct stat Namespace{};
+    Event.Namespace = stat("/proc/self/ns/pid", &Namespace) == 0 ? Namespace.st_ino : 0;
+    Event.Pid = getpid();
+    Event.Tid = gettid();
+    Event.Start = Start;
+    Event.End = End;
+    strncpy(Event.Name, Name, sizeof(Event.Name) - 1);
+    strncpy(Event.Thread, g_threadName.c_str(), sizeof(Event.Thread) - 1);
+    Event.Complete.store(1, std::memory_order_release);
+}
@@ -0,0 +1,79 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Timeline of the named steps that run while the VM and a distribution boot.
+//
+// Recording is enabled with WSL_BOOT_TRACE=1 on the kernel command line. Spans are recorded in a
+// shared memory region, so the spans of the child processes that mini_init forks, and of the
+// distribution init (which maps the region passed to it by mini_init), end up in the same
+// timeline. Spans recorded on the same thread nest by time. Write() saves the timeline in the
+// Chrome trace-event format, which can be opened with chrome://tracing or Perfetto.
+//
+// When recording is disabled, creating and destroying a span only tests a null pointer.
+class BootTimeline
+{
+public:
+    class Span
+    {
+    public:
+        explicit Span(const char* Name) noexcept : m_name(Name)
+        {
+            if (s_region != nullptr) [[unlikely]]
+            {
+                m_start = Now();
+            }
+        }
+
+        ~Span() noexcept
+        {
+            if (m_start != 0) [[unlikely]]
+            {
+                Record(m_name, m_start, Now());
+            }
+        }
+
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* m_name;
+        uint64_t m_start{};
+    };
+
+    static void Enable() noexcept;
+    static void Attach(const char* Descriptor) noexcept;
+    static int Duplicate() noexcept;
+    static void Write(const char* Path) noexcept;
+
+private:
+    static constexpr size_t c_capacity = 4096;
+
+    struct Event
+    {
+        std::atomic<uint32_t> Complete;
+        int32_t Pid;
+        int32_t Tid;
+        uint64_t Namespace;
+        uint64_t Start;
+        uint64_t End;
+        char Name[48];
+        char Thread[16];
+    };
+
+    struct Region
+    {
+        std::atomic<uint32_t> Count;
+        Event Events[c_capacity];
+    };
+
+    static uint64_t Now() noexcept;
+    static void Record(const char* Name, uint64_t Start, uint64_t End) noexcept;
+
+    static Region* s_region;
+    static int s_descriptor;
+    static uint32_t s_written;
+};
@@ -0,0 +1,417 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <cctype>
+#include <charconv>
+#include <dirent.h>
+#include <filesystem>
+#include <limits>
+#include <linux/kernel-page-flags.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "ColdPages.h"
+#include "util.h"
+
+#define DAMON_KDAMONDS_PATH "/sys/kernel/mm/damon/admin/kdamonds"
+#define DAMON_KDAMOND_PATH DAMON_KDAMONDS_PATH "/0"
+#define DAMON_CONTEXT_PATH DAMON_KDAMOND_PATH "/contexts/0"
+#define DAMON_SCHEME_PATH DAMON_CONTEXT_PATH "/schemes/0"
+#define PAGE_IDLE_BITMAP_PATH "/sys/kernel/mm/page_idle/bitmap"
+
+namespace {
+
+// DAMON checks a sampled page of each region every sample interval, and the number of accesses
+// seen in each aggregation interval gives the region's access frequency.
+constexpr auto c_damonSampleInterval = std::chrono::milliseconds{100};
+constexpr auto c_damonAggregationInterval = std::chrono::seconds{2};
+
+// Number of pages read from /proc/kpageflags and /proc/kpagecgroup at a time.
+constexpr size_t c_chunkPages = 4096;
+
+// The idle page bitmap is read and written in 64-bit words.
+constexpr uint64_t c_bitmapWordPages = 64;
+
+constexpr uint64_t c_pageAnonymous = (1ull << KPF_ANON) | (1ull << KPF_SWAPBACKED);
+
+void WriteValue(const std::string& Path, const std::string& Value)
+{
+    THROW_LAST_ERROR_IF(WriteToFile(Path.c_str(), Value.c_str()) < 0);
+}
+
+uint64_t ReadNumber(const std::string& Path)
+{
+    const auto Content = UtilReadFileContent(Path);
+    uint64_t Value{};
+    const auto Result = std::from_chars(Content.data(), Content.data() + Content.size(), Value);
+    THROW_ERRNO_IF(EINVAL, Result.ec != std::errc{});
+
+    return Value;
+}
+
+// Returns the number of 64-bit entries read.
+size_t ReadEntries(int Fd, uint64_t Offset, uint64_t* Entries, size_t Count)
+{
+    const auto Result = TEMP_FAILURE_RETRY(pread(Fd, Entries, Count * sizeof(uint64_t), Offset * sizeof(uint64_t)));
+    THROW_LAST_ERROR_IF(Result < 0);
+
+    return static_cast<size_t>(Result) / sizeof(uint64_t);
+}
+
+// Returns the page ranges of the "System RAM" resources of /proc/iomem.
+std::vector<std::pair<uint64_t, uint64_t>> ReadSystemMemory(uint64_t PageSize)
+{
+    const auto Content = UtilReadFileContent("/proc/iomem");
+    std::string_view Remaining{Content};
+    std::vector<std::pair<uint64_t, uint64_t>> Ranges;
+    while (!Remaining.empty())
+    {
+        //
+        // Top level resources aren't indented, and look like: "00100000-bffdffff : System RAM".
+        //
+
+        auto Line = UtilStringNextToken(Remaining, '\n');
+        const auto Separator = Line.find(" : ");
+        if (Line.empty() || Line[0] == ' ' || Separator == std::string_view::npos || Line.substr(Separator + 3) != "System RAM")
+        {
+            continue;
+        }
+
+        uint64_t Start{};
+        uint64_t Last{};
+        const auto StartResult = std::from_chars(Line.data(), Line.data() + Separator, Start, 16);
+        if (StartResult.ec != std::errc{} || *StartResult.ptr != '-' ||
+            std::from_chars(StartResult.ptr + 1, Line.data() + Separator, Last, 16).ec != std::errc{})
+        {
+            continue;
+        }
+
+        Ranges.emplace_back(Start / PageSize, (Last + 1) / PageSize);
+    }
+
+    return Ranges;
+}
+
+// Returns the path of every cgroup, indexed by the inode number /proc/kpagecgroup reports.
+std::map<uint64_t, std::string> ReadCgroupInodes()
+{
+    std::map<uint64_t, std::string> Cgroups;
+    struct stat Status{};
+    if (stat(CGROUP_MOUNTPOINT, &Status) == 0)
+    {
+        Cgroups.emplace(Status.st_ino, CGROUP_MOUNTPOINT);
+    }
+
+    std::error_code Error;
+    std::filesystem::recursive_directory_iterator Iterator{CGROUP_MOUNTPOINT, Error};
+    for (; !Error && Iterator != std::filesystem::recursive_directory_iterator{}; Iterator.increment(Error))
+    {
+        if (Iterator->is_directory(Error) && stat(Iterator->path().c_str(), &Status) == 0)
+        {
+            Cgroups.emplace(Status.st_ino, Iterator->path().string());
+        }
+    }
+
+    return Cgroups;
+}
+
+void StopDamon()
+{
+    WriteToFile(DAMON_KDAMOND_PATH "/state", "off");
+    WriteToFile(DAMON_KDAMONDS_PATH "/nr_kdamonds", "0");
+}
+
+void StartDamon(const std::vector<std::pair<uint64_t, uint64_t>>& Memory, uint64_t PageSize, std::chrono::seconds Age)
+{
+    //
+    // Don't take over a kdamond that something else configured.
+    //
+
+    THROW_ERRNO_IF(EBUSY, ReadNumber(DAMON_KDAMONDS_PATH "/nr_kdamonds") != 0);
+
+    auto Cleanup = wil::scope_exit([]() { StopDamon(); });
+    WriteValue(DAMON_KDAMONDS_PATH "/nr_kdamonds", "1");
+    WriteValue(DAMON_KDAMOND_PATH "/contexts/nr_contexts", "1");
+    WriteValue(DAMON_CONTEXT_PATH "/operations", "paddr");
+    WriteValue(
+        DAMON_CONTEXT_PATH "/monitoring_attrs/intervals/sample_us",
+        std::to_string(std::chrono::microseconds{c_damonSampleInterval}.count()));
+
+    WriteValue(
+        DAMON_CONTEXT_PATH "/monitoring_attrs/intervals/aggr_us",
+        std::to_string(std::chrono::microseconds{c_damonAggregationInterval}.count()));
+
+    WriteValue(DAMON_CONTEXT_PATH "/targets/nr_targets", "1");
+    WriteValue(DAMON_CONTEXT_PATH "/targets/0/regions/nr_regions", std::to_string(Memory.size()));
+    for (size_t Index = 0; Index < Memory.size(); Index++)
+    {
+        const auto Region = std::format(DAMON_CONTEXT_PATH "/targets/0/regions/{}", Index);
+        WriteValue(Region + "/start", std::to_string(Memory[Index].first * PageSize));
+        WriteValue(Region + "/end", std::to_string(Memory[Index].second * PageSize));
+    }
+
+    //
+    // The 'stat' action only counts the regions the scheme applies to. The scheme applies to regions
+    // of any size that had no access (nr_accesses stays at 0..0) for at least the age, expressed in
+    // aggregation intervals.
+    //
+
+    const auto Unlimited = std::to_string(std::numeric_limits<unsigned long>::max());
+    WriteValue(DAMON_CONTEXT_PATH "/schemes/nr_schemes", "1");
+    WriteValue(DAMON_SCHEME_PATH "/action", "stat");
+    WriteValue(DAMON_SCHEME_PATH "/access_pattern/sz/max", Unlimited);
+    WriteValue(DAMON_SCHEME_PATH "/access_pattern/age/min", std::to_string(Age / c_damonAggregationInterval));
+    WriteValue(DAMON_SCHEME_PATH "/access_pattern/age/max", Unlimited);
+    WriteValue(DAMON_KDAMOND_PATH "/state", "on");
+
+    //
+    // Collecting the regions the scheme applied to needs a newer kernel than DAMON itself.
+    //
+
+    WriteValue(DAMON_KDAMOND_PATH "/state", "update_schemes_tried_regions");
+    Cleanup.release();
+}
+
+} // namespace
+
+/**
+ * @brief Start tracking cold pages, with DAMON if available or idle page tracking otherwise.
+ *
+ * @param[in] Age The time after which a page that wasn't accessed is cold.
+ *
+ * @return The tracker, or nullptr if the kernel supports neither.
+ */
+std::unique_ptr<ColdPageTracker> ColdPageTracker::Create(std::chrono::seconds Age)
+try
+{
+    const auto PageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    auto Memory = ReadSystemMemory(PageSize);
+    THROW_ERRNO_IF(ENOENT, Memory.empty());
+
+    std::unique_ptr<ColdPageTracker> Tracker;
+    if (access(DAMON_KDAMONDS_PATH, W_OK) == 0)
+    {
+        try
+        {
+            StartDamon(Memory, PageSize, Age);
+            Tracker.reset(new ColdPageTracker(Type::Damon, {}));
+        }
+        catch (...)
+        {
+            LOG_WARNING("DAMON is not usable {}, using idle page tracking", wil::ResultFromCaughtException());
+        }
+    }
+
+    if (!Tracker)
+    {
+        //
+        // The bitmap is accessed in words, so only whole words of each range are tracked.
+        //
+
+        std::vector<PfnRange> Aligned;
+        for (const auto& [Start, End] : Memory)
+        {
+            const auto AlignedStart = (Start + c_bitmapWordPages - 1) / c_bitmapWordPages * c_bitmapWordPages;
+            const auto AlignedEnd = End / c_bitmapWordPages * c_bitmapWordPages;
+            if (AlignedStart < AlignedEnd)
+            {
+                Aligned.push_back({AlignedStart, AlignedEnd});
+            }
+        }
+
+        Tracker.reset(new ColdPageTracker(Type::PageIdle, std::move(Aligned)));
+        Tracker->m_idleBitmap.reset(open(PAGE_IDLE_BITMAP_PATH, O_RDWR | O_CLOEXEC));
+        THROW_LAST_ERROR_IF(!Tracker->m_idleBitmap);
+    }
+
+    Tracker->m_pageFlags.reset(open("/proc/kpageflags", O_RDONLY | O_CLOEXEC));
+    THROW_LAST_ERROR_IF(!Tracker->m_pageFlags);
+
+    //
+    // Without memory cgroups, every page is attributed to the root cgroup.
+    //
+
+    Tracker->m_pageCgroups.reset(open("/proc/kpagecgroup", O_RDONLY | O_CLOEXEC));
+    if (!Tracker->m_pageCgroups)
+    {
+        LOG_WARNING("open(/proc/kpagecgroup) failed {}", errno);
+    }
+
+    if (Tracker->m_type == Type::PageIdle)
+    {
+        Tracker->MarkIdle();
+    }
+
+    return Tracker;
+}
+catch (...)
+{
+    LOG_ERROR("Cold page tracking is not available {}", wil::ResultFromCaughtException());
+    return {};
+}
+
+ColdPageTracker::ColdPageTracker(Type Type, std::vector<PfnRange> Memory) :
+    m_type(Type), m_memory(std::move(Memory)), m_pageSize(sysconf(_SC_PAGESIZE))
+{
+}
+
+ColdPageTracker::~ColdPageTracker()
+{
+    if (m_type == Type::Damon)
+    {
+        StopDamon();
+    }
+}
+
+/**
+ * @brief Return the name of the mechanism used to measure access recency.
+ */
+const char* ColdPageTracker::Backend() const
+{
+    return m_type == Type::Damon ? "DAMON" : "page_idle";
+}
+
+/**
+ * @brief Return the cold memory of each cgroup.
+ *
+ * With idle page tracking, a page is cold if it wasn't accessed since the previous scan.
+ *
+ * @return The cold memory of each cgroup that has any.
+ */
+std::vector<ColdMemory> ColdPageTracker::Scan()
+{
+    std::map<uint64_t, ColdMemory> Inodes;
+    if (m_type == Type::Damon)
+    {
+        for (const auto& Range : ReadDamonRegions())
+        {
+            Account(Range, Inodes);
+        }
+    }
+    else
+    {
+        for (const auto& Range : m_memory)
+        {
+            Account(Range, Inodes);
+        }
+
+        MarkIdle();
+    }
+
+    //
+    // Pages charged to a cgroup that was removed since are attributed to the root cgroup.
+    //
+
+    const auto Paths = ReadCgroupInodes();
+    std::map<std::string, ColdMemory> Cgroups;
+    for (const auto& [Inode, Memory] : Inodes)
+    {
+        const auto Path = Paths.find(Inode);
+        auto& Entry = Cgroups[Path == Paths.end() ? std::string{CGROUP_MOUNTPOINT} : Path->second];
+        Entry.AnonymousBytes += Memory.AnonymousBytes;
+        Entry.FileBytes += Memory.FileBytes;
+    }
+
+    std::vector<ColdMemory> Result;
+    for (auto& [Path, Memory] : Cgroups)
+    {
+        Memory.Cgroup = Path;
+        Result.emplace_back(std::move(Memory));
+    }
+
+    return Result;
+}
+
+std::vector<ColdPageTracker::PfnRange> ColdPageTracker::ReadDamonRegions() const
+{
+    //
+    // The kernel fills tried_regions with the regions the scheme applied to in the last
+    // aggregation interval before the write returns.
+    //
+
+    WriteValue(DAMON_KDAMOND_PATH "/state", "update_schemes_tried_regions");
+
+    const wil::unique_dir Directory{opendir(DAMON_SCHEME_PATH "/tried_regions")};
+    THROW_LAST_ERROR_IF(!Directory);
+
+    std::vector<PfnRange> Regions;
+    while (const auto* Entry = readdir(Directory.get()))
+    {
+        if (Entry->d_type != DT_DIR || !isdigit(Entry->d_name[0]))
+        {
+            continue;
+        }
+
+        const auto Region = std::format(DAMON_SCHEME_PATH "/tried_regions/{}", Entry->d_name);
+        Regions.push_back({ReadNumber(Region + "/start") / m_pageSize, ReadNumber(Region + "/end") / m_pageSize});
+    }
+
+    return Regions;
+}
+
+void ColdPageTracker::MarkIdle() const
+{
+    const std::vector<uint64_t> Idle(c_chunkPages / c_bitmapWordPages, std::numeric_limits<uint64_t>::max());
+    for (const auto& Range : m_memory)
+    {
+        for (auto Page = Range.Start; Page < Range.End; Page += c_chunkPages)
+        {
+            const auto Words = std::min<uint64_t>(c_chunkPages, Range.End - Page) / c_bitmapWordPages;
+            const auto Size = Words * sizeof(uint64_t);
+            THROW_LAST_ERROR_IF(
+                TEMP_FAILURE_RETRY(pwrite(m_idleBitmap.get(), Idle.data(), Size, Page / c_bitmapWordPages * sizeof(uint64_t))) !=
+                static_cast<ssize_t>(Size));
+        }
+    }
+}
+
+void ColdPageTracker::Account(const PfnRange& Range, std::map<uint64_t, ColdMemory>& Cgroups) const
+{
+    std::vector<uint64_t> Flags(c_chunkPages);
+    std::vector<uint64_t> Inodes(c_chunkPages);
+    std::vector<uint64_t> Idle(c_chunkPages / c_bitmapWordPages);
+    for (auto Page = Range.Start; Page < Range.End;)
+    {
+        auto Count = ReadEntries(m_pageFlags.get(), Page, Flags.data(), std::min<uint64_t>(c_chunkPages, Range.End - Page));
+        if (Count == 0)
+        {
+            break;
+        }
+
+        if (m_pageCgroups)
+        {
+            Count = ReadEntries(m_pageCgroups.get(), Page, Inodes.data(), Count);
+        }
+
+        if (m_idleBitmap)
+        {
+            const auto Words = ReadEntries(m_idleBitmap.get(), Page / c_bitmapWordPages, Idle.data(), Count / c_bitmapWordPages);
+            Count = Words * c_bitmapWordPages;
+        }
+
+        for (size_t Index = 0; Index < Count; Index++)
+        {
+            if (m_idleBitmap && (Idle[Index / c_bitmapWordPages] & (1ull << (Index % c_bitmapWordPages))) == 0)
+            {
+                continue;
+            }
+
+            //
+            // Only pages on the evictable LRU lists can be reclaimed.
+            //
+
+            const auto PageFlags = Flags[Index];
+            if ((PageFlags & (1ull << KPF_LRU)) == 0 || (PageFlags & (1ull << KPF_UNEVICTABLE)) != 0)
+            {
+                continue;
+            }
+
+            auto& Memory = Cgroups[m_pageCgroups ? Inodes[Index] : 0];
+            ((PageFlags & c_pageAnonymous) != 0 ? Memory.AnonymousBytes : Memory.FileBytes) += m_pageSize;
+        }
+
+        if (Count == 0)
+        {
+            break;
+        }
+
+        Page += Count;
+    }
+}
@@ -0,0 +1,72 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "common.h"
+
+// Memory of a cgroup that hasn't been accessed recently.
+struct ColdMemory
+{
+    std::string Cgroup;
+    uint64_t AnonymousBytes{};
+    uint64_t FileBytes{};
+};
+
+// Measures how recently the pages of the VM were accessed, and attributes the pages that haven't
+// been accessed for a given age to the cgroup they're charged to.
+//
+// DAMON is used when the kernel has it: a kdamond monitors the physical address space, and a
+// scheme with the 'stat' action collects the regions that weren't accessed for the age, without
+// acting on them. Otherwise, the pages are marked idle through /sys/kernel/mm/page_idle, and the
+// pages still idle at the next scan are the cold ones, so scans must be the age apart.
+//
+// Cold pages are attributed with /proc/kpageflags and /proc/kpagecgroup; only pages on the LRU
+// lists are counted, since they're the only ones reclaim can act on.
+class ColdPageTracker
+{
+public:
+    static std::unique_ptr<ColdPageTracker> Create(std::chrono::seconds Age);
+
+    ~ColdPageTracker();
+
+    ColdPageTracker(const ColdPageTracker&) = delete;
+    ColdPageTracker& operator=(const ColdPageTracker&) = delete;
+
+    std::vector<ColdMemory> Scan();
+
+    const char* Backend() const;
+
+private:
+    enum class Type
+    {
+        Damon,
+        PageIdle
+    };
+
+    struct PfnRange
+    {
+        uint64_t Start;
+        uint64_t End;
+    };
+
+    ColdPageTracker(Type Type, std::vector<PfnRange> Memory);
+
+    std::vector<PfnRange> ReadDamonRegions() const;
+
+    void MarkIdle() const;
+
+    void Account(const PfnRange& Range, std::map<uint64_t, ColdMemory>& Cgroups) const;
+
+    Type m_type;
+    std::vector<PfnRange> m_memory;
+    uint64_t m_pageSize;
+    wil::unique_fd m_pageFlags;
+    wil::unique_fd m_pageCgroups;
+    wil::unique_fd m_idleBitmap;
+};
@@ -0,0 +1,324 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <fstream>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/random.h>
+#include <sys/swap.h>
+#include <sys/sysinfo.h>
+#include <thread>
+#include <vector>
+#include "common.h"
+#include "CompressedSwap.h"
+#include "BlockDeviceMonitor.h"
+#include "KernelModules.h"
+#include "util.h"
+
+#define ZRAM_CONTROL_PATH "/sys/class/zram-control"
+#define ZSWAP_PARAMETERS_PATH "/sys/module/zswap/parameters"
+
+namespace {
+
+// Priority of the zram device. Swap areas enabled without a priority get a negative one, so the
+// zram device is always used before the swap VHD.
+constexpr int c_zramPriority = 100;
+
+constexpr auto c_statisticsPeriod = std::chrono::minutes{1};
+
+// Change in the amount of memory stored in the tier that is worth logging.
+constexpr uint64_t c_statisticsThreshold = 64ull * 1024 * 1024;
+
+constexpr std::string_view c_swapMagic{"SWAPSPACE2"};
+
+// The kernel refuses swap areas with fewer pages than this.
+constexpr uint64_t c_minimumSwapPages = 10;
+
+// Layout of the version 1 swap header, in the first page of the swap area.
+struct SwapHeader
+{
+    char BootBits[1024];
+    uint32_t Version;
+    uint32_t LastPage;
+    uint32_t BadPageCount;
+    uint8_t Uuid[16];
+    char Label[16];
+};
+
+struct Statistics
+{
+    uint64_t StoredBytes;
+    uint64_t CompressedBytes;
+};
+
+uint64_t GetTotalMemory()
+{
+    struct sysinfo Info{};
+    THROW_LAST_ERROR_IF(sysinfo(&Info) < 0);
+
+    return static_cast<uint64_t>(Info.totalram) * Info.mem_unit;
+}
+
+std::string ReadValue(const std::string& Path)
+{
+    auto Value = UtilReadFileContent(Path);
+    while (!Value.empty() && (Value.back() == '\n' || Value.back() == ' '))
+    {
+        Value.pop_back();
+    }
+
+    return Value;
+}
+
+// Returns the id of an unused zram device, creating one if needed.
+std::string GetZramDevice(const std::string& ModulesDirectory)
+{
+    if (access(ZRAM_CONTROL_PATH, F_OK) < 0 && !ModulesDirectory.empty())
+    {
+        KernelModuleLoader{ModulesDirectory}.Load({"zram"}, 1);
+    }
+
+    THROW_LAST_ERROR_IF(access(ZRAM_CONTROL_PATH, F_OK) < 0);
+
+    //
+    // The module creates zram0 when it's loaded; use it unless something else already did.
+    //
+
+    try
+    {
+        if (ReadValue("/sys/block/zram0/disksize") == "0")
+        {
+            return "0";
+        }
+    }
+    CATCH_LOG()
+
+    return ReadValue(ZRAM_CONTROL_PATH "/hot_add");
+}
+
+std::optional<Statistics> ReadZramStatistics(const std::string& Id)
+{
+    //
+    // mm_stat starts with orig_data_size, compr_data_size and mem_used_total.
+    //
+
+    std::ifstream Stat(std::format("/sys/block/zram{}/mm_stat", Id));
+    uint64_t Stored{};
+    uint64_t Compressed{};
+    uint64_t Used{};
+    if (!(Stat >> Stored >> Compressed >> Used))
+    {
+        return {};
+    }
+
+    return Statistics{Stored, Used};
+}
+
+std::optional<Statistics> ReadZswapStatistics()
+{
+    //
+    // Zswap is the size of the pool and Zswapped the size of the pages stored in it, in kB.
+    //
+
+    std::ifstream MemInfo("/proc/meminfo");
+    std::optional<uint64_t> Pool;
+    std::optional<uint64_t> Stored;
+    std::string Name;
+    uint64_t Value{};
+    std::string Unit;
+    while (MemInfo >> Name >> Value >> Unit)
+    {
+        if (Name == "Zswap:")
+        {
+            Pool = Value * 1024;
+        }
+        else if (Name == "Zswapped:")
+        {
+            Stored = Value * 1024;
+        }
+    }
+
+    if (!Pool.has_value() || !Stored.has_value())
+    {
+        return {};
+    }
+
+    return Statistics{Stored.value(), Pool.value()};
+}
+
+void StartStatisticsThread(LX_MINI_INIT_COMPRESSED_SWAP_MODE Mode, std::string ZramDevice)
+{
+    std::thread([Mode, ZramDevice = std::move(ZramDevice)]() {
+        UtilSetThreadName("CompressedSwap");
+
+        uint64_t Reported{};
+        for (;;)
+        {
+            std::this_thread::sleep_for(c_statisticsPeriod);
+
+            const auto Current =
+                Mode == LxMiniInitCompressedSwapModeZram ? ReadZramStatistics(ZramDevice) : ReadZswapStatistics();
+            if (!Current.has_value())
+            {
+                LOG_WARNING("Compressed swap statistics are not available");
+                return;
+            }
+
+            const auto Change =
+                Current->StoredBytes > Reported ? Current->StoredBytes - Reported : Reported - Current->StoredBytes;
+            if (Change < c_statisticsThreshold)
+            {
+                continue;
+            }
+
+            const double Ratio =
+                Current->CompressedBytes == 0 ? 0 : static_cast<double>(Current->StoredBytes) / Current->CompressedBytes;
+
+            LOG_INFO(
+                "Compressed swap stores {} MB in {} MB (ratio {:.2f})",
+                Current->StoredBytes >> 20,
+                Current->CompressedBytes >> 20,
+                Ratio);
+
+            Reported = Current->StoredBytes;
+        }
+    }).detach();
+}
+
+std::string ConfigureZram(const std::string& Compressor, uint64_t SizeBytes, const std::string& ModulesDirectory)
+{
+    const auto Id = GetZramDevice(ModulesDirectory);
+    const auto Block = std::format("/sys/block/zram{}", Id);
+
+    //
+    // The compressor must be set before the size. If the kernel doesn't support it, the default one
+    // is used.
+    //
+
+    if (!Compressor.empty() && WriteToFile(std::format("{}/comp_algorithm", Block).c_str(), Compressor.c_str()) < 0)
+    {
+        LOG_WARNING("Compressor {} is not supported by zram, using {}", Compressor, ReadValue(Block + "/comp_algorithm"));
+    }
+
+    if (SizeBytes == 0)
+    {
+        SizeBytes = GetTotalMemory() / 2;
+    }
+
+    THROW_LAST_ERROR_IF(WriteToFile(std::format("{}/disksize", Block).c_str(), std::to_string(SizeBytes).c_str()) < 0);
+
+    //
+    // The device node is created by devtmpfs once the device has a size.
+    //
+
+    const auto Device = std::format("/dev/zram{}", Id);
+    BlockDeviceMonitor::Current()->RetryWithTimeout<void>(
+        [&]() { THROW_LAST_ERROR_IF(access(Device.c_str(), F_OK) < 0); },
+        c_defaultRetryTimeout,
+        []() { return wil::ResultFromCaughtException() == ENOENT; });
+
+    CreateSwapArea(Device.c_str());
+    THROW_LAST_ERROR_IF(
+        swapon(Device.c_str(), SWAP_FLAG_PREFER | SWAP_FLAG_DISCARD | (c_zramPriority << SWAP_FLAG_PRIO_SHIFT)) < 0);
+
+    LOG_INFO("Enabled zram swap on {} ({} MB)", Device, SizeBytes >> 20);
+    return Id;
+}
+
+void ConfigureZswap(const std::string& Compressor, uint64_t SizeBytes)
+{
+    THROW_LAST_ERROR_IF(access(ZSWAP_PARAMETERS_PATH "/enabled", W_OK) < 0);
+
+    if (!Compressor.empty() && WriteToFile(ZSWAP_PARAMETERS_PATH "/compressor", Compressor.c_str()) < 0)
+    {
+        LOG_WARNING(
+            "Compressor {} is not supported by zswap, using {}", Compressor, ReadValue(ZSWAP_PARAMETERS_PATH "/compressor"));
+    }
+
+    //
+    // The pool size is set as a percentage of memory.
+    //
+
+    if (SizeBytes != 0)
+    {
+        const auto Percent = std::clamp<uint64_t>((SizeBytes * 100) / GetTotalMemory(), 1, 100);
+        WriteToFile(ZSWAP_PARAMETERS_PATH "/max_pool_percent", std::to_string(Percent).c_str());
+    }
+
+    THROW_LAST_ERROR_IF(WriteToFile(ZSWAP_PARAMETERS_PATH "/enabled", "Y") < 0);
+
+    LOG_INFO("Enabled zswap (pool limit {}%)", ReadValue(ZSWAP_PARAMETERS_PATH "/max_pool_percent"));
+}
+
+} // namespace
+
+/**
+ * @brief Set up the compressed swap tier.
+ *
+ * @param[in] Mode The type of compressed swap to use.
+ * @param[in] Compressor The compression algorithm, or empty for the kernel's default.
+ * @param[in] SizeBytes The size of the zram device or of the zswap pool, or 0 for the default.
+ * @param[in] ModulesDirectory The directory to load the zram module from, if it isn't loaded.
+ */
+void ConfigureCompressedSwap(
+    LX_MINI_INIT_COMPRESSED_SWAP_MODE Mode,
+    const std::string& Compressor,
+    uint64_t SizeBytes,
+    const std::string& ModulesDirectory)
+try
+{
+    std::string ZramDevice;
+    if (Mode == LxMiniInitCompressedSwapModeZram)
+    {
+        ZramDevice = ConfigureZram(Compressor, SizeBytes, ModulesDirectory);
+    }
+    else if (Mode == LxMiniInitCompressedSwapModeZswap)
+    {
+        ConfigureZswap(Compressor, SizeBytes);
+    }
+    else
+    {
+        return;
+    }
+
+    StartStatisticsThread(Mode, std::move(ZramDevice));
+}
+catch (...)
+{
+    LOG_ERROR("Failed to configure compressed swap {}", wil::ResultFromCaughtException());
+}
+
+/**
+ * @brief Write a swap header on a block device, like mkswap does.
+ *
+ * @param[in] Path The path of the block device.
+ */
+void CreateSwapArea(const char* Path)
+{
+    wil::unique_fd Device{open(Path, O_RDWR | O_CLOEXEC)};
+    THROW_LAST_ERROR_IF(!Device);
+
+    uint64_t Size{};
+    THROW_LAST_ERROR_IF(ioctl(Device.get(), BLKGETSIZE64, &Size) < 0);
+
+    const auto PageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const auto Pages = Size / PageSize;
+    THROW_ERRNO_IF(EINVAL, Pages < c_minimumSwapPages);
+
+    std::vector<char> Page(PageSize);
+    SwapHeader Header{};
+    Header.Version = 1;
+    Header.LastPage = static_cast<uint32_t>(std::min<uint64_t>(Pages - 1, UINT32_MAX));
+    THROW_LAST_ERROR_IF(getrandom(Header.Uuid, sizeof(Header.Uuid), 0) != sizeof(Header.Uuid));
+
+    //
+    // Mark the UUID as a random (version 4) one.
+    //
+
+    Header.Uuid[6] = (Header.Uuid[6] & 0x0f) | 0x40;
+    Header.Uuid[8] = (Header.Uuid[8] & 0x3f) | 0x80;
+
+    memcpy(Page.data(), &Header, sizeof(Header));
+    memcpy(Page.data() + PageSize - c_swapMagic.size(), c_swapMagic.data(), c_swapMagic.size());
+    THROW_LAST_ERROR_IF(
+        TEMP_FAILURE_RETRY(pwrite(Device.get(), Page.data(), Page.size(), 0)) != static_cast<ssize_t>(Page.size()));
+    THROW_LAST_ERROR_IF(fsync(Device.get()) < 0);
+}
@@ -0,0 +1,25 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "lxinitshared.h"
+
+// Sets up a compressed swap tier in memory, in front of the swap VHD or in place of it.
+//
+// With zswap, pages being swapped out are compressed into a pool in memory, and only written to
+// the swap VHD once the pool is full, so zswap needs the swap VHD. With zram, a compressed block
+// device in memory is used as a swap device, with a higher priority than the swap VHD so that it's
+// filled first; it works with or without the swap VHD.
+//
+// Everything is configured in process, by writing to sysfs and writing the swap header directly.
+// Once configured, the amount of memory stored in the tier and its compression ratio are logged
+// whenever they change significantly.
+void ConfigureCompressedSwap(
+    LX_MINI_INIT_COMPRESSED_SWAP_MODE Mode,
+    const std::string& Compressor,
+    uint64_t SizeBytes,
+    const std::string& ModulesDirectory);
+
+void CreateSwapArea(const char* Path);
@@ -0,0 +1,160 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <endian.h>
+#include <string_view>
+#include <vector>
+#include "common.h"
+#include "FilesystemProbe.h"
+
+namespace {
+
+// The first page holds the boot sector, the ext superblock and the swap signature.
+constexpr size_t c_headerSize = 4096;
+
+constexpr off_t c_btrfsSuperblockOffset = 0x10000;
+constexpr size_t c_btrfsMagicOffset = 0x40;
+constexpr std::string_view c_btrfsMagic{"_BHRfS_M"};
+
+constexpr size_t c_extSuperblockOffset = 1024;
+constexpr uint16_t c_extMagic = 0xef53;
+constexpr uint32_t c_extCompatHasJournal = 0x0004;
+constexpr uint32_t c_extIncompatJournalDevice = 0x0008;
+constexpr uint32_t c_extFlagsTestFilesystem = 0x0004;
+
+// Features that the ext2 and ext3 drivers support, as defined by libblkid. A file system that uses
+// any other feature is ext4.
+constexpr uint32_t c_ext2IncompatSupported = 0x0012;
+constexpr uint32_t c_ext3IncompatSupported = 0x0016;
+constexpr uint32_t c_ext3RoCompatSupported = 0x0007;
+
+constexpr std::string_view c_xfsMagic{"XFSB"};
+constexpr std::string_view c_ntfsMagic{"NTFS    "};
+constexpr std::string_view c_luksMagic{"LUKS\xba\xbe", 6};
+constexpr std::string_view c_swapMagics[] = {"SWAPSPACE2", "SWAP-SPACE"};
+constexpr std::string_view c_fatMagics[] = {"FAT12   ", "FAT16   ", "FAT     "};
+constexpr std::string_view c_fat32Magic{"FAT32   "};
+
+bool HasMagic(const std::vector<char>& Buffer, size_t Offset, std::string_view Magic)
+{
+    return Offset + Magic.size() <= Buffer.size() && std::string_view{Buffer.data() + Offset, Magic.size()} == Magic;
+}
+
+template <typename T>
+T ReadLittleEndian(const std::vector<char>& Buffer, size_t Offset)
+{
+    T Value{};
+    memcpy(&Value, Buffer.data() + Offset, sizeof(Value));
+    if constexpr (sizeof(T) == sizeof(uint16_t))
+    {
+        return le16toh(Value);
+    }
+    else
+    {
+        return le32toh(Value);
+    }
+}
+
+// Returns the ext variant the superblock describes, the same way libblkid tells them apart, or an
+// empty string for the variants that are left to blkid (journal devices, ext4dev).
+std::string_view ProbeExt(const std::vector<char>& Buffer)
+{
+    const auto Compat = ReadLittleEndian<uint32_t>(Buffer, c_extSuperblockOffset + 0x5c);
+    const auto Incompat = ReadLittleEndian<uint32_t>(Buffer, c_extSuperblockOffset + 0x60);
+    const auto RoCompat = ReadLittleEndian<uint32_t>(Buffer, c_extSuperblockOffset + 0x64);
+    const auto Flags = ReadLittleEndian<uint32_t>(Buffer, c_extSuperblockOffset + 0x160);
+    if ((Incompat & c_extIncompatJournalDevice) != 0)
+    {
+        return {};
+    }
+
+    if ((Incompat & ~c_ext3IncompatSupported) != 0 || (RoCompat & ~c_ext3RoCompatSupported) != 0)
+    {
+        return (Flags & c_extFlagsTestFilesystem) != 0 ? std::string_view{} : "ext4";
+    }
+
+    if ((Compat & c_extCompatHasJournal) != 0)
+    {
+        return "ext3";
+    }
+
+    return (Incompat & ~c_ext2IncompatSupported) == 0 ? "ext2" : std::string_view{};
+}
+
+} // namespace
+
+/**
+ * @brief Identify the file system on a block device from its superblock.
+ *
+ * @param[in] Device A file descriptor for the block device.
+ *
+ * @return The file system type, as blkid would report it, or nothing if the device should be probed
+ * with blkid.
+ */
+std::optional<std::string> ProbeFilesystem(int Device)
+try
+{
+    std::vector<char> Header(c_headerSize);
+    const auto HeaderSize = TEMP_FAILURE_RETRY(pread(Device, Header.data(), Header.size(), 0));
+    THROW_LAST_ERROR_IF(HeaderSize < 0);
+    if (static_cast<size_t>(HeaderSize) < Header.size())
+    {
+        return {};
+    }
+
+    std::vector<char> Btrfs(c_btrfsMagicOffset + c_btrfsMagic.size());
+    const auto BtrfsSize = TEMP_FAILURE_RETRY(pread(Device, Btrfs.data(), Btrfs.size(), c_btrfsSuperblockOffset));
+    Btrfs.resize(std::max<ssize_t>(BtrfsSize, 0));
+
+    //
+    // Collect every signature that matches; a device with more than one is ambiguous and blkid
+    // decides what to report for it.
+    //
+
+    std::vector<std::string_view> Found;
+    const bool BootSignature = static_cast<uint8_t>(Header[510]) == 0x55 && static_cast<uint8_t>(Header[511]) == 0xaa;
+    const auto HasFatMagic = [&](auto Magic) { return HasMagic(Header, 0x36, Magic); };
+    if (ReadLittleEndian<uint16_t>(Header, c_extSuperblockOffset + 0x38) == c_extMagic)
+    {
+        Found.emplace_back(ProbeExt(Header));
+    }
+
+    if (HasMagic(Header, 0, c_xfsMagic))
+    {
+        Found.emplace_back("xfs");
+    }
+
+    if (HasMagic(Btrfs, c_btrfsMagicOffset, c_btrfsMagic))
+    {
+        Found.emplace_back("btrfs");
+    }
+
+    if (BootSignature && HasMagic(Header, 3, c_ntfsMagic))
+    {
+        Found.emplace_back("ntfs");
+    }
+    else if (
+        BootSignature &&
+        (HasMagic(Header, 0x52, c_fat32Magic) || std::any_of(std::begin(c_fatMagics), std::end(c_fatMagics), HasFatMagic)))
+    {
+        Found.emplace_back("vfat");
+    }
+
+    if (HasMagic(Header, 0, c_luksMagic) ||
+        std::any_of(std::begin(c_swapMagics), std::end(c_swapMagics), [&](auto Magic) {
+            return HasMagic(Header, c_headerSize - Magic.size(), Magic);
+        }))
+    {
+        Found.emplace_back();
+    }
+
+    if (Found.size() != 1 || Found[0].empty())
+    {
+        return {};
+    }
+
+    return std::string{Found[0]};
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return {};
+}
@@ -0,0 +1,15 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <optional>
+#include <string>
+
+// Identifies the file system on a block device from its superblock, without running blkid.
+//
+// Only the signatures of the file systems that WSL mounts are checked (ext2/3/4, xfs, btrfs, vfat
+// and ntfs), along with swap and LUKS so that a device carrying one of those isn't mistaken for a
+// file system. The result is only returned when it's certain to match blkid: if no signature or
+// more than one is found, or the device holds swap or LUKS, nothing is returned and the caller
+// runs blkid.
+std::optional<std::string> ProbeFilesystem(int Device);
@@ -0,0 +1,647 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <algorithm>
+#include <array>
+#include <cinttypes>
+#include <filesystem>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include "common.h"
+#include "IncrementalExport.h"
+#include "util.h"
+
+#define EXPORT_STATE_PATH "var/lib/wsl"
+#define EXPORT_MANIFEST_PATH EXPORT_STATE_PATH "/export.manifest"
+#define EXPORT_MANIFEST_TEMP_PATH EXPORT_MANIFEST_PATH ".tmp"
+#define EXPORT_DELTA_PATH EXPORT_STATE_PATH "/export.delta"
+#define EXPORT_LAYER_PATH EXPORT_STATE_PATH "/export.layer"
+
+namespace {
+
+constexpr std::string_view c_manifestHeader{"WSL-EXPORT-MANIFEST 1 "};
+constexpr std::string_view c_deltaHeader{"WSL-EXPORT-DELTA 1 "};
+
+// Written in place of the base id in the first layer.
+constexpr auto c_noBase = "-";
+
+// Size of the buffer the changed paths are accumulated in before being written to the path list.
+constexpr size_t c_pathListBufferSize = 64 * 1024;
+
+// Paths that are never archived: the state of incremental exports, and the staging directory of
+// --import-delta if a previous one was interrupted.
+constexpr std::array<std::string_view, 4> c_excludedPaths{
+    "./" EXPORT_MANIFEST_PATH, "./" EXPORT_MANIFEST_TEMP_PATH, "./" EXPORT_LAYER_PATH, "./" EXPORT_DELTA_STAGING_PATH};
+
+struct Delta
+{
+    std::string Id;
+    std::string BaseId;
+    std::vector<std::string> Deleted;
+};
+
+// Compares paths in the order the root is walked, where a directory comes right before its content.
+int ComparePaths(std::string_view Left, std::string_view Right)
+{
+    const auto Size = std::min(Left.size(), Right.size());
+    for (size_t Index = 0; Index < Size; Index++)
+    {
+        const unsigned int LeftChar = Left[Index] == '/' ? 0 : static_cast<unsigned char>(Left[Index]);
+        const unsigned int RightChar = Right[Index] == '/' ? 0 : static_cast<unsigned char>(Right[Index]);
+        if (LeftChar != RightChar)
+        {
+            return LeftChar < RightChar ? -1 : 1;
+        }
+    }
+
+    if (Left.size() == Right.size())
+    {
+        return 0;
+    }
+
+    return Left.size() < Right.size() ? -1 : 1;
+}
+
+int64_t ToNanoseconds(const timespec& Time)
+{
+    return static_cast<int64_t>(Time.tv_sec) * 1000000000 + Time.tv_nsec;
+}
+
+std::string GenerateId()
+{
+    uint8_t Bytes[16];
+    THROW_LAST_ERROR_IF(getrandom(Bytes, sizeof(Bytes), 0) != sizeof(Bytes));
+
+    std::string Id;
+    for (const auto Byte : Bytes)
+    {
+        Id += std::format("{:02x}", Byte);
+    }
+
+    return Id;
+}
+
+// Runs a routine with the root changed to the distribution, so its absolute symlinks resolve in it.
+template <typename TRoutine>
+void RunInRoot(const char* Root, TRoutine&& Routine)
+{
+    wil::unique_fd PreviousRoot{open("/", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    THROW_LAST_ERROR_IF(!PreviousRoot);
+
+    wil::unique_fd PreviousDirectory{open(".", O_RDONLY | O_DIRECTORY | O_CLOEXEC)};
+    THROW_LAST_ERROR_IF(!PreviousDirectory);
+
+    THROW_LAST_ERROR_IF(chdir(Root) < 0);
+    auto Restore = wil::scope_exit([&]() {
+        FAIL_FAST_IF(fchdir(PreviousRoot.get()) < 0);
+        FAIL_FAST_IF(chroot(".") < 0);
+        FAIL_FAST_IF(fchdir(PreviousDirectory.get()) < 0);
+    });
+
+    THROW_LAST_ERROR_IF(chroot(".") < 0);
+    Routine();
+}
+
+void CreateStateDirectory()
+{
+    std::error_code Error;
+    std::filesystem::create_directories(EXPORT_STATE_PATH, Error);
+    THROW_ERRNO_IF(Error.value(), Error.value() != 0);
+}
+
+std::string ReadLayer()
+{
+    std::ifstream File(EXPORT_LAYER_PATH);
+    std::string Id;
+    File >> Id;
+    return Id;
+}
+
+void WriteLayer(const std::string& Id)
+{
+    CreateStateDirectory();
+    THROW_LAST_ERROR_IF(WriteToFile(EXPORT_LAYER_PATH, Id.c_str(), O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC) < 0);
+}
+
+void ReportError(int ErrorFd, const std::string& Message)
+{
+    LOG_ERROR("{}", Message);
+    dprintf(ErrorFd, "%s\n", Message.c_str());
+}
+
+bool IsValidDeletedPath(std::string_view Path)
+{
+    return Path.starts_with("./") && Path.size() > 2 && Path.find("/../") == std::string_view::npos && !Path.ends_with("/..");
+}
+
+std::optional<Delta> ReadDelta(const char* Path)
+{
+    std::ifstream File(Path, std::ios::binary);
+    if (!File)
+    {
+        THROW_ERRNO_IF(errno, errno != ENOENT);
+        return {};
+    }
+
+    //
+    // The header is "WSL-EXPORT-DELTA 1 <id> <base id>", followed by the deleted paths, each
+    // terminated by a null character.
+    //
+
+    std::string Header;
+    std::getline(File, Header);
+    THROW_ERRNO_IF(EINVAL, !Header.starts_with(c_deltaHeader));
+
+    Delta Result;
+    std::istringstream Ids(Header.substr(c_deltaHeader.size()));
+    THROW_ERRNO_IF(EINVAL, !(Ids >> Result.Id >> Result.BaseId));
+
+    std::string Deleted;
+    while (std::getline(File, Deleted, '\0'))
+    {
+        THROW_ERRNO_IF(EINVAL, !IsValidDeletedPath(Deleted));
+        Result.Deleted.emplace_back(std::move(Deleted));
+    }
+
+    return Result;
+}
+
+std::vector<std::string> ListAttributes(const char* Path)
+{
+    const auto Size = llistxattr(Path, nullptr, 0);
+    THROW_LAST_ERROR_IF(Size < 0);
+
+    std::vector<char> Buffer(Size);
+    const auto Read = llistxattr(Path, Buffer.data(), Buffer.size());
+    THROW_LAST_ERROR_IF(Read < 0);
+
+    std::vector<std::string> Names;
+    for (const char* Name = Buffer.data(); Name < Buffer.data() + Read; Name += strlen(Name) + 1)
+    {
+        Names.emplace_back(Name);
+    }
+
+    return Names;
+}
+
+// Copies the owner, extended attributes, mode and times of a staged directory to the one it's merged into.
+void CopyDirectoryMetadata(const char* Source, const struct stat& Stat, const char* Target)
+{
+    THROW_LAST_ERROR_IF(lchown(Target, Stat.st_uid, Stat.st_gid) < 0);
+
+    const auto SourceAttributes = ListAttributes(Source);
+    for (const auto& Name : ListAttributes(Target))
+    {
+        if (std::find(SourceAttributes.begin(), SourceAttributes.end(), Name) == SourceAttributes.end())
+        {
+            THROW_LAST_ERROR_IF(lremovexattr(Target, Name.c_str()) < 0);
+        }
+    }
+
+    for (const auto& Name : SourceAttributes)
+    {
+        const auto Size = lgetxattr(Source, Name.c_str(), nullptr, 0);
+        THROW_LAST_ERROR_IF(Size < 0);
+
+        std::vector<char> Value(Size);
+        THROW_LAST_ERROR_IF(lgetxattr(Source, Name.c_str(), Value.data(), Value.size()) != Size);
+        THROW_LAST_ERROR_IF(lsetxattr(Target, Name.c_str(), Value.data(), Value.size(), 0) < 0);
+    }
+
+    THROW_LAST_ERROR_IF(chmod(Target, Stat.st_mode & 07777) < 0);
+
+    const timespec Times[2]{Stat.st_atim, Stat.st_mtim};
+    THROW_LAST_ERROR_IF(utimensat(AT_FDCWD, Target, Times, AT_SYMLINK_NOFOLLOW) < 0);
+}
+
+// Moves a staged path to its target. Directories that exist on both sides are merged, anything
+// else replaces the target.
+void Merge(const std::string& Source, const std::string& Target)
+{
+    struct stat SourceStat{};
+    THROW_LAST_ERROR_IF(lstat(Source.c_str(), &SourceStat) < 0);
+
+    struct stat TargetStat{};
+    bool TargetExists = true;
+    if (lstat(Target.c_str(), &TargetStat) < 0)
+    {
+        THROW_LAST_ERROR_IF(errno != ENOENT);
+        TargetExists = false;
+    }
+
+    if (TargetExists && S_ISDIR(SourceStat.st_mode) && S_ISDIR(TargetStat.st_mode))
+    {
+        std::vector<std::string> Names;
+        {
+            wil::unique_dir Directory{opendir(Source.c_str())};
+            THROW_LAST_ERROR_IF(!Directory);
+
+            while (const auto* Entry = readdir(Directory.get()))
+            {
+                if (strcmp(Entry->d_name, ".") != 0 && strcmp(Entry->d_name, "..") != 0)
+                {
+                    Names.emplace_back(Entry->d_name);
+                }
+            }
+        }
+
+        for (const auto& Name : Names)
+        {
+            Merge(Source + "/" + Name, Target + "/" + Name);
+        }
+
+        CopyDirectoryMetadata(Source.c_str(), SourceStat, Target.c_str());
+        THROW_LAST_ERROR_IF(rmdir(Source.c_str()) < 0);
+        return;
+    }
+
+    if (TargetExists && S_ISDIR(TargetStat.st_mode))
+    {
+        std::filesystem::remove_all(Target);
+    }
+    else if (TargetExists && S_ISDIR(SourceStat.st_mode))
+    {
+        THROW_LAST_ERROR_IF(unlink(Target.c_str()) < 0);
+    }
+
+    THROW_LAST_ERROR_IF(rename(Source.c_str(), Target.c_str()) < 0);
+}
+
+} // namespace
+
+/**
+ * @brief Find the paths that changed since the previous incremental export of a root file system.
+ *
+ * @param[in] Root The root file system to export.
+ */
+IncrementalExport::IncrementalExport(const char* Root) : m_root(Root), m_id(GenerateId()), m_baseId(c_noBase)
+{
+    //
+    // The delta file is created before the walk so it's archived with its parent directories.
+    //
+
+    RunInRoot(Root, [this]() {
+        CreateStateDirectory();
+        THROW_LAST_ERROR_IF(unlink(EXPORT_DELTA_PATH) < 0 && errno != ENOENT);
+        THROW_LAST_ERROR_IF(WriteToFile(EXPORT_DELTA_PATH, "", O_WRONLY | O_CLOEXEC | O_CREAT | O_EXCL, 0600) < 0);
+
+        m_previousManifest.open(EXPORT_MANIFEST_PATH, std::ios::binary);
+        m_manifest.open(EXPORT_MANIFEST_TEMP_PATH, std::ios::binary | std::ios::trunc);
+        THROW_LAST_ERROR_IF(!m_manifest);
+    });
+
+    if (m_previousManifest)
+    {
+        std::string Header;
+        std::getline(m_previousManifest, Header);
+        if (Header.starts_with(c_manifestHeader))
+        {
+            m_baseId = Header.substr(c_manifestHeader.size());
+            ReadManifestEntry();
+        }
+        else
+        {
+            LOG_WARNING("Ignoring invalid export manifest, exporting all files");
+        }
+    }
+
+    m_manifest << c_manifestHeader << m_id << '\n';
+
+    m_pathList.reset(memfd_create("export-paths", 0));
+    THROW_LAST_ERROR_IF(!m_pathList);
+
+    struct stat Stat{};
+    THROW_LAST_ERROR_IF(stat(Root, &Stat) < 0);
+
+    Walk(AT_FDCWD, ".", Stat.st_dev);
+    FlushDeletions(nullptr);
+
+    THROW_LAST_ERROR_IF(UtilWriteBuffer(m_pathList.get(), m_pathBuffer.data(), m_pathBuffer.size()) < 0);
+    m_pathBuffer.clear();
+
+    m_manifest.flush();
+    THROW_ERRNO_IF(EIO, !m_manifest);
+
+    //
+    // Write the layer ids and the deleted paths to the delta file.
+    //
+
+    std::string Content = std::format("{}{} {}\n", c_deltaHeader, m_id, m_baseId);
+    for (const auto& Path : m_deleted)
+    {
+        Content += Path;
+        Content += '\0';
+    }
+
+    RunInRoot(Root, [&]() {
+        wil::unique_fd File{open(EXPORT_DELTA_PATH, O_WRONLY | O_CLOEXEC | O_TRUNC | O_NOFOLLOW)};
+        THROW_LAST_ERROR_IF(!File);
+        THROW_LAST_ERROR_IF(UtilWriteBuffer(File.get(), Content.data(), Content.size()) < 0);
+    });
+
+    LOG_INFO("Incremental export {} (base {}): {} changed paths, {} deleted", m_id, m_baseId, m_changedPaths, m_deleted.size());
+}
+
+IncrementalExport::~IncrementalExport()
+{
+    try
+    {
+        RunInRoot(m_root.c_str(), [this]() {
+            unlink(EXPORT_DELTA_PATH);
+            if (!m_committed)
+            {
+                unlink(EXPORT_MANIFEST_TEMP_PATH);
+            }
+        });
+    }
+    CATCH_LOG()
+}
+
+/**
+ * @brief Save the manifest once the host stored the archive, so the next export is based on it.
+ */
+void IncrementalExport::Commit()
+{
+    m_manifest.close();
+    THROW_ERRNO_IF(EIO, m_manifest.fail());
+
+    RunInRoot(m_root.c_str(), []() { THROW_LAST_ERROR_IF(rename(EXPORT_MANIFEST_TEMP_PATH, EXPORT_MANIFEST_PATH) < 0); });
+    m_committed = true;
+}
+
+/**
+ * @brief Get the path of the file that lists the paths to archive, separated by null characters.
+ */
+std::string IncrementalExport::PathList() const
+{
+    return std::format("/proc/self/fd/{}", m_pathList.get());
+}
+
+void IncrementalExport::Walk(int Parent, const std::string& Path, dev_t Device)
+{
+    const auto* Name = Parent == AT_FDCWD ? m_root.c_str() : Path.c_str() + Path.rfind('/') + 1;
+    struct stat Stat{};
+    THROW_LAST_ERROR_IF(fstatat(Parent, Name, &Stat, AT_SYMLINK_NOFOLLOW) < 0);
+
+    //
+    // Sockets can't be archived, and the paths of the export state are skipped.
+    //
+
+    if (S_ISSOCK(Stat.st_mode) || std::find(c_excludedPaths.begin(), c_excludedPaths.end(), Path) != c_excludedPaths.end())
+    {
+        return;
+    }
+
+    Entry Current{
+        Path,
+        Stat.st_ino,
+        static_cast<uint64_t>(Stat.st_size),
+        ToNanoseconds(Stat.st_mtim),
+        ToNanoseconds(Stat.st_ctim),
+        Stat.st_mode};
+    const bool Changed = Compare(Current);
+    if (Changed)
+    {
+        Emit(Path);
+    }
+
+    //
+    // Like bsdtar --one-file-system, the content of mount points isn't archived.
+    //
+
+    if (!S_ISDIR(Stat.st_mode) || Stat.st_dev != Device)
+    {
+        return;
+    }
+
+    //
+    // Parent directories are archived along with any changed path, so the staged directories
+    // have the right metadata when the layer is applied.
+    //
+
+    m_ancestors.emplace_back(Path);
+    if (Changed)
+    {
+        m_emittedAncestors = m_ancestors.size();
+    }
+
+    {
+        wil::unique_fd DirectoryFd{openat(Parent, Name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)};
+        THROW_LAST_ERROR_IF(!DirectoryFd);
+
+        wil::unique_dir Directory{fdopendir(DirectoryFd.get())};
+        THROW_LAST_ERROR_IF(!Directory);
+        DirectoryFd.release();
+
+        std::vector<std::string> Names;
+        while (const auto* Child = readdir(Directory.get()))
+        {
+            if (strcmp(Child->d_name, ".") != 0 && strcmp(Child->d_name, "..") != 0)
+            {
+                Names.emplace_back(Child->d_name);
+            }
+        }
+
+        std::sort(Names.begin(), Names.end());
+        for (const auto& Child : Names)
+        {
+            Walk(dirfd(Directory.get()), Path + "/" + Child, Device);
+        }
+    }
+
+    m_ancestors.pop_back();
+    m_emittedAncestors = std::min(m_emittedAncestors, m_ancestors.size());
+}
+
+bool IncrementalExport::Compare(const Entry& Current)
+{
+    FlushDeletions(&Current.Path);
+
+    bool Changed = true;
+    if (m_previous.has_value() && m_previous->Path == Current.Path)
+    {
+        Changed = m_previous->Inode != Current.Inode || m_previous->Size != Current.Size ||
+                  m_previous->ModifiedTime != Current.ModifiedTime || m_previous->ChangeTime != Current.ChangeTime ||
+                  m_previous->Mode != Current.Mode;
+
+        ReadManifestEntry();
+    }
+
+    WriteManifestEntry(Current);
+    return Changed;
+}
+
+void IncrementalExport::Emit(const std::string& Path)
+{
+    for (auto Index = m_emittedAncestors; Index < m_ancestors.size(); Index++)
+    {
+        m_pathBuffer += m_ancestors[Index];
+        m_pathBuffer += '\0';
+        m_changedPaths++;
+    }
+
+    m_emittedAncestors = m_ancestors.size();
+    m_pathBuffer += Path;
+    m_pathBuffer += '\0';
+    m_changedPaths++;
+
+    if (m_pathBuffer.size() >= c_pathListBufferSize)
+    {
+        THROW_LAST_ERROR_IF(UtilWriteBuffer(m_pathList.get(), m_pathBuffer.data(), m_pathBuffer.size()) < 0);
+        m_pathBuffer.clear();
+    }
+}
+
+// Records the paths of the previous manifest that come before a path of the walk as deleted.
+void IncrementalExport::FlushDeletions(const std::string* Until)
+{
+    while (m_previous.has_value() && (Until == nullptr || ComparePaths(m_previous->Path, *Until) < 0))
+    {
+        //
+        // The content of a deleted directory is removed with it.
+        //
+
+        if (m_deleted.empty() || !m_previous->Path.starts_with(m_deleted.back() + "/"))
+        {
+            m_deleted.emplace_back(std::move(m_previous->Path));
+        }
+
+        ReadManifestEntry();
+    }
+}
+
+// Manifest entries are "<inode> <size> <mtime> <ctime> <mode> <path>", terminated by a null character.
+bool IncrementalExport::ReadManifestEntry()
+{
+    std::string Record;
+    if (!std::getline(m_previousManifest, Record, '\0'))
+    {
+        m_previous.reset();
+        return false;
+    }
+
+    Entry Previous{};
+    unsigned int Mode{};
+    int Offset{};
+    if (sscanf(
+            Record.c_str(),
+            "%" SCNu64 " %" SCNu64 " %" SCNd64 " %" SCNd64 " %u %n",
+            &Previous.Inode,
+            &Previous.Size,
+            &Previous.ModifiedTime,
+            &Previous.ChangeTime,
+            &Mode,
+            &Offset) != 5 ||
+        Offset == 0)
+    {
+        LOG_ERROR("Invalid export manifest entry: {}", Record);
+        THROW_ERRNO(EINVAL);
+    }
+
+    Previous.Mode = Mode;
+    Previous.Path = Record.substr(Offset);
+    m_previous = std::move(Previous);
+    return true;
+}
+
+void IncrementalExport::WriteManifestEntry(const Entry& Current)
+{
+    m_manifest << Current.Inode << ' ' << Current.Size << ' ' << Current.ModifiedTime << ' ' << Current.ChangeTime << ' '
+               << static_cast<unsigned int>(Current.Mode) << ' ' << Current.Path << '\0';
+}
+
+/**
+ * @brief Apply a layer of an incremental export that was extracted to the staging directory.
+ *
+ * @param[in] Root The root file system of the distribution.
+ * @param[in] ErrorFd The file descriptor errors are reported to, for the user.
+ */
+void ApplyExportDelta(const char* Root, int ErrorFd)
+{
+    RunInRoot(Root, [ErrorFd]() {
+        const auto StagedDelta = "./" EXPORT_DELTA_STAGING_PATH "/" EXPORT_DELTA_PATH;
+        const auto Delta = ReadDelta(StagedDelta);
+        if (!Delta.has_value())
+        {
+            ReportError(ErrorFd, "The archive is not an incremental export.");
+            THROW_ERRNO(EINVAL);
+        }
+
+        if (Delta->BaseId == c_noBase)
+        {
+            ReportError(ErrorFd, std::format("The incremental export {} is a first export. Import it with --import.", Delta->Id));
+            THROW_ERRNO(EINVAL);
+        }
+
+        const auto Layer = ReadLayer();
+        if (Delta->BaseId != Layer)
+        {
+            ReportError(
+                ErrorFd,
+                std::format(
+                    "The incremental export {} is based on {}, but the distribution is at {}.",
+                    Delta->Id,
+                    Delta->BaseId,
+                    Layer.empty() ? c_noBase : Layer));
+
+            THROW_ERRNO(EINVAL);
+        }
+
+        THROW_LAST_ERROR_IF(unlink(StagedDelta) < 0);
+
+        //
+        // Deleted paths are removed first, since a path may have been deleted and created again
+        // with a different type.
+        //
+
+        for (const auto& Path : Delta->Deleted)
+        {
+            std::error_code Error;
+            std::filesystem::remove_all(Path, Error);
+            if (Error)
+            {
+                LOG_WARNING("Failed to delete {}, {}", Path, Error.value());
+            }
+        }
+
+        Merge("./" EXPORT_DELTA_STAGING_PATH, ".");
+        WriteLayer(Delta->Id);
+
+        LOG_INFO("Applied incremental export {}: {} deleted paths", Delta->Id, Delta->Deleted.size());
+    });
+}
+
+/**
+ * @brief Record the layer that a distribution was imported from, if it's the first layer of an
+ *        incremental export.
+ *
+ * @param[in] Root The root file system of the distribution.
+ * @param[in] ErrorFd The file descriptor errors are reported to, for the user.
+ */
+void RecordImportedLayer(const char* Root, int ErrorFd)
+{
+    RunInRoot(Root, [ErrorFd]() {
+        const auto Delta = ReadDelta(EXPORT_DELTA_PATH);
+        if (!Delta.has_value())
+        {
+            return;
+        }
+
+        if (Delta->BaseId != c_noBase)
+        {
+            ReportError(
+                ErrorFd,
+                std::format(
+                    "The incremental export {} is based on {}. Import the first export, then apply the following ones with "
+                    "--import-delta.",
+                    Delta->Id,
+                    Delta->BaseId));
+
+            THROW_ERRNO(EINVAL);
+        }
+
+        WriteLayer(Delta->Id);
+        THROW_LAST_ERROR_IF(unlink(EXPORT_DELTA_PATH) < 0);
+    });
+}
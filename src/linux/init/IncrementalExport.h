@@ -0,0 +1,91 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <vector>
+#include "common.h"
+
+// Directory of the root file system that --import-delta extracts a layer to before applying it.
+#define EXPORT_DELTA_STAGING_PATH ".wsl-import-delta"
+
+// Incremental exports of a distribution.
+//
+// The distribution keeps the manifest of its last incremental export in /var/lib/wsl: the inode,
+// size, mode, modification and change times of every path. The next incremental export walks the
+// root file system, compares it to the manifest, and only archives the paths that are new or whose
+// metadata changed, along with their parent directories. Since any write, chmod, chown, link or
+// xattr change updates the change time, and it can't be set from user mode, the metadata is enough
+// to find every changed file without hashing its content.
+//
+// Each export is a layer with a random id. The archive contains /var/lib/wsl/export.delta, which
+// holds the id of the layer, the id of the layer it's based on, and the paths that were deleted
+// since then. Importing the first layer with --import creates the distribution, and every
+// following layer is applied in order with --import-delta: the layer is extracted to a staging
+// directory, the deleted paths are removed, and the staging directory is merged into the root.
+// The id of the last layer applied is kept in /var/lib/wsl/export.layer, so a layer that isn't
+// based on it is refused.
+//
+// The manifest is only saved once the host confirmed that it stored the archive, so a layer that
+// was lost on the way is exported again with the next one.
+//
+// The manifest is sorted in the order the root is walked: depth first, with the entries of each
+// directory sorted by name. This allows comparing it to the file system in a single pass without
+// loading it in memory.
+class IncrementalExport
+{
+public:
+    explicit IncrementalExport(const char* Root);
+    ~IncrementalExport();
+
+    IncrementalExport(const IncrementalExport&) = delete;
+    IncrementalExport& operator=(const IncrementalExport&) = delete;
+
+    void Commit();
+
+    std::string PathList() const;
+
+private:
+    struct Entry
+    {
+        std::string Path;
+        uint64_t Inode{};
+        uint64_t Size{};
+        int64_t ModifiedTime{};
+        int64_t ChangeTime{};
+        mode_t Mode{};
+    };
+
+    void Walk(int Parent, const std::string& Path, dev_t Device);
+
+    bool Compare(const Entry& Current);
+
+    void Emit(const std::string& Path);
+
+    void FlushDeletions(const std::string* Until);
+
+    bool ReadManifestEntry();
+
+    void WriteManifestEntry(const Entry& Current);
+
+    std::string m_root;
+    std::string m_id;
+    std::string m_baseId;
+    std::ifstream m_previousManifest;
+    std::optional<Entry> m_previous;
+    std::ofstream m_manifest;
+    wil::unique_fd m_pathList;
+    std::string m_pathBuffer;
+    std::vector<std::string> m_deleted;
+    std::vector<std::string> m_ancestors;
+    size_t m_emittedAncestors{};
+    uint64_t m_changedPaths{};
+    bool m_committed{};
+};
+
+void ApplyExportDelta(const char* Root, int ErrorFd);
+
+void RecordImportedLayer(const char* Root, int ErrorFd);
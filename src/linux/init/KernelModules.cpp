@@ -0,0 +1,659 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <condition_variable>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <fstream>
+#include <mutex>
+#include <sys/syscall.h>
+#include <thread>
+#include "common.h"
+#include "KernelModules.h"
+#include "BootTimeline.h"
+#include "util.h"
+
+#define MODPROBE_PATH "/sbin/modprobe"
+
+#ifndef MODULE_INIT_COMPRESSED_FILE
+#define MODULE_INIT_COMPRESSED_FILE 4
+#endif
+
+namespace {
+
+// Kernel command line, whose <module>.<parameter>=<value> entries are module options too.
+constexpr const char* c_commandLinePath = "/proc/cmdline";
+
+// Directories that modprobe reads its configuration from, in order of precedence.
+constexpr const char* c_configurationDirectories[] = {
+    "/etc/modprobe.d", "/run/modprobe.d", "/usr/local/lib/modprobe.d", "/lib/modprobe.d", "/usr/lib/modprobe.d"};
+
+// Module names treat '-' and '_' the same. Like modprobe, replace dashes with underscores,
+// except in the bracket expressions of alias patterns.
+std::string NormalizeAlias(std::string_view Alias)
+{
+    std::string Normalized{Alias};
+    bool InBrackets = false;
+    for (auto& Character : Normalized)
+    {
+        if (Character == '[')
+        {
+            InBrackets = true;
+        }
+        else if (Character == ']')
+        {
+            InBrackets = false;
+        }
+        else if (Character == '-' && !InBrackets)
+        {
+            Character = '_';
+        }
+    }
+
+    return Normalized;
+}
+
+// Read the lines of a modprobe configuration file, joining continuation lines and skipping
+// comments and empty lines, and split them into words.
+template <typename TCallback>
+void ForEachConfigurationLine(const std::string& Path, TCallback&& Callback)
+{
+    std::ifstream File{Path};
+    std::string Line;
+    std::string Continued;
+    while (std::getline(File, Line))
+    {
+        if (!Line.empty() && Line.back() == '\\')
+        {
+            Line.pop_back();
+            Continued += Line;
+            continue;
+        }
+
+        Line = std::move(Continued) + Line;
+        Continued.clear();
+        if (Line.empty() || Line.front() == '#')
+        {
+            continue;
+        }
+
+        const auto Words = wsl::shared::string::SplitByMultipleSeparators(Line, std::string{" \t"});
+        if (!Words.empty())
+        {
+            Callback(Words);
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Parse the module database of a modules directory and the modprobe configuration.
+ *
+ * @param[in] ModulesDirectory The modules directory of the running kernel (/lib/modules/<release>).
+ */
+KernelModuleLoader::KernelModuleLoader(const std::string& ModulesDirectory) : m_directory(ModulesDirectory)
+{
+    //
+    // Each line of modules.dep lists a module followed by every module it depends on, directly or
+    // not, relative to the modules directory.
+    //
+
+    std::vector<std::vector<std::string>> DependencyNames;
+    std::ifstream Dependencies{m_directory + "/modules.dep"};
+    std::string Line;
+    while (std::getline(Dependencies, Line))
+    {
+        const auto Separator = Line.find(':');
+        if (Separator == std::string::npos)
+        {
+            continue;
+        }
+
+        auto& NewModule = m_modules.emplace_back();
+        NewModule.Path = Line.substr(0, Separator);
+        NewModule.Name = NormalizeName(NewModule.Path);
+        m_names.emplace(NewModule.Name, m_modules.size() - 1);
+        DependencyNames.emplace_back(
+            wsl::shared::string::SplitByMultipleSeparators(Line.substr(Separator + 1), std::string{" \t"}));
+    }
+
+    for (size_t Index = 0; Index < m_modules.size(); Index++)
+    {
+        for (const auto& Dependency : DependencyNames[Index])
+        {
+            const auto Found = m_names.find(NormalizeName(Dependency));
+            if (Found != m_names.end())
+            {
+                m_modules[Index].Dependencies.push_back(Found->second);
+            }
+        }
+    }
+
+    std::ifstream Builtin{m_directory + "/modules.builtin"};
+    while (std::getline(Builtin, Line))
+    {
+        if (!Line.empty())
+        {
+            m_builtin.emplace(NormalizeName(Line));
+        }
+    }
+
+    ForEachConfigurationLine(m_directory + "/modules.alias", [&](const std::vector<std::string>& Words) {
+        if (Words.size() >= 3 && Words[0] == "alias")
+        {
+            m_aliases.emplace_back(NormalizeAlias(Words[1]), NormalizeAlias(Words[2]));
+        }
+    });
+
+    //
+    // Configuration files with the same name are only read from the first directory that has
+    // them, like modprobe does.
+    //
+
+    std::map<std::string, std::string> Files;
+    for (const auto* Directory : c_configurationDirectories)
+    {
+        std::unique_ptr<DIR, decltype(&closedir)> DirectoryStream{opendir(Directory), closedir};
+        if (!DirectoryStream)
+        {
+            continue;
+        }
+
+        while (const auto* Entry = readdir(DirectoryStream.get()))
+        {
+            const std::string_view Name{Entry->d_name};
+            if (Name.ends_with(".conf"))
+            {
+                Files.try_emplace(std::string{Name}, std::format("{}/{}", Directory, Name));
+            }
+        }
+    }
+
+    for (const auto& [Name, File] : Files)
+    {
+        ParseConfiguration(File);
+    }
+
+    ParseConfiguration(m_directory + "/modules.softdep");
+    ParseCommandLine(c_commandLinePath);
+}
+
+/**
+ * @brief Load kernel modules and their dependencies.
+ *
+ * @param[in] Names The names or aliases of the modules to load.
+ * @param[in] MaximumThreads The maximum number of modules to load concurrently.
+ */
+void KernelModuleLoader::Load(const std::vector<std::string>& Names, size_t MaximumThreads) const
+{
+    BootTimeline::Span Span{"LoadKernelModules"};
+    const auto Start = std::chrono::steady_clock::now();
+
+    //
+    // Build the graph of the modules to load. A module is loaded once every module it depends on
+    // is loaded.
+    //
+
+    struct Task
+    {
+        size_t Module;
+        size_t Remaining;
+        std::vector<size_t> Dependents;
+        bool Loaded;
+        bool Skipped;
+    };
+
+    std::vector<Task> Tasks;
+    std::map<size_t, size_t> TaskIndex;
+    auto AddTask = [&](auto& Self, size_t Module) -> size_t {
+        const auto Found = TaskIndex.find(Module);
+        if (Found != TaskIndex.end())
+        {
+            return Found->second;
+        }
+
+        const auto Index = Tasks.size();
+        Tasks.push_back(Task{Module, 0, {}, false, false});
+        TaskIndex.emplace(Module, Index);
+        for (const auto Dependency : m_modules[Module].Dependencies)
+        {
+            if (!IsLoaded(m_modules[Dependency].Name))
+            {
+                const auto DependencyTask = Self(Self, Dependency);
+                Tasks[DependencyTask].Dependents.push_back(Index);
+                Tasks[Index].Remaining += 1;
+            }
+        }
+
+        return Index;
+    };
+
+    std::vector<std::pair<std::string, std::optional<size_t>>> Requested;
+    for (const auto& Name : Names)
+    {
+        const auto Module = Resolve(Name);
+        if (IsLoaded(Module.has_value() ? m_modules[Module.value()].Name : NormalizeAlias(Name)))
+        {
+            continue;
+        }
+
+        //
+        // Leave modules that modprobe would treat specially, either because of the module itself
+        // or one of its dependencies, to modprobe.
+        //
+
+        bool UseModprobe = !Module.has_value() || m_modules[Module.value()].UseModprobe;
+        if (!UseModprobe)
+        {
+            for (const auto Dependency : m_modules[Module.value()].Dependencies)
+            {
+                UseModprobe = UseModprobe || m_modules[Dependency].UseModprobe;
+            }
+        }
+
+        Requested.emplace_back(Name, UseModprobe ? std::optional<size_t>{} : AddTask(AddTask, Module.value()));
+    }
+
+    //
+    // Load the modules on a bounded number of threads. When a module fails to load, the modules
+    // that depend on it are skipped, and the requested ones are retried with modprobe below.
+    //
+
+    std::mutex Lock;
+    std::condition_variable Changed;
+    std::deque<size_t> Ready;
+    size_t Outstanding = Tasks.size();
+    size_t InFlight = 0;
+    for (size_t Index = 0; Index < Tasks.size(); Index++)
+    {
+        if (Tasks[Index].Remaining == 0)
+        {
+            Ready.push_back(Index);
+        }
+    }
+
+    auto Skip = [&](auto& Self, size_t Index) -> void {
+        for (const auto Dependent : Tasks[Index].Dependents)
+        {
+            if (!Tasks[Dependent].Skipped)
+            {
+                Tasks[Dependent].Skipped = true;
+                Outstanding -= 1;
+                Self(Self, Dependent);
+            }
+        }
+    };
+
+    auto Worker = [&]() {
+        std::unique_lock Guard{Lock};
+        for (;;)
+        {
+            //
+            // N.B. If no module is ready and none is being loaded, the remaining modules can't
+            //      become ready (modules.dep has a cycle), and they are left to modprobe.
+            //
+
+            Changed.wait(Guard, [&]() { return !Ready.empty() || Outstanding == 0 || InFlight == 0; });
+            if (Ready.empty())
+            {
+                return;
+            }
+
+            const auto Current = Ready.front();
+            Ready.pop_front();
+            InFlight += 1;
+            const auto& Module = m_modules[Tasks[Current].Module];
+            Guard.unlock();
+
+            const auto LoadStart = std::chrono::steady_clock::now();
+            const int Result = LoadModule(Module);
+            const int Error = errno;
+            const auto Elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - LoadStart);
+
+            Guard.lock();
+            if (Result == 0)
+            {
+                LOG_INFO("Loaded module {} in {}us", Module.Name, Elapsed.count());
+                Tasks[Current].Loaded = true;
+                for (const auto Dependent : Tasks[Current].Dependents)
+                {
+                    if (--Tasks[Dependent].Remaining == 0)
+                    {
+                        Ready.push_back(Dependent);
+                    }
+                }
+            }
+            else
+            {
+                LOG_WARNING("finit_module({}) failed {}, falling back to modprobe", Module.Name, Error);
+                Skip(Skip, Current);
+            }
+
+            Outstanding -= 1;
+            InFlight -= 1;
+            Changed.notify_all();
+        }
+    };
+
+    //
+    // The calling thread loads modules too, so if no thread can be created the modules are still
+    // loaded one at a time.
+    //
+
+    std::vector<std::thread> Threads;
+    const auto ThreadCount = std::min(MaximumThreads, Tasks.size());
+    for (size_t Index = 1; Index < ThreadCount; Index++)
+    {
+        try
+        {
+            Threads.emplace_back(Worker);
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            break;
+        }
+    }
+
+    Worker();
+    for (auto& Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    //
+    // Load the remaining modules with modprobe.
+    //
+
+    for (const auto& [Name, Index] : Requested)
+    {
+        if (Index.has_value() && Tasks[Index.value()].Loaded)
+        {
+            continue;
+        }
+
+        const auto ModprobeStart = std::chrono::steady_clock::now();
+        const char* Argv[] = {MODPROBE_PATH, Name.c_str(), nullptr};
+        int Status = -1;
+        auto result = UtilCreateProcessAndWait(MODPROBE_PATH, Argv, &Status);
+        if (result < 0)
+        {
+            LOG_ERROR("Failed to load module '{}', {}", Name, Status);
+        }
+        else
+        {
+            LOG_INFO(
+                "Loaded module {} with modprobe in {}us",
+                Name,
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - ModprobeStart).count());
+        }
+    }
+
+    LOG_INFO(
+        "Loaded {} kernel modules in {}ms",
+        Requested.size(),
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - Start).count());
+}
+
+/**
+ * @brief Apply a modprobe configuration file.
+ *
+ * @param[in] Path The path of the configuration file.
+ */
+void KernelModuleLoader::ParseConfiguration(const std::string& Path)
+{
+    ForEachConfigurationLine(Path, [&](const std::vector<std::string>& Words) {
+        if (Words.size() < 2)
+        {
+            return;
+        }
+
+        const auto& Command = Words[0];
+        if (Command == "blacklist")
+        {
+            m_blacklist.emplace(NormalizeAlias(Words[1]));
+            return;
+        }
+
+        if (Command == "alias")
+        {
+            m_configAliases.emplace(NormalizeAlias(Words[1]));
+            return;
+        }
+
+        const auto Found = m_names.find(NormalizeAlias(Words[1]));
+        if (Found == m_names.end())
+        {
+            return;
+        }
+
+        auto& Module = m_modules[Found->second];
+        if (Command == "options")
+        {
+            for (size_t Index = 2; Index < Words.size(); Index++)
+            {
+                if (!Module.Options.empty())
+                {
+                    Module.Options += ' ';
+                }
+
+                Module.Options += Words[Index];
+            }
+        }
+        else if (Command == "install" || Command == "softdep")
+        {
+            Module.UseModprobe = true;
+        }
+    });
+}
+
+/**
+ * @brief Apply the module options and the modprobe blacklist from the kernel command line. Like
+ * modprobe, the options are passed after the ones from the configuration files, so they take
+ * precedence.
+ *
+ * @param[in] Path The path of the kernel command line.
+ */
+void KernelModuleLoader::ParseCommandLine(const std::string& Path)
+{
+    std::ifstream File{Path};
+    std::string CommandLine;
+    std::getline(File, CommandLine);
+    for (const auto& Entry : SplitCommandLine(CommandLine))
+    {
+        //
+        // Entries without a dot before the value are kernel parameters, not module parameters.
+        //
+
+        const auto Dot = Entry.find('.');
+        if (Dot == std::string::npos || Dot == 0 || Dot > Entry.find('='))
+        {
+            continue;
+        }
+
+        const auto Name = NormalizeAlias(std::string_view{Entry}.substr(0, Dot));
+        const auto Parameter = Entry.substr(Dot + 1);
+        if (Name == "modprobe")
+        {
+            constexpr std::string_view BlacklistPrefix = "blacklist=";
+            if (Parameter.starts_with(BlacklistPrefix))
+            {
+                for (const auto& Blacklisted : wsl::shared::string::Split(Parameter.substr(BlacklistPrefix.size()), ','))
+                {
+                    m_blacklist.emplace(NormalizeAlias(Blacklisted));
+                }
+            }
+
+            continue;
+        }
+
+        const auto Found = m_names.find(Name);
+        if (Found == m_names.end() || Parameter.empty())
+        {
+            continue;
+        }
+
+        auto& Module = m_modules[Found->second];
+        if (!Module.Options.empty())
+        {
+            Module.Options += ' ';
+        }
+
+        Module.Options += Parameter;
+    }
+}
+
+/**
+ * @brief Split a kernel command line into its entries. Like the kernel, spaces inside double quotes
+ * don't separate entries, and the quotes are kept so the module parses the value the same way.
+ *
+ * @param[in] CommandLine The kernel command line.
+ */
+std::vector<std::string> KernelModuleLoader::SplitCommandLine(std::string_view CommandLine)
+{
+    std::vector<std::string> Entries;
+    std::string Current;
+    bool InQuotes = false;
+    for (const auto Character : CommandLine)
+    {
+        if (Character == '"')
+        {
+            InQuotes = !InQuotes;
+        }
+        else if (!InQuotes && isspace(static_cast<unsigned char>(Character)))
+        {
+            if (!Current.empty())
+            {
+                Entries.emplace_back(std::move(Current));
+                Current.clear();
+            }
+
+            continue;
+        }
+
+        Current += Character;
+    }
+
+    if (!Current.empty())
+    {
+        Entries.emplace_back(std::move(Current));
+    }
+
+    return Entries;
+}
+
+/**
+ * @brief Find the module a name refers to, either directly or through an alias.
+ *
+ * @param[in] Name The name or alias of the module.
+ *
+ * @return The index of the module, or no value if the module should be left to modprobe.
+ */
+std::optional<size_t> KernelModuleLoader::Resolve(const std::string& Name) const
+{
+    const auto Normalized = NormalizeAlias(Name);
+    if (m_configAliases.contains(Normalized))
+    {
+        return {};
+    }
+
+    const auto Found = m_names.find(Normalized);
+    if (Found != m_names.end())
+    {
+        return Found->second;
+    }
+
+    //
+    // Like modprobe, only use an alias if it refers to a single module.
+    //
+
+    std::optional<size_t> Match;
+    for (const auto& [Pattern, ModuleName] : m_aliases)
+    {
+        if (fnmatch(Pattern.c_str(), Normalized.c_str(), 0) != 0 || m_blacklist.contains(ModuleName))
+        {
+            continue;
+        }
+
+        const auto Module = m_names.find(ModuleName);
+        if (Module == m_names.end() || (Match.has_value() && Match.value() != Module->second))
+        {
+            return {};
+        }
+
+        Match = Module->second;
+    }
+
+    return Match;
+}
+
+/**
+ * @brief Return whether a module is built into the kernel or already loaded.
+ *
+ * @param[in] Name The normalized name of the module.
+ */
+bool KernelModuleLoader::IsLoaded(const std::string& Name) const
+{
+    if (m_builtin.contains(Name))
+    {
+        return true;
+    }
+
+    const auto InitState = std::format("/sys/module/{}/initstate", Name);
+    return access(InitState.c_str(), F_OK) == 0;
+}
+
+/**
+ * @brief Load a single module with finit_module().
+ *
+ * @param[in] Module The module to load.
+ *
+ * @return 0 on success, -1 with errno set on failure. A module that is already loaded is
+ *         treated as success.
+ */
+int KernelModuleLoader::LoadModule(const Module& Module) const
+{
+    BootTimeline::Span Span{Module.Name.c_str()};
+    const auto Path = Module.Path.starts_with('/') ? Module.Path : std::format("{}/{}", m_directory, Module.Path);
+    wil::unique_fd Fd{open(Path.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (!Fd)
+    {
+        return -1;
+    }
+
+    //
+    // Compressed modules (.ko.xz, .ko.zst, .ko.gz) are decompressed by the kernel.
+    //
+
+    const int Flags = Path.ends_with(".ko") ? 0 : MODULE_INIT_COMPRESSED_FILE;
+    if (syscall(SYS_finit_module, Fd.get(), Module.Options.c_str(), Flags) < 0 && errno != EEXIST)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Return the name of a module from its path, for example kernel/net/tun.ko becomes tun.
+ *
+ * @param[in] Path The path of the module, relative to the modules directory.
+ */
+std::string KernelModuleLoader::NormalizeName(std::string_view Path)
+{
+    const auto Separator = Path.rfind('/');
+    if (Separator != std::string_view::npos)
+    {
+        Path.remove_prefix(Separator + 1);
+    }
+
+    const auto Extension = Path.find(".ko");
+    if (Extension != std::string_view::npos)
+    {
+        Path = Path.substr(0, Extension);
+    }
+
+    return NormalizeAlias(Path);
+}
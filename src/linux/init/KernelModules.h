@@ -0,0 +1,57 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Loads kernel modules and their dependencies without running modprobe for each of them.
+//
+// modules.dep, modules.alias, modules.softdep and modules.builtin are parsed once, along with the
+// modprobe.d configuration and the module options on the kernel command line. The requested
+// modules and their dependencies are then loaded with finit_module(), and modules whose
+// dependencies are all loaded are loaded concurrently.
+//
+// Modules that modprobe would handle differently (install and softdep rules, and aliases defined
+// in modprobe.d), and modules that fail to load in process, are loaded with modprobe instead.
+class KernelModuleLoader
+{
+public:
+    explicit KernelModuleLoader(const std::string& ModulesDirectory);
+
+    KernelModuleLoader(const KernelModuleLoader&) = delete;
+    KernelModuleLoader& operator=(const KernelModuleLoader&) = delete;
+
+    void Load(const std::vector<std::string>& Names, size_t MaximumThreads) const;
+
+private:
+    struct Module
+    {
+        std::string Name;
+        std::string Path;
+        std::vector<size_t> Dependencies;
+        std::string Options;
+        bool UseModprobe{};
+    };
+
+    void ParseConfiguration(const std::string& Path);
+    void ParseCommandLine(const std::string& Path);
+    std::optional<size_t> Resolve(const std::string& Name) const;
+    bool IsLoaded(const std::string& Name) const;
+    int LoadModule(const Module& Module) const;
+
+    static std::string NormalizeName(std::string_view Name);
+    static std::vector<std::string> SplitCommandLine(std::string_view CommandLine);
+
+    std::string m_directory;
+    std::vector<Module> m_modules;
+    std::map<std::string, size_t, std::less<>> m_names;
+    std::vector<std::pair<std::string, std::string>> m_aliases;
+    std::set<std::string, std::less<>> m_builtin;
+    std::set<std::string, std::less<>> m_blacklist;
+    std::set<std::string, std::less<>> m_configAliases;
+};
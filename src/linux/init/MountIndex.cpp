@@ -0,0 +1,386 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <algorithm>
+#include <fcntl.h>
+#include <limits>
+#include <mutex>
+#include <poll.h>
+#include <sys/stat.h>
+#include "common.h"
+#include "MountIndex.h"
+#include "drvfs.h"
+#include "mountutilcpp.h"
+#include "util.h"
+
+namespace {
+
+constexpr size_t c_noEntry = std::numeric_limits<size_t>::max();
+
+// Windows paths are matched case-insensitively, so their components are stored in lower case.
+void LowerCase(std::string& Component)
+{
+    for (auto& Character : Component)
+    {
+        if (Character >= 'A' && Character <= 'Z')
+        {
+            Character += 'a' - 'A';
+        }
+    }
+}
+
+} // namespace
+
+/**
+ * @brief Build an index of the translatable mounts in a mountinfo file.
+ *
+ * @param[in] MountInfoFile The path to the mountinfo file.
+ */
+MountIndex::MountIndex(const char* MountInfoFile)
+{
+    mountutil::MountEnum MountEnum{MountInfoFile};
+    while (MountEnum.Next())
+    {
+        auto& Mount = MountEnum.Current();
+        auto& NewEntry = m_entries.emplace_back();
+        NewEntry.MountPoint = Mount.MountPoint;
+
+        //
+        // Internal virtiofs device mounts live under VIRTIOFS_MOUNT_DIR and carry the same Windows
+        // source as the user-facing /mnt/<drive> bind mounts. They are ignored when translating
+        // Windows paths, so translation doesn't return an internal plumbing path (for example
+        // /run/wsl/virtiofs-mounts/drvfsa/<guid>) instead of the real mount point such as /mnt/c.
+        //
+
+        NewEntry.Internal = UtilIsPathPrefix(Mount.MountPoint, VIRTIOFS_MOUNT_DIR, false) > 0;
+
+        //
+        // For Plan 9, parse the actual mount source from the superblock options.
+        // For virtiofs, parse the mount source from source (for example drvfsC or drvfsaC).
+        // If the file system isn't Plan 9, virtiofs, or DrvFs, the mount isn't translatable.
+        //
+
+        std::string_view MountRoot{Mount.Root};
+        if (strcmp(Mount.FileSystemType, PLAN9_FS_TYPE) == 0)
+        {
+            NewEntry.Source = UtilParsePlan9MountSource(Mount.SuperOptions);
+        }
+        else if (strcmp(Mount.FileSystemType, VIRTIO_FS_TYPE) == 0)
+        {
+            const auto AggregateRoot = ParseAggregateVirtioFsMountRoot(Mount.Source, MountRoot);
+            NewEntry.Source = QueryVirtiofsMountSource(Mount.Source, Mount.Root);
+            if (AggregateRoot)
+            {
+                MountRoot = AggregateRoot->SubPath;
+            }
+        }
+        else if (strcmp(Mount.FileSystemType, DRVFS_FS_TYPE) == 0)
+        {
+            //
+            // The mount source is a Windows path and may use forward slashes; flip them to
+            // backslashes. DrvFs mounts are translatable even if the source is empty.
+            //
+
+            NewEntry.Source = Mount.Source;
+            UtilCanonicalisePathSeparator(NewEntry.Source, PATH_SEP_NT);
+            NewEntry.Translatable = true;
+        }
+
+        if (!NewEntry.Translatable && NewEntry.Source.empty())
+        {
+            continue;
+        }
+
+        NewEntry.Translatable = true;
+
+        //
+        // Strip the trailing backslash if present.
+        //
+
+        if (!NewEntry.Source.empty() && NewEntry.Source.back() == PATH_SEP_NT)
+        {
+            NewEntry.Source.pop_back();
+        }
+
+        //
+        // For bind mounts, use the concatenation of the mount source and root of the mount as
+        // the mount source string.
+        //
+
+        if (MountRoot != "/")
+        {
+            NewEntry.Source += MountRoot;
+            UtilCanonicalisePathSeparator(NewEntry.Source, PATH_SEP_NT);
+        }
+    }
+
+    for (size_t Index = 0; Index < m_entries.size(); Index++)
+    {
+        const auto& Entry = m_entries[Index];
+        Insert(m_mountPoints, Entry.MountPoint, false, Index);
+        if (Entry.Translatable && !Entry.Internal)
+        {
+            Insert(m_sources, Entry.Source, true, Index);
+        }
+    }
+
+    //
+    // A later mount on the mount point of an earlier one, or on one of its parents, makes the
+    // earlier mount unreachable. Record the first such mount for each entry, so Windows path
+    // lookups can tell whether a matching mount is still visible.
+    //
+
+    for (size_t Index = 0; Index < m_entries.size(); Index++)
+    {
+        auto& Entry = m_entries[Index];
+        Entry.NextCovering = c_noEntry;
+        Walk(m_mountPoints, Entry.MountPoint, false, [&](const Node& Match, size_t) {
+            const auto Later = std::upper_bound(Match.Entries.begin(), Match.Entries.end(), Index);
+            for (auto Found = Later; Found != Match.Entries.end(); ++Found)
+            {
+                if (!m_entries[*Found].Internal)
+                {
+                    Entry.NextCovering = std::min(Entry.NextCovering, *Found);
+                    break;
+                }
+            }
+        });
+    }
+}
+
+/**
+ * @brief Find the mount that a path is on and return the prefix to replace the mount path with.
+ *
+ * @param[in] Path The path to look up.
+ * @param[in] WinPath Whether the path is a Windows path.
+ * @param[out] PrefixLength Receives the length of the prefix that should be stripped from the path.
+ *
+ * @return The replacement prefix, or an empty string if the path isn't on a translatable mount.
+ */
+std::string MountIndex::Find(const char* Path, bool WinPath, size_t* PrefixLength) const
+{
+    size_t Found = c_noEntry;
+    size_t FoundPrefixLength = 0;
+    if (WinPath == false)
+    {
+        //
+        // The path is on the last mount whose mount point is a prefix of the path; earlier mounts
+        // are shadowed by it. If it isn't a translatable mount, the path isn't on one.
+        //
+        // For example, when translating /mnt/c/foo/bar and /mnt/c/foo is a tmpfs mounted over
+        // /mnt/c, /mnt/c/foo/bar is not on the /mnt/c mount.
+        //
+
+        Walk(m_mountPoints, Path, false, [&](const Node& Match, size_t Length) {
+            if (!Match.Entries.empty() && (Found == c_noEntry || Match.Entries.back() > Found))
+            {
+                Found = Match.Entries.back();
+                FoundPrefixLength = Length;
+            }
+        });
+
+        if (Found == c_noEntry || !m_entries[Found].Translatable)
+        {
+            return {};
+        }
+    }
+    else
+    {
+        //
+        // Consider the mounts whose source is a prefix of the path in mountinfo order. Only
+        // matches at least as long as the existing match are considered, because Windows mounts
+        // aren't guaranteed to be in order and NTFS directory mounts should be preferred over
+        // plain drive letter mounts if they match. A match is discarded once a later mount makes
+        // its mount point unreachable; for example when translating C:\foo, /mnt/c is found, but
+        // a later entry indicates /mnt itself is a mount point.
+        //
+        // TODO_LX: This doesn't catch the case when translating C:\foo\bar and /mnt/c/foo is a
+        //          mount point. Handling that is more complicated.
+        //
+
+        std::vector<std::pair<size_t, size_t>> Candidates;
+        Walk(m_sources, Path, true, [&](const Node& Match, size_t Length) {
+            for (const auto Index : Match.Entries)
+            {
+                Candidates.emplace_back(Index, Length);
+            }
+        });
+
+        std::sort(Candidates.begin(), Candidates.end());
+        for (const auto& [Index, Length] : Candidates)
+        {
+            if (Found != c_noEntry && m_entries[Found].NextCovering <= Index)
+            {
+                Found = c_noEntry;
+            }
+
+            if (Length < FoundPrefixLength)
+            {
+                continue;
+            }
+
+            Found = Index;
+            FoundPrefixLength = Length;
+        }
+
+        if (Found == c_noEntry || m_entries[Found].NextCovering != c_noEntry)
+        {
+            return {};
+        }
+    }
+
+    const auto& Replacement = WinPath ? m_entries[Found].MountPoint : m_entries[Found].Source;
+    if (!Replacement.empty() && PrefixLength != nullptr)
+    {
+        *PrefixLength = FoundPrefixLength;
+    }
+
+    return Replacement;
+}
+
+/**
+ * @brief Return the index of the mount table of the calling process, rebuilding it if the mount
+ * table changed since it was last built.
+ *
+ * The index is shared by all the threads of the process. A forked child rebuilds its own
+ * index the first time it's used, since the parent and the child would otherwise consume each
+ * other's change notifications.
+ */
+std::shared_ptr<const MountIndex> MountIndex::Current()
+{
+    static std::mutex Lock;
+    static std::shared_ptr<const MountIndex> Index;
+    static wil::unique_fd MountInfo;
+    static pid_t Owner = 0;
+    static ino_t Namespace = 0;
+
+    std::lock_guard Guard{Lock};
+
+    //
+    // A mountinfo file descriptor reports changes to the mount namespace it was opened in, so
+    // open it again if the process moved to another namespace.
+    //
+
+    struct stat NamespaceStatus{};
+    if (stat("/proc/self/ns/mnt", &NamespaceStatus) < 0)
+    {
+        NamespaceStatus.st_ino = 0;
+    }
+
+    if (Owner != getpid() || Namespace != NamespaceStatus.st_ino)
+    {
+        Index.reset();
+        MountInfo.reset(open(MOUNT_INFO_FILE, O_RDONLY | O_CLOEXEC));
+        Owner = getpid();
+        Namespace = NamespaceStatus.st_ino;
+    }
+
+    //
+    // The kernel signals POLLPRI (and POLLERR) on mountinfo when the mount table has changed since
+    // the last poll. Poll before building, so a change made while the index is built is seen by the
+    // next lookup. If mountinfo can't be polled, the index is rebuilt for every lookup.
+    //
+
+    bool Changed = !Index || !MountInfo;
+    if (MountInfo)
+    {
+        pollfd PollDescriptor{MountInfo.get(), POLLPRI};
+        if (TEMP_FAILURE_RETRY(poll(&PollDescriptor, 1, 0)) > 0 && WI_IsAnyFlagSet(PollDescriptor.revents, POLLPRI | POLLERR))
+        {
+            Changed = true;
+        }
+    }
+
+    if (Changed)
+    {
+        Index = std::make_shared<const MountIndex>(MOUNT_INFO_FILE);
+    }
+
+    return Index;
+}
+
+/**
+ * @brief Add an entry to a trie.
+ *
+ * @param[in] Root The root of the trie.
+ * @param[in] Path The mount point or source of the entry.
+ * @param[in] WinPath Whether the path is a Windows path.
+ * @param[in] Index The index of the entry.
+ */
+void MountIndex::Insert(Node& Root, std::string_view Path, bool WinPath, size_t Index)
+{
+    //
+    // An empty prefix never matches a path.
+    //
+
+    if (Path.empty())
+    {
+        return;
+    }
+
+    const char Separator = WinPath ? PATH_SEP_NT : PATH_SEP;
+    auto* Branch = &Root;
+    size_t Position = 0;
+    for (;;)
+    {
+        const auto End = std::min(Path.find(Separator, Position), Path.size());
+        std::string Component{Path.substr(Position, End - Position)};
+        if (WinPath)
+        {
+            LowerCase(Component);
+        }
+
+        Branch = &Branch->Children[std::move(Component)];
+        if (End == Path.size())
+        {
+            break;
+        }
+
+        Position = End + 1;
+    }
+
+    Branch->Entries.push_back(Index);
+}
+
+/**
+ * @brief Visit the nodes of a trie that match a prefix of a path, from the shortest prefix to the
+ * longest. A prefix matches if it's followed by a separator or the end of the path, which is the
+ * same rule as UtilIsPathPrefix.
+ *
+ * @param[in] Root The root of the trie.
+ * @param[in] Path The path to match.
+ * @param[in] WinPath Whether the path is a Windows path.
+ * @param[in] Callback Called with each matching node and the length of its prefix.
+ */
+template <typename TCallback>
+void MountIndex::Walk(const Node& Root, std::string_view Path, bool WinPath, TCallback&& Callback)
+{
+    const char Separator = WinPath ? PATH_SEP_NT : PATH_SEP;
+    const auto* Branch = &Root;
+    std::string Component;
+    size_t Position = 0;
+    for (;;)
+    {
+        const auto End = std::min(Path.find(Separator, Position), Path.size());
+        std::string_view Key = Path.substr(Position, End - Position);
+        if (WinPath)
+        {
+            Component = Key;
+            LowerCase(Component);
+            Key = Component;
+        }
+
+        const auto Found = Branch->Children.find(Key);
+        if (Found == Branch->Children.end())
+        {
+            return;
+        }
+
+        Branch = &Found->second;
+        Callback(*Branch, End);
+        if (End == Path.size())
+        {
+            return;
+        }
+
+        Position = End + 1;
+    }
+}
@@ -0,0 +1,60 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Index of the mounts that path translation uses to map Linux paths to Windows paths and back.
+//
+// The mountinfo file is parsed once, and the DrvFs, Plan 9 and virtiofs mounts are normalised to
+// their Windows source. Mount points and sources are stored in prefix tries keyed by path
+// component, so a lookup walks the components of the path instead of every mount. Entries keep
+// their position in the mountinfo file, which decides which of several matching mounts wins.
+//
+// Current() returns an index of /proc/self/mountinfo that is shared by the process and rebuilt
+// only when the kernel reports a change to the mount table (POLLPRI on mountinfo), when the
+// process switches mount namespaces, or after a fork.
+class MountIndex
+{
+public:
+    MountIndex() = default;
+    explicit MountIndex(const char* MountInfoFile);
+
+    MountIndex(const MountIndex&) = delete;
+    MountIndex& operator=(const MountIndex&) = delete;
+
+    std::string Find(const char* Path, bool WinPath, size_t* PrefixLength) const;
+
+    static std::shared_ptr<const MountIndex> Current();
+
+private:
+    struct Entry
+    {
+        std::string MountPoint;
+        std::string Source;
+        bool Translatable{};
+        bool Internal{};
+        size_t NextCovering{};
+    };
+
+    struct Node
+    {
+        std::map<std::string, Node, std::less<>> Children;
+
+        // Indices of the entries that end at this node, in mountinfo order.
+        std::vector<size_t> Entries;
+    };
+
+    static void Insert(Node& Root, std::string_view Path, bool WinPath, size_t Index);
+
+    template <typename TCallback>
+    static void Walk(const Node& Root, std::string_view Path, bool WinPath, TCallback&& Callback);
+
+    std::vector<Entry> m_entries;
+    Node m_mountPoints;
+    Node m_sources;
+};
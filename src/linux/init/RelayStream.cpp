@@ -0,0 +1,355 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <fcntl.h>
+#include "RelayStream.h"
+#include "StreamDigest.h"
+#include "util.h"
+
+/**
+ * @brief Create a relay stream.
+ *
+ * @param[in] InputFd File descriptor to read from. The caller retains ownership.
+ * @param[in] OutputFd File descriptor to write to. The caller retains ownership.
+ * @param[in] MaximumChunk The largest amount of data to move at once.
+ * @param[in] NonBlockingOutput Never block on writes to the output, even if the output
+ *            descriptor is blocking. Data that can't be written right away stays pending.
+ */
+RelayStream::RelayStream(int InputFd, int OutputFd, size_t MaximumChunk, bool NonBlockingOutput) :
+    m_inputFd(InputFd),
+    m_outputFd(OutputFd),
+    m_nonBlockingOutput(NonBlockingOutput),
+    m_maximumChunkSize(std::clamp(MaximumChunk, MinimumChunkSize, MaximumChunkSize)),
+    m_chunkSize(std::min(InitialChunkSize, m_maximumChunkSize))
+{
+    int Pipe[2];
+    if (pipe2(Pipe, O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("pipe2 failed {}, relay will copy", errno);
+        return;
+    }
+
+    m_pipeRead.reset(Pipe[0]);
+    m_pipeWrite.reset(Pipe[1]);
+
+    //
+    // The pipe must be able to hold a whole chunk. It starts at its default size and is grown as
+    // the chunk size grows, so idle streams don't count against the user's pipe buffer limits.
+    //
+
+    const int PipeSize = fcntl(m_pipeWrite.get(), F_GETPIPE_SZ);
+    if (PipeSize > 0)
+    {
+        m_pipeSize = PipeSize;
+        m_chunkSize = std::min(m_chunkSize, m_pipeSize);
+    }
+}
+
+/**
+ * @brief Read the data available on the input and write it to the output.
+ *
+ * The caller should only call this once the input is readable. Neither the input nor the output is
+ * waited on: if the input has no data after all, or the output can't take the data that's left
+ * from an earlier transfer, this fails with EAGAIN so the caller can go back to polling all of its
+ * streams. Data that the output doesn't accept right away stays pending and is written by the next
+ * call to Transfer() or Flush().
+ *
+ * @return The number of bytes read, 0 if the input reached end of file, or -1 with errno set on
+ *         failure.
+ */
+ssize_t RelayStream::Transfer() noexcept
+try
+{
+    //
+    // Data left over from an earlier transfer is written first, so the output sees the stream in
+    // order and end of file is only reported once everything has been written.
+    //
+
+    if (Pending() != 0)
+    {
+        const auto Result = Flush();
+        if (Result != 0)
+        {
+            if (Result > 0)
+            {
+                errno = EAGAIN;
+            }
+
+            return -1;
+        }
+    }
+
+    ssize_t BytesRead = -1;
+    if (Splicing())
+    {
+        BytesRead = TEMP_FAILURE_RETRY(
+            splice(m_inputFd, nullptr, m_pipeWrite.get(), nullptr, m_chunkSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK));
+
+        //
+        // EINVAL means that the input doesn't support splicing (for example a tty on older
+        // kernels); switch to copying for the rest of the stream.
+        //
+
+        if (BytesRead < 0 && errno == EINVAL)
+        {
+            DisableSplice();
+        }
+    }
+
+    if (!Splicing())
+    {
+        if (m_buffer.size() < m_chunkSize)
+        {
+            m_buffer.resize(m_chunkSize);
+        }
+
+        BytesRead = TEMP_FAILURE_RETRY(read(m_inputFd, m_buffer.data(), m_chunkSize));
+    }
+
+    //
+    // N.B. The input can be drained by the time it's read, even though it polled as readable. The
+    //      EAGAIN is returned as is rather than waited on, since waiting on this one descriptor
+    //      would stall every other stream the caller relays.
+    //
+
+    if (BytesRead <= 0)
+    {
+        return BytesRead;
+    }
+
+    if (Splicing())
+    {
+        m_piped = BytesRead;
+        m_statistics.BytesSpliced += BytesRead;
+        if (m_digest != nullptr)
+        {
+            m_digest->UpdateFromPipe(m_pipeRead.get(), BytesRead);
+        }
+    }
+    else
+    {
+        m_bufferOffset = 0;
+        m_bufferLength = BytesRead;
+        m_statistics.BytesCopied += BytesRead;
+        if (m_digest != nullptr)
+        {
+            m_digest->Update(gsl::make_span(m_buffer.data(), BytesRead));
+        }
+    }
+
+    m_statistics.LastTransfer = std::chrono::steady_clock::now();
+    if (m_statistics.Transfers++ == 0)
+    {
+        m_statistics.FirstTransfer = m_statistics.LastTransfer;
+    }
+
+    AdaptChunkSize(BytesRead);
+    if (Flush() < 0)
+    {
+        return -1;
+    }
+
+    return BytesRead;
+}
+CATCH_RETURN_ERRNO()
+
+/**
+ * @brief Write pending data to the output.
+ *
+ * In blocking mode, writes wait for the output unless the output descriptor is itself
+ * non-blocking. In non-blocking output mode, this writes as much as the output accepts. Either way,
+ * data the output doesn't accept stays pending.
+ *
+ * @return The number of bytes still pending, or -1 with errno set on failure.
+ */
+ssize_t RelayStream::Flush() noexcept
+try
+{
+    while (m_piped > 0)
+    {
+        const unsigned int Flags = SPLICE_F_MOVE | (m_nonBlockingOutput ? SPLICE_F_NONBLOCK : 0);
+        auto BytesWritten = TEMP_FAILURE_RETRY(splice(m_pipeRead.get(), nullptr, m_outputFd, nullptr, m_piped, Flags));
+
+        if (BytesWritten < 0)
+        {
+            //
+            // The output doesn't support splicing. Move the data that's already in the pipe to the
+            // buffer and copy from now on.
+            //
+
+            if (errno == EINVAL)
+            {
+                if (!DisableSplice())
+                {
+                    return -1;
+                }
+
+                break;
+            }
+
+            if (errno == EAGAIN)
+            {
+                return Pending();
+            }
+
+            return -1;
+        }
+
+        m_piped -= BytesWritten;
+    }
+
+    while (m_bufferLength > 0)
+    {
+        auto BytesWritten = TEMP_FAILURE_RETRY(write(m_outputFd, m_buffer.data() + m_bufferOffset, m_bufferLength));
+        if (BytesWritten < 0)
+        {
+            if (errno == EAGAIN)
+            {
+                return Pending();
+            }
+
+            return -1;
+        }
+
+        m_bufferOffset += BytesWritten;
+        m_bufferLength -= BytesWritten;
+    }
+
+    return 0;
+}
+CATCH_RETURN_ERRNO()
+
+/**
+ * @brief Hash the data that's read from the input from now on.
+ *
+ * @param[in] Digest The digest to update. The caller retains ownership.
+ */
+void RelayStream::SetDigest(StreamDigest* Digest) noexcept
+{
+    m_digest = Digest;
+}
+
+/**
+ * @brief Return the number of bytes read from the input but not yet written to the output.
+ */
+size_t RelayStream::Pending() const noexcept
+{
+    return m_piped + m_bufferLength;
+}
+
+/**
+ * @brief Return whether data is moved with splice() rather than copied.
+ */
+bool RelayStream::Splicing() const noexcept
+{
+    return static_cast<bool>(m_pipeRead);
+}
+
+const RelayStream::Statistics& RelayStream::GetStatistics() const noexcept
+{
+    return m_statistics;
+}
+
+/**
+ * @brief Log the throughput of the stream, if it moved enough data for it to be meaningful.
+ *
+ * @param[in] Name Name of the stream.
+ */
+void RelayStream::LogStatistics(const char* Name) const
+{
+    const auto Bytes = m_statistics.BytesSpliced + m_statistics.BytesCopied;
+    if (Bytes < LogThreshold)
+    {
+        return;
+    }
+
+    const auto Elapsed =
+        std::chrono::duration_cast<std::chrono::milliseconds>(m_statistics.LastTransfer - m_statistics.FirstTransfer);
+    LOG_INFO(
+        "{}: relayed {} bytes ({} spliced, {} copied) in {} transfers over {}ms, {} MB/s",
+        Name,
+        Bytes,
+        m_statistics.BytesSpliced,
+        m_statistics.BytesCopied,
+        m_statistics.Transfers,
+        Elapsed.count(),
+        (Bytes / (1024 * 1024)) * 1000 / std::max<int64_t>(Elapsed.count(), 1));
+}
+
+/**
+ * @brief Grow the chunk size while reads fill it, and shrink it when they stop doing so, so an
+ * interactive stream doesn't hold on to a large buffer.
+ *
+ * @param[in] BytesRead The number of bytes returned by the last read.
+ */
+void RelayStream::AdaptChunkSize(size_t BytesRead) noexcept
+{
+    if (BytesRead >= m_chunkSize)
+    {
+        m_chunkSize = std::min(m_chunkSize * 2, m_maximumChunkSize);
+
+        //
+        // If the pipe can't be grown (for example because of /proc/sys/fs/pipe-max-size), limit
+        // the chunk size to its current capacity instead.
+        //
+
+        if (Splicing() && m_chunkSize > m_pipeSize)
+        {
+            const int PipeSize = fcntl(m_pipeWrite.get(), F_SETPIPE_SZ, static_cast<int>(m_chunkSize));
+            if (PipeSize > 0)
+            {
+                m_pipeSize = PipeSize;
+            }
+            else
+            {
+                m_maximumChunkSize = m_pipeSize;
+            }
+
+            m_chunkSize = std::min(m_chunkSize, m_pipeSize);
+        }
+    }
+    else if (BytesRead < m_chunkSize / 8)
+    {
+        m_chunkSize = std::max(m_chunkSize / 2, MinimumChunkSize);
+        if (!Splicing() && m_bufferLength == 0 && m_buffer.size() > m_chunkSize * 4)
+        {
+            m_buffer.resize(m_chunkSize);
+            m_buffer.shrink_to_fit();
+        }
+    }
+}
+
+/**
+ * @brief Switch the stream to copying. Any data in the pipe is moved to the buffer.
+ *
+ * @return true on success, false with errno set if the pipe couldn't be drained.
+ */
+bool RelayStream::DisableSplice() noexcept
+try
+{
+    if (m_piped > 0)
+    {
+        m_buffer.resize(std::max(m_buffer.size(), m_piped));
+        m_bufferOffset = 0;
+        m_bufferLength = 0;
+        while (m_piped > 0)
+        {
+            auto BytesRead = UtilRead(m_pipeRead.get(), m_buffer.data() + m_bufferLength, m_piped);
+            if (BytesRead <= 0)
+            {
+                return false;
+            }
+
+            m_bufferLength += BytesRead;
+            m_piped -= BytesRead;
+        }
+    }
+
+    m_pipeRead.reset();
+    m_pipeWrite.reset();
+    return true;
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    errno = ENOMEM;
+    return false;
+}
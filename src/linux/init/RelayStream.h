@@ -0,0 +1,73 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <chrono>
+#include <vector>
+#include "common.h"
+
+class StreamDigest;
+
+// Moves data from one file descriptor to another for the stdio and socket relays.
+//
+// When the kernel can splice both descriptors, data is moved with splice() through an intermediate
+// pipe and never copied to user space. Otherwise the stream falls back to read() and write()
+// through a buffer. In both modes, the chunk size grows while reads keep filling it and shrinks
+// again when the stream goes back to small writes. A digest can be attached to the stream to hash
+// the data as it's moved.
+class RelayStream
+{
+public:
+    static constexpr size_t MinimumChunkSize = 4 * 1024;
+    static constexpr size_t InitialChunkSize = 64 * 1024;
+    static constexpr size_t MaximumChunkSize = 1024 * 1024;
+
+    // Streams that moved less than this aren't worth logging statistics for.
+    static constexpr uint64_t LogThreshold = 64 * 1024 * 1024;
+
+    struct Statistics
+    {
+        uint64_t BytesSpliced{};
+        uint64_t BytesCopied{};
+        uint64_t Transfers{};
+        std::chrono::steady_clock::time_point FirstTransfer{};
+        std::chrono::steady_clock::time_point LastTransfer{};
+    };
+
+    RelayStream() = default;
+    RelayStream(int InputFd, int OutputFd, size_t MaximumChunk = MaximumChunkSize, bool NonBlockingOutput = false);
+
+    RelayStream(const RelayStream&) = delete;
+    RelayStream& operator=(const RelayStream&) = delete;
+    RelayStream(RelayStream&&) = default;
+    RelayStream& operator=(RelayStream&&) = default;
+
+    ssize_t Transfer() noexcept;
+    ssize_t Flush() noexcept;
+
+    void SetDigest(StreamDigest* Digest) noexcept;
+
+    size_t Pending() const noexcept;
+    bool Splicing() const noexcept;
+    const Statistics& GetStatistics() const noexcept;
+    void LogStatistics(const char* Name) const;
+
+private:
+    void AdaptChunkSize(size_t BytesRead) noexcept;
+    bool DisableSplice() noexcept;
+
+    int m_inputFd = -1;
+    int m_outputFd = -1;
+    bool m_nonBlockingOutput = false;
+    wil::unique_fd m_pipeRead;
+    wil::unique_fd m_pipeWrite;
+    size_t m_pipeSize = MaximumChunkSize;
+    size_t m_piped = 0;
+    std::vector<gsl::byte> m_buffer;
+    size_t m_bufferOffset = 0;
+    size_t m_bufferLength = 0;
+    size_t m_maximumChunkSize = MaximumChunkSize;
+    size_t m_chunkSize = InitialChunkSize;
+    Statistics m_statistics;
+    StreamDigest* m_digest = nullptr;
+};
@@ -0,0 +1,248 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <array>
+#include <fcntl.h>
+#include <linux/if_alg.h>
+#include <sys/socket.h>
+#include "common.h"
+#include "StreamDigest.h"
+#include "util.h"
+
+namespace {
+
+constexpr size_t c_sha256Size = 32;
+
+} // namespace
+
+/**
+ * @brief Create a SHA-256 digest of a stream.
+ *
+ * @return The digest, or nullptr if the kernel doesn't support hashing through AF_ALG sockets.
+ */
+std::unique_ptr<StreamDigest> StreamDigest::Create()
+{
+    wil::unique_fd Algorithm{socket(AF_ALG, SOCK_SEQPACKET | SOCK_CLOEXEC, 0)};
+    if (!Algorithm)
+    {
+        LOG_WARNING("AF_ALG socket failed {}, archives won't be hashed", errno);
+        return {};
+    }
+
+    sockaddr_alg Address{};
+    Address.salg_family = AF_ALG;
+    strcpy(reinterpret_cast<char*>(Address.salg_type), "hash");
+    strcpy(reinterpret_cast<char*>(Address.salg_name), "sha256");
+    if (bind(Algorithm.get(), reinterpret_cast<sockaddr*>(&Address), sizeof(Address)) < 0)
+    {
+        LOG_WARNING("sha256 is not available {}, archives won't be hashed", errno);
+        return {};
+    }
+
+    wil::unique_fd Socket{accept4(Algorithm.get(), nullptr, nullptr, SOCK_CLOEXEC)};
+    if (!Socket)
+    {
+        LOG_WARNING("AF_ALG accept failed {}, archives won't be hashed", errno);
+        return {};
+    }
+
+    return std::unique_ptr<StreamDigest>(new StreamDigest(std::move(Socket)));
+}
+
+StreamDigest::StreamDigest(wil::unique_fd Socket) : m_socket(std::move(Socket))
+{
+    int Pipe[2];
+    if (pipe2(Pipe, O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("pipe2 failed {}, digest will copy", errno);
+        return;
+    }
+
+    m_pipeRead.reset(Pipe[0]);
+    m_pipeWrite.reset(Pipe[1]);
+    m_pipeSize = fcntl(m_pipeWrite.get(), F_GETPIPE_SZ);
+}
+
+/**
+ * @brief Add data to the digest.
+ *
+ * @param[in] Data The data to hash.
+ */
+void StreamDigest::Update(gsl::span<const gsl::byte> Data) noexcept
+{
+    while (!m_failed && !Data.empty())
+    {
+        //
+        // MSG_MORE keeps the hash open for the next part of the stream. It's finalized when the
+        // digest is read.
+        //
+
+        const auto BytesSent = TEMP_FAILURE_RETRY(send(m_socket.get(), Data.data(), Data.size(), MSG_MORE));
+        if (BytesSent < 0)
+        {
+            Fail("send");
+            return;
+        }
+
+        Data = Data.subspan(BytesSent);
+    }
+}
+
+/**
+ * @brief Add the data that's in a pipe to the digest, without consuming it.
+ *
+ * @param[in] PipeFd The read end of the pipe.
+ * @param[in] Size The number of bytes in the pipe.
+ */
+void StreamDigest::UpdateFromPipe(int PipeFd, size_t Size) noexcept
+{
+    if (m_failed)
+    {
+        return;
+    }
+
+    if (!m_pipeRead)
+    {
+        Fail("pipe2");
+        return;
+    }
+
+    //
+    // tee() always duplicates from the start of the pipe, so the whole content must fit in the
+    // digest's pipe at once. The relay grows its pipe as the stream speeds up; follow it.
+    //
+
+    const int PipeSize = fcntl(PipeFd, F_GETPIPE_SZ);
+    if (PipeSize > m_pipeSize)
+    {
+        const int NewSize = fcntl(m_pipeWrite.get(), F_SETPIPE_SZ, PipeSize);
+        if (NewSize > 0)
+        {
+            m_pipeSize = NewSize;
+        }
+    }
+
+    const auto BytesDuplicated = TEMP_FAILURE_RETRY(tee(PipeFd, m_pipeWrite.get(), Size, SPLICE_F_NONBLOCK));
+    if (BytesDuplicated <= 0)
+    {
+        Fail("tee");
+        return;
+    }
+
+    if (!SendPiped(BytesDuplicated))
+    {
+        return;
+    }
+
+    if (static_cast<size_t>(BytesDuplicated) < Size)
+    {
+        Fail("tee");
+    }
+}
+
+/**
+ * @brief Read the digest of the stream.
+ *
+ * @return The digest as a hexadecimal string, or nullopt if part of the stream couldn't be hashed.
+ */
+std::optional<std::string> StreamDigest::Finish() noexcept
+try
+{
+    if (m_failed)
+    {
+        return {};
+    }
+
+    std::array<uint8_t, c_sha256Size> Digest{};
+    if (UtilRead(m_socket.get(), Digest.data(), Digest.size()) != static_cast<ssize_t>(Digest.size()))
+    {
+        Fail("read");
+        return {};
+    }
+
+    std::string Result;
+    Result.reserve(Digest.size() * 2);
+    for (const auto Byte : Digest)
+    {
+        std::format_to(std::back_inserter(Result), "{:02x}", Byte);
+    }
+
+    return Result;
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return {};
+}
+
+/**
+ * @brief Send the data in the digest's pipe to the socket.
+ *
+ * @param[in] Size The number of bytes in the pipe.
+ *
+ * @return true on success, false if the digest failed.
+ */
+bool StreamDigest::SendPiped(size_t Size) noexcept
+try
+{
+    while (Size > 0 && m_spliceToSocket)
+    {
+        const auto BytesSpliced =
+            TEMP_FAILURE_RETRY(splice(m_pipeRead.get(), nullptr, m_socket.get(), nullptr, Size, SPLICE_F_MORE));
+        if (BytesSpliced < 0)
+        {
+            //
+            // Older kernels can't splice to AF_ALG sockets. Copy through a buffer from now on.
+            //
+
+            if (errno == EINVAL)
+            {
+                m_spliceToSocket = false;
+                break;
+            }
+
+            Fail("splice");
+            return false;
+        }
+
+        Size -= BytesSpliced;
+    }
+
+    if (Size > m_buffer.size())
+    {
+        m_buffer.resize(Size);
+    }
+
+    while (Size > 0)
+    {
+        const auto BytesRead = UtilRead(m_pipeRead.get(), m_buffer.data(), Size);
+        if (BytesRead <= 0)
+        {
+            Fail("read");
+            return false;
+        }
+
+        Update(gsl::make_span(m_buffer.data(), BytesRead));
+        Size -= BytesRead;
+    }
+
+    return !m_failed;
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    m_failed = true;
+    return false;
+}
+
+/**
+ * @brief Stop hashing the stream. The digest is reported as unavailable.
+ *
+ * @param[in] Operation The operation that failed.
+ */
+void StreamDigest::Fail(const char* Operation) noexcept
+{
+    if (!m_failed)
+    {
+        LOG_WARNING("{} failed {}, the archive won't be hashed", Operation, errno);
+        m_failed = true;
+    }
+}
@@ -0,0 +1,47 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "common.h"
+
+// Computes the SHA-256 digest of a stream as it's relayed.
+//
+// The digest is computed by the kernel crypto API through an AF_ALG socket, which uses the SHA
+// extensions or AVX2 implementations of SHA-256 when the processor has them. Data that's relayed
+// through a pipe is duplicated with tee() and spliced to the socket, so hashing it doesn't copy it
+// to user space. Otherwise, the data is sent to the socket from the relay buffer.
+//
+// Failing to hash doesn't fail the relay: the digest is reported as unavailable instead.
+class StreamDigest
+{
+public:
+    static std::unique_ptr<StreamDigest> Create();
+
+    StreamDigest(const StreamDigest&) = delete;
+    StreamDigest& operator=(const StreamDigest&) = delete;
+
+    void Update(gsl::span<const gsl::byte> Data) noexcept;
+
+    void UpdateFromPipe(int PipeFd, size_t Size) noexcept;
+
+    std::optional<std::string> Finish() noexcept;
+
+private:
+    explicit StreamDigest(wil::unique_fd Socket);
+
+    bool SendPiped(size_t Size) noexcept;
+
+    void Fail(const char* Operation) noexcept;
+
+    wil::unique_fd m_socket;
+    wil::unique_fd m_pipeRead;
+    wil::unique_fd m_pipeWrite;
+    int m_pipeSize{};
+    bool m_spliceToSocket{true};
+    bool m_failed{};
+    std::vector<gsl::byte> m_buffer;
+};
@@ -0,0 +1,160 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <thread>
+#include "common.h"
+#include "TaskGraph.h"
+#include "BootTimeline.h"
+#include "util.h"
+
+/**
+ * @brief Add a step to the graph.
+ *
+ * @param[in] Name The name of the step, which must outlive the graph.
+ * @param[in] Routine The step, which returns a negative value on failure.
+ * @param[in] Dependencies The steps that must complete before this one starts.
+ *
+ * @return The identifier of the step.
+ */
+size_t TaskGraph::Add(const char* Name, std::function<int()>&& Routine, const std::vector<size_t>& Dependencies)
+{
+    const auto Index = m_tasks.size();
+    for (const auto Dependency : Dependencies)
+    {
+        THROW_ERRNO_IF(EINVAL, Dependency >= Index);
+        m_tasks[Dependency].Dependents.push_back(Index);
+    }
+
+    m_tasks.push_back({Name, std::move(Routine), Dependencies.size()});
+    return Index;
+}
+
+/**
+ * @brief Run the steps. The calling thread runs steps too.
+ *
+ * @param[in] MaximumThreads The maximum number of steps that run at the same time. If this is 1,
+ * the steps run one at a time in the order they were added.
+ *
+ * @return 0 if every step succeeded, otherwise the result of the first failed step. If that step
+ * threw, the exception is rethrown.
+ */
+int TaskGraph::Run(size_t MaximumThreads)
+{
+    std::mutex Lock;
+    std::condition_variable Changed;
+    std::set<size_t> Ready;
+    std::vector<int> Results(m_tasks.size());
+    std::vector<std::exception_ptr> Exceptions(m_tasks.size());
+    size_t InFlight = 0;
+    bool Failed = false;
+    for (size_t Index = 0; Index < m_tasks.size(); Index++)
+    {
+        if (m_tasks[Index].Remaining == 0)
+        {
+            Ready.insert(Index);
+        }
+    }
+
+    auto Worker = [&]() {
+        std::unique_lock Guard{Lock};
+        for (;;)
+        {
+            //
+            // N.B. If no step is ready and none is running, every step that can run has completed.
+            //
+
+            Changed.wait(Guard, [&]() { return Failed || !Ready.empty() || InFlight == 0; });
+            if (Failed || Ready.empty())
+            {
+                return;
+            }
+
+            //
+            // Start the earliest ready step, so a single thread runs the steps in the order they
+            // were added.
+            //
+
+            const auto Current = *Ready.begin();
+            Ready.erase(Ready.begin());
+            InFlight += 1;
+            Guard.unlock();
+
+            int Result = 0;
+            try
+            {
+                BootTimeline::Span Span{m_tasks[Current].Name};
+                Result = m_tasks[Current].Routine();
+            }
+            catch (...)
+            {
+                Exceptions[Current] = std::current_exception();
+                Result = -1;
+            }
+
+            Guard.lock();
+            Results[Current] = Result;
+            if (Result < 0)
+            {
+                Failed = true;
+            }
+            else
+            {
+                for (const auto Dependent : m_tasks[Current].Dependents)
+                {
+                    if (--m_tasks[Dependent].Remaining == 0)
+                    {
+                        Ready.insert(Dependent);
+                    }
+                }
+            }
+
+            InFlight -= 1;
+            Changed.notify_all();
+        }
+    };
+
+    //
+    // If no thread can be created, the steps still run one at a time on the calling thread.
+    //
+
+    std::vector<std::thread> Threads;
+    const auto ThreadCount = std::min(MaximumThreads, m_tasks.size());
+    for (size_t Index = 1; Index < ThreadCount; Index++)
+    {
+        try
+        {
+            Threads.emplace_back([&Worker]() {
+                UtilSetThreadName("BootTask");
+                Worker();
+            });
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            break;
+        }
+    }
+
+    Worker();
+    for (auto& Thread : Threads)
+    {
+        Thread.join();
+    }
+
+    for (size_t Index = 0; Index < m_tasks.size(); Index++)
+    {
+        if (Exceptions[Index])
+        {
+            std::rethrow_exception(Exceptions[Index]);
+        }
+
+        if (Results[Index] < 0)
+        {
+            return Results[Index];
+        }
+    }
+
+    return 0;
+}
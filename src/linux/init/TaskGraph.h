@@ -0,0 +1,37 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// Runs a set of steps that depend on each other, running the steps whose dependencies are complete
+// concurrently.
+//
+// A step can only depend on steps that were added before it, so the order in which the steps are
+// added is always a valid order to run them in. With a single thread, the steps run in exactly that
+// order. If a step fails (returns a negative value or throws), no further step is started, the
+// steps already running are waited for, and Run() reports the failure of the first failed step in
+// the order they were added. A graph can only be run once.
+class TaskGraph
+{
+public:
+    TaskGraph() = default;
+
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    size_t Add(const char* Name, std::function<int()>&& Routine, const std::vector<size_t>& Dependencies = {});
+    int Run(size_t MaximumThreads);
+
+private:
+    struct Task
+    {
+        const char* Name;
+        std::function<int()> Routine;
+        size_t Remaining{};
+        std::vector<size_t> Dependents;
+    };
+
+    std::vector<Task> m_tasks;
+};
@@ -0,0 +1,380 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <grp.h>
+#include <sys/stat.h>
+#include "UserLookupCache.h"
+#include "util.h"
+
+namespace {
+
+// Files that the cached state is derived from. If any of them changes, the state is discarded.
+// The userdb directories hold the user and membership records that nss-systemd serves.
+constexpr const char* c_sourceFiles[] = {
+    ETC_FOLDER "passwd",
+    ETC_FOLDER "group",
+    ETC_FOLDER "nsswitch.conf",
+    ETC_FOLDER "default/locale",
+    ETC_FOLDER "locale.conf",
+    ETC_FOLDER "userdb",
+    "/run/userdb",
+    "/run/host/userdb",
+    "/usr/lib/userdb"};
+
+constexpr const char* c_nsswitchFile = ETC_FOLDER "nsswitch.conf";
+
+constexpr const char* c_passwdFile = ETC_FOLDER "passwd";
+
+// Databases that are cached. Lookups in them are only cached if they are resolved from local sources.
+constexpr std::string_view c_cachedDatabases[] = {"passwd", "group"};
+
+constexpr std::string_view c_languagePrefix = "LANG=";
+
+} // namespace
+
+UserLookupCache g_UserLookupCache;
+
+bool UserLookupCache::FileSignature::operator==(const FileSignature& Other) const noexcept
+{
+    return Exists == Other.Exists && Inode == Other.Inode && Size == Other.Size &&
+           ModifiedTime.tv_sec == Other.ModifiedTime.tv_sec && ModifiedTime.tv_nsec == Other.ModifiedTime.tv_nsec;
+}
+
+/**
+ * @brief Cache the lookups for the user that a create process request runs as. This is called by
+ * the session leader before forking, so the relay and the child process inherit the state.
+ *
+ * @param[in] Buffer The common create process message data.
+ * @param[in] Config The distribution configuration.
+ */
+void UserLookupCache::Prepare(gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config) noexcept
+try
+{
+    m_enabled = Config.UserLookupCache;
+    if (!m_enabled)
+    {
+        return;
+    }
+
+    //
+    // Discard everything if a file the state depends on has changed since it was cached.
+    //
+
+    auto Signature = Snapshot();
+    if (Signature != m_signature)
+    {
+        m_users.clear();
+        m_uids.clear();
+        m_language.reset();
+        m_localSources = ResolvedLocally();
+        m_signature = std::move(Signature);
+    }
+
+    //
+    // Resolve the user the same way the child process does.
+    //
+
+    const auto* Common = gslhelpers::try_get_struct<LX_INIT_CREATE_PROCESS_COMMON>(Buffer);
+    if (!Common)
+    {
+        return;
+    }
+
+    const passwd* Entry = nullptr;
+    const auto* Username = wsl::shared::string::FromSpan(Buffer, Common->UsernameOffset);
+    if (strlen(Username) != 0)
+    {
+        Entry = GetUserByName(Username);
+    }
+    else if (Config.DefaultUser.has_value())
+    {
+        Entry = GetUserByName(Config.DefaultUser->c_str());
+    }
+
+    if (Entry == nullptr)
+    {
+        Entry = GetUserById(Common->DefaultUid);
+    }
+
+    if (Entry != nullptr && CacheAccounts())
+    {
+        auto* CachedUser = Find(Entry->pw_name);
+        if (CachedUser != nullptr && !CachedUser->Groups.has_value())
+        {
+            int Count{};
+            getgrouplist(Entry->pw_name, Entry->pw_gid, nullptr, &Count);
+            std::vector<gid_t> Groups(Count);
+            if (getgrouplist(Entry->pw_name, Entry->pw_gid, Groups.data(), &Count) >= 0)
+            {
+                Groups.resize(Count);
+                CachedUser->Groups = std::move(Groups);
+            }
+        }
+    }
+
+    if (!m_language.has_value())
+    {
+        EnvironmentBlock Environment;
+        ConfigUpdateLanguage(Environment);
+        m_language.emplace();
+        for (const auto* Variable : Environment.Variables())
+        {
+            if (Variable != nullptr && std::string_view{Variable}.starts_with(c_languagePrefix))
+            {
+                m_language->emplace(Variable + c_languagePrefix.size());
+            }
+        }
+    }
+}
+CATCH_LOG()
+
+/**
+ * @brief Look up a user by name, like getpwnam().
+ *
+ * @param[in] Name The user name.
+ *
+ * @return The password entry, or nullptr with errno set if the user doesn't exist.
+ */
+const passwd* UserLookupCache::GetUserByName(const char* Name)
+{
+    if (CacheAccounts())
+    {
+        auto* CachedUser = Find(Name);
+        if (CachedUser != nullptr)
+        {
+            return &CachedUser->Entry;
+        }
+    }
+
+    const auto* Entry = getpwnam(Name);
+    if (Entry == nullptr || !CacheAccounts() || !InPasswdFile(Entry))
+    {
+        return Entry;
+    }
+
+    return Insert(Entry);
+}
+
+/**
+ * @brief Look up a user by uid, like getpwuid().
+ *
+ * @param[in] Uid The user id.
+ *
+ * @return The password entry, or nullptr with errno set if the user doesn't exist.
+ */
+const passwd* UserLookupCache::GetUserById(uid_t Uid)
+{
+    if (CacheAccounts())
+    {
+        auto Found = m_uids.find(Uid);
+        if (Found != m_uids.end())
+        {
+            return &m_users.at(Found->second).Entry;
+        }
+    }
+
+    const auto* Entry = getpwuid(Uid);
+    if (Entry == nullptr || !CacheAccounts() || !InPasswdFile(Entry))
+    {
+        return Entry;
+    }
+
+    Entry = Insert(Entry);
+    m_uids.emplace(Uid, Entry->pw_name);
+    return Entry;
+}
+
+/**
+ * @brief Set the supplementary groups of the calling process for the user, using the cached
+ * group list if there is one.
+ *
+ * @param[in] Entry The password entry of the user.
+ */
+void UserLookupCache::InitGroups(const passwd* Entry)
+{
+    if (CacheAccounts())
+    {
+        const auto* CachedUser = Find(Entry->pw_name);
+        if (CachedUser != nullptr && CachedUser->Groups.has_value() && CachedUser->Entry.pw_gid == Entry->pw_gid)
+        {
+            THROW_LAST_ERROR_IF(setgroups(CachedUser->Groups->size(), CachedUser->Groups->data()) < 0);
+            return;
+        }
+    }
+
+    UtilInitGroups(Entry->pw_name, Entry->pw_gid);
+}
+
+/**
+ * @brief Set $LANG from the locale configuration, using the cached value if there is one.
+ *
+ * @param[in] Environment The environment block to update.
+ */
+void UserLookupCache::UpdateLanguage(EnvironmentBlock& Environment)
+{
+    if (!m_enabled || !m_language.has_value())
+    {
+        ConfigUpdateLanguage(Environment);
+        return;
+    }
+
+    if (m_language->has_value())
+    {
+        Environment.AddVariable("LANG", m_language->value());
+    }
+}
+
+const passwd* UserLookupCache::Insert(const passwd* Entry)
+{
+    auto [Iterator, Inserted] = m_users.try_emplace(Entry->pw_name);
+    auto& NewUser = Iterator->second;
+    if (Inserted)
+    {
+        NewUser.Name = Entry->pw_name;
+        NewUser.Password = Entry->pw_passwd != nullptr ? Entry->pw_passwd : "";
+        NewUser.Gecos = Entry->pw_gecos != nullptr ? Entry->pw_gecos : "";
+        NewUser.Directory = Entry->pw_dir != nullptr ? Entry->pw_dir : "";
+        NewUser.Shell = Entry->pw_shell != nullptr ? Entry->pw_shell : "";
+        NewUser.Entry.pw_name = NewUser.Name.data();
+        NewUser.Entry.pw_passwd = NewUser.Password.data();
+        NewUser.Entry.pw_uid = Entry->pw_uid;
+        NewUser.Entry.pw_gid = Entry->pw_gid;
+        NewUser.Entry.pw_gecos = NewUser.Gecos.data();
+        NewUser.Entry.pw_dir = NewUser.Directory.data();
+        NewUser.Entry.pw_shell = NewUser.Shell.data();
+    }
+
+    return &NewUser.Entry;
+}
+
+/**
+ * @brief Return whether user and group lookups go through the cache.
+ */
+bool UserLookupCache::CacheAccounts() const noexcept
+{
+    return m_enabled && m_localSources;
+}
+
+/**
+ * @brief Check whether /etc/nsswitch.conf resolves the cached databases from local sources. The
+ * files source must come first, optionally followed by systemd (the default on distributions
+ * that ship systemd). Other sources (for example sss or ldap) can change without any local file
+ * changing, so lookups in them can't be cached.
+ *
+ * N.B. Users that systemd resolves on its own (dynamic and homed users) aren't in /etc/passwd, so
+ *      they're never cached. The group memberships it adds come from the userdb directories, which
+ *      are part of the cache key.
+ *
+ * @return true if every cached database is resolved from files, or from files then systemd.
+ */
+bool UserLookupCache::ResolvedLocally()
+{
+    //
+    // Without nsswitch.conf, or without an entry for a database, glibc resolves it from files.
+    //
+
+    std::ifstream File(c_nsswitchFile);
+    if (!File)
+    {
+        return true;
+    }
+
+    std::string Line;
+    while (std::getline(File, Line))
+    {
+        Line = Line.substr(0, Line.find('#'));
+        const auto Separator = Line.find(':');
+        if (Separator == std::string::npos)
+        {
+            continue;
+        }
+
+        const auto Database = wsl::shared::string::Trim(Line.substr(0, Separator));
+        if (std::find(std::begin(c_cachedDatabases), std::end(c_cachedDatabases), Database) == std::end(c_cachedDatabases))
+        {
+            continue;
+        }
+
+        std::istringstream Stream(Line.substr(Separator + 1));
+        const std::vector<std::string> Sources{std::istream_iterator<std::string>{Stream}, std::istream_iterator<std::string>{}};
+        if (Sources.empty())
+        {
+            continue;
+        }
+
+        const bool SystemdAfterFiles = Sources.size() == 2 && Sources[1] == "systemd";
+        if (Sources[0] != "files" || (Sources.size() > 1 && !SystemdAfterFiles))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Check whether a password entry comes from /etc/passwd, rather than from a source that
+ * follows files in /etc/nsswitch.conf.
+ *
+ * @param[in] Entry The password entry.
+ *
+ * @return true if /etc/passwd has an entry with the same name and uid.
+ */
+bool UserLookupCache::InPasswdFile(const passwd* Entry)
+{
+    wil::unique_file File{fopen(c_passwdFile, "re")};
+    if (!File)
+    {
+        return false;
+    }
+
+    passwd FileEntry{};
+    passwd* Result{};
+    std::vector<char> Buffer(1024);
+    for (;;)
+    {
+        const int Error = fgetpwent_r(File.get(), &FileEntry, Buffer.data(), Buffer.size(), &Result);
+        if (Error == ERANGE)
+        {
+            Buffer.resize(Buffer.size() * 2);
+            continue;
+        }
+
+        if (Error != 0 || Result == nullptr)
+        {
+            return false;
+        }
+
+        if (FileEntry.pw_uid == Entry->pw_uid && strcmp(FileEntry.pw_name, Entry->pw_name) == 0)
+        {
+            return true;
+        }
+    }
+}
+
+std::vector<UserLookupCache::FileSignature> UserLookupCache::Snapshot() const
+{
+    std::vector<FileSignature> Signature;
+    Signature.reserve(std::size(c_sourceFiles));
+    for (const auto* Path : c_sourceFiles)
+    {
+        struct stat Status;
+        auto& File = Signature.emplace_back();
+        if (stat(Path, &Status) == 0)
+        {
+            File.Inode = Status.st_ino;
+            File.Size = Status.st_size;
+            File.ModifiedTime = Status.st_mtim;
+            File.Exists = true;
+        }
+    }
+
+    return Signature;
+}
+
+UserLookupCache::User* UserLookupCache::Find(const char* Name)
+{
+    auto Found = m_users.find(std::string_view{Name});
+    return Found != m_users.end() ? &Found->second : nullptr;
+}
@@ -0,0 +1,81 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+
+#pragma once
+
+#include <map>
+#include <optional>
+#include <pwd.h>
+#include <string>
+#include <vector>
+#include "common.h"
+#include "config.h"
+
+// Cache of the passwd and group lookups that a launch makes, kept by the session leader and
+// inherited by the processes it creates.
+//
+// Each launch looks up the user (getpwnam / getpwuid) and its supplementary groups, and reads
+// the locale configuration. That means parsing /etc/passwd, /etc/group and the locale files every
+// time. When user.lookupCache is enabled in /etc/wsl.conf, the session leader does this once per
+// user and keeps the results while those files and /etc/nsswitch.conf are unchanged. Every relay
+// and child process forked from the session leader inherits them, so a launch only applies its own
+// command line, working directory and environment before exec.
+//
+// This takes the place of a pre-forked per-user zygote: the user process must stay a child of its
+// relay, which owns the pty and collects the exit status, and the session leader already forks
+// every relay, so the state it caches is inherited the same way a zygote's would be.
+//
+// The cache only knows when local files change, so user and group lookups bypass it unless
+// /etc/nsswitch.conf resolves both passwd and group from files, optionally followed by systemd.
+class UserLookupCache
+{
+public:
+    UserLookupCache() = default;
+
+    UserLookupCache(const UserLookupCache&) = delete;
+    UserLookupCache& operator=(const UserLookupCache&) = delete;
+
+    void Prepare(gsl::span<gsl::byte> Buffer, const wsl::linux::WslDistributionConfig& Config) noexcept;
+
+    const passwd* GetUserByName(const char* Name);
+    const passwd* GetUserById(uid_t Uid);
+    void InitGroups(const passwd* Entry);
+    void UpdateLanguage(EnvironmentBlock& Environment);
+
+private:
+    struct User
+    {
+        std::string Name;
+        std::string Password;
+        std::string Gecos;
+        std::string Directory;
+        std::string Shell;
+        passwd Entry{};
+        std::optional<std::vector<gid_t>> Groups;
+    };
+
+    struct FileSignature
+    {
+        ino_t Inode{};
+        off_t Size{};
+        timespec ModifiedTime{};
+        bool Exists{};
+
+        bool operator==(const FileSignature& Other) const noexcept;
+    };
+
+    const passwd* Insert(const passwd* Entry);
+    bool CacheAccounts() const noexcept;
+    static bool ResolvedLocally();
+    static bool InPasswdFile(const passwd* Entry);
+    std::vector<FileSignature> Snapshot() const;
+    User* Find(const char* Name);
+
+    bool m_enabled = false;
+    bool m_localSources = false;
+    std::map<std::string, User, std::less<>> m_users;
+    std::map<uid_t, std::string> m_uids;
+    std::optional<std::optional<std::string>> m_language;
+    std::vector<FileSignature> m_signature;
+};
+
+extern UserLookupCache g_UserLookupCache;
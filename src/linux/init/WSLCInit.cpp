@@ -814,9 +814,10 @@ void HandleMountMessage(
             WriteWslcCdiSpec();
             WriteDockerDaemonConfig();
 
-            // Start the memory reduction thread now that procfs is in its final location.
+            // Start the memory reduction thread now that procfs is in its final location. Gradual mode tracks the
+            // containers that Docker creates separately, and reclaims from idle ones even while others are busy.
             static std::once_flag memoryReductionFlag;
-            std::call_once(memoryReductionFlag, [] { StartMemoryReductionThread(LxMiniInitMemoryReclaimModeDropCache); });
+            std::call_once(memoryReductionFlag, [] { StartMemoryReductionThread(LxMiniInitMemoryReclaimModeGradual); });
         }
 
         response.Result = 0;
@@ -26,6 +26,8 @@ WslDistributionConfig::WslDistributionConfig(const char* configFilePath)
         ConfigKey(c_ConfigAutoMountOption, AutoMount),
         ConfigKey(c_ConfigAutoMountRoot, DrvFsPrefix),
         ConfigKey("automount.options", DrvFsOptions),
+        ConfigKey("automount.mountThreads", DrvFsMountThreads),
+        ConfigKey("automount.deferTimeout", DrvFsMountDeferTimeout),
         ConfigKey(c_ConfigMountFsTabOption, MountFsTab),
         ConfigKey(c_ConfigLinkOsLibsOption, LinkOsLibs),
         ConfigKey("automount.cgroups", {{"v1", CGroupVersion::v1}, {"v2", CGroupVersion::v2}}, CGroup, nullptr),
@@ -45,11 +47,17 @@ WslDistributionConfig::WslDistributionConfig(const char* configFilePath)
         ConfigKey("fileServer.logFile", Plan9LogFile),
         ConfigKey("fileServer.logLevel", Plan9LogLevel),
         ConfigKey("fileServer.logTruncate", Plan9LogTruncate),
+        ConfigKey("fileServer.fairQueue", Plan9FairQueue),
+        ConfigKey("fileServer.ioBudget", MemoryString(Plan9IoBudget)),
+        ConfigKey("fileServer.readDirCache", Plan9ReadDirCache),
+        ConfigKey("fileServer.streamingReads", Plan9StreamingReads),
+        ConfigKey("fileServer.streamingThreshold", MemoryString(Plan9StreamingThreshold)),
 
         ConfigKey(c_ConfigGpuEnabledOption, GpuEnabled),
         ConfigKey(c_ConfigAppendGpuLibPathOption, AppendGpuLibPath),
 
         ConfigKey("user.default", DefaultUser),
+        ConfigKey("user.lookupCache", UserLookupCache),
 
         ConfigKey(c_ConfigBootCommandOption, BootCommand),
         ConfigKey(c_ConfigBootSystemdOption, BootInit),
@@ -83,6 +91,12 @@ WslDistributionConfig::WslDistributionConfig(const char* configFilePath)
         DrvFsPrefix = Prefix;
     }
 
+    //
+    // At least one thread is needed to mount the DrvFs volumes.
+    //
+
+    DrvFsMountThreads = std::max(DrvFsMountThreads, 1);
+
     //
     // Using boot.systemd is only supported on WSL2.
     //
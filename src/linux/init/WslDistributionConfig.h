@@ -61,8 +61,11 @@ struct WslDistributionConfig
     int BootInitTimeout = 10 * 1000;
     bool BootProtectBinfmt = true;
     std::optional<std::string> DefaultUser;
+    bool UserLookupCache = false;
     std::string DrvFsPrefix = "/mnt";
     std::optional<std::string> DrvFsOptions;
+    int DrvFsMountThreads = 4;
+    int DrvFsMountDeferTimeout = 0;
     bool InteropAppendWindowsPath = true;
     bool InteropEnabled = true;
     bool MountFsTab = true;
@@ -73,6 +76,11 @@ struct WslDistributionConfig
     std::optional<std::string> Plan9LogFile;
     int Plan9LogLevel = TRACE_LEVEL_INFORMATION;
     bool Plan9LogTruncate = true;
+    bool Plan9FairQueue = true;
+    uint64_t Plan9IoBudget = 0;
+    bool Plan9ReadDirCache = false;
+    bool Plan9StreamingReads = true;
+    uint64_t Plan9StreamingThreshold = 0;
     int Umask = 0022;
     bool AppendGpuLibPath = true;
     bool GpuEnabled = true;
@@ -22,6 +22,7 @@ Abstract:
 #include "wslpath.h"
 #include <libgen.h>
 #include "util.h"
+#include "RelayStream.h"
 #include "SocketChannel.h"
 
 #define ACCEPT_TIMEOUT (10 * 1000)
@@ -222,10 +223,14 @@ try
     // Fill output and poll file descriptors.
     //
 
+    int InputFd[] = {0, Sockets[1].get(), Sockets[2].get()};
     int OutputFd[] = {Sockets[0].get(), 1, 2};
     pollfd PollDescriptors[] = {
         {0, POLLIN}, {Sockets[1].get(), POLLIN}, {Sockets[2].get(), POLLIN}, {Sockets[3].get(), POLLIN}, {SignalFd.get(), POLLIN}};
 
+    RelayStream Relays[] = {
+        RelayStream{InputFd[0], OutputFd[0]}, RelayStream{InputFd[1], OutputFd[1]}, RelayStream{InputFd[2], OutputFd[2]}};
+
     //
     // Begin relaying from stdin to the stdin socket, and from the stdout and
     // stderr sockets to stdout and stderr.
@@ -233,6 +238,22 @@ try
 
     while (HasOpenFileDescriptors(PollDescriptors, COUNT_OF(PollDescriptors)))
     {
+        //
+        // N.B. Data that an output didn't accept right away (for example because the terminal put
+        //      it in non-blocking mode) stays pending in its relay stream. Until it's written, wait
+        //      for that output to be writable instead of reading more from the input.
+        //
+
+        for (int Index = 0; Index < COUNT_OF(OutputFd); Index += 1)
+        {
+            if (PollDescriptors[Index].fd != -1)
+            {
+                const bool Pending = Relays[Index].Pending() != 0;
+                PollDescriptors[Index].fd = Pending ? OutputFd[Index] : InputFd[Index];
+                PollDescriptors[Index].events = Pending ? POLLOUT : POLLIN;
+            }
+        }
+
         Result = poll(PollDescriptors, COUNT_OF(PollDescriptors), -1);
         if (Result <= 0)
         {
@@ -241,9 +262,25 @@ try
 
         for (int Index = 0; Index < COUNT_OF(OutputFd); Index += 1)
         {
+            if (PollDescriptors[Index].events & POLLOUT)
+            {
+                if (PollDescriptors[Index].revents != 0 && Relays[Index].Flush() < 0)
+                {
+                    LOG_STDERR("relay failed %d", errno);
+                    PollDescriptors[Index].fd = -1;
+                }
+
+                continue;
+            }
+
             if (PollDescriptors[Index].revents & (POLLIN | POLLHUP | POLLERR))
             {
-                auto BytesRead = UtilReadBuffer(PollDescriptors[Index].fd, Buffer);
+                auto BytesRead = Relays[Index].Transfer();
+                if (BytesRead < 0 && errno == EAGAIN)
+                {
+                    continue;
+                }
+
                 if (BytesRead == 0)
                 {
                     PollDescriptors[Index].fd = -1;
@@ -257,17 +294,9 @@ try
                 }
                 else if (BytesRead < 0)
                 {
-                    LOG_STDERR("read failed %d", errno);
+                    LOG_STDERR("relay failed %d", errno);
                     PollDescriptors[Index].fd = -1;
                 }
-                else
-                {
-                    auto BytesWritten = UtilWriteBuffer(OutputFd[Index], Buffer.data(), BytesRead);
-                    if (BytesWritten < 0)
-                    {
-                        LOG_STDERR("write failed %d", errno);
-                    }
-                }
             }
         }
 
@@ -19,6 +19,7 @@ Abstract:
 #include <sys/sysmacros.h>
 #include <pwd.h>
 #include <future>
+#include <thread>
 #include <signal.h>
 #include <pty.h>
 #include <lxbusapi.h>
@@ -36,6 +37,7 @@ Abstract:
 #include "WslDistributionConfig.h"
 #include "lxfsshares.h"
 #include "plan9.h"
+#include "BootTimeline.h"
 
 #define AUTO_MOUNT_PARENT_MODE 0755
 #define CGROUP_DEVICE "cgroup"
@@ -76,10 +78,36 @@ Abstract:
 
 using wsl::linux::WslDistributionConfig;
 
+struct DrvFsVolumeMount
+{
+    char Source[sizeof(DRVFS_SOURCE)] = DRVFS_SOURCE;
+    std::string Target;
+    std::optional<int> Result;
+};
+
+struct DRVFS_VOLUME_MOUNT_RESULT
+{
+    uint32_t Index;
+    int32_t Result;
+};
+
 static void ConfigApplyWindowsLibPath(const wsl::linux::WslDistributionConfig& Config);
 
 static bool CreateLoginSession(const wsl::linux::WslDistributionConfig& Config, const char* Username, uid_t Uid);
 
+static void ConfigMountDrvFsVolumesConcurrently(
+    std::vector<DrvFsVolumeMount>& Volumes,
+    const char* Options,
+    std::optional<bool> Admin,
+    const wsl::linux::WslDistributionConfig& Config,
+    const std::function<void(size_t)>& Completed);
+
+static wil::unique_fd ConfigMountDrvFsVolumesDeferred(
+    const std::vector<DrvFsVolumeMount>& Volumes,
+    const char* Options,
+    std::optional<bool> Admin,
+    const wsl::linux::WslDistributionConfig& Config);
+
 class RemoveMountAndEnvironmentOnScopeExit
 {
 public:
@@ -646,6 +674,8 @@ Return Value:
 
 try
 {
+    std::optional<BootTimeline::Span> InitializeSpan{std::in_place, "ConfigInitializeInstance"};
+
     //
     // Validate input parameters.
     //
@@ -927,6 +957,13 @@ try
 
     SendResponse(Response.Span());
 
+    //
+    // The instance is initialized, save the boot timeline.
+    //
+
+    InitializeSpan.reset();
+    BootTimeline::Write((Config.DrvFsPrefix + SHARED_MOUNT_FOLDER "/" WSL_BOOT_TRACE_FILE).c_str());
+
     //
     // Accept the interop connection.
     //
@@ -1032,6 +1069,8 @@ Return Value:
 --*/
 
 {
+    BootTimeline::Span Span{"ConfigInitializeVmMode"};
+
     //
     // Move temporary mounts created by mini_init to their final locations.
     //
@@ -1981,6 +2020,8 @@ Return Value:
 
 try
 {
+    BootTimeline::Span Span{"ConfigMountDrvFsVolumes"};
+
     if (DrvFsVolumes == 0)
     {
         return;
@@ -2021,13 +2062,13 @@ try
         std::format("noatime,uid={},gid={},{}", OwnerUid, OwnerGid, Config.DrvFsOptions.has_value() ? Config.DrvFsOptions->c_str() : "");
 
     //
-    // Iterate over the bitmap and attempt to create a DrvFs mount for each
-    // drive letter.
+    // Iterate over the bitmap and create the target directory for each drive
+    // letter that needs to be mounted.
     //
     // N.B. __builtin_ffsll returns a one-based index.
     //
 
-    char Source[] = DRVFS_SOURCE;
+    std::vector<DrvFsVolumeMount> Volumes;
     for (int Index = __builtin_ffsll(DrvFsVolumes); Index != 0; Index = __builtin_ffsll(DrvFsVolumes))
     {
         //
@@ -2048,24 +2089,250 @@ try
             continue;
         }
 
-        //
-        // Create the target directory and attempt the mount.
-        //
-
         if (UtilMkdir(Target.c_str(), DRVFS_TARGET_MODE) < 0)
         {
             continue;
         }
 
-        Source[0] = 'A' + Index;
-        if (MountDrvfs(Source, Target.c_str(), Options.c_str(), Admin, Config) < 0)
+        auto& Volume = Volumes.emplace_back();
+        Volume.Source[0] = 'A' + Index;
+        Volume.Target = std::move(Target);
+    }
+
+    if (Volumes.empty())
+    {
+        return;
+    }
+
+    //
+    // Each mount is a round trip to the file server on the host, so the
+    // volumes are mounted concurrently.
+    //
+    // If a timeout is configured, the volumes are mounted by a child process
+    // and only the mounts that complete within the timeout are waited for. The
+    // remaining mounts complete in the background, so a slow or unreachable
+    // drive doesn't delay the instance start.
+    //
+
+    wil::unique_fd ReadPipe;
+    if (Config.DrvFsMountDeferTimeout > 0)
+    {
+        ReadPipe = ConfigMountDrvFsVolumesDeferred(Volumes, Options.c_str(), Admin, Config);
+    }
+
+    if (!ReadPipe)
+    {
+        ConfigMountDrvFsVolumesConcurrently(Volumes, Options.c_str(), Admin, Config, {});
+    }
+    else
+    {
+        const auto Deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds{Config.DrvFsMountDeferTimeout};
+        size_t Remaining = Volumes.size();
+        while (Remaining > 0)
+        {
+            const auto Timeout =
+                std::chrono::duration_cast<std::chrono::milliseconds>(Deadline - std::chrono::steady_clock::now()).count();
+
+            if (Timeout <= 0)
+            {
+                break;
+            }
+
+            //
+            // N.B. Each result is written at once and is smaller than
+            //      PIPE_BUF, so it is never split.
+            //
+
+            DRVFS_VOLUME_MOUNT_RESULT Result;
+            if ((UtilRead(ReadPipe.get(), &Result, sizeof(Result), static_cast<int>(Timeout)) != sizeof(Result)) ||
+                (Result.Index >= Volumes.size()))
+            {
+                break;
+            }
+
+            Volumes[Result.Index].Result = Result.Result;
+            Remaining -= 1;
+        }
+    }
+
+    //
+    // Report the results in drive letter order, regardless of the order the
+    // mounts completed in.
+    //
+
+    for (const auto& Volume : Volumes)
+    {
+        if (!Volume.Result.has_value())
         {
-            EMIT_USER_WARNING(wsl::shared::Localization::MessageDrvfsMountFailed(Source));
+            LOG_WARNING("Mounting {} did not complete within {}ms, deferring", Volume.Target, Config.DrvFsMountDeferTimeout);
+        }
+        else if (Volume.Result.value() < 0)
+        {
+            EMIT_USER_WARNING(wsl::shared::Localization::MessageDrvfsMountFailed(Volume.Source));
         }
     }
 }
 CATCH_LOG()
 
+static void ConfigMountDrvFsVolumesConcurrently(
+    std::vector<DrvFsVolumeMount>& Volumes,
+    const char* Options,
+    std::optional<bool> Admin,
+    const wsl::linux::WslDistributionConfig& Config,
+    const std::function<void(size_t)>& Completed)
+
+/*++
+
+Routine Description:
+
+    This routine mounts DrvFs volumes with a bounded number of threads.
+
+Arguments:
+
+    Volumes - Supplies the volumes to mount. The result of each mount is
+        stored in its entry.
+
+    Options - Supplies the mount options.
+
+    Admin - Supplies an optional boolean to specify if the admin or non-admin
+        server should be used.
+
+    Config - Supplies the distribution configuration.
+
+    Completed - Supplies an optional callback that is invoked with the index
+        of each volume once it is mounted. Invocations are serialized.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+    std::atomic<size_t> NextIndex{0};
+    std::mutex Lock;
+    auto Worker = [&]() {
+        for (auto Index = NextIndex++; Index < Volumes.size(); Index = NextIndex++)
+        {
+            auto& Volume = Volumes[Index];
+            const int Result = MountDrvfs(Volume.Source, Volume.Target.c_str(), Options, Admin, Config);
+            std::lock_guard Guard{Lock};
+            Volume.Result = Result;
+            if (Completed)
+            {
+                Completed(Index);
+            }
+        }
+    };
+
+    //
+    // The calling thread mounts volumes too, so if no thread can be created
+    // the volumes are still mounted one at a time.
+    //
+
+    std::vector<std::thread> Threads;
+    const auto ThreadCount = std::min<size_t>(Config.DrvFsMountThreads, Volumes.size());
+    for (size_t Index = 1; Index < ThreadCount; Index += 1)
+    {
+        try
+        {
+            Threads.emplace_back(Worker);
+        }
+        catch (...)
+        {
+            LOG_CAUGHT_EXCEPTION();
+            break;
+        }
+    }
+
+    Worker();
+    for (auto& Thread : Threads)
+    {
+        Thread.join();
+    }
+}
+
+static wil::unique_fd ConfigMountDrvFsVolumesDeferred(
+    const std::vector<DrvFsVolumeMount>& Volumes,
+    const char* Options,
+    std::optional<bool> Admin,
+    const wsl::linux::WslDistributionConfig& Config)
+
+/*++
+
+Routine Description:
+
+    This routine mounts DrvFs volumes in a child process, which reports the
+    result of each mount as it completes. The child process keeps running
+    until every mount has completed, even if the caller stops waiting.
+
+    N.B. A child process is used instead of threads, because init execs the
+         distribution init process and switches mount namespaces, neither of
+         which can be done while mounts are in progress on other threads.
+
+Arguments:
+
+    Volumes - Supplies the volumes to mount.
+
+    Options - Supplies the mount options.
+
+    Admin - Supplies an optional boolean to specify if the admin or non-admin
+        server should be used.
+
+    Config - Supplies the distribution configuration.
+
+Return Value:
+
+    The read end of a pipe that receives a DRVFS_VOLUME_MOUNT_RESULT for each
+    mount, or an invalid file descriptor if the child process could not be
+    created.
+
+--*/
+
+{
+    int Pipe[2];
+    if (pipe2(Pipe, O_CLOEXEC) < 0)
+    {
+        LOG_ERROR("pipe2 failed {}", errno);
+        return {};
+    }
+
+    wil::unique_fd ReadPipe{Pipe[0]};
+    wil::unique_fd WritePipe{Pipe[1]};
+    const int ChildPid = UtilCreateChildProcess("DrvFsMount", [&]() {
+        ReadPipe.reset();
+
+        //
+        // If init stops waiting, the results can't be delivered anymore and
+        // failures are logged instead.
+        //
+
+        signal(SIGPIPE, SIG_IGN);
+        auto ChildVolumes = Volumes;
+        ConfigMountDrvFsVolumesConcurrently(ChildVolumes, Options, Admin, Config, [&](size_t Index) {
+            const DRVFS_VOLUME_MOUNT_RESULT Result{static_cast<uint32_t>(Index), ChildVolumes[Index].Result.value()};
+            if (WritePipe && (UtilWriteBuffer(WritePipe.get(), &Result, sizeof(Result)) < 0))
+            {
+                WritePipe.reset();
+            }
+
+            if (!WritePipe && (Result.Result < 0))
+            {
+                LOG_ERROR("Deferred mount of {} failed", ChildVolumes[Index].Target);
+            }
+        });
+
+        _exit(0);
+    });
+
+    if (ChildPid < 0)
+    {
+        return {};
+    }
+
+    return ReadPipe;
+}
+
 static void ConfigApplyWindowsLibPath(const wsl::linux::WslDistributionConfig& Config)
 
 /*++
@@ -2145,6 +2412,8 @@ Return Value:
 --*/
 
 {
+    BootTimeline::Span Span{"ConfigMountFsTab"};
+
     //
     // Note: The WSL_DRVFS_ELEVATED_ENV variable is used because the interop server isn't running yet.
     //
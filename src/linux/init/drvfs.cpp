@@ -21,6 +21,7 @@ Abstract:
 #include "drvfs.h"
 #include "config.h"
 #include "message.h"
+#include "BootTimeline.h"
 #include <cassert>
 #include <filesystem>
 #include <mutex>
@@ -495,6 +496,7 @@ Return Value:
 
 try
 {
+    BootTimeline::Span Span{"MountDrvfs"};
     if (!UtilIsUtilityVm())
     {
         return MountFilesystem(DRVFS_FS_TYPE, Source, Target, Options, ExitCode);
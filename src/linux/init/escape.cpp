@@ -13,10 +13,24 @@ Abstract:
 
 --*/
 
+#include <cassert>
+#include <cstdlib>
 #include "common.h"
 #include "escape.h"
 #include "util.h"
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+//
+// See WSL_PATH_ESCAPE_SCALAR_ENV.
+//
+
+static const bool EscapeUseScalar = getenv(WSL_PATH_ESCAPE_SCALAR_ENV) != nullptr;
+
 //
 // List indicating which characters are legal in NTFS.
 // This differs from the Windows logic in two ways:
@@ -193,13 +207,185 @@ Return:
     return (static_cast<unsigned char>(Character) <= SCHAR_MAX) && (EscapeNtfsLegalAnsiCharacterArray[static_cast<int>(Character)] == false);
 }
 
-void EscapePathForNt(const char* Path, char* EscapedPath)
+namespace {
+
+//
+// Characters below 0x80, other than control characters, that need to be
+// escaped. This must match EscapeNtfsLegalAnsiCharacterArray.
+//
+
+constexpr char EscapeIllegalCharacters[] = {'"', '*', ':', '<', '>', '?', '\\', '|'};
+
+enum class EscapeScan
+{
+    Escape,
+    EscapeOrSeparator,
+    Separator
+};
+
+template <EscapeScan Scan>
+bool EscapeScanMatches(char Character)
+{
+    if constexpr (Scan == EscapeScan::Escape)
+    {
+        return EscapeCharNeedsEscape(Character);
+    }
+    else if constexpr (Scan == EscapeScan::EscapeOrSeparator)
+    {
+        return (Character == PATH_SEP) || EscapeCharNeedsEscape(Character);
+    }
+    else
+    {
+        return (Character == PATH_SEP) || (Character == PATH_SEP_NT);
+    }
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+//
+// Paths are classified 16 bytes at a time. SSE2 and NEON are part of the
+// baseline of the x86_64 and arm64 targets, so no runtime detection is needed.
+// Each byte that matches sets one bit of the mask on SSE2 and four bits on
+// NEON.
+//
+
+constexpr size_t EscapeBlockSize = 16;
+
+#if defined(__SSE2__)
+
+constexpr unsigned int EscapeMaskBitsPerByte = 1;
+
+template <EscapeScan Scan>
+uint64_t EscapeScanBlock(const char* Data)
+{
+    const __m128i Block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Data));
+    __m128i Match = _mm_setzero_si128();
+    if constexpr (Scan != EscapeScan::Separator)
+    {
+        //
+        // Control characters are the bytes that are unsigned-less-or-equal to
+        // 0x1f.
+        //
+
+        Match = _mm_cmpeq_epi8(_mm_min_epu8(Block, _mm_set1_epi8(0x1f)), Block);
+        for (const auto Character : EscapeIllegalCharacters)
+        {
+            Match = _mm_or_si128(Match, _mm_cmpeq_epi8(Block, _mm_set1_epi8(Character)));
+        }
+    }
+
+    if constexpr (Scan != EscapeScan::Escape)
+    {
+        Match = _mm_or_si128(Match, _mm_cmpeq_epi8(Block, _mm_set1_epi8(PATH_SEP)));
+    }
+
+    if constexpr (Scan == EscapeScan::Separator)
+    {
+        Match = _mm_or_si128(Match, _mm_cmpeq_epi8(Block, _mm_set1_epi8(PATH_SEP_NT)));
+    }
+
+    return static_cast<uint32_t>(_mm_movemask_epi8(Match));
+}
+
+#else
+
+constexpr unsigned int EscapeMaskBitsPerByte = 4;
+
+template <EscapeScan Scan>
+uint64_t EscapeScanBlock(const char* Data)
+{
+    const uint8x16_t Block = vld1q_u8(reinterpret_cast<const uint8_t*>(Data));
+    uint8x16_t Match = vdupq_n_u8(0);
+    if constexpr (Scan != EscapeScan::Separator)
+    {
+        Match = vcleq_u8(Block, vdupq_n_u8(0x1f));
+        for (const auto Character : EscapeIllegalCharacters)
+        {
+            Match = vorrq_u8(Match, vceqq_u8(Block, vdupq_n_u8(Character)));
+        }
+    }
+
+    if constexpr (Scan != EscapeScan::Escape)
+    {
+        Match = vorrq_u8(Match, vceqq_u8(Block, vdupq_n_u8(PATH_SEP)));
+    }
+
+    if constexpr (Scan == EscapeScan::Separator)
+    {
+        Match = vorrq_u8(Match, vceqq_u8(Block, vdupq_n_u8(PATH_SEP_NT)));
+    }
+
+    //
+    // NEON has no equivalent of movemask; narrowing each 16-bit lane by 4 bits
+    // leaves one nibble per byte.
+    //
+
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(Match), 4)), 0);
+}
+
+#endif
+
+#endif
+
+template <EscapeScan Scan>
+size_t EscapeScanFind(const char* Data, size_t Length)
 
 /*++
 
 Description:
 
-    This routine escapes a Linux path for use with NT.
+    This routine finds the first character in a buffer that matches the scan.
+
+Parameters:
+
+    Data - Supplies the buffer.
+
+    Length - Supplies the length of the buffer.
+
+Return:
+
+    The offset of the first matching character, or the length of the buffer if
+    no character matches.
+
+--*/
+
+{
+    size_t Offset = 0;
+
+#if defined(__SSE2__) || defined(__ARM_NEON)
+
+    for (; Offset + EscapeBlockSize <= Length; Offset += EscapeBlockSize)
+    {
+        const uint64_t Mask = EscapeScanBlock<Scan>(Data + Offset);
+        if (Mask != 0)
+        {
+            return Offset + (__builtin_ctzll(Mask) / EscapeMaskBitsPerByte);
+        }
+    }
+
+#endif
+
+    for (; Offset < Length; Offset += 1)
+    {
+        if (EscapeScanMatches<Scan>(Data[Offset]))
+        {
+            break;
+        }
+    }
+
+    return Offset;
+}
+
+} // namespace
+
+void EscapePathForNtScalar(const char* Path, char* EscapedPath)
+
+/*++
+
+Description:
+
+    This routine escapes a Linux path for use with NT, one character at a
+    time. This is the reference implementation for EscapePathForNt.
 
     N.B. The path is assumed to use Linux separators (forward slash), so those
          are not escaped, but rather replaced with backslashes.
@@ -252,14 +438,14 @@ Return:
     }
 }
 
-size_t EscapePathForNtLength(const char* Path)
+size_t EscapePathForNtLengthScalar(const char* Path)
 
 /*++
 
 Description:
 
     This routine determines the length needed to escape a Linux path for use
-    in NT.
+    in NT. This is the reference implementation for EscapePathForNt.
 
     N.B. The path is assumed to use Linux separators (forward slash), so those
          are not escaped.
@@ -295,13 +481,14 @@ Return:
     return Length;
 }
 
-void UnescapePathInplace(char* Path)
+void UnescapePathInplaceScalar(char* Path)
 
 /*++
 
 Description:
 
-    This routine unescapes the supplied string inplace.
+    This routine unescapes the supplied string inplace, one character at a
+    time. This is the reference implementation for UnescapePathInplace.
 
 Parameters:
 
@@ -338,3 +525,203 @@ Return:
         }
     }
 }
+
+bool EscapePathForNt(const char* Path, std::string& EscapedPath)
+
+/*++
+
+Description:
+
+    This routine escapes a Linux path for use with NT, and appends it to the
+    supplied string.
+
+    The path is escaped in a single pass: runs of characters that don't need
+    to be escaped are found a block at a time and copied at once.
+
+    N.B. The path is assumed to use Linux separators (forward slash), so those
+         are not escaped, but rather replaced with backslashes.
+
+Parameters:
+
+    Path - Supplies the path to escape.
+
+    EscapedPath - Supplies a string that the escaped path is appended to.
+
+Return:
+
+    True if any character was escaped; otherwise, false.
+
+--*/
+
+{
+    bool Escaped = false;
+    const size_t Start = EscapedPath.size();
+    std::string_view Remaining{Path};
+
+    if (EscapeUseScalar)
+    {
+        EscapedPath.resize(Start + EscapePathForNtLengthScalar(Path));
+        EscapePathForNtScalar(Path, EscapedPath.data() + Start);
+        return EscapedPath.size() - Start != Remaining.size();
+    }
+
+    EscapedPath.reserve(Start + Remaining.size());
+    while (!Remaining.empty())
+    {
+        const size_t Next = EscapeScanFind<EscapeScan::EscapeOrSeparator>(Remaining.data(), Remaining.size());
+        EscapedPath.append(Remaining.data(), Next);
+        if (Next == Remaining.size())
+        {
+            break;
+        }
+
+        const char Character = Remaining[Next];
+        if (Character == PATH_SEP)
+        {
+            EscapedPath += PATH_SEP_NT;
+        }
+        else
+        {
+            //
+            // See EscapePathForNtScalar for the encoding.
+            //
+
+            const char Sequence[] = {
+                UtilEscapeCharBase[0],
+                static_cast<char>(UtilEscapeCharBase[1] | (Character >> 6)),
+                static_cast<char>(UtilEscapeCharBase[2] | (Character & 0x3f))};
+
+            EscapedPath.append(Sequence, sizeof(Sequence));
+            Escaped = true;
+        }
+
+        Remaining.remove_prefix(Next + 1);
+    }
+
+#ifdef DBG
+
+    std::string Reference(EscapePathForNtLengthScalar(Path), '\0');
+    EscapePathForNtScalar(Path, Reference.data());
+    assert(EscapedPath.compare(Start, std::string::npos, Reference) == 0);
+
+#endif
+
+    return Escaped;
+}
+
+size_t EscapeFindSeparator(const char* Path, size_t Length)
+
+/*++
+
+Description:
+
+    This routine finds the first Linux or NT separator in a path.
+
+Parameters:
+
+    Path - Supplies the path.
+
+    Length - Supplies the length of the path.
+
+Return:
+
+    The offset of the first separator, or the length of the path if there is
+    none.
+
+--*/
+
+{
+    return EscapeScanFind<EscapeScan::Separator>(Path, Length);
+}
+
+void UnescapePathInplace(char* Path)
+
+/*++
+
+Description:
+
+    This routine unescapes the supplied string inplace.
+
+    The string is compacted in a single pass; the search for the first byte of
+    the next escape sequence uses the vectorized strchr of the C library.
+
+Parameters:
+
+    Path - Supplies the path to be unescaped.
+
+Return:
+
+    None.
+
+--*/
+
+{
+    char* Current;
+    char* Next;
+    char* Output;
+    bool Unescape;
+    char Unescaped;
+
+    if (EscapeUseScalar)
+    {
+        UnescapePathInplaceScalar(Path);
+        return;
+    }
+
+#ifdef DBG
+
+    std::string Reference{Path};
+    UnescapePathInplaceScalar(Reference.data());
+
+#endif
+
+    Current = strchr(Path, UtilEscapeCharBase[0]);
+    Output = Current;
+    while (Current != nullptr)
+    {
+        //
+        // If the current character is a utf-8 sequence that can be unescaped,
+        // replace the character; otherwise keep the lead byte.
+        //
+
+        Unescape = false;
+        if (((Current[1] & UtilEscapeCharBase[1]) != 0) && ((Current[2] & UtilEscapeCharBase[2]) != 0))
+        {
+            Unescaped = (Current[1] << 6) | (Current[2] & 0x3f);
+            Unescape = EscapeCharNeedsEscape(Unescaped);
+        }
+
+        if (Unescape != false)
+        {
+            *Output = Unescaped;
+            Current += sizeof(UtilEscapeCharBase);
+        }
+        else
+        {
+            *Output = *Current;
+            Current += 1;
+        }
+
+        Output += 1;
+
+        //
+        // Move everything up to the next lead byte, or the end of the string.
+        //
+
+        Next = strchr(Current, UtilEscapeCharBase[0]);
+        const size_t Length = (Next != nullptr) ? (Next - Current) : (strlen(Current) + 1);
+        if (Output != Current)
+        {
+            memmove(Output, Current, Length);
+        }
+
+        Output += Length;
+        Current = Next;
+    }
+
+#ifdef DBG
+
+    assert(strcmp(Reference.c_str(), Path) == 0);
+
+#endif
+}
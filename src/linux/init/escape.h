@@ -13,8 +13,29 @@ Abstract:
 
 --*/
 
-void EscapePathForNt(const char* Path, char* EscapedPath);
+#pragma once
 
-size_t EscapePathForNtLength(const char* Path);
+#include <string>
+
+//
+// When set, paths are escaped and unescaped with the scalar reference implementations, so their
+// performance can be compared with the vectorized ones.
+//
+
+#define WSL_PATH_ESCAPE_SCALAR_ENV "WSL_PATH_ESCAPE_SCALAR"
+
+bool EscapePathForNt(const char* Path, std::string& EscapedPath);
+
+size_t EscapeFindSeparator(const char* Path, size_t Length);
 
 void UnescapePathInplace(char* Path);
+
+//
+// Scalar reference implementations.
+//
+
+void EscapePathForNtScalar(const char* Path, char* EscapedPath);
+
+size_t EscapePathForNtLengthScalar(const char* Path);
+
+void UnescapePathInplaceScalar(char* Path);
@@ -46,6 +46,10 @@ Abstract:
 #include "message.h"
 #include "configfile.h"
 #include "CommandLine.h"
+#include "stdiomux.h"
+#include "RelayStream.h"
+#include "UserLookupCache.h"
+#include "BootTimeline.h"
 
 static_assert(EX_NOUSER == LX_INIT_USER_NOT_FOUND);
 static_assert(EUSERS == LX_INIT_TTY_LIMIT);
@@ -592,7 +596,7 @@ try
     const passwd* PasswordEntry{};
 
     auto ConfigureUid = [&](uint32_t Uid) {
-        PasswordEntry = getpwuid(Uid);
+        PasswordEntry = g_UserLookupCache.GetUserById(Uid);
         if (PasswordEntry == nullptr)
         {
             LOG_ERROR("getpwuid({}) failed {}", Uid, errno);
@@ -615,7 +619,7 @@ try
     // N.B. Failure to update $LANG environment variable is non-fatal.
     //
 
-    ConfigUpdateLanguage(Common->Environment);
+    g_UserLookupCache.UpdateLanguage(Common->Environment);
 
     //
     // Launch the OOBE command, if any
@@ -777,7 +781,7 @@ try
     // Set the supplemental groups, gid, uid, and current working directory.
     //
 
-    UtilInitGroups(PasswordEntry->pw_name, PasswordEntry->pw_gid);
+    g_UserLookupCache.InitGroups(PasswordEntry);
     THROW_LAST_ERROR_IF(setgid(PasswordEntry->pw_gid) < 0);
     THROW_LAST_ERROR_IF(setuid(PasswordEntry->pw_uid) < 0);
 
@@ -997,11 +1001,11 @@ try
     // Otherwise, use the default UID from the registry.
     //
 
-    struct passwd* PasswordEntry = nullptr;
+    const passwd* PasswordEntry = nullptr;
     auto Username = wsl::shared::string::FromSpan(Buffer, Common->UsernameOffset);
     if (strlen(Username) != 0)
     {
-        PasswordEntry = getpwnam(Username);
+        PasswordEntry = g_UserLookupCache.GetUserByName(Username);
         if (PasswordEntry == nullptr)
         {
             FATAL_ERROR_EX(EX_NOUSER, "getpwnam({}) failed {}", Username, errno);
@@ -1009,7 +1013,7 @@ try
     }
     else if (Config.DefaultUser.has_value())
     {
-        PasswordEntry = getpwnam(Config.DefaultUser->c_str());
+        PasswordEntry = g_UserLookupCache.GetUserByName(Config.DefaultUser->c_str());
         if (PasswordEntry == nullptr)
         {
             LOG_ERROR("getpwnam({}) failed {}", Config.DefaultUser->c_str(), errno);
@@ -1018,7 +1022,7 @@ try
 
     if (PasswordEntry == nullptr)
     {
-        PasswordEntry = getpwuid(Common->DefaultUid);
+        PasswordEntry = g_UserLookupCache.GetUserById(Common->DefaultUid);
         if (PasswordEntry == nullptr)
         {
             LOG_ERROR("getpwuid({}) failed {}", Common->DefaultUid, errno);
@@ -1384,9 +1388,16 @@ Return Value:
     InteropServer InteropServer;
     int ListenSocket = -1;
     int Master = -1;
+    const bool Multiplexed = WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagMultiplexStdio);
+    wil::unique_fd MuxSocket;
+    std::vector<wil::unique_fd> MuxStreams;
+    std::thread MuxThread;
     CREATE_PROCESS_PARSED_COMMON Parsed = {nullptr};
-    std::vector<gsl::byte> PendingStdin;
     struct pollfd PollDescriptors[7];
+    int PtyOutput = -1;
+    RelayStream Relays[4];
+    int RelayInput[COUNT_OF(Relays)] = {-1, -1, -1, -1};
+    int RelayOutput[COUNT_OF(Relays)] = {-1, -1, -1, -1};
     pid_t RelayPid = -1;
     int Result;
     int SignalFd = -1;
@@ -1421,7 +1432,7 @@ Return Value:
     //      should be sent to unblock the wsl service.
     //
 
-    ListenSocket = UtilListenVsockAnyPort(&SocketAddress, Sockets.size());
+    ListenSocket = UtilListenVsockAnyPort(&SocketAddress, Multiplexed ? 1 : Sockets.size());
     if (ListenSocket < 0)
     {
         SocketAddress.svm_port = -1;
@@ -1443,6 +1454,13 @@ Return Value:
         goto CreateProcessUtilityVmEnd;
     }
 
+    //
+    // Prepare the state of the user the process runs as, so the relay and the
+    // child process inherit it.
+    //
+
+    g_UserLookupCache.Prepare(Span.subspan(offsetof(LX_INIT_CREATE_PROCESS_UTILITY_VM, Common)), Config);
+
     //
     // Create a process to relay input and output via sockets. The parent
     // returns to continue processing messages.
@@ -1475,15 +1493,45 @@ Return Value:
     //
     // Accept connections from the wsl service.
     //
+    // N.B. In multiplexed mode, a single connection carries all the streams.
+    //      Each stream is backed by a local socket pair so the rest of the
+    //      relay is the same in both modes.
+    //
 
-    for (auto& Socket : Sockets)
+    if (Multiplexed)
     {
-        Socket.reset(UtilAcceptVsock(ListenSocket, SocketAddress, SESSION_LEADER_ACCEPT_TIMEOUT_MS));
-        if (Socket.get() < 0)
+        MuxSocket.reset(UtilAcceptVsock(ListenSocket, SocketAddress, SESSION_LEADER_ACCEPT_TIMEOUT_MS));
+        if (MuxSocket.get() < 0)
         {
             Result = -1;
             goto CreateProcessUtilityVmEnd;
         }
+
+        for (auto& Socket : Sockets)
+        {
+            int Pair[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, Pair) < 0)
+            {
+                LOG_ERROR("socketpair failed {}", errno);
+                Result = -1;
+                goto CreateProcessUtilityVmEnd;
+            }
+
+            Socket.reset(Pair[0]);
+            MuxStreams.emplace_back(Pair[1]);
+        }
+    }
+    else
+    {
+        for (auto& Socket : Sockets)
+        {
+            Socket.reset(UtilAcceptVsock(ListenSocket, SocketAddress, SESSION_LEADER_ACCEPT_TIMEOUT_MS));
+            if (Socket.get() < 0)
+            {
+                Result = -1;
+                goto CreateProcessUtilityVmEnd;
+            }
+        }
     }
 
     //
@@ -1694,6 +1742,30 @@ Return Value:
         Sockets[5].reset();
     }
 
+    //
+    // Start relaying the streams over the multiplexed connection.
+    //
+    // N.B. The thread is only created after forking the child so it isn't
+    //      running while the child sets up the process.
+    //
+
+    if (Multiplexed)
+    {
+        MuxThread = std::thread([&MuxSocket, &MuxStreams]() {
+            try
+            {
+                std::vector<int> Streams;
+                for (const auto& Stream : MuxStreams)
+                {
+                    Streams.push_back(Stream.get());
+                }
+
+                wsl::shared::StdioMux(MuxSocket.get(), std::move(Streams)).Run();
+            }
+            CATCH_LOG();
+        });
+    }
+
     //
     // Add the child pid to the thread name for convenience.
     //
@@ -1764,6 +1836,40 @@ Return Value:
     PollDescriptors[6].fd = Sockets[3].get();
     PollDescriptors[6].events = POLLIN;
 
+    //
+    // Create the relay streams, indexed like the poll descriptors. Output from the PTY master
+    // goes to the stdout socket if stdout is a console, or else to the stderr socket.
+    //
+
+    RelayInput[0] = Sockets[0].get();
+    RelayOutput[0] = StdIn;
+    Relays[0] = RelayStream{RelayInput[0], RelayOutput[0], RelayStream::MaximumChunkSize, true};
+    for (Index = 1; Index < 3; Index += 1)
+    {
+        if (PollDescriptors[Index].fd >= 0)
+        {
+            RelayInput[Index] = PollDescriptors[Index].fd;
+            RelayOutput[Index] = Sockets[Index].get();
+            Relays[Index] = RelayStream{RelayInput[Index], RelayOutput[Index]};
+        }
+    }
+
+    if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdOutConsole))
+    {
+        PtyOutput = Sockets[1].get();
+    }
+    else if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdErrConsole))
+    {
+        PtyOutput = Sockets[2].get();
+    }
+
+    RelayInput[3] = Master;
+    if (Master != -1 && PtyOutput != -1)
+    {
+        RelayOutput[3] = PtyOutput;
+        Relays[3] = RelayStream{Master, PtyOutput};
+    }
+
     TerminalControlChannel = {{Sockets[3].get()}, "TerminalControl"};
 
     //
@@ -1784,43 +1890,59 @@ Return Value:
     {
         BytesWritten = 0;
 
-        Result = poll(PollDescriptors, COUNT_OF(PollDescriptors), PendingStdin.empty() ? -1 : 100);
-        if (!PendingStdin.empty())
+        //
+        // While a relay stream has data that its output didn't accept, wait for the output to be
+        // writable instead of reading more from its input.
+        //
+
+        for (Index = 0; Index < COUNT_OF(Relays); Index += 1)
         {
-            BytesWritten = write(StdIn, PendingStdin.data(), PendingStdin.size());
-            if (BytesWritten < 0)
+            if (PollDescriptors[Index].fd != -1)
             {
-                if (errno != EAGAIN && errno != EWOULDBLOCK)
-                {
-                    LOG_ERROR("delayed stdin write failed {}, ChildPid={}", errno, ChildPid);
-                }
-            }
-            else if (BytesWritten <= PendingStdin.size()) // Partial or complete write
-            {
-                PendingStdin.erase(PendingStdin.begin(), PendingStdin.begin() + BytesWritten);
-            }
-            else
-            {
-                LOG_ERROR("Unexpected write result {}, pending={}", BytesWritten, PendingStdin.size());
+                const bool Pending = Relays[Index].Pending() != 0;
+                PollDescriptors[Index].fd = Pending ? RelayOutput[Index] : RelayInput[Index];
+                PollDescriptors[Index].events = Pending ? POLLOUT : POLLIN;
             }
         }
 
+        Result = poll(PollDescriptors, COUNT_OF(PollDescriptors), -1);
         if (Result < 0)
         {
             LOG_ERROR("poll failed {}", errno);
             break;
         }
 
+        for (Index = 0; Index < COUNT_OF(Relays); Index += 1)
+        {
+            if ((PollDescriptors[Index].events & POLLOUT) && (PollDescriptors[Index].revents != 0))
+            {
+                const auto Pending = Relays[Index].Pending();
+                if (Relays[Index].Flush() < 0)
+                {
+                    LOG_ERROR("delayed write failed {}, index={}, ChildPid={}", errno, Index, ChildPid);
+                    PollDescriptors[Index].fd = -1;
+                }
+                else
+                {
+                    BytesWritten += Pending - Relays[Index].Pending();
+                }
+            }
+        }
+
         //
         // Relay input from the stdin socket to the stdin file descriptor.
         //
+        // N.B. Data that can't be written to stdin right away stays pending in the relay stream,
+        //      since blocking on the write could lead to a deadlock if the child process is
+        //      blocked writing to stdout / stderr while the relay tries to write stdin.
+        //
 
-        if (PollDescriptors[0].revents & (POLLIN | POLLHUP | POLLERR) && PendingStdin.empty())
+        if ((PollDescriptors[0].events & POLLIN) && (PollDescriptors[0].revents & (POLLIN | POLLHUP | POLLERR)))
         {
-            BytesRead = UtilReadBuffer(Sockets[0].get(), Buffer);
-            if (BytesRead < 0)
+            BytesRead = Relays[0].Transfer();
+            if (BytesRead < 0 && errno != EAGAIN)
             {
-                LOG_ERROR("read failed {}", errno);
+                LOG_ERROR("stdin relay failed {}", errno);
                 break;
             }
 
@@ -1847,33 +1969,9 @@ Return Value:
                     PollDescriptors[3].fd = -1;
                 }
             }
-            else
+            else if (BytesRead > 0)
             {
-                BytesWritten = write(StdIn, Buffer.data(), BytesRead);
-                if (BytesWritten < 0)
-                {
-                    //
-                    // If writing on stdin's pipe would block, mark the write as pending and continue.
-                    // This is required blocking on the write() could lead to a deadlock if the child process
-                    // is blocking trying to write on stderr / stdout while the relay tries to write stdin.
-                    //
-
-                    if (errno == EWOULDBLOCK || errno == EAGAIN)
-                    {
-                        assert(PendingStdin.empty());
-                        PendingStdin.assign(Buffer.begin(), Buffer.begin() + BytesRead);
-                    }
-                    else
-                    {
-                        LOG_ERROR("write failed {}", errno);
-                        break;
-                    }
-                }
-                else if (BytesWritten < BytesRead)
-                {
-                    assert(PendingStdin.empty());
-                    PendingStdin.assign(Buffer.begin() + BytesWritten, Buffer.begin() + BytesRead);
-                }
+                BytesWritten = BytesRead - Relays[0].Pending();
             }
         }
 
@@ -1883,29 +1981,30 @@ Return Value:
 
         for (Index = 1; Index < 3; Index += 1)
         {
-            if (PollDescriptors[Index].revents & (POLLIN | POLLHUP | POLLERR))
+            if ((PollDescriptors[Index].events & POLLIN) && (PollDescriptors[Index].revents & (POLLIN | POLLHUP | POLLERR)))
             {
-                BytesRead = UtilReadBuffer(PollDescriptors[Index].fd, Buffer);
-                if (BytesRead <= 0)
+                BytesRead = Relays[Index].Transfer();
+                if (BytesRead < 0 && errno == EAGAIN)
                 {
-                    if (BytesRead < 0)
-                    {
-                        LOG_ERROR("read failed {} {}", BytesRead, errno);
-                    }
-
-                    PollDescriptors[Index].fd = -1;
-                    UtilSocketShutdown(Sockets[Index].get(), SHUT_WR);
                     continue;
                 }
 
-                BytesWritten = UtilWriteBuffer(Sockets[Index].get(), Buffer.data(), BytesRead);
-                if (BytesWritten < 0)
+                if (BytesRead <= 0)
                 {
-                    if (errno == EPIPE)
+                    const int Error = BytesRead < 0 ? errno : 0;
+                    if (Error != 0 && Error != EPIPE)
                     {
-                        CLOSE(PollDescriptors[Index].fd);
-                        PollDescriptors[Index].fd = -1;
+                        LOG_ERROR("relay failed {}, index={}, ChildPid={}, fd={}", Error, Index, ChildPid, Sockets[Index].get());
+                    }
 
+                    //
+                    // If the socket was closed by the other end, close the pipe so the child
+                    // process sees EPIPE on its next write.
+                    //
+
+                    PollDescriptors[Index].fd = -1;
+                    if (Error == EPIPE)
+                    {
                         if (Index == 1)
                         {
                             StdOutPipe.read().reset();
@@ -1917,9 +2016,13 @@ Return Value:
                     }
                     else
                     {
-                        LOG_ERROR("write failed {}, index={}, ChildPid={}, fd={}", errno, Index, ChildPid, Sockets[Index].get());
+                        UtilSocketShutdown(Sockets[Index].get(), SHUT_WR);
                     }
+
+                    continue;
                 }
+
+                BytesWritten = BytesRead;
             }
         }
 
@@ -1927,9 +2030,20 @@ Return Value:
         // Relay output from the PTY master to the stdout or stderr socket.
         //
 
-        if (PollDescriptors[3].revents & (POLLIN | POLLHUP | POLLERR))
+        if ((PollDescriptors[3].events & POLLIN) && (PollDescriptors[3].revents & (POLLIN | POLLHUP | POLLERR)))
         {
-            BytesRead = UtilReadBuffer(Master, Buffer);
+            if (PtyOutput != -1)
+            {
+                BytesRead = Relays[3].Transfer();
+            }
+            else
+            {
+                BytesRead = UtilReadBuffer(Master, Buffer);
+                if (BytesRead > 0)
+                {
+                    LOG_ERROR("Unexpected output from PTY master");
+                }
+            }
 
             //
             // N.B. The pty will fail with EIO on read on hangup instead of
@@ -1951,30 +2065,16 @@ Return Value:
             }
             else if (BytesRead < 0)
             {
-                LOG_ERROR("read failed {} {}", BytesRead, errno);
-                break;
-            }
-            else
-            {
-                if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdOutConsole))
-                {
-                    BytesWritten = UtilWriteBuffer(Sockets[1].get(), Buffer.data(), BytesRead);
-                }
-                else if (WI_IsFlagSet(CreateProcess.Common.Flags, LxInitCreateProcessFlagsStdErrConsole))
-                {
-                    BytesWritten = UtilWriteBuffer(Sockets[2].get(), Buffer.data(), BytesRead);
-                }
-                else
-                {
-                    LOG_ERROR("Unexpected output from PTY master");
-                }
-
-                if (BytesWritten < 0)
+                if (errno != EAGAIN)
                 {
-                    LOG_ERROR("write failed {}", errno);
+                    LOG_ERROR("pty relay failed {}", errno);
                     break;
                 }
             }
+            else if (PtyOutput != -1)
+            {
+                BytesWritten = BytesRead;
+            }
         }
 
         //
@@ -2127,6 +2227,11 @@ Return Value:
         }
     }
 
+    Relays[0].LogStatistics("stdin");
+    Relays[1].LogStatistics("stdout");
+    Relays[2].LogStatistics("stderr");
+    Relays[3].LogStatistics("pty");
+
     //
     // Cleanly shut down the sockets.
     //
@@ -2173,6 +2278,17 @@ CreateProcessUtilityVmEnd:
 
     InteropServer.Reset();
 
+    //
+    // Close the relay's end of the streams and wait for the multiplexer to
+    // flush them.
+    //
+
+    if (MuxThread.joinable())
+    {
+        Sockets.clear();
+        MuxThread.join();
+    }
+
     //
     // The relay process should always exit.
     //
@@ -2260,6 +2376,17 @@ Return Value:
 {
     UtilSetThreadName("init-distro");
 
+    //
+    // Record the distro startup in the boot timeline if mini_init is recording one.
+    //
+
+    const auto* BootTimelineFd = getenv(LX_WSL2_BOOT_TRACE_FD_ENV);
+    if (BootTimelineFd != nullptr)
+    {
+        BootTimeline::Attach(BootTimelineFd);
+        unsetenv(LX_WSL2_BOOT_TRACE_FD_ENV);
+    }
+
     //
     // Set the close-on-exec flag on the socket file descriptor inherited from mini_init.
     //
@@ -3359,7 +3486,10 @@ unsigned int StartPlan9(int Argc, char** Argv)
 {
     constexpr auto* Usage = "Usage: plan9 " LX_INIT_PLAN9_CONTROL_SOCKET_ARG " fd " LX_INIT_PLAN9_SOCKET_PATH_ARG
                             " path " LX_INIT_PLAN9_SERVER_FD_ARG " fd " LX_INIT_PLAN9_LOG_FILE_ARG
-                            " log-file " LX_INIT_PLAN9_LOG_LEVEL_ARG " level " LX_INIT_PLAN9_PIPE_FD_ARG " fd [--log-truncate]\n";
+                            " log-file " LX_INIT_PLAN9_LOG_LEVEL_ARG " level " LX_INIT_PLAN9_PIPE_FD_ARG " fd [--log-truncate]"
+                            " [" LX_INIT_PLAN9_NO_FAIR_QUEUE_ARG
+                            "] [" LX_INIT_PLAN9_IO_BUDGET_ARG " bytes] [" LX_INIT_PLAN9_READDIR_CACHE_ARG
+                            "] [" LX_INIT_PLAN9_NO_STREAMING_READS_ARG "] [" LX_INIT_PLAN9_STREAMING_THRESHOLD_ARG " bytes]\n";
 
     bool LogTruncate = false;
     int LogLevel = TRACE_LEVEL_INFORMATION;
@@ -3368,6 +3498,9 @@ unsigned int StartPlan9(int Argc, char** Argv)
     const char* LogFile{};
     wil::unique_fd ControlSocket;
     wil::unique_fd ServerFd;
+    bool NoFairQueue = false;
+    bool NoStreamingReads = false;
+    p9fs::FileSystemOptions Options{};
 
     ArgumentParser parser(Argc, Argv);
     parser.AddArgument(UniqueFd{ControlSocket}, LX_INIT_PLAN9_CONTROL_SOCKET_ARG);
@@ -3377,6 +3510,11 @@ unsigned int StartPlan9(int Argc, char** Argv)
     parser.AddArgument(Integer{LogLevel}, LX_INIT_PLAN9_LOG_LEVEL_ARG);
     parser.AddArgument(UniqueFd{PipeFd}, LX_INIT_PLAN9_PIPE_FD_ARG);
     parser.AddArgument(LogTruncate, LX_INIT_PLAN9_TRUNCATE_LOG_ARG);
+    parser.AddArgument(NoFairQueue, LX_INIT_PLAN9_NO_FAIR_QUEUE_ARG);
+    parser.AddArgument(Integer{Options.IoBudget}, LX_INIT_PLAN9_IO_BUDGET_ARG);
+    parser.AddArgument(Options.ReadDirCache, LX_INIT_PLAN9_READDIR_CACHE_ARG);
+    parser.AddArgument(NoStreamingReads, LX_INIT_PLAN9_NO_STREAMING_READS_ARG);
+    parser.AddArgument(Integer{Options.StreamingThreshold}, LX_INIT_PLAN9_STREAMING_THRESHOLD_ARG);
 
     try
     {
@@ -3388,7 +3526,9 @@ unsigned int StartPlan9(int Argc, char** Argv)
         return 1;
     }
 
-    RunPlan9Server(SocketPath, LogFile, LogLevel, LogTruncate, ControlSocket.get(), ServerFd.get(), PipeFd);
+    Options.FairQueue = !NoFairQueue;
+    Options.StreamingReads = !NoStreamingReads;
+    RunPlan9Server(SocketPath, LogFile, LogLevel, LogTruncate, ControlSocket.get(), ServerFd.get(), PipeFd, Options);
 
     return 0;
 }
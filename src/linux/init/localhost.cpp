@@ -18,6 +18,7 @@
 #include <linux/if_tun.h>
 
 #include "util.h"
+#include "RelayStream.h"
 #include "SocketChannel.h"
 #include "GnsPortTracker.h"
 #include "SecCompDispatcher.h"
@@ -305,41 +306,67 @@ void RunLocalHostRelay(sockaddr_vm hvSocketAddress, int listenSocket)
                     return;
                 }
 
-                // Resize the buffer to be the requested size.
-                buffer.resize(message->BufferSize);
-
-                // Begin relaying data.
+                // Begin relaying data, moving at most the requested buffer size at once.
+                int inFd[2] = {relaySocket.get(), tcpSocket.get()};
                 int outFd[2] = {tcpSocket.get(), relaySocket.get()};
-                pollfd pollDescriptors[] = {{relaySocket.get(), POLLIN}, {tcpSocket.get(), POLLIN}};
+                pollfd pollDescriptors[2]{};
+                RelayStream relays[] = {
+                    RelayStream{inFd[0], outFd[0], message->BufferSize}, RelayStream{inFd[1], outFd[1], message->BufferSize}};
+
+                auto logStatistics = wil::scope_exit([&]() {
+                    relays[0].LogStatistics("localhost relay (inbound)");
+                    relays[1].LogStatistics("localhost relay (outbound)");
+                });
 
                 for (;;)
                 {
-                    if ((pollDescriptors[0].fd == -1) || (pollDescriptors[1].fd == -1))
+                    // While a direction has data that its output didn't accept, wait for the output to be
+                    // writable instead of reading more, so a slow peer doesn't stall the other direction.
+                    for (int Index = 0; Index < COUNT_OF(pollDescriptors); Index += 1)
                     {
-                        return;
+                        if (relays[Index].Pending() != 0)
+                        {
+                            pollDescriptors[Index] = {outFd[Index], POLLOUT};
+                        }
+                        else
+                        {
+                            pollDescriptors[Index] = {inFd[Index], POLLIN};
+                        }
                     }
 
                     THROW_LAST_ERROR_IF(poll(pollDescriptors, COUNT_OF(pollDescriptors), -1) < 0);
 
-                    bytesRead = 0;
                     for (int Index = 0; Index < COUNT_OF(pollDescriptors); Index += 1)
                     {
-                        if (pollDescriptors[Index].revents & POLLIN)
+                        if (pollDescriptors[Index].revents == 0)
                         {
-                            bytesRead = UtilReadBuffer(pollDescriptors[Index].fd, buffer);
-                            if (bytesRead == 0)
-                            {
-                                pollDescriptors[Index].fd = -1;
-                                shutdown(outFd[Index], SHUT_WR);
-                            }
-                            else if (bytesRead < 0)
-                            {
-                                return;
-                            }
-                            else if (UtilWriteBuffer(outFd[Index], buffer.data(), bytesRead) < 0)
+                            continue;
+                        }
+
+                        if (pollDescriptors[Index].events & POLLOUT)
+                        {
+                            if (relays[Index].Flush() < 0)
                             {
                                 return;
                             }
+
+                            continue;
+                        }
+
+                        bytesRead = relays[Index].Transfer();
+                        if (bytesRead < 0 && errno == EAGAIN)
+                        {
+                            continue;
+                        }
+
+                        if (bytesRead == 0)
+                        {
+                            shutdown(outFd[Index], SHUT_WR);
+                            return;
+                        }
+                        else if (bytesRead < 0)
+                        {
+                            return;
                         }
                     }
                 }
@@ -16,6 +16,7 @@ Abstract:
 #include <sys/signalfd.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/swap.h>
 #include <sys/sysinfo.h>
 #include <sys/sysmacros.h>
 #include <sys/reboot.h>
@@ -63,6 +64,15 @@ Abstract:
 #include "binfmt.h"
 #include "address.h"
 #include "SocketChannel.h"
+#include "KernelModules.h"
+#include "BootTimeline.h"
+#include "TaskGraph.h"
+#include "BlockDeviceMonitor.h"
+#include "FilesystemProbe.h"
+#include "CompressedSwap.h"
+#include "IncrementalExport.h"
+#include "RelayStream.h"
+#include "StreamDigest.h"
 
 #define BSDTAR_PATH "/usr/bin/bsdtar"
 #define BINFMT_REGISTER_STRING BINFMT_INTEROP_REGISTRATION_STRING_VM(LX_INIT_BINFMT_NAME) "\n"
@@ -85,7 +95,6 @@ Abstract:
 #define KERNEL_MODULES_PATH "/lib/modules"
 #define KERNEL_MODULES_VHD_PATH "/modules"
 #define KERNEL_MODULES_OVERLAY "/modules_overlay"
-#define MODPROBE_PATH "/sbin/modprobe"
 #define PROCFS_PATH "/proc"
 #define RESOLV_CONF_FILE "resolv.conf"
 #define RESOLV_CONF_PATH ETC_PATH "/" RESOLV_CONF_FILE
@@ -105,6 +114,7 @@ constexpr auto c_trueString = "1";
 constexpr size_t c_systemReservedMemory = 32 * 1024 * 1024; // 32MiB reserved for WSL system processes
 constexpr long c_cpuPeriodMicros = 100000;
 constexpr long c_systemReservedCpuMicros = 1000; // 0.01 Logical core reserved for WSL system processes
+constexpr size_t c_zstdFrameSize = 32 * 1024 * 1024; // Uncompressed size of each independent zstd frame
 
 struct VmConfiguration
 {
@@ -114,11 +124,15 @@ struct VmConfiguration
     bool EnableSafeMode = false;
     bool EnableSystemDistro = false;
     bool EnableCrashDumpCollection = false;
+    bool SerialBoot = false;
     std::string KernelModulesPath;
     LX_MINI_INIT_NETWORKING_MODE NetworkingMode = LxMiniInitNetworkingModeNone;
+    int NotifyFd = -1;
+    std::optional<std::chrono::seconds> ColdPageAge;
 };
 
 int g_LogFd = STDERR_FILENO;
+std::mutex g_NotifyLock;
 int g_TelemetryFd = -1;
 std::optional<bool> g_EnableSocketLogging;
 
@@ -134,7 +148,13 @@ int EjectScsi(unsigned int Lun);
 
 int EnableInterface(int Socket, const char* Name);
 
-int ExportToSocket(const char* Source, int Socket, int ErrorSocket, unsigned int flags);
+int ExportToSocket(
+    const char* Source,
+    int Socket,
+    int ErrorSocket,
+    unsigned int Flags,
+    std::string& Digest,
+    std::unique_ptr<IncrementalExport>& Delta);
 
 int FormatDevice(unsigned int Lun);
 
@@ -146,7 +166,11 @@ int GetDiskPartitionIndex(const char* DiskPath, const char* PartitionName);
 
 std::string GetMountTarget(const char* Name);
 
-int ImportFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags);
+std::string GetZstdOptions();
+
+int ImportDeltaFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags, std::string& Digest);
+
+int ImportFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags, std::string& Digest);
 
 int Initialize(const char* Hostname);
 
@@ -195,6 +219,8 @@ int ProcessMessage(wsl::shared::Transaction& Transaction, LX_MESSAGE_TYPE Type,
 
 wil::unique_fd RegisterSeccompHook();
 
+int RelayArchive(int InputFd, int OutputFd, StreamDigest& Digest);
+
 int ReportMountStatus(wsl::shared::SocketChannel& Channel, int Result, LX_MINI_MOUNT_STEP Step);
 
 int SendCapabilities(wsl::shared::SocketChannel& Channel);
@@ -322,7 +348,7 @@ Return Value:
 
 {
     //
-    // Create the swap file asynchronously using the mkswap and swapon utilities in the system distro.
+    // Create the swap file asynchronously.
     //
     // N.B. This is done because creating the swap file can take some time and
     //      the swap file does not need to be available immediately.
@@ -333,11 +359,11 @@ Return Value:
 
         WaitForBlockDevice(DevicePath.c_str());
 
-        std::string CommandLine = std::format("/usr/sbin/mkswap '{}'", DevicePath);
-        THROW_LAST_ERROR_IF(UtilExecCommandLine(CommandLine.c_str(), nullptr) < 0);
-
-        CommandLine = std::format("/usr/sbin/swapon '{}'", DevicePath);
-        UtilExecCommandLine(CommandLine.c_str(), nullptr);
+        CreateSwapArea(DevicePath.c_str());
+        if (swapon(DevicePath.c_str(), 0) < 0)
+        {
+            LOG_ERROR("swapon({}) failed {}", DevicePath, errno);
+        }
     });
 }
 
@@ -510,15 +536,32 @@ try
     // Wait for the block device to be available.
     //
 
-    wsl::shared::retry::RetryWithTimeout<void>(
-        [&]() { THROW_LAST_ERROR_IF(!wil::unique_fd{open(BlockDevice, O_RDONLY)}); },
-        c_defaultRetryPeriod,
+    auto Device = BlockDeviceMonitor::Current()->RetryWithTimeout<wil::unique_fd>(
+        [&]() {
+            wil::unique_fd Device{open(BlockDevice, O_RDONLY | O_CLOEXEC)};
+            THROW_LAST_ERROR_IF(!Device);
+            return Device;
+        },
         c_defaultRetryTimeout,
         []() {
             auto err = wil::ResultFromCaughtException();
             return err == ENOENT || err == ENXIO;
         });
 
+    //
+    // Read the superblock directly for the common file systems, and only run blkid if the result
+    // isn't certain.
+    //
+
+    auto Detected = ProbeFilesystem(Device.get());
+    Device.reset();
+    if (Detected.has_value())
+    {
+        Output = std::move(Detected.value());
+        LOG_INFO("Detected {} filesystem from superblock for device: {}", Output, BlockDevice);
+        return 0;
+    }
+
     auto CommandLine = std::format("/usr/sbin/blkid '{}' -p -s TYPE -o value -u filesystem", BlockDevice);
     if (UtilExecCommandLine(CommandLine.c_str(), &Output) < 0)
     {
@@ -627,7 +670,13 @@ Return Value:
     return 0;
 }
 
-int ExportToSocket(const char* Source, int Socket, int ErrorSocket, unsigned int Flags)
+int ExportToSocket(
+    const char* Source,
+    int Socket,
+    int ErrorSocket,
+    unsigned int Flags,
+    std::string& Digest,
+    std::unique_ptr<IncrementalExport>& Delta)
 
 /*++
 
@@ -636,6 +685,14 @@ Routine Description:
     This routine uses bsdtar to export a source directory in tar format via a
     socket.
 
+    For incremental exports, only the paths that changed since the previous
+    incremental export are archived. The caller saves the manifest once the
+    host confirmed that it stored the archive.
+
+    If requested, the archive is relayed to the socket through a pipe so its
+    SHA-256 digest can be computed as it's written, unless the kernel can't
+    compute it.
+
 Arguments:
 
     Source - Supplies the path to export.
@@ -644,22 +701,54 @@ Arguments:
 
     Flags - Additional compression flags.
 
+    Digest - Receives the SHA-256 digest of the archive, if requested and
+        available.
+
+    Delta - Receives the state of the incremental export, if requested.
+
 Return Value:
 
     0 on success, -1 on failure.
 
 --*/
 
+try
 {
+    std::string PathList;
+    if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportIncremental))
+    {
+        Delta = std::make_unique<IncrementalExport>(Source);
+        PathList = Delta->PathList();
+    }
+
+    std::unique_ptr<StreamDigest> ArchiveDigest;
+    if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagDigest))
+    {
+        ArchiveDigest = StreamDigest::Create();
+    }
+
+    wil::unique_fd PipeRead;
+    wil::unique_fd PipeWrite;
+    if (ArchiveDigest)
+    {
+        int Pipe[2];
+        THROW_LAST_ERROR_IF(pipe2(Pipe, O_CLOEXEC) < 0);
+        PipeRead.reset(Pipe[0]);
+        PipeWrite.reset(Pipe[1]);
+    }
+
     //
-    // Create a child process running bsdtar with the socket set to stdout.
+    // Create a child process running bsdtar with the pipe or the socket set to stdout.
     //
 
-    int ChildPid = UtilCreateChildProcess("ExportDistro", [Source, TarFd = Socket, ErrorSocket = ErrorSocket, Flags = Flags]() {
+    const int TarFd = ArchiveDigest ? PipeWrite.get() : Socket;
+    int ChildPid = UtilCreateChildProcess("ExportDistro", [Source, TarFd, ErrorSocket = ErrorSocket, Flags = Flags, &PathList]() {
+        THROW_LAST_ERROR_IF(signal(SIGPIPE, SIG_DFL) == SIG_ERR);
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(TarFd, STDOUT_FILENO)) < 0);
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(ErrorSocket, STDERR_FILENO)) < 0);
 
         std::string compressionArguments;
+        std::string zstdOptions;
 
         if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressGzip))
         {
@@ -674,6 +763,10 @@ Return Value:
         else
         {
             compressionArguments = "-c";
+            if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd))
+            {
+                zstdOptions = GetZstdOptions();
+            }
         }
 
         if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagVerbose))
@@ -699,6 +792,22 @@ Return Value:
             arguments.emplace(arguments.begin() + 3, "--totals");
         }
 
+        if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagExportCompressZstd))
+        {
+            if (!zstdOptions.empty())
+            {
+                arguments.insert(arguments.begin() + 4, {"--options", zstdOptions.c_str()});
+            }
+
+            arguments.emplace(arguments.begin() + 4, "--zstd");
+        }
+
+        if (!PathList.empty())
+        {
+            arguments.erase(arguments.end() - 2);
+            arguments.insert(arguments.begin() + 4, {"-n", "--null", "-T", PathList.c_str()});
+        }
+
         execv(BSDTAR_PATH, const_cast<char**>(arguments.data()));
         LOG_ERROR("execl failed, {}", errno);
     });
@@ -708,18 +817,47 @@ Return Value:
         return -1;
     }
 
+    //
+    // Relay the archive to the socket. If the relay fails, closing the pipe
+    // makes bsdtar fail as well.
+    //
+
+    int RelayResult = 0;
+    if (ArchiveDigest)
+    {
+        PipeWrite.reset();
+        RelayResult = RelayArchive(PipeRead.get(), Socket, *ArchiveDigest);
+        if (RelayResult < 0)
+        {
+            LOG_ERROR("Failed to relay archive, {}", errno);
+        }
+
+        PipeRead.reset();
+    }
+
     //
     // Wait for the child to exit and shut down the socket.
     //
 
-    const int Result = WaitForChild(ChildPid, BSDTAR_PATH);
+    int Result = WaitForChild(ChildPid, BSDTAR_PATH);
     if (shutdown(Socket, SHUT_WR) < 0)
     {
         LOG_ERROR("shutdown failed {}", errno);
     }
 
+    if (Result == 0 && RelayResult < 0)
+    {
+        Result = -1;
+    }
+
+    if (Result == 0 && ArchiveDigest)
+    {
+        Digest = ArchiveDigest->Finish().value_or("");
+    }
+
     return Result;
 }
+CATCH_RETURN_ERRNO()
 
 int FormatDevice(unsigned int Lun)
 
@@ -782,12 +920,23 @@ Return Value:
     //
     // N.B. A retry loop is needed because there is a delay between when the vhd
     //      is hot-added from the host, and when the sysfs directory is
-    //      available in the guest.
+    //      available in the guest. The device is looked up in the disks reported
+    //      by uevents first; sysfs is read if the disk was added before the
+    //      monitor was created.
     //
 
     std::string Path = std::format("{}{}/block", SCSI_DEVICE_PREFIX, Lun);
-    return wsl::shared::retry::RetryWithTimeout<std::string>(
+    const auto Address = std::format("{}{}", SCSI_DEVICE_NAME_PREFIX, Lun);
+    auto Monitor = BlockDeviceMonitor::Current();
+    return Monitor->RetryWithTimeout<std::string>(
         [&]() {
+            auto Disk = Monitor->FindDisk(Address);
+            if (Disk.has_value() && access(std::format("{}/{}", Path, Disk.value()).c_str(), F_OK) == 0)
+            {
+                LOG_INFO("Found disk {} at SCSI address {} from uevent", Disk.value(), Address);
+                return std::move(Disk.value());
+            }
+
             wil::unique_dir Dir{opendir(Path.c_str())};
             THROW_LAST_ERROR_IF(!Dir);
 
@@ -806,7 +955,6 @@ Return Value:
 
             THROW_ERRNO(ENXIO);
         },
-        c_defaultRetryPeriod,
         c_defaultRetryTimeout);
 }
 
@@ -877,7 +1025,66 @@ try
 }
 CATCH_RETURN_ERRNO()
 
-int ImportFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags)
+std::string GetZstdOptions()
+
+/*++
+
+Routine Description:
+
+    This routine returns the bsdtar options for zstd compression, depending on what the libarchive
+    version that bsdtar uses supports.
+
+    Compression uses a worker thread per processor, and the output is split in frames of bounded
+    size that can be decompressed independently, so readers can decompress it in parallel.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    The value of the --options argument, or an empty string if no option is supported.
+
+--*/
+
+try
+{
+    //
+    // The output looks like: "bsdtar 3.7.7 - libarchive 3.7.7 zlib/1.3.1 liblzma/5.6.2 libzstd/1.5.6".
+    //
+
+    std::string Output;
+    THROW_LAST_ERROR_IF(UtilExecCommandLine(BSDTAR_PATH " --version", &Output) < 0);
+
+    const auto Position = Output.find("libarchive ");
+    unsigned int Major{};
+    unsigned int Minor{};
+    unsigned int Patch{};
+    THROW_ERRNO_IF(
+        EINVAL,
+        Position == std::string::npos || sscanf(Output.c_str() + Position, "libarchive %u.%u.%u", &Major, &Minor, &Patch) != 3);
+
+    const auto Version = std::make_tuple(Major, Minor, Patch);
+    std::string Options;
+    if (Version >= std::make_tuple(3u, 6u, 0u))
+    {
+        Options = std::format("zstd:threads={}", get_nprocs());
+    }
+
+    if (Version >= std::make_tuple(3u, 7u, 5u))
+    {
+        Options += std::format(",zstd:max-frame-in={}", c_zstdFrameSize);
+    }
+
+    return Options;
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return {};
+}
+
+int ImportFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags, std::string& Digest)
 
 /*++
 
@@ -885,6 +1092,10 @@ Routine Description:
 
     This routine uses bsdtar to extract a tar file via a socket.
 
+    If requested, the archive is relayed from the socket through a pipe so its
+    SHA-256 digest can be computed as it's read, unless the kernel can't
+    compute it.
+
 Arguments:
 
     Destination - Supplies the path to extract the tar.
@@ -893,18 +1104,40 @@ Arguments:
 
     Flags - Import flags.
 
+    Digest - Receives the SHA-256 digest of the archive, if requested and
+        available.
+
 Return Value:
 
     0 on success, -1 on failure.
 
 --*/
 
+try
 {
+    std::unique_ptr<StreamDigest> ArchiveDigest;
+    if (WI_IsFlagSet(Flags, LxMiniInitMessageFlagDigest))
+    {
+        ArchiveDigest = StreamDigest::Create();
+    }
+
+    wil::unique_fd PipeRead;
+    wil::unique_fd PipeWrite;
+    if (ArchiveDigest)
+    {
+        int Pipe[2];
+        THROW_LAST_ERROR_IF(pipe2(Pipe, O_CLOEXEC) < 0);
+        PipeRead.reset(Pipe[0]);
+        PipeWrite.reset(Pipe[1]);
+    }
+
     //
-    // Create a child process running bsdtar with the socket set to stdin.
+    // Create a child process running bsdtar with the pipe or the socket set to stdin.
     //
 
-    int ChildPid = UtilCreateChildProcess("ImportDistro", [Destination, TarFd = Socket, ErrorSocket = ErrorSocket, Flags]() {
+    const int TarFd = ArchiveDigest ? PipeRead.get() : Socket;
+    int ChildPid = UtilCreateChildProcess("ImportDistro", [Destination, TarFd, ErrorSocket = ErrorSocket, Flags]() {
+        THROW_LAST_ERROR_IF(signal(SIGPIPE, SIG_DFL) == SIG_ERR);
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(TarFd, STDIN_FILENO)) < 0);
         THROW_LAST_ERROR_IF(TEMP_FAILURE_RETRY(dup2(ErrorSocket, STDERR_FILENO)) < 0);
 
@@ -928,8 +1161,105 @@ Return Value:
         return -1;
     }
 
-    return WaitForChild(ChildPid, BSDTAR_PATH);
+    //
+    // Relay the archive to bsdtar. bsdtar can exit before reading the end of
+    // the stream, for example the padding after the end of the archive, so the
+    // rest of the stream is hashed once it succeeds.
+    //
+
+    int RelayResult = 0;
+    bool Drain = false;
+    if (ArchiveDigest)
+    {
+        PipeRead.reset();
+        RelayResult = RelayArchive(Socket, PipeWrite.get(), *ArchiveDigest);
+        if (RelayResult < 0)
+        {
+            Drain = (errno == EPIPE);
+            if (!Drain)
+            {
+                LOG_ERROR("Failed to relay archive, {}", errno);
+            }
+        }
+
+        PipeWrite.reset();
+    }
+
+    int Result = WaitForChild(ChildPid, BSDTAR_PATH);
+    if (Result == 0 && RelayResult < 0 && !Drain)
+    {
+        Result = -1;
+    }
+
+    if (Result == 0 && ArchiveDigest)
+    {
+        if (Drain)
+        {
+            wil::unique_fd Null{open("/dev/null", O_WRONLY | O_CLOEXEC)};
+            THROW_LAST_ERROR_IF(!Null);
+            THROW_LAST_ERROR_IF(RelayArchive(Socket, Null.get(), *ArchiveDigest) < 0);
+        }
+
+        Digest = ArchiveDigest->Finish().value_or("");
+    }
+
+    return Result;
 }
+CATCH_RETURN_ERRNO()
+
+int ImportDeltaFromSocket(const char* Destination, int Socket, int ErrorSocket, unsigned int Flags, std::string& Digest)
+
+/*++
+
+Routine Description:
+
+    This routine applies a layer of an incremental export to a distribution.
+    The layer is extracted to a staging directory in the distribution, and
+    then merged into it.
+
+Arguments:
+
+    Destination - Supplies the path of the distribution.
+
+    Socket - Supplies the socket to read from.
+
+    ErrorSocket - Supplies the socket to write errors to.
+
+    Flags - Import flags.
+
+    Digest - Receives the SHA-256 digest of the archive, if available.
+
+Return Value:
+
+    0 on success, -1 on failure.
+
+--*/
+
+try
+{
+    //
+    // Remove the staging directory of an interrupted import, if any.
+    //
+
+    const auto Staging = std::format("{}/{}", Destination, EXPORT_DELTA_STAGING_PATH);
+    auto RemoveStaging = [&Staging]() {
+        std::error_code Error;
+        std::filesystem::remove_all(Staging, Error);
+    };
+
+    RemoveStaging();
+    THROW_LAST_ERROR_IF(mkdir(Staging.c_str(), 0700) < 0);
+    auto Cleanup = wil::scope_exit([&]() { RemoveStaging(); });
+
+    if (ImportFromSocket(Staging.c_str(), Socket, ErrorSocket, Flags, Digest) != 0)
+    {
+        return -1;
+    }
+
+    ApplyExportDelta(Destination, ErrorSocket);
+    return 0;
+}
+CATCH_RETURN_ERRNO()
 
 void StartDebugShell()
 
@@ -994,6 +1324,8 @@ Return Value:
 --*/
 
 {
+    BootTimeline::Span Span{"StartDhcpClient"};
+
     int ChildPid = UtilCreateChildProcess("dhcpcd", [DhcpTimeout]() {
         //
         // Write the dhcpcd.conf config file.
@@ -1042,6 +1374,8 @@ Return Value:
 --*/
 
 {
+    BootTimeline::Span Span{"StartGuestNetworkService"};
+
     const auto ChildPid =
         UtilCreateChildProcess("GuestNetworkService", [GnsFd, DnsTunnelingFd = std::move(DnsTunnelingFd), DnsTunnelingIpAddress]() {
             std::string GnsSocketArg = std::to_string(GnsFd);
@@ -1191,6 +1525,8 @@ Return Value:
 --*/
 
 {
+    BootTimeline::Span Span{"Initialize"};
+
     //
     // Allow unprivileged users to view the kernel log.
     //
@@ -1586,6 +1922,17 @@ try
         AddEnvironmentVariable(LX_WSL2_SAFE_MODE, c_trueString);
     }
 
+    //
+    // If the boot timeline is being recorded, pass it to the distro init so its
+    // startup is recorded as well.
+    //
+
+    const int BootTimelineFd = BootTimeline::Duplicate();
+    if (BootTimelineFd >= 0)
+    {
+        AddEnvironmentVariable(LX_WSL2_BOOT_TRACE_FD_ENV, std::to_string(BootTimelineFd).c_str());
+    }
+
     //
     // If GPU support is enabled, move the GPU share mounts to temporary
     // mount points inside the distro. These will be moved by the distro init
@@ -1838,6 +2185,8 @@ Return Value:
 
 try
 {
+    BootTimeline::Span Span{"MountDevice"};
+
     //
     // Build the /dev path of the device.
     //
@@ -1969,6 +2318,8 @@ Return Value:
 --*/
 
 {
+    BootTimeline::Span Span{"MountSystemDistro"};
+
     //
     // Mount the system distro device as read-only.
     //
@@ -2043,7 +2394,7 @@ Return Value:
 {
     std::string DevicePath = std::format("/sys/block/{}", DeviceName);
 
-    return wsl::shared::retry::RetryWithTimeout<std::map<unsigned long, std::string>>(
+    return BlockDeviceMonitor::Current()->RetryWithTimeout<std::map<unsigned long, std::string>>(
         [&]() {
             wil::unique_dir Dir{opendir(DevicePath.c_str())};
             THROW_LAST_ERROR_IF(!Dir);
@@ -2064,7 +2415,6 @@ Return Value:
 
             return partitions;
         },
-        c_defaultRetryPeriod,
         c_defaultRetryTimeout,
         []() {
             auto err = wil::ResultFromCaughtException();
@@ -2547,26 +2897,30 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
         return;
     }
 
+    //
+    // The archive is relayed between bsdtar and the data socket. If the host end of the socket is
+    // reset, a write will raise SIGPIPE. Ignore it so the relay fails instead.
+    //
+
+    THROW_LAST_ERROR_IF(signal(SIGPIPE, SIG_IGN) == SIG_ERR);
+
     Result = -1;
-    auto ReportStatus = wil::scope_exit([&Channel, &Result, MessageType = Message->Header.MessageType]() {
-        if (MessageType == LxMiniInitMessageExport)
+    std::string Digest;
+    std::unique_ptr<IncrementalExport> Delta;
+    auto ReportStatus = wil::scope_exit([&Channel, &Result, &Digest, MessageType = Message->Header.MessageType]() {
+        wsl::shared::MessageWriter<LX_MINI_INIT_IMPORT_RESULT> message;
+        message->Result = Result;
+        if (Result == 0 && (MessageType == LxMiniInitMessageImport || MessageType == LxMiniInitMessageImportInplace))
         {
-            if (UtilWriteBuffer(Channel.Socket(), &Result, sizeof(Result)) < 0)
-            {
-                LOG_ERROR("response write failed {}", errno);
-            }
+            PostProcessImportedDistribution(message, DISTRO_PATH);
         }
-        else
-        {
-            wsl::shared::MessageWriter<LX_MINI_INIT_IMPORT_RESULT> message;
-            message->Result = Result;
-            if (Result == 0)
-            {
-                PostProcessImportedDistribution(message, DISTRO_PATH);
-            }
 
-            Channel.SendMessage<LX_MINI_INIT_IMPORT_RESULT>(message.Span());
+        if (!Digest.empty())
+        {
+            message.WriteString(message->Sha256Index, Digest);
         }
+
+        Channel.SendMessage<LX_MINI_INIT_IMPORT_RESULT>(message.Span());
     });
 
     wil::unique_fd DataSocket{UtilAcceptVsock(ListenSocket.get(), ListenAddress, SESSION_LEADER_ACCEPT_TIMEOUT_MS)};
@@ -2578,11 +2932,27 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
     switch (Message->Header.MessageType)
     {
     case LxMiniInitMessageImport:
-        Result = ImportFromSocket(DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags);
+        Result = ImportFromSocket(DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags, Digest);
+        if (Result == 0)
+        {
+            try
+            {
+                RecordImportedLayer(DISTRO_PATH, ErrorSocket.get());
+            }
+            catch (...)
+            {
+                Result = wil::ResultFromCaughtException();
+            }
+        }
+
+        break;
+
+    case LxMiniInitMessageImportDelta:
+        Result = ImportDeltaFromSocket(DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags, Digest);
         break;
 
     case LxMiniInitMessageExport:
-        Result = ExportToSocket(DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags);
+        Result = ExportToSocket(DISTRO_PATH, DataSocket.get(), ErrorSocket.get(), Message->Flags, Digest, Delta);
         break;
 
     case LxMiniInitMessageImportInplace:
@@ -2592,6 +2962,24 @@ void ProcessImportExportMessage(gsl::span<gsl::byte> Buffer, wsl::shared::Socket
     default:
         LOG_ERROR("Unexpected message type {}", Message->Header.MessageType);
     }
+
+    //
+    // Only save the manifest of an incremental export once the host confirmed that it stored the
+    // archive. Otherwise, the next incremental export would be based on a layer that was lost.
+    //
+
+    if (Result == 0 && Delta)
+    {
+        ReportStatus.reset();
+        const auto& Stored = Channel.ReceiveMessage<RESULT_MESSAGE<int32_t>>();
+        if (Stored.Result != 0)
+        {
+            LOG_ERROR("The host failed to store the incremental export, {}", Stored.Result);
+            return;
+        }
+
+        Delta->Commit();
+    }
 }
 
 int ProcessMountFolderMessage(wsl::shared::Transaction& Transaction, gsl::span<gsl::byte> Buffer)
@@ -2789,6 +3177,65 @@ Return Value:
     return (ChildPid < 0) ? -1 : 0;
 }
 
+int RelayArchive(int InputFd, int OutputFd, StreamDigest& Digest)
+
+/*++
+
+Routine Description:
+
+    This routine relays an archive between bsdtar and a socket, and hashes it on
+    the way.
+
+Arguments:
+
+    InputFd - Supplies the file descriptor to read from.
+
+    OutputFd - Supplies the file descriptor to write to.
+
+    Digest - Supplies the digest to update.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set.
+
+--*/
+
+{
+    RelayStream Relay(InputFd, OutputFd);
+    Relay.SetDigest(&Digest);
+    for (;;)
+    {
+        const auto Result = Relay.Transfer();
+        if (Result < 0)
+        {
+            //
+            // The archive is the only stream relayed here, so wait for whichever side it's
+            // blocked on.
+            //
+
+            if (errno == EAGAIN)
+            {
+                const bool Writing = Relay.Pending() != 0;
+                pollfd PollDescriptor{Writing ? OutputFd : InputFd, static_cast<short>(Writing ? POLLOUT : POLLIN)};
+                if (TEMP_FAILURE_RETRY(poll(&PollDescriptor, 1, -1)) >= 0)
+                {
+                    continue;
+                }
+            }
+
+            return -1;
+        }
+
+        if (Result == 0)
+        {
+            break;
+        }
+    }
+
+    Relay.LogStatistics("Archive");
+    return 0;
+}
+
 int ReportMountStatus(wsl::shared::SocketChannel& Channel, int Result, LX_MINI_MOUNT_STEP Step)
 
 /*++
@@ -2861,14 +3308,12 @@ Return Value:
         std::string DevicePath = std::format("{}/pmem{}", DEVFS_PATH, PmemId);
 
         //
-        // Poll for the device to appear. Ideally we'd replace this with something
-        // like libudev so we can be notified when devices appear.
+        // Wait for the device to appear.
         //
 
         struct stat Buffer;
-        wsl::shared::retry::RetryWithTimeout<void>(
+        BlockDeviceMonitor::Current()->RetryWithTimeout<void>(
             [&]() { THROW_LAST_ERROR_IF(stat(DevicePath.c_str(), &Buffer) < 0); },
-            c_defaultRetryPeriod,
             c_defaultRetryTimeout,
             [&]() {
                 Result = -wil::ResultFromCaughtException();
@@ -2982,6 +3427,7 @@ try
     case LxMiniInitMessageLaunchInit:
     case LxMiniInitMessageImport:
     case LxMiniInitMessageImportInplace:
+    case LxMiniInitMessageImportDelta:
     case LxMiniInitMessageExport:
         try
         {
@@ -3049,6 +3495,7 @@ try
 
     case LxMiniInitMessageEarlyConfig:
     {
+        BootTimeline::Span Span{"EarlyConfig"};
         const auto EarlyConfig = gslhelpers::try_get_struct<LX_MINI_INIT_EARLY_CONFIG_MESSAGE>(Buffer);
         if (!EarlyConfig)
         {
@@ -3092,10 +3539,40 @@ try
         }
 
         //
-        // Configure memory reclamation.
+        // Configure memory reclamation. Working set estimates are sent to the service on the
+        // notification channel.
         //
 
-        StartMemoryReductionThread(EarlyConfig->MemoryReclaimMode);
+        StartMemoryReductionThread(
+            EarlyConfig->MemoryReclaimMode,
+            [NotifyFd = Config.NotifyFd](const LX_MINI_INIT_WORKING_SET_MESSAGE& Message) {
+                std::lock_guard Lock{g_NotifyLock};
+                if (UtilWriteBuffer(NotifyFd, gslhelpers::struct_as_bytes(Message)) < 0)
+                {
+                    LOG_ERROR("write failed {}", errno);
+                }
+            },
+            Config.ColdPageAge);
+
+        //
+        // Run the rest of the boot steps. Steps that don't depend on each other run concurrently,
+        // unless serial boot was requested, in which case they run one at a time in the order
+        // they're added here.
+        //
+        // N.B. Mounting the system distro chroots the process, so every step that uses a path
+        //      depends on it.
+        //
+        // N.B. Steps that fork a child process which runs code before calling exec (the debug
+        //      shell, swap, chronyd and the guest network service) are not part of the graph. A
+        //      child forked while other threads run only has the forking thread, and any lock
+        //      those threads held (for example the allocator's or the block device monitor's)
+        //      stays locked in it forever. They run on this thread once the concurrent steps are
+        //      done, followed by the compressed swap tier. The kernel modules step only forks to
+        //      exec modprobe right away.
+        //
+
+        TaskGraph BootSteps;
+        std::vector<size_t> SystemDistro;
 
         //
         // Initialize system distro if supported.
@@ -3103,56 +3580,41 @@ try
 
         if (EarlyConfig->SystemDistroDeviceId != UINT_MAX)
         {
-            if (MountSystemDistro(EarlyConfig->SystemDistroDeviceType, EarlyConfig->SystemDistroDeviceId) < 0)
-            {
-                return -1;
-            }
-
-            //
-            // Crash dump collection needs to be reconfigured here, because we called chroot.
-            //
-
-            if (Config.EnableCrashDumpCollection)
-            {
-                EnableCrashDumpCollection();
-            }
-
-            Config.EnableSystemDistro = true;
-
-            //
-            // Set the $LANG environment variable.
-            //
-            // N.B. This is needed by bsdtar for path conversions (to support .xz file format).
-            //
+            SystemDistro.push_back(BootSteps.Add("MountSystemDistro", [EarlyConfig]() {
+                if (MountSystemDistro(EarlyConfig->SystemDistroDeviceType, EarlyConfig->SystemDistroDeviceId) < 0)
+                {
+                    return -1;
+                }
 
-            if (setenv("LANG", "en_US.UTF-8", 1) < 0)
-            {
-                LOG_ERROR("setenv(LANG, en_US.UTF-8) failed {}", errno);
-            }
+                //
+                // Set the $LANG environment variable.
+                //
+                // N.B. This is needed by bsdtar for path conversions (to support .xz file format).
+                //      No other step is running yet, so the environment can be changed safely.
+                //
 
-            //
-            // Start the debug shell if enabled.
-            //
+                if (setenv("LANG", "en_US.UTF-8", 1) < 0)
+                {
+                    LOG_ERROR("setenv(LANG, en_US.UTF-8) failed {}", errno);
+                }
 
-            if (EarlyConfig->EnableDebugShell)
-            {
-                StartDebugShell();
-            }
+                return 0;
+            }));
 
             //
-            // Configure swap space.
+            // Crash dump collection needs to be reconfigured here, because we called chroot.
             //
 
-            if (EarlyConfig->SwapLun != UINT_MAX)
+            if (Config.EnableCrashDumpCollection)
             {
-                CreateSwap(EarlyConfig->SwapLun);
+                BootSteps.Add(
+                    "EnableCrashDumpCollection",
+                    []() {
+                        EnableCrashDumpCollection();
+                        return 0;
+                    },
+                    SystemDistro);
             }
-
-            //
-            // Start the time sync agent (chronyd) to keep guest clock in sync with the host.
-            //
-
-            StartTimeSyncAgent();
         }
 
         //
@@ -3162,56 +3624,111 @@ try
         //      directory must be writable for tools like depmod to work.
         //
 
+        std::string KernelModulesPath;
         if (EarlyConfig->KernelModulesDeviceId != UINT_MAX)
         {
-            THROW_LAST_ERROR_IF(
-                MountDevice(LxMiniInitMountDeviceTypeLun, EarlyConfig->KernelModulesDeviceId, KERNEL_MODULES_VHD_PATH, "ext4", LxMiniInitMessageFlagMountReadOnly, nullptr) <
-                0);
+            BootSteps.Add(
+                "KernelModules",
+                [EarlyConfig, Buffer, &KernelModulesPath]() {
+                    THROW_LAST_ERROR_IF(
+                        MountDevice(
+                            LxMiniInitMountDeviceTypeLun,
+                            EarlyConfig->KernelModulesDeviceId,
+                            KERNEL_MODULES_VHD_PATH,
+                            "ext4",
+                            LxMiniInitMessageFlagMountReadOnly,
+                            nullptr) < 0);
+
+                    utsname UnameBuffer{};
+                    THROW_LAST_ERROR_IF(uname(&UnameBuffer) < 0);
+
+                    std::string Target = std::format("{}/{}", KERNEL_MODULES_PATH, UnameBuffer.release);
+                    THROW_LAST_ERROR_IF(
+                        UtilMountOverlayFs(Target.c_str(), KERNEL_MODULES_VHD_PATH, (MS_NOATIME | MS_NOSUID | MS_NODEV)) < 0);
+
+                    const std::string KernelModulesList =
+                        wsl::shared::string::FromSpan(Buffer, EarlyConfig->KernelModulesListOffset);
+                    KernelModuleLoader{Target}.Load(wsl::shared::string::Split(KernelModulesList, ','), get_nprocs());
+
+                    KernelModulesPath = std::move(Target);
+                    return 0;
+                },
+                SystemDistro);
+        }
+
+        //
+        // Initialization required by mini_init.
+        //
+
+        BootSteps.Add(
+            "Initialize",
+            [EarlyConfig, Buffer]() { return Initialize(wsl::shared::string::FromSpan(Buffer, EarlyConfig->HostnameOffset)); },
+            SystemDistro);
 
-            utsname UnameBuffer{};
-            THROW_LAST_ERROR_IF(uname(&UnameBuffer) < 0);
+        if (BootSteps.Run(Config.SerialBoot ? 1 : get_nprocs()) < 0)
+        {
+            return -1;
+        }
 
-            std::string Target = std::format("{}/{}", KERNEL_MODULES_PATH, UnameBuffer.release);
-            THROW_LAST_ERROR_IF(UtilMountOverlayFs(Target.c_str(), KERNEL_MODULES_VHD_PATH, (MS_NOATIME | MS_NOSUID | MS_NODEV)) < 0);
+        //
+        // Start the debug shell, configure swap space and start the time sync agent (chronyd) to
+        // keep guest clock in sync with the host.
+        //
 
-            const std::string KernelModulesList = wsl::shared::string::FromSpan(Buffer, EarlyConfig->KernelModulesListOffset);
-            for (const auto& Module : wsl::shared::string::Split(KernelModulesList, ','))
+        if (!SystemDistro.empty())
+        {
+            if (EarlyConfig->EnableDebugShell)
             {
-                const char* Argv[] = {MODPROBE_PATH, Module.c_str(), nullptr};
-                int Status = -1;
-                auto result = UtilCreateProcessAndWait(MODPROBE_PATH, Argv, &Status);
-                if (result < 0)
-                {
-                    LOG_ERROR("Failed to load module '{}', {}", Module, Status);
-                }
+                StartDebugShell();
+            }
+
+            if (EarlyConfig->SwapLun != UINT_MAX)
+            {
+                CreateSwap(EarlyConfig->SwapLun);
             }
 
-            Config.KernelModulesPath = std::move(Target);
+            StartTimeSyncAgent();
         }
 
         //
-        // Initialization required by mini_init.
+        // Start the guest network service.
+        //
+        // N.B. The guest network service is started once the modules are loaded, since the
+        //      requested modules can include network drivers.
         //
 
-        if (Initialize(wsl::shared::string::FromSpan(Buffer, EarlyConfig->HostnameOffset)) < 0)
+        if (StartGuestNetworkService(SocketFd.get(), std::move(DnsTunnelingSocketFd), EarlyConfig->DnsTunnelingIpAddress) < 0)
         {
             return -1;
         }
 
         //
-        // Start the guest network service.
+        // Configure the compressed swap tier.
+        //
+        // N.B. This is done once the kernel modules are available, since zram can be a module.
         //
 
-        if (StartGuestNetworkService(SocketFd.get(), std::move(DnsTunnelingSocketFd), EarlyConfig->DnsTunnelingIpAddress) < 0)
+        if (EarlyConfig->CompressedSwapMode == LxMiniInitCompressedSwapModeZswap && EarlyConfig->SwapLun == UINT_MAX)
         {
-            return -1;
+            LOG_WARNING("zswap requires a swap disk and will not be used");
+        }
+        else if (EarlyConfig->CompressedSwapMode != LxMiniInitCompressedSwapModeDisabled)
+        {
+            ConfigureCompressedSwap(
+                EarlyConfig->CompressedSwapMode,
+                wsl::shared::string::FromSpan(Buffer, EarlyConfig->CompressedSwapCompressorOffset),
+                EarlyConfig->CompressedSwapSizeBytes,
+                KernelModulesPath);
         }
 
+        Config.EnableSystemDistro = !SystemDistro.empty();
+        Config.KernelModulesPath = std::move(KernelModulesPath);
         return 0;
     }
 
     case LxMiniInitMessageInitialConfig:
     {
+        BootTimeline::Span Span{"InitialConfig"};
         const auto ConfigMessage = gslhelpers::try_get_struct<LX_MINI_INIT_CONFIG_MESSAGE>(Buffer);
         if (!ConfigMessage)
         {
@@ -3630,12 +4147,11 @@ Return Value:
 --*/
 
 {
-    wsl::shared::retry::RetryWithTimeout<void>(
+    BlockDeviceMonitor::Current()->RetryWithTimeout<void>(
         [&]() {
             wil::unique_fd device{open(Path, O_RDONLY)};
             THROW_LAST_ERROR_IF(!device);
         },
-        c_defaultRetryPeriod,
         c_defaultRetryTimeout,
         [&]() {
             errno = wil::ResultFromCaughtException();
@@ -3878,6 +4394,19 @@ int main(int Argc, char* Argv[])
         LOG_ERROR("unsetenv failed {}", errno);
     }
 
+    //
+    // Record a timeline of the boot if requested.
+    //
+
+    if (getenv(WSL_BOOT_TRACE_ENV) != nullptr)
+    {
+        BootTimeline::Enable();
+        if (unsetenv(WSL_BOOT_TRACE_ENV))
+        {
+            LOG_ERROR("unsetenv failed {}", errno);
+        }
+    }
+
     //
     // Mount devtmpfs.
     //
@@ -4027,6 +4556,31 @@ int main(int Argc, char* Argv[])
         goto ErrorExit;
     }
 
+    Config.NotifyFd = NotifyFd.get();
+
+    if (getenv(WSL_SERIAL_BOOT_ENV))
+    {
+        Config.SerialBoot = true;
+        if (unsetenv(WSL_SERIAL_BOOT_ENV) < 0)
+        {
+            LOG_ERROR("unsetenv failed {}", errno);
+        }
+    }
+
+    if (const char* ColdPageAge = getenv(WSL_COLD_PAGE_AGE_ENV))
+    {
+        try
+        {
+            Config.ColdPageAge = std::chrono::seconds(std::stoul(ColdPageAge));
+        }
+        CATCH_LOG()
+
+        if (unsetenv(WSL_COLD_PAGE_AGE_ENV) < 0)
+        {
+            LOG_ERROR("unsetenv failed {}", errno);
+        }
+    }
+
     if (getenv(WSL_ENABLE_CRASH_DUMP_ENV))
     {
         Config.EnableCrashDumpCollection = true;
@@ -4108,6 +4662,8 @@ int main(int Argc, char* Argv[])
             {
                 goto ErrorExit;
             }
+
+            BootTimeline::Write(CROSS_DISTRO_SHARE_PATH "/" WSL_BOOT_TRACE_FILE);
         }
 
         //
@@ -4199,7 +4755,11 @@ int main(int Argc, char* Argv[])
                     Message.Header.MessageType = LxMiniInitMessageChildExit;
                     Message.Header.MessageSize = sizeof(Message);
                     Message.ChildPid = Result;
-                    Result = UtilWriteBuffer(NotifyFd.get(), gslhelpers::struct_as_bytes(Message));
+                    {
+                        std::lock_guard Lock{g_NotifyLock};
+                        Result = UtilWriteBuffer(NotifyFd.get(), gslhelpers::struct_as_bytes(Message));
+                    }
+
                     if (Result < 0)
                     {
                         LOG_ERROR("write failed {}", errno);
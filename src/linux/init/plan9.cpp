@@ -17,6 +17,7 @@
 #include "util.h"
 #include "SocketChannel.h"
 #include "WslDistributionConfig.h"
+#include "BootTimeline.h"
 
 namespace {
 
@@ -171,7 +172,15 @@ CATCH_LOG();
 
 } // namespace
 
-void RunPlan9Server(const char* socketPath, const char* logFile, int logLevel, bool truncateLog, int controlSocket, int serverFd, wil::unique_fd& pipeFd)
+void RunPlan9Server(
+    const char* socketPath,
+    const char* logFile,
+    int logLevel,
+    bool truncateLog,
+    int controlSocket,
+    int serverFd,
+    wil::unique_fd& pipeFd,
+    const p9fs::FileSystemOptions& options)
 {
     // Initialize logging.
     InitializeLogging(false, LogPlan9Exception);
@@ -193,7 +202,7 @@ void RunPlan9Server(const char* socketPath, const char* logFile, int logLevel, b
 
     {
         // Create the file system server.
-        auto fileSystem = p9fs::CreateFileSystem(serverFd);
+        auto fileSystem = p9fs::CreateFileSystem(serverFd, options);
 
         // Add the share (the share takes ownership of the fd).
         fileSystem->AddShare("", rootFd.get());
@@ -219,6 +228,7 @@ void RunPlan9Server(const char* socketPath, const char* logFile, int logLevel, b
 std::pair<unsigned int, wsl::shared::SocketChannel> StartPlan9Server(const char* socketWindowsPath, const wsl::linux::WslDistributionConfig& Config)
 try
 {
+    BootTimeline::Span Span{"StartPlan9Server"};
     unsigned int result = LX_INIT_UTILITY_VM_INVALID_PORT;
 
     // Don't run the server if no socket was specified by init.
@@ -273,6 +283,8 @@ try
             const std::string logLevelStr = std::to_string(Config.Plan9LogLevel);
             const std::string serverFdStr = std::to_string(server.get());
             const std::string pipeFdStr = std::to_string(pipe.get());
+            const std::string ioBudgetStr = std::to_string(Config.Plan9IoBudget);
+            const std::string streamingThresholdStr = std::to_string(Config.Plan9StreamingThreshold);
             std::vector<const char*> Arguments{
                 LX_INIT_PLAN9,
                 LX_INIT_PLAN9_CONTROL_SOCKET_ARG,
@@ -295,6 +307,33 @@ try
                 Arguments.emplace_back(LX_INIT_PLAN9_TRUNCATE_LOG_ARG);
             }
 
+            if (!Config.Plan9FairQueue)
+            {
+                Arguments.emplace_back(LX_INIT_PLAN9_NO_FAIR_QUEUE_ARG);
+            }
+
+            if (Config.Plan9IoBudget != 0)
+            {
+                Arguments.emplace_back(LX_INIT_PLAN9_IO_BUDGET_ARG);
+                Arguments.emplace_back(ioBudgetStr.c_str());
+            }
+
+            if (Config.Plan9ReadDirCache)
+            {
+                Arguments.emplace_back(LX_INIT_PLAN9_READDIR_CACHE_ARG);
+            }
+
+            if (!Config.Plan9StreamingReads)
+            {
+                Arguments.emplace_back(LX_INIT_PLAN9_NO_STREAMING_READS_ARG);
+            }
+
+            if (Config.Plan9StreamingThreshold != 0)
+            {
+                Arguments.emplace_back(LX_INIT_PLAN9_STREAMING_THRESHOLD_ARG);
+                Arguments.emplace_back(streamingThresholdStr.c_str());
+            }
+
             if (Config.Plan9LogFile.has_value())
             {
                 Arguments.emplace_back(LX_INIT_PLAN9_LOG_FILE_ARG);
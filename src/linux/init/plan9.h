@@ -5,9 +5,18 @@
 #include <lxwil.h>
 #include "SocketChannel.h"
 #include "WslDistributionConfig.h"
+#include <p9fs.h>
 
 std::pair<unsigned int, wsl::shared::SocketChannel> StartPlan9Server(const char* socketWindowsPath, const wsl::linux::WslDistributionConfig& Config);
 
-void RunPlan9Server(const char* socketPath, const char* logFile, int logLevel, bool truncateLog, int controlSocket, int serverFd, wil::unique_fd& pipeFd);
+void RunPlan9Server(
+    const char* socketPath,
+    const char* logFile,
+    int logLevel,
+    bool truncateLog,
+    int controlSocket,
+    int serverFd,
+    wil::unique_fd& pipeFd,
+    const p9fs::FileSystemOptions& options);
 
 bool StopPlan9Server(bool force, wsl::linux::WslDistributionConfig& Config);
\ No newline at end of file
@@ -27,6 +27,7 @@ Abstract:
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
 #include <regex>
 #include <thread>
 #include <chrono>
@@ -35,10 +36,12 @@ Abstract:
 #include "common.h"
 #include "wslpath.h"
 #include "util.h"
+#include "ColdPages.h"
 #include "drvfs.h"
 #include "escape.h"
 #include "config.h"
 #include "mountutilcpp.h"
+#include "MountIndex.h"
 #include "message.h"
 #include "RuntimeErrorWithSourceLocation.h"
 #include "SocketChannel.h"
@@ -377,6 +380,7 @@ Return Value:
 
 {
     size_t DestIndex;
+    size_t NextIndex;
     size_t PathLength;
     size_t SourceIndex;
 
@@ -385,32 +389,38 @@ Return Value:
     PathLength = strlen(Path);
 
     //
-    // Iterate through the path, replacing all separators.
+    // Iterate through the path, replacing all separators. The characters
+    // between separators are found a block at a time and moved at once.
     //
 
-    for (; SourceIndex < PathLength; SourceIndex++)
+    while (SourceIndex < PathLength)
     {
-        if (Path[SourceIndex] == PATH_SEP || Path[SourceIndex] == PATH_SEP_NT)
+        NextIndex = SourceIndex + EscapeFindSeparator(&Path[SourceIndex], PathLength - SourceIndex);
+        if (DestIndex != SourceIndex)
         {
-            //
-            // Don't add a separator if previous char already is a separator.
-            // Also handle the special case where 'Path' is a UNC path (\\X or //X)
-            // where both separators should be kept.
-            //
-
-            if (DestIndex > 1 && Path[DestIndex - 1] == Separator)
-            {
-                continue;
-            }
+            memmove(&Path[DestIndex], &Path[SourceIndex], NextIndex - SourceIndex);
+        }
 
-            Path[DestIndex] = Separator;
+        DestIndex += NextIndex - SourceIndex;
+        SourceIndex = NextIndex;
+        if (SourceIndex == PathLength)
+        {
+            break;
         }
-        else
+
+        //
+        // Don't add a separator if previous char already is a separator.
+        // Also handle the special case where 'Path' is a UNC path (\\X or //X)
+        // where both separators should be kept.
+        //
+
+        if (DestIndex <= 1 || Path[DestIndex - 1] != Separator)
         {
-            Path[DestIndex] = Path[SourceIndex];
+            Path[DestIndex] = Separator;
+            DestIndex++;
         }
 
-        DestIndex++;
+        SourceIndex++;
     }
 
     Path[DestIndex] = '\0';
@@ -441,6 +451,287 @@ Return Value:
     Path.resize(UtilCanonicalisePathSeparator(Path.data(), Separator));
 }
 
+static bool ReadProcessStat(pid_t Pid, pid_t& Parent, unsigned long long& StartTime)
+
+/*++
+
+Routine Description:
+
+    This routine reads the parent process id and the start time of the specified process.
+
+Arguments:
+
+    Pid - Supplies the process id.
+
+    Parent - Receives the parent process id.
+
+    StartTime - Receives the start time of the process, in clock ticks since boot.
+
+Return Value:
+
+    true on success, false otherwise.
+
+--*/
+
+{
+    //
+    // Parse the /proc/[pid]/stat file. Sample format: "86 (bash) S 9 ...".
+    //
+    // N.B. The second entry can contain spaces and parentheses, so the fields are parsed from the
+    //      last closing parenthesis.
+    //
+
+    const auto FilePath = std::format("/proc/{}/stat", Pid);
+    wil::unique_fd File{open(FilePath.c_str(), O_RDONLY | O_CLOEXEC)};
+    if (!File)
+    {
+        return false;
+    }
+
+    char Buffer[1024];
+    const auto BytesRead = TEMP_FAILURE_RETRY(read(File.get(), Buffer, sizeof(Buffer) - 1));
+    if (BytesRead <= 0)
+    {
+        return false;
+    }
+
+    Buffer[BytesRead] = '\0';
+    const char* Fields = strrchr(Buffer, ')');
+    if (Fields == nullptr ||
+        sscanf(
+            Fields + 1,
+            " %*c %d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu",
+            &Parent,
+            &StartTime) != 2)
+    {
+        LOG_ERROR("Failed to parse: {}, content: {}", FilePath, Buffer);
+        return false;
+    }
+
+    return true;
+}
+
+static std::string InteropSessionCachePath()
+
+/*++
+
+Routine Description:
+
+    This routine returns the path of the interop server cache of the current session.
+
+    The first process of a session that has to search the process tree for an
+    interop server links the cache to the server it found, so the following
+    processes of the session don't search again. The start time of the session
+    leader is part of the path so a recycled session id doesn't reuse the cache,
+    and so is the effective user id so processes of the session that run as
+    another user (for example under sudo) don't replace each other's cache.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    The path of the cache, or an empty string if the session can't be identified.
+
+--*/
+
+{
+    const pid_t Session = getsid(0);
+    if (Session <= 0)
+    {
+        return {};
+    }
+
+    pid_t Parent;
+    unsigned long long StartTime;
+    if (!ReadProcessStat(Session, Parent, StartTime))
+    {
+        return {};
+    }
+
+    return std::format(
+        WSL_INTEROP_SESSION_CACHE_FORMAT, WSL_TEMP_FOLDER, Session, StartTime, geteuid(), WSL_INTEROP_SESSION_CACHE);
+}
+
+static std::string InteropSessionCacheRead(const std::string& CachePath)
+
+/*++
+
+Routine Description:
+
+    This routine reads the interop server path from the cache of the current session.
+
+Arguments:
+
+    CachePath - Supplies the path of the cache.
+
+Return Value:
+
+    The path of the interop server, or an empty string if the cache is missing or
+    the server is gone.
+
+--*/
+
+{
+    //
+    // The temp folder can be written by any user, so only trust a cache that was
+    // created by the current user.
+    //
+
+    struct stat Stat;
+    if (lstat(CachePath.c_str(), &Stat) < 0 || !S_ISLNK(Stat.st_mode) || Stat.st_uid != geteuid())
+    {
+        return {};
+    }
+
+    char Target[PATH_MAX];
+    const auto Size = readlink(CachePath.c_str(), Target, sizeof(Target) - 1);
+    if (Size <= 0)
+    {
+        return {};
+    }
+
+    Target[Size] = '\0';
+    if (access(Target, F_OK) < 0)
+    {
+        unlink(CachePath.c_str());
+        return {};
+    }
+
+    return Target;
+}
+
+static void InteropSessionCacheCleanup()
+
+/*++
+
+Routine Description:
+
+    This routine removes the caches of the current user whose interop server is
+    gone, and the temporary links left behind by processes that exited before
+    renaming them over a cache.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    None.
+
+--*/
+
+try
+{
+    const wil::unique_dir Directory{opendir(WSL_TEMP_FOLDER)};
+    if (!Directory)
+    {
+        return;
+    }
+
+    constexpr std::string_view Suffix = "_" WSL_INTEROP_SESSION_CACHE;
+    const int DirectoryFd = dirfd(Directory.get());
+    while (const auto* Entry = readdir(Directory.get()))
+    {
+        const std::string_view Name{Entry->d_name};
+        const auto Position = Name.find(Suffix);
+        if (Position == std::string_view::npos)
+        {
+            continue;
+        }
+
+        struct stat Stat;
+        if (fstatat(DirectoryFd, Entry->d_name, &Stat, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISLNK(Stat.st_mode) ||
+            Stat.st_uid != geteuid())
+        {
+            continue;
+        }
+
+        //
+        // A cache is stale once the interop server it links to is gone, and a
+        // temporary link is stale once the process that created it is gone.
+        //
+
+        bool Stale;
+        const auto Extension = Name.substr(Position + Suffix.size());
+        if (Extension.empty())
+        {
+            Stale = faccessat(DirectoryFd, Entry->d_name, F_OK, 0) < 0 && errno == ENOENT;
+        }
+        else
+        {
+            if (Extension[0] != '.')
+            {
+                continue;
+            }
+
+            pid_t Pid{};
+            const auto* End = Extension.data() + Extension.size();
+            const auto Result = std::from_chars(Extension.data() + 1, End, Pid);
+            if (Result.ec != std::errc{} || Result.ptr != End)
+            {
+                continue;
+            }
+
+            Stale = kill(Pid, 0) < 0 && errno == ESRCH;
+        }
+
+        if (Stale && unlinkat(DirectoryFd, Entry->d_name, 0) < 0 && errno != ENOENT)
+        {
+            LOG_ERROR("unlink({}/{}) failed {}", WSL_TEMP_FOLDER, Name, errno);
+        }
+    }
+}
+CATCH_LOG()
+
+static void InteropSessionCacheWrite(const std::string& CachePath, const char* InteropSocketPath)
+
+/*++
+
+Routine Description:
+
+    This routine links the cache of the current session to an interop server.
+
+    Since this only happens once per session, the stale caches of previous
+    sessions are removed first so they don't accumulate in the temp folder.
+
+Arguments:
+
+    CachePath - Supplies the path of the cache.
+
+    InteropSocketPath - Supplies the path of the interop server.
+
+Return Value:
+
+    None.
+
+--*/
+
+try
+{
+    //
+    // Processes of the session can race to create the cache, so link a temporary
+    // name and rename it over the cache.
+    //
+
+    InteropSessionCacheCleanup();
+    const auto TemporaryPath = std::format("{}.{}", CachePath, getpid());
+    unlink(TemporaryPath.c_str());
+    if (symlink(InteropSocketPath, TemporaryPath.c_str()) < 0)
+    {
+        LOG_ERROR("symlink({}, {}) failed {}", InteropSocketPath, TemporaryPath, errno);
+        return;
+    }
+
+    if (rename(TemporaryPath.c_str(), CachePath.c_str()) < 0)
+    {
+        LOG_ERROR("rename({}, {}) failed {}", TemporaryPath, CachePath, errno);
+        unlink(TemporaryPath.c_str());
+    }
+}
+CATCH_LOG()
+
 wil::unique_fd UtilConnectToInteropServer(std::optional<pid_t> Pid)
 
 /*++
@@ -472,13 +763,37 @@ try
     {
         //
         // Query the interop server environment variable. If the process does not
-        // have the environment variable, or if the socket does not exists, search through parent process tree for an
+        // have the environment variable, or if the socket does not exists, use the
+        // interop server of the session, or search through parent process tree for an
         // interop server.
         //
 
         InteropSocketPath = getenv(WSL_INTEROP_ENV);
         if (InteropSocketPath == nullptr || (access(InteropSocketPath, F_OK) < 0 && errno == ENOENT))
         {
+            InteropSocketPath = nullptr;
+            const auto CachePath = InteropSessionCachePath();
+            if (!CachePath.empty())
+            {
+                Path = InteropSessionCacheRead(CachePath);
+                if (!Path.empty())
+                {
+                    //
+                    // The socket file of a server that was killed remains, so search
+                    // again if the cached server can't be reached.
+                    //
+
+                    auto Socket = UtilConnectUnix(Path.c_str());
+                    if (Socket)
+                    {
+                        setenv(WSL_INTEROP_ENV, Path.c_str(), 1);
+                        return Socket;
+                    }
+
+                    unlink(CachePath.c_str());
+                }
+            }
+
             pid_t Parent = getppid();
             while (Parent > 0)
             {
@@ -497,6 +812,11 @@ try
                 return {};
             }
 
+            if (!CachePath.empty())
+            {
+                InteropSessionCacheWrite(CachePath, InteropSocketPath);
+            }
+
             setenv(WSL_INTEROP_ENV, InteropSocketPath, 1);
         }
     }
@@ -832,11 +1152,12 @@ std::string UtilFindMount(const char* MountInfoFile, const char* Path, bool WinP
 
 Routine Description:
 
-    This routine parses the /proc/self/mountinfo file to find a mount that
-    matches the specified path.
+    This routine finds a DrvFs, Plan 9 or virtiofs mount that matches the
+    specified path.
 
-    N.B. The caller is responsible for freeing the returned replacement prefix
-         buffer.
+    N.B. For the mountinfo file of the calling process, the cached mount index
+         is used and is only rebuilt when the mount table changes. Other files
+         are parsed on each call.
 
 Arguments:
 
@@ -858,197 +1179,30 @@ Return Value:
 
 try
 {
-    char** MatchField;
-    char** ReplacementField;
-
-    mountutil::MountEnum MountEnum{MountInfoFile};
-    if (WinPath != false)
-    {
-        MatchField = &MountEnum.Current().Source;
-        ReplacementField = &MountEnum.Current().MountPoint;
-    }
-    else
+    if (strcmp(MountInfoFile, MOUNT_INFO_FILE) == 0)
     {
-        MatchField = &MountEnum.Current().MountPoint;
-        ReplacementField = &MountEnum.Current().Source;
+        return MountIndex::Current()->Find(Path, WinPath, PrefixLength);
     }
 
-    std::string FoundReplacement;
-    size_t FoundPrefixLength = 0;
-    while (MountEnum.Next())
-    {
-        //
-        // When translating Windows paths to Linux, skip internal virtiofs
-        // device mounts. The aggregate virtiofs root and its per-share child
-        // binds live under VIRTIOFS_MOUNT_DIR and carry the same Windows source
-        // as the user-facing /mnt/<drive> bind mounts. If they were considered,
-        // translation could return an internal plumbing path (for example
-        // /run/wsl/virtiofs-mounts/drvfsa/<guid>) instead of the real mount
-        // point such as /mnt/c.
-        //
+    return MountIndex{MountInfoFile}.Find(Path, WinPath, PrefixLength);
+}
+catch (...)
+{
+    LOG_CAUGHT_EXCEPTION();
+    return {};
+}
 
-        if (WinPath && UtilIsPathPrefix(MountEnum.Current().MountPoint, VIRTIOFS_MOUNT_DIR, false) > 0)
-        {
-            continue;
-        }
+std::optional<std::string> UtilGetEnv(const char* Name, char* Environment)
 
-        //
-        // If a mount point was previously found, and this mount point is a
-        // prefix of the path (or the previously found mount point, for Windows
-        // to Linux translation), it means that the path is not actually on
-        // the previously found mount, so discard that result.
-        //
-        // For example:
-        // - When translating /mnt/c/foo/bar, first /mnt/c is found, but a
-        //   later entry indicates /mnt/c/foo is also a mount point (e.g. using
-        //   tmpfs). This means /mnt/c/foo/bar is not on the /mnt/c mount.
-        // - When translating C:\foo, first /mnt/c is found. A later entry
-        //   indicates /mnt itself is a mount point, making the earlier /mnt/c
-        //   mount unreachable.
-        //
-        // TODO_LX: This doesn't catch the case when translating C:\foo\bar and
-        //          /mnt/c/foo is a mount point. Handling that is more complicated.
-        //
+/*++
 
-        if (!FoundReplacement.empty())
-        {
-            const char* LinuxPath = WinPath ? FoundReplacement.c_str() : Path;
-            size_t LinuxPrefixLength = UtilIsPathPrefix(LinuxPath, MountEnum.Current().MountPoint, false);
-            if (LinuxPrefixLength > 0)
-            {
-                FoundReplacement.resize(0);
-            }
-        }
+Routine Description:
 
-        //
-        // For Plan 9, parse the actual mount source from the superblock options.
-        // For virtiofs, parse the mount source from source (for example drvfsC or drvfsaC).
-        // If the file system isn't Plan 9, virtiofs, or DrvFs, skip this mount.
-        //
+    This queries the specified environment variable.
 
-        std::string MountSource;
-        std::string_view MountRoot{MountEnum.Current().Root};
-        if (strcmp(MountEnum.Current().FileSystemType, PLAN9_FS_TYPE) == 0)
-        {
-            MountSource = UtilParsePlan9MountSource(MountEnum.Current().SuperOptions);
-            if (MountSource.empty())
-            {
-                continue;
-            }
+Arguments:
 
-            MountEnum.Current().Source = MountSource.data();
-        }
-        else if (strcmp(MountEnum.Current().FileSystemType, VIRTIO_FS_TYPE) == 0)
-        {
-            const auto aggregateRoot = ParseAggregateVirtioFsMountRoot(MountEnum.Current().Source, MountRoot);
-            MountSource = QueryVirtiofsMountSource(MountEnum.Current().Source, MountEnum.Current().Root);
-            if (MountSource.empty())
-            {
-                continue;
-            }
-
-            MountEnum.Current().Source = MountSource.data();
-            if (aggregateRoot)
-            {
-                MountRoot = aggregateRoot->SubPath;
-            }
-        }
-        else if (strcmp(MountEnum.Current().FileSystemType, DRVFS_FS_TYPE) == 0)
-        {
-            //
-            // The mount source is a Windows path and may use forward slashes;
-            // flip them to backslashes.
-            //
-
-            UtilCanonicalisePathSeparator(MountEnum.Current().Source, PATH_SEP_NT);
-        }
-        else
-        {
-            continue;
-        }
-
-        //
-        // Strip the trailing backslash if present.
-        //
-
-        size_t Length = strlen(MountEnum.Current().Source);
-        if ((Length > 0) && (MountEnum.Current().Source[Length - 1] == PATH_SEP_NT))
-        {
-            MountEnum.Current().Source[Length - 1] = '\0';
-        }
-
-        //
-        // For bind mounts, use the concatenation of the mount source and root
-        // of the mount as the mount source string.
-        //
-
-        std::string CombinedMountSource;
-        if (MountRoot != "/")
-        {
-            CombinedMountSource += MountEnum.Current().Source;
-            CombinedMountSource += MountRoot;
-            UtilCanonicalisePathSeparator(CombinedMountSource, PATH_SEP_NT);
-            MountEnum.Current().Source = CombinedMountSource.data();
-        }
-
-        //
-        // Check if the match field is a prefix of the path.
-        //
-        // N.B. For Windows paths, only matches longer than the existing match
-        //      are considered. This is because Windows mounts aren't
-        //      guaranteed to be in order and NTFS directory mounts should be
-        //      preferred over plain drive letter mounts if they match.
-        //
-
-        Length = UtilIsPathPrefix(Path, *MatchField, WinPath);
-        if ((Length == 0) || ((WinPath != false) && (Length < FoundPrefixLength)))
-        {
-            continue;
-        }
-
-        //
-        // Store the length of the prefix so the caller can strip it from the
-        // string.
-        //
-
-        FoundPrefixLength = Length;
-
-        //
-        // Store the replacement.
-        //
-
-        FoundReplacement = *ReplacementField;
-
-        //
-        // Continue searching the file even if a mount has been found, since
-        // newer mounts could shadow this one or be a nested mount.
-        //
-    }
-
-    if (!FoundReplacement.empty() && PrefixLength != nullptr)
-    {
-        *PrefixLength = FoundPrefixLength;
-    }
-
-    return FoundReplacement;
-}
-catch (...)
-{
-    LOG_CAUGHT_EXCEPTION();
-    return {};
-}
-
-std::optional<std::string> UtilGetEnv(const char* Name, char* Environment)
-
-/*++
-
-Routine Description:
-
-    This queries the specified environment variable.
-
-Arguments:
-
-    Name - Supplies the name to query.
+    Name - Supplies the name to query.
 
     Environment - Supplies an environment block to search. If NULL is provided
         the environment of the calling process is used.
@@ -1327,40 +1481,14 @@ Return Value:
 --*/
 
 {
-    //
-    // Open the /proc/[pid]/stat file.
-    //
-
-    const auto FilePath = std::format("/proc/{}/stat", Pid);
-    std::ifstream File(FilePath);
-
-    std::string Line;
-    if (!File || !std::getline(File, Line))
-    {
-        return -1;
-    }
-
-    //
-    // Parse the file. Sample format: "86 (bash) S 9".
-    // N.B. The second entry can contain a space so we can't just use strtok.
-    //
-
-    const std::regex Pattern("^[0-9]+ \\(.*\\) \\w ([0-9]+).*");
-    std::smatch Match;
-    if (!std::regex_match(Line, Match, Pattern) || Match.size() != 2)
-    {
-        LOG_ERROR("Failed to parse: {}, content: {}", FilePath, Line);
-        return -1;
-    }
-
-    auto Result = strtol(Match.str(1).c_str(), nullptr, 10);
-    if (Result == 0)
+    pid_t Parent;
+    unsigned long long StartTime;
+    if (!ReadProcessStat(Pid, Parent, StartTime) || Parent == 0)
     {
-        LOG_ERROR("Failed to parse: {}, content: {}", FilePath, Line);
         return -1;
     }
 
-    return Result;
+    return Parent;
 }
 
 std::string UtilGetVmId(void)
@@ -3037,10 +3165,7 @@ try
 {
     size_t PathLength;
     size_t PrefixLength;
-    char* Suffix;
     size_t SuffixLength;
-    size_t TranslatedLength;
-    size_t TranslatedSuffixLength;
 
     //
     // Find if there is a DrvFs or Plan 9 mount for the specified path.
@@ -3058,71 +3183,49 @@ try
     }
 
     //
-    // If translating Linux to Windows, see if any characters need to be
-    // escaped.
+    // Construct the new path out of the replacement prefix and the remainder
+    // of the path. If translating Linux to Windows, escape any characters
+    // that need to be escaped.
     //
 
     PathLength = strlen(Path);
     SuffixLength = PathLength - PrefixLength;
+    std::string TranslatedPath{PrefixReplacement};
     if (Reverse == false)
     {
         //
         // If the suffix is empty and the replacement prefix is just a drive
-        // letter, make space to append a backslash.
+        // letter, append a backslash.
         //
 
         if ((SuffixLength == 0) && (PrefixReplacement.length() == 2) && (PrefixReplacement[1] == DRIVE_SEP_NT))
         {
-            TranslatedSuffixLength = 1;
-        }
-        else
-        {
-            TranslatedSuffixLength = EscapePathForNtLength(&Path[PrefixLength]);
+            TranslatedPath += PATH_SEP_NT;
+            return TranslatedPath;
         }
-    }
-    else
-    {
-        TranslatedSuffixLength = SuffixLength;
-    }
-
-    //
-    // Construct the new path out of the replacement prefix and the remainder
-    // of the path, escaping it if necessary.
-    //
 
-    std::string TranslatedPath{PrefixReplacement};
-    TranslatedLength = PrefixReplacement.length() + TranslatedSuffixLength;
-    TranslatedPath.resize(TranslatedLength, '\0');
-    Suffix = &TranslatedPath[PrefixReplacement.length()];
-    if (TranslatedSuffixLength != SuffixLength)
-    {
         //
-        // If the suffix is empty and the replacement prefix is just a drive
-        // letter, append a backslash. Otherwise, escape and append the
-        // suffix.
+        // N.B. If no character had to be escaped, duplicate separators are
+        //      collapsed like they are for Windows to Linux translations.
         //
 
-        if ((SuffixLength == 0) && (TranslatedSuffixLength == 1))
-        {
-            *Suffix = PATH_SEP_NT;
-        }
-        else
+        if (EscapePathForNt(&Path[PrefixLength], TranslatedPath) != false)
         {
-            EscapePathForNt(&Path[PrefixLength], Suffix);
+            return TranslatedPath;
         }
     }
     else
     {
-        memcpy(Suffix, &Path[PrefixLength], SuffixLength);
+        TranslatedPath.append(&Path[PrefixLength], SuffixLength);
+    }
 
-        //
-        // Make sure the translated path uses the correct separators.
-        //
-        // N.B. This is done by the escape method if escaping is necessary.
-        //
+    //
+    // Make sure the translated path uses the correct separators.
+    //
 
-        UtilCanonicalisePathSeparator(Suffix, Reverse ? PATH_SEP : PATH_SEP_NT);
-    }
+    TranslatedPath.resize(
+        PrefixReplacement.length() +
+        UtilCanonicalisePathSeparator(&TranslatedPath[PrefixReplacement.length()], Reverse ? PATH_SEP : PATH_SEP_NT));
 
     return TranslatedPath;
 }
@@ -3183,10 +3286,7 @@ try
     if (Reverse == false)
     {
         TranslatedPath += Prefix;
-        const size_t EscapedPathLength = EscapePathForNtLength(Path);
-        std::string EscapedPath(EscapedPathLength, '\0');
-        EscapePathForNt(Path, EscapedPath.data());
-        TranslatedPath += EscapedPath;
+        EscapePathForNt(Path, TranslatedPath);
     }
     else
     {
@@ -3530,9 +3630,80 @@ int ProcessCreateProcessMessage(wsl::shared::Transaction& Transaction, gsl::span
 }
 
 #define RECLAIM_PATH CGROUP_MOUNTPOINT "/memory.reclaim"
+#define CPU_PRESSURE_PATH "/proc/pressure/cpu"
+#define MEMORY_PRESSURE_PATH "/proc/pressure/memory"
+#define USER_MEMORY_EVENTS_PATH WSL_USER_CGROUP_PATH "/memory.events"
 
 namespace {
 
+constexpr auto c_pollInterval = std::chrono::seconds(10);
+
+// Length of the window of CPU idleness required before reclaiming.
+constexpr auto c_idleWindow = std::chrono::minutes(2);
+
+// How often an idle VM is rechecked for activity that didn't raise a pressure event.
+constexpr auto c_idleRecheckPeriod = std::chrono::minutes(10);
+
+constexpr unsigned long long c_busyThresholdPerMille = 5; // 0.5%
+
+// Reclaimable cache below this floor is always retained to protect a minimal working set.
+constexpr long long c_floorBytes = 128ll * 1024 * 1024;
+
+// Scale reclaim requests with the VM size while keeping individual operations bounded.
+constexpr long long c_minReclaimBytes = 256ll * 1024 * 1024;
+constexpr long long c_maxReclaimBytes = 1024ll * 1024 * 1024;
+
+// PSI triggers: 20ms of CPU contention, or 100ms of memory stall, within two seconds.
+//
+// N.B. Without CAP_SYS_RESOURCE, the kernel only accepts windows that are a multiple of two seconds.
+constexpr char c_cpuPressureTrigger[] = "some 20000 2000000";
+constexpr char c_memoryPressureTrigger[] = "some 100000 2000000";
+constexpr auto c_pressureWindow = std::chrono::seconds(2);
+
+// In WorkingSet mode, pages that weren't accessed for this long are cold, unless overridden on the kernel
+// command line (see WSL_COLD_PAGE_AGE_ENV).
+constexpr auto c_coldPageAge = std::chrono::minutes(5);
+
+// Cold memory of a cgroup below this size isn't worth a reclaim request.
+constexpr long long c_minColdBytes = 4ll * 1024 * 1024;
+
+// Parents of the cgroups whose memory is tracked separately: the distributions (see
+// UtilGetDistroCgroupPath) and non-distro processes of WSL, and the containers that Docker creates
+// with the cgroupfs or systemd cgroup driver.
+constexpr const char* c_workloadCgroupParents[] = {
+    WSL_USER_CGROUP_PATH, CGROUP_MOUNTPOINT "/docker", CGROUP_MOUNTPOINT "/system.slice"};
+
+// How often the per-cgroup reclaim statistics are logged, if they changed.
+constexpr auto c_cgroupStatisticsPeriod = std::chrono::minutes(10);
+
+// The per-cgroup reclaim statistics are also published in the cross-distro share, so they can be
+// queried from any distribution.
+constexpr char c_cgroupStatisticsPath[] = "/mnt/wsl/" WSL_MEMORY_RECLAIM_FILE;
+
+// The working set estimate of the last cold page scan is published in the cross-distro share too.
+constexpr char c_workingSetPath[] = "/mnt/wsl/" WSL_WORKING_SET_FILE;
+
+// memory.reclaim swappiness values that restrict reclaim to file-backed or anonymous memory.
+constexpr int c_fileSwappiness = 0;
+constexpr int c_anonymousSwappiness = 200;
+
+bool IsIdle(unsigned long long Busy, unsigned long long Total)
+{
+    return Total == 0 || Busy * 1000 <= Total * c_busyThresholdPerMille;
+}
+
+// Replace a published file atomically so readers never see a partial update.
+void PublishFile(const char* Path, const std::string& Content)
+{
+    const auto temporaryPath = std::format("{}.{}", Path, getpid());
+    if (WriteToFile(temporaryPath.c_str(), Content.c_str(), O_WRONLY | O_CLOEXEC | O_CREAT | O_TRUNC) == 0 &&
+        rename(temporaryPath.c_str(), Path) < 0)
+    {
+        LOG_ERROR("rename({}, {}) failed {}", temporaryPath, Path, errno);
+        unlink(temporaryPath.c_str());
+    }
+}
+
 class CpuIdleTracker
 {
 public:
@@ -3573,13 +3744,7 @@ public:
     }
 
 private:
-    static bool IsIdle(unsigned long long Busy, unsigned long long Total)
-    {
-        return Total == 0 || Busy * 1000 <= Total * c_busyThresholdPerMille;
-    }
-
-    static constexpr size_t c_windowIntervals = 12;                  // 2 minutes
-    static constexpr unsigned long long c_busyThresholdPerMille = 5; // 0.5%
+    static constexpr size_t c_windowIntervals = c_idleWindow / c_pollInterval;
 
     std::array<unsigned long long, c_windowIntervals> m_busyWindow{};
     std::array<unsigned long long, c_windowIntervals> m_totalWindow{};
@@ -3589,6 +3754,61 @@ private:
     size_t m_windowSamples = 0;
 };
 
+// Reads a procfs or cgroupfs file into a caller supplied buffer, without allocating.
+std::string_view ReadSmallFile(int Fd, const char* Path, char* Buffer, size_t Size)
+{
+    size_t Offset = 0;
+    while (Offset < Size)
+    {
+        const ssize_t Result = TEMP_FAILURE_RETRY(pread(Fd, Buffer + Offset, Size - Offset, Offset));
+        if (Result < 0)
+        {
+            LOG_ERROR("read({}) failed {}", Path, errno);
+            return {};
+        }
+        else if (Result == 0)
+        {
+            break;
+        }
+
+        Offset += Result;
+    }
+
+    return {Buffer, Offset};
+}
+
+std::string_view ReadSmallFile(const char* Path, char* Buffer, size_t Size)
+{
+    wil::unique_fd Fd{TEMP_FAILURE_RETRY(open(Path, O_RDONLY | O_CLOEXEC))};
+    if (!Fd)
+    {
+        LOG_ERROR("open({}) failed {}", Path, errno);
+        return {};
+    }
+
+    return ReadSmallFile(Fd.get(), Path, Buffer, Size);
+}
+
+// Parses the next decimal number in Text, skipping leading blanks.
+bool ParseNextNumber(std::string_view& Text, unsigned long long& Value)
+{
+    const auto Start = Text.find_first_not_of(" \t");
+    if (Start == std::string_view::npos)
+    {
+        return false;
+    }
+
+    Text.remove_prefix(Start);
+    const auto [End, Error] = std::from_chars(Text.data(), Text.data() + Text.size(), Value);
+    if (Error != std::errc{})
+    {
+        return false;
+    }
+
+    Text.remove_prefix(End - Text.data());
+    return true;
+}
+
 } // namespace
 
 static bool ReadCpuBusyIdle(unsigned long long& Busy, unsigned long long& Idle)
@@ -3615,22 +3835,9 @@ Return Value:
 --*/
 
 {
-    wil::unique_fd fd{TEMP_FAILURE_RETRY(open("/proc/stat", O_RDONLY | O_CLOEXEC))};
-    if (!fd)
-    {
-        LOG_ERROR("open(/proc/stat) failed {}", errno);
-        return false;
-    }
-
     char buffer[256];
-    const ssize_t result = TEMP_FAILURE_RETRY(read(fd.get(), buffer, sizeof(buffer) - 1));
-    if (result <= 0)
-    {
-        LOG_ERROR("read(/proc/stat) failed {}", errno);
-        return false;
-    }
-
-    buffer[result] = '\0';
+    std::string_view content = ReadSmallFile("/proc/stat", buffer, sizeof(buffer));
+    std::string_view line = UtilStringNextToken(content, '\n');
 
     //
     // Format: "cpu  user nice system idle iowait irq softirq steal ...". The user, nice, system, idle,
@@ -3638,123 +3845,134 @@ Return Value:
     // are ignored.
     //
 
-    static const std::regex cpuLine{R"(^cpu[ \t]+(\d+)[ \t]+(\d+)[ \t]+(\d+)[ \t]+(\d+)[ \t]+(\d+)(?:[ \t]+(\d+))?(?:[ \t]+(\d+))?(?:[ \t]+(\d+))?)"};
-    std::cmatch match;
-    if (!std::regex_search(buffer, match, cpuLine))
-    {
-        LOG_ERROR("failed to parse /proc/stat cpu line");
-        return false;
-    }
-
     unsigned long long fields[8] = {};
-    for (size_t index = 0; index < COUNT_OF(fields); index += 1)
+    size_t count = 0;
+    if (line.starts_with("cpu ") || line.starts_with("cpu\t"))
     {
-        if (match[index + 1].matched)
+        line.remove_prefix(3);
+        while (count < COUNT_OF(fields) && ParseNextNumber(line, fields[count]))
         {
-            fields[index] = strtoull(match[index + 1].first, nullptr, 10);
+            count += 1;
         }
     }
 
+    if (count < 5)
+    {
+        LOG_ERROR("failed to parse /proc/stat cpu line");
+        return false;
+    }
+
     Idle = fields[3] + fields[4];
     Busy = fields[0] + fields[1] + fields[2] + fields[5] + fields[6] + fields[7];
 
     return true;
 }
 
-static long long GetReclaimableCacheBytes()
+static long long ReadMemInfoBytes(std::initializer_list<std::string_view> Counters)
 
 /*++
 
 Routine Description:
 
-    This routine returns the amount of reclaimable file-backed page cache (in bytes) by parsing
-    /proc/meminfo. It counts only memory that cache reclaim can actually return to the host:
-    Active(file) + Inactive(file) + SReclaimable. Anonymous memory is excluded because reclaim of clean
-    cache cannot free it.
+    This routine returns the sum of the given /proc/meminfo counters, in bytes.
 
 Arguments:
 
-    None.
+    Counters - Supplies the names of the counters.
 
 Return Value:
 
-    Reclaimable cache in bytes, or -1 on failure.
+    The sum in bytes, or -1 on failure.
 
 --*/
 
 {
-    std::ifstream memInfo("/proc/meminfo");
-    if (!memInfo)
+    //
+    // The counters are in the first few lines of /proc/meminfo, so a partial read is enough.
+    //
+
+    char buffer[4096];
+    std::string_view content = ReadSmallFile("/proc/meminfo", buffer, sizeof(buffer));
+    if (content.empty())
     {
-        LOG_ERROR("failed to open /proc/meminfo");
         return -1;
     }
 
     // /proc/meminfo values are in kB.
-    long long activeFileKb = 0;
-    long long inactiveFileKb = 0;
-    long long reclaimableSlabKb = 0;
-    bool foundActiveFile = false;
-    bool foundInactiveFile = false;
-    bool foundReclaimableSlab = false;
-    std::string line;
-    while (std::getline(memInfo, line))
+    unsigned long long totalKb = 0;
+    size_t found = 0;
+    while (!content.empty())
     {
-        std::istringstream stream(line);
-        std::string name;
-        long long value = 0;
-        if (!(stream >> name >> value))
+        std::string_view line = UtilStringNextToken(content, '\n');
+        const auto separator = line.find(':');
+        if (separator == std::string_view::npos)
         {
             continue;
         }
 
-        if (name == "Active(file):")
-        {
-            activeFileKb = value;
-            foundActiveFile = true;
-        }
-        else if (name == "Inactive(file):")
-        {
-            inactiveFileKb = value;
-            foundInactiveFile = true;
-        }
-        else if (name == "SReclaimable:")
+        const auto name = line.substr(0, separator);
+        line.remove_prefix(separator + 1);
+        unsigned long long value = 0;
+        if (std::find(Counters.begin(), Counters.end(), name) != Counters.end() && ParseNextNumber(line, value))
         {
-            reclaimableSlabKb = value;
-            foundReclaimableSlab = true;
+            totalKb += value;
+            found += 1;
         }
     }
 
-    if (memInfo.bad())
+    if (found != Counters.size())
     {
-        LOG_ERROR("failed to read /proc/meminfo");
+        LOG_ERROR("failed to find memory counters in /proc/meminfo");
         return -1;
     }
 
-    if (!foundActiveFile || !foundInactiveFile || !foundReclaimableSlab)
-    {
-        LOG_ERROR("failed to find reclaimable cache counters in /proc/meminfo");
-        return -1;
-    }
+    return static_cast<long long>(totalKb) * 1024;
+}
+
+static long long GetReclaimableCacheBytes()
+
+/*++
+
+Routine Description:
+
+    This routine returns the amount of reclaimable file-backed page cache (in bytes) by parsing
+    /proc/meminfo. It counts only memory that cache reclaim can actually return to the host:
+    Active(file) + Inactive(file) + SReclaimable. Anonymous memory is excluded because reclaim of clean
+    cache cannot free it.
+
+Arguments:
+
+    None.
+
+Return Value:
+
+    Reclaimable cache in bytes, or -1 on failure.
 
-    return (activeFileKb + inactiveFileKb + reclaimableSlabKb) * 1024;
+--*/
+
+{
+    return ReadMemInfoBytes({"Active(file)", "Inactive(file)", "SReclaimable"});
 }
 
-static bool RequestReclaim(long long Bytes)
+static bool RequestReclaim(const char* Path, long long Bytes, int Swappiness)
 
 /*++
 
 Routine Description:
 
-    Best-effort write of a byte count to the cgroup memory.reclaim knob. EAGAIN is an expected outcome
+    Best-effort write of a byte count to a cgroup memory.reclaim knob. EAGAIN is an expected outcome
     (the kernel freed some, but not all, of the requested pages) and is treated as success without
     logging, so the long-lived reduction thread does not error out every interval. A transient failure
     never throws.
 
 Arguments:
 
+    Path - Supplies the path of the memory.reclaim knob.
+
     Bytes - Supplies the number of bytes to request the kernel reclaim.
 
+    Swappiness - Supplies the balance between anonymous (200) and file-backed (0) memory to reclaim.
+
 Return Value:
 
     true if pages were reclaimed (full success or EAGAIN), false otherwise.
@@ -3762,41 +3980,801 @@ Return Value:
 --*/
 
 {
-    wil::unique_fd fd{TEMP_FAILURE_RETRY(open(RECLAIM_PATH, O_WRONLY | O_CLOEXEC))};
+    wil::unique_fd fd{TEMP_FAILURE_RETRY(open(Path, O_WRONLY | O_CLOEXEC))};
     if (!fd)
     {
-        LOG_ERROR("open({}) failed {}", RECLAIM_PATH, errno);
+        LOG_ERROR("open({}) failed {}", Path, errno);
         return false;
     }
 
-    const std::string request = std::to_string(Bytes) + " swappiness=0";
+    char buffer[64];
+    const auto end = std::format_to_n(buffer, sizeof(buffer), "{} swappiness={}", Bytes, Swappiness).out;
+    const std::string_view request{buffer, static_cast<size_t>(end - buffer)};
     const ssize_t result = UtilWriteStringView(fd.get(), request);
     if (result == static_cast<ssize_t>(request.size()) || (result < 0 && errno == EAGAIN))
     {
         return true;
     }
 
-    LOG_ERROR("write({}, {}) failed {}", RECLAIM_PATH, request, errno);
+    LOG_ERROR("write({}, {}) failed {}", Path, request, errno);
     return false;
 }
 
-void StartMemoryReductionThread(LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode)
+namespace {
 
-/*++
+class CgroupTracker
+{
+public:
+    using Clock = std::chrono::steady_clock;
 
-Routine Description:
+    //
+    // Samples the CPU usage and page cache of each workload cgroup. A cgroup is active during an
+    // interval if it used CPU, or if pages of its cache that were reclaimed had to be read again.
+    //
 
-    This routine starts a background thread that reclaims cold page cache and compacts free pages while
-    the VM is idle, so the maximum number of pages can be discarded back to the host.
+    void Refresh()
+    {
+        const auto now = Clock::now();
+        const auto cpus = static_cast<unsigned long long>(std::max(get_nprocs(), 1));
+        for (auto& [path, cgroup] : m_cgroups)
+        {
+            cgroup.Present = false;
+        }
 
-    Reclaim is gated on CPU idle using a rolling window of all non-idle CPU time, not just user time.
-    Gradual mode reclaims cold file-backed page cache above a small floor via the cgroup memory.reclaim
-    knob, falling back to drop_caches when the knob is unavailable. DropCache mode uses drop_caches
-    directly. Freed pages are compacted so free-page reporting can hand back large blocks.
+        for (const auto* parent : c_workloadCgroupParents)
+        {
+            const wil::unique_dir directory{opendir(parent)};
+            if (!directory)
+            {
+                continue;
+            }
 
-Arguments:
+            while (const auto* entry = readdir(directory.get()))
+            {
+                if (entry->d_type != DT_DIR || entry->d_name[0] == '.')
+                {
+                    continue;
+                }
 
-    Mode - Supplies the memory reclaim mode.
+                auto path = std::format("{}/{}", parent, entry->d_name);
+                CgroupSample sample{};
+                if (!ReadSample(path, sample))
+                {
+                    continue;
+                }
+
+                auto [iterator, inserted] = m_cgroups.try_emplace(std::move(path));
+                auto& cgroup = iterator->second;
+                if (inserted)
+                {
+                    cgroup.LastActive = now;
+                }
+                else
+                {
+                    const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(now - cgroup.LastSample).count();
+                    const auto busy =
+                        sample.UsageUsec >= cgroup.Current.UsageUsec ? sample.UsageUsec - cgroup.Current.UsageUsec : 0;
+                    if (!IsIdle(busy, static_cast<unsigned long long>(elapsed) * cpus) ||
+                        sample.RefaultCount != cgroup.Current.RefaultCount)
+                    {
+                        cgroup.LastActive = now;
+                    }
+                }
+
+                cgroup.Current = sample;
+                cgroup.LastSample = now;
+                cgroup.Present = true;
+            }
+        }
+
+        std::erase_if(m_cgroups, [](const auto& entry) { return !entry.second.Present; });
+    }
+
+    //
+    // Reclaims up to Budget bytes of inactive page cache from the cgroups that were idle for the whole
+    // idle window, in proportion to their inactive cache. Returns the number of bytes reclaimed.
+    //
+
+    long long ReclaimFromIdleCgroups(long long Budget)
+    {
+        const auto now = Clock::now();
+        long long totalCold = 0;
+        for (const auto& [path, cgroup] : m_cgroups)
+        {
+            if (IsCandidate(cgroup, now))
+            {
+                totalCold += cgroup.Current.InactiveFileBytes;
+            }
+        }
+
+        if (totalCold == 0 || Budget <= 0)
+        {
+            return 0;
+        }
+
+        long long reclaimed = 0;
+        for (auto& [path, cgroup] : m_cgroups)
+        {
+            if (!IsCandidate(cgroup, now))
+            {
+                continue;
+            }
+
+            const long long cold = cgroup.Current.InactiveFileBytes;
+            const long long share =
+                totalCold <= Budget ? cold : static_cast<long long>(static_cast<double>(Budget) * cold / totalCold);
+            if (share < c_minColdBytes || !RequestReclaim((path + "/memory.reclaim").c_str(), share, c_fileSwappiness))
+            {
+                continue;
+            }
+
+            //
+            // Measure what the request freed.
+            //
+
+            CgroupSample sample{};
+            if (!ReadSample(path, sample))
+            {
+                continue;
+            }
+
+            const long long freed = std::max(cgroup.Current.FileBytes - sample.FileBytes, 0ll);
+            cgroup.Current.FileBytes = sample.FileBytes;
+            cgroup.Current.InactiveFileBytes = sample.InactiveFileBytes;
+            cgroup.Requests += 1;
+            cgroup.ReclaimedBytes += freed;
+            reclaimed += freed;
+        }
+
+        return reclaimed;
+    }
+
+    //
+    // Publishes the reclaim statistics of each cgroup, one line per cgroup, and logs them
+    // periodically if they changed.
+    //
+
+    void ReportStatistics()
+    {
+        const auto now = Clock::now();
+        std::string content;
+        for (const auto& [path, cgroup] : m_cgroups)
+        {
+            content += std::format(
+                "{} state={} page_cache_bytes={} reclaimed_bytes={} requests={}\n",
+                path,
+                now - cgroup.LastActive >= c_idleWindow ? "idle" : "active",
+                cgroup.Current.FileBytes,
+                cgroup.ReclaimedBytes,
+                cgroup.Requests);
+        }
+
+        PublishFile(c_cgroupStatisticsPath, content);
+
+        if (now - m_lastStatistics < c_cgroupStatisticsPeriod)
+        {
+            return;
+        }
+
+        m_lastStatistics = now;
+        for (auto& [path, cgroup] : m_cgroups)
+        {
+            if (cgroup.ReclaimedBytes == cgroup.LoggedBytes)
+            {
+                continue;
+            }
+
+            LOG_INFO(
+                "Reclaimed {} MB from {} in {} requests, {} MB of page cache left ({})",
+                cgroup.ReclaimedBytes >> 20,
+                path,
+                cgroup.Requests,
+                cgroup.Current.FileBytes >> 20,
+                now - cgroup.LastActive >= c_idleWindow ? "idle" : "active");
+
+            cgroup.LoggedBytes = cgroup.ReclaimedBytes;
+        }
+    }
+
+private:
+    struct CgroupSample
+    {
+        unsigned long long UsageUsec;
+        unsigned long long RefaultCount;
+        long long FileBytes;
+        long long InactiveFileBytes;
+    };
+
+    struct CgroupState
+    {
+        CgroupSample Current{};
+        Clock::time_point LastSample;
+        Clock::time_point LastActive;
+        unsigned long long Requests = 0;
+        unsigned long long ReclaimedBytes = 0;
+        unsigned long long LoggedBytes = 0;
+        bool Present = false;
+    };
+
+    static bool IsCandidate(const CgroupState& State, Clock::time_point Now)
+    {
+        return Now - State.LastActive >= c_idleWindow && State.Current.InactiveFileBytes >= c_minColdBytes;
+    }
+
+    static bool ReadSample(const std::string& Path, CgroupSample& Sample)
+    {
+        //
+        // Cgroups without the memory controller are charged to their parent.
+        //
+
+        const auto memoryStat = Path + "/memory.stat";
+        if (access(memoryStat.c_str(), R_OK) < 0)
+        {
+            return false;
+        }
+
+        char buffer[8192];
+        std::string_view content = ReadSmallFile(memoryStat.c_str(), buffer, sizeof(buffer));
+        bool found = false;
+        unsigned long long activeFile = 0;
+        unsigned long long inactiveFile = 0;
+        Sample = {};
+        while (!content.empty())
+        {
+            std::string_view line = UtilStringNextToken(content, '\n');
+            const auto name = UtilStringNextToken(line, ' ');
+            unsigned long long value = 0;
+            if (!ParseNextNumber(line, value))
+            {
+                continue;
+            }
+
+            if (name == "active_file")
+            {
+                activeFile = value;
+                found = true;
+            }
+            else if (name == "inactive_file")
+            {
+                inactiveFile = value;
+            }
+            else if (name == "workingset_refault_file")
+            {
+                Sample.RefaultCount = value;
+            }
+        }
+
+        if (!found)
+        {
+            return false;
+        }
+
+        Sample.FileBytes = static_cast<long long>(activeFile + inactiveFile);
+        Sample.InactiveFileBytes = static_cast<long long>(inactiveFile);
+
+        //
+        // cpu.stat is always present and starts with usage_usec.
+        //
+
+        const auto cpuStat = Path + "/cpu.stat";
+        content = ReadSmallFile(cpuStat.c_str(), buffer, sizeof(buffer));
+        std::string_view line = UtilStringNextToken(content, '\n');
+        return UtilStringNextToken(line, ' ') == "usage_usec" && ParseNextNumber(line, Sample.UsageUsec);
+    }
+
+    std::map<std::string, CgroupState> m_cgroups;
+    Clock::time_point m_lastStatistics{};
+};
+
+class IdleReclaimer
+{
+public:
+    IdleReclaimer(bool UseReclaim, long long StepBytes) : m_useReclaim(UseReclaim), m_stepBytes(StepBytes)
+    {
+    }
+
+    //
+    // Reclaims cold cache and compacts memory once the VM is idle. Returns true if any memory
+    // operation was performed.
+    //
+
+    bool Step()
+    {
+        bool reclaimed = false;
+        m_pending = false;
+        if (m_useReclaim)
+        {
+            const long long cache = GetReclaimableCacheBytes();
+            if (cache > c_floorBytes)
+            {
+                //
+                // Reclaim from the idle cgroups first, and from the whole VM for the rest.
+                //
+
+                const long long bytes = std::min(cache - c_floorBytes, m_stepBytes);
+                m_cgroups.Refresh();
+                const long long fromCgroups = m_cgroups.ReclaimFromIdleCgroups(bytes);
+                reclaimed = fromCgroups > 0;
+                if (bytes - fromCgroups >= c_minColdBytes)
+                {
+                    reclaimed |= RequestReclaim(RECLAIM_PATH, bytes - fromCgroups, c_fileSwappiness);
+                }
+
+                m_pending = reclaimed && (cache - c_floorBytes) > bytes;
+                m_cgroups.ReportStatistics();
+            }
+        }
+        else if (!m_dropped)
+        {
+            //
+            // drop_caches=3 frees the page cache along with reclaimable slab (dentries and
+            // inodes), matching the SReclaimable slab counted by GetReclaimableCacheBytes.
+            //
+
+            if (WriteToFile("/proc/sys/vm/drop_caches", "3\n") == 0)
+            {
+                m_dropped = true;
+                reclaimed = true;
+            }
+        }
+
+        //
+        // Coalesce freed pages into larger blocks for efficient page reporting.
+        //
+
+        bool memoryOperation = reclaimed;
+        if (!m_compacted || reclaimed)
+        {
+            if (WriteToFile("/proc/sys/vm/compact_memory", "1\n") == 0)
+            {
+                m_compacted = true;
+                memoryOperation = true;
+            }
+        }
+
+        return memoryOperation;
+    }
+
+    //
+    // Reclaims cold cache from the cgroups that are idle while the VM as a whole isn't, at most once
+    // per idle window. Returns true if any memory was reclaimed.
+    //
+
+    bool StepIdleCgroups()
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (!m_useReclaim || now - m_lastCgroupStep < c_idleWindow)
+        {
+            return false;
+        }
+
+        m_lastCgroupStep = now;
+        const long long cache = GetReclaimableCacheBytes();
+        if (cache <= c_floorBytes)
+        {
+            return false;
+        }
+
+        m_cgroups.Refresh();
+        const bool reclaimed = m_cgroups.ReclaimFromIdleCgroups(std::min(cache - c_floorBytes, m_stepBytes)) > 0;
+        m_cgroups.ReportStatistics();
+        return reclaimed;
+    }
+
+    //
+    // Returns true if the last step left cache above the floor that a further step can reclaim.
+    //
+
+    bool Pending() const
+    {
+        return m_pending;
+    }
+
+    //
+    // Starts a new idle period.
+    //
+
+    void Reset()
+    {
+        m_dropped = false;
+        m_compacted = false;
+        m_pending = false;
+    }
+
+private:
+    const bool m_useReclaim;
+    const long long m_stepBytes;
+    CgroupTracker m_cgroups;
+    std::chrono::steady_clock::time_point m_lastCgroupStep{};
+    bool m_dropped = false;
+    bool m_compacted = false;
+    bool m_pending = false;
+};
+
+wil::unique_fd OpenPressureTrigger(const char* Path, const char* Trigger)
+{
+    wil::unique_fd fd{TEMP_FAILURE_RETRY(open(Path, O_RDWR | O_NONBLOCK | O_CLOEXEC))};
+    if (!fd)
+    {
+        LOG_WARNING("open({}) failed {}", Path, errno);
+        return {};
+    }
+
+    if (TEMP_FAILURE_RETRY(write(fd.get(), Trigger, strlen(Trigger) + 1)) < 0)
+    {
+        LOG_WARNING("write({}, {}) failed {}", Path, Trigger, errno);
+        return {};
+    }
+
+    return fd;
+}
+
+// Returns the number of times the memory of the WSL user cgroup went over its limits.
+unsigned long long ReadMemoryEventCount(int Fd)
+{
+    char buffer[256];
+    std::string_view content = ReadSmallFile(Fd, USER_MEMORY_EVENTS_PATH, buffer, sizeof(buffer));
+    unsigned long long count = 0;
+    while (!content.empty())
+    {
+        std::string_view line = UtilStringNextToken(content, '\n');
+        const auto name = UtilStringNextToken(line, ' ');
+        unsigned long long value = 0;
+        if ((name == "high" || name == "max" || name == "oom") && ParseNextNumber(line, value))
+        {
+            count += value;
+        }
+    }
+
+    return count;
+}
+
+void ReclaimOnPressureEvents(IdleReclaimer& Reclaimer, const wil::unique_fd& CpuTrigger, const wil::unique_fd& MemoryTrigger)
+
+/*++
+
+Routine Description:
+
+    This routine reclaims memory when the VM becomes idle, sleeping until an event requires a
+    decision instead of sampling CPU usage at a fixed interval.
+
+    The thread sleeps until the idle window elapses, then checks the CPU usage over the whole window
+    with a single /proc/stat sample. Once the VM is idle, reclaim starts immediately and continues
+    while cache remains above the floor. While idle, the PSI triggers report CPU contention or memory
+    stalls, and memory.events reports the WSL user cgroup reaching its limits; any of these ends the
+    idle period and starts a new window.
+
+Arguments:
+
+    Reclaimer - Supplies the reclaimer.
+
+    CpuTrigger - Supplies the CPU pressure trigger.
+
+    MemoryTrigger - Supplies the memory pressure trigger.
+
+Return Value:
+
+    None. Returns if the triggers stop working, so the caller can fall back to polling.
+
+--*/
+
+{
+    using Clock = std::chrono::steady_clock;
+
+    unsigned long long windowBusy = 0;
+    unsigned long long windowIdle = 0;
+    auto sampleWindow = [&]() {
+        if (!ReadCpuBusyIdle(windowBusy, windowIdle))
+        {
+            windowBusy = 0;
+            windowIdle = 0;
+        }
+    };
+
+    sampleWindow();
+    std::optional<Clock::time_point> deadline = Clock::now() + c_idleWindow;
+    bool idle = false;
+
+    //
+    // Reclaim and compaction stall the thread itself, so trigger events that follow them are ignored
+    // for one trigger window.
+    //
+
+    Clock::time_point quietUntil{};
+
+    wil::unique_fd memoryEvents;
+    unsigned long long memoryEventCount = 0;
+
+    for (;;)
+    {
+        //
+        // The WSL user cgroup is created after this thread starts.
+        //
+
+        if (!memoryEvents)
+        {
+            memoryEvents.reset(TEMP_FAILURE_RETRY(open(USER_MEMORY_EVENTS_PATH, O_RDONLY | O_CLOEXEC)));
+            if (memoryEvents)
+            {
+                memoryEventCount = ReadMemoryEventCount(memoryEvents.get());
+            }
+        }
+
+        //
+        // The pressure triggers are only needed while idle. Outside of an idle period, the CPU usage
+        // is checked once the window elapses, so trigger events wouldn't change anything.
+        //
+
+        pollfd pollDescriptors[] = {
+            {idle ? CpuTrigger.get() : -1, POLLPRI, 0},
+            {idle ? MemoryTrigger.get() : -1, POLLPRI, 0},
+            {memoryEvents ? memoryEvents.get() : -1, POLLPRI, 0},
+        };
+
+        int timeout = -1;
+        if (deadline.has_value())
+        {
+            const auto remaining = std::chrono::ceil<std::chrono::milliseconds>(deadline.value() - Clock::now());
+            timeout = static_cast<int>(std::max<long long>(remaining.count(), 0));
+        }
+
+        const int result = poll(pollDescriptors, COUNT_OF(pollDescriptors), timeout);
+        if (result < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            LOG_ERROR("poll failed {}", errno);
+            return;
+        }
+
+        if (((pollDescriptors[0].revents | pollDescriptors[1].revents) & (POLLERR | POLLNVAL)) != 0)
+        {
+            LOG_ERROR("PSI trigger failed");
+            return;
+        }
+
+        const auto now = Clock::now();
+        bool activity = ((pollDescriptors[0].revents | pollDescriptors[1].revents) & POLLPRI) != 0 && now >= quietUntil;
+        if (pollDescriptors[2].revents != 0)
+        {
+            const auto count = ReadMemoryEventCount(memoryEvents.get());
+            activity |= count != memoryEventCount;
+            memoryEventCount = count;
+            if ((pollDescriptors[2].revents & (POLLERR | POLLNVAL)) != 0)
+            {
+                memoryEvents.reset();
+            }
+        }
+
+        if (activity)
+        {
+            sampleWindow();
+            deadline = now + c_idleWindow;
+            idle = false;
+            Reclaimer.Reset();
+            continue;
+        }
+        else if (!deadline.has_value() || now < deadline.value())
+        {
+            continue;
+        }
+
+        //
+        // The deadline elapsed: check whether the CPU was idle since the window started.
+        //
+
+        const unsigned long long previousBusy = windowBusy;
+        const unsigned long long previousIdle = windowIdle;
+        sampleWindow();
+        if (windowBusy < previousBusy || windowIdle < previousIdle ||
+            !IsIdle(windowBusy - previousBusy, (windowBusy - previousBusy) + (windowIdle - previousIdle)))
+        {
+            //
+            // Some cgroups can be idle while others keep the VM busy.
+            //
+
+            if (Reclaimer.StepIdleCgroups())
+            {
+                sampleWindow();
+            }
+
+            deadline = now + c_idleWindow;
+            idle = false;
+            Reclaimer.Reset();
+            continue;
+        }
+
+        //
+        // The VM is idle. Without pending work, the thread sleeps until an event; activity that
+        // raises no event is caught by an occasional recheck, and the cache it left is reclaimed
+        // after the next idle window.
+        //
+
+        if (idle && !Reclaimer.Pending())
+        {
+            deadline = now + c_idleRecheckPeriod;
+            continue;
+        }
+
+        //
+        // Clear the trigger events raised while the window was running, since they're stale.
+        //
+
+        if (!idle)
+        {
+            pollfd triggers[] = {{CpuTrigger.get(), POLLPRI, 0}, {MemoryTrigger.get(), POLLPRI, 0}};
+            TEMP_FAILURE_RETRY(poll(triggers, COUNT_OF(triggers), 0));
+            idle = true;
+        }
+
+        if (Reclaimer.Step())
+        {
+            //
+            // Exclude the reclaim/compaction work from the next check.
+            //
+
+            sampleWindow();
+            quietUntil = Clock::now() + c_pressureWindow;
+        }
+
+        deadline = Clock::now() + (Reclaimer.Pending() ? c_pollInterval : c_idleRecheckPeriod);
+    }
+}
+
+void ReclaimColdPages(
+    ColdPageTracker& Tracker,
+    std::chrono::seconds Age,
+    const std::function<void(const LX_MINI_INIT_WORKING_SET_MESSAGE&)>& ReportWorkingSet)
+
+/*++
+
+Routine Description:
+
+    This routine periodically reclaims the memory that wasn't accessed for the given age, from the
+    cgroup it's charged to, and reports the estimated working set to the host. The estimate of the
+    last scan is also published in /mnt/wsl/working-set.
+
+    Reclaim doesn't wait for the VM to be idle since only cold memory is targeted. Cold file-backed
+    memory is always reclaimed, and cold anonymous memory is swapped out if swap is available. The
+    kernel picks the pages from the tail of the cgroup's LRU lists, so the amount of cold memory
+    measured bounds each request. The working set is the memory on the LRU lists that isn't cold.
+
+Arguments:
+
+    Tracker - Supplies the cold page tracker.
+
+    Age - Supplies the age after which pages are cold. This is also the scan interval.
+
+    ReportWorkingSet - Supplies the routine that sends the working set estimate to the host.
+
+Return Value:
+
+    None. Returns if the tracker stops working, so the caller can fall back to another mode.
+
+--*/
+
+try
+{
+    LOG_INFO("Tracking cold pages with {}", Tracker.Backend());
+
+    for (;;)
+    {
+        std::this_thread::sleep_for(Age);
+
+        const auto cold = Tracker.Scan();
+        const long long lruBytes = ReadMemInfoBytes({"Active(anon)", "Inactive(anon)", "Active(file)", "Inactive(file)"});
+
+        struct sysinfo before = {};
+        THROW_LAST_ERROR_IF(sysinfo(&before) < 0);
+
+        LX_MINI_INIT_WORKING_SET_MESSAGE message{};
+        message.Header.MessageType = LxMiniInitMessageWorkingSet;
+        message.Header.MessageSize = sizeof(message);
+
+        bool reclaimed = false;
+        for (const auto& memory : cold)
+        {
+            message.ColdAnonymousBytes += memory.AnonymousBytes;
+            message.ColdFileBytes += memory.FileBytes;
+
+            const auto path = memory.Cgroup + "/memory.reclaim";
+            if (static_cast<long long>(memory.FileBytes) >= c_minColdBytes)
+            {
+                reclaimed |= RequestReclaim(
+                    path.c_str(), std::min(static_cast<long long>(memory.FileBytes), c_maxReclaimBytes), c_fileSwappiness);
+            }
+
+            if (before.freeswap > 0 && static_cast<long long>(memory.AnonymousBytes) >= c_minColdBytes)
+            {
+                reclaimed |= RequestReclaim(
+                    path.c_str(),
+                    std::min(static_cast<long long>(memory.AnonymousBytes), c_maxReclaimBytes),
+                    c_anonymousSwappiness);
+            }
+        }
+
+        struct sysinfo after = {};
+        THROW_LAST_ERROR_IF(sysinfo(&after) < 0);
+        if (after.freeram > before.freeram)
+        {
+            message.ReclaimedBytes = static_cast<uint64_t>(after.freeram - before.freeram) * after.mem_unit;
+        }
+
+        //
+        // Coalesce freed pages into larger blocks for efficient page reporting.
+        //
+
+        if (reclaimed)
+        {
+            WriteToFile("/proc/sys/vm/compact_memory", "1\n");
+        }
+
+        const uint64_t coldBytes = message.ColdAnonymousBytes + message.ColdFileBytes;
+        if (lruBytes >= 0)
+        {
+            message.WorkingSetBytes =
+                static_cast<uint64_t>(lruBytes) > coldBytes ? static_cast<uint64_t>(lruBytes) - coldBytes : 0;
+        }
+
+        PublishFile(
+            c_workingSetPath,
+            std::format(
+                "working_set_bytes={} cold_anonymous_bytes={} cold_file_bytes={} reclaimed_bytes={}\n",
+                message.WorkingSetBytes,
+                message.ColdAnonymousBytes,
+                message.ColdFileBytes,
+                message.ReclaimedBytes));
+
+        if (ReportWorkingSet)
+        {
+            ReportWorkingSet(message);
+        }
+    }
+}
+CATCH_LOG()
+
+} // namespace
+
+void StartMemoryReductionThread(
+    LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode,
+    std::function<void(const LX_MINI_INIT_WORKING_SET_MESSAGE&)> ReportWorkingSet,
+    std::optional<std::chrono::seconds> ColdPageAge)
+
+/*++
+
+Routine Description:
+
+    This routine starts a background thread that reclaims cold page cache and compacts free pages while
+    the VM is idle, so the maximum number of pages can be discarded back to the host.
+
+    Reclaim is gated on CPU idle using a rolling window of all non-idle CPU time, not just user time.
+    Gradual mode reclaims cold file-backed page cache above a small floor via the cgroup memory.reclaim
+    knob, falling back to drop_caches when the knob is unavailable. DropCache mode uses drop_caches
+    directly. Freed pages are compacted so free-page reporting can hand back large blocks.
+
+    Gradual mode tracks the distribution, non-distro and container cgroups separately (see
+    CgroupTracker): cgroups that stayed idle for the idle window are reclaimed first, in proportion to
+    their inactive cache, and even while other cgroups keep the VM busy. The statistics of each cgroup
+    are published in /mnt/wsl/memory-reclaim.
+
+    WorkingSet mode reclaims the memory that wasn't accessed recently instead (see ReclaimColdPages),
+    and falls back to Gradual mode when the kernel can't measure access recency.
+
+    When the kernel supports PSI triggers, the thread is driven by pressure events (see
+    ReclaimOnPressureEvents). Otherwise, CPU usage is sampled at a fixed interval.
+
+Arguments:
+
+    Mode - Supplies the memory reclaim mode.
+
+    ReportWorkingSet - Supplies the routine that sends the working set estimate to the host, in
+        WorkingSet mode.
+
+    ColdPageAge - Supplies an optional override of the age after which pages are cold, in WorkingSet
+        mode.
 
 Return Value:
 
@@ -3811,7 +4789,7 @@ try
         return;
     }
 
-    std::thread([Mode]() {
+    std::thread([Mode, ReportWorkingSet = std::move(ReportWorkingSet), ColdPageAge]() {
         try
         {
             //
@@ -3834,26 +4812,39 @@ try
                 useReclaim = false;
             }
 
-            constexpr auto c_pollInterval = std::chrono::seconds(10);
-
-            // Reclaimable cache below this floor is always retained to protect a minimal working set.
-            constexpr long long c_floorBytes = 128ll * 1024 * 1024;
+            if (useReclaim && Mode == LxMiniInitMemoryReclaimModeWorkingSet)
+            {
+                const auto age = ColdPageAge.value_or(c_coldPageAge);
+                if (const auto tracker = ColdPageTracker::Create(age))
+                {
+                    ReclaimColdPages(*tracker, age, ReportWorkingSet);
+                }
 
-            // Scale reclaim requests with the VM size while keeping individual operations bounded.
-            constexpr long long c_minReclaimBytes = 256ll * 1024 * 1024;
-            constexpr long long c_maxReclaimBytes = 1024ll * 1024 * 1024;
+                LOG_WARNING("Cold page tracking is unavailable, falling back to gradual memory reclaim");
+            }
 
             struct sysinfo info = {};
             THROW_LAST_ERROR_IF(sysinfo(&info) < 0);
 
-            long long reclaimStepBytes = (static_cast<long long>(info.totalram) * info.mem_unit) / 32;
-            if (reclaimStepBytes < c_minReclaimBytes)
-            {
-                reclaimStepBytes = c_minReclaimBytes;
-            }
-            else if (reclaimStepBytes > c_maxReclaimBytes)
+            const long long reclaimStepBytes =
+                std::clamp((static_cast<long long>(info.totalram) * info.mem_unit) / 32, c_minReclaimBytes, c_maxReclaimBytes);
+
+            IdleReclaimer reclaimer{useReclaim, reclaimStepBytes};
+
+            //
+            // Prefer PSI triggers, and fall back to polling if they are unavailable or stop working.
+            //
+
             {
-                reclaimStepBytes = c_maxReclaimBytes;
+                const auto cpuTrigger = OpenPressureTrigger(CPU_PRESSURE_PATH, c_cpuPressureTrigger);
+                const auto memoryTrigger = OpenPressureTrigger(MEMORY_PRESSURE_PATH, c_memoryPressureTrigger);
+                if (cpuTrigger && memoryTrigger)
+                {
+                    ReclaimOnPressureEvents(reclaimer, cpuTrigger, memoryTrigger);
+                }
+
+                LOG_WARNING("PSI triggers are unavailable, polling for memory reclaim");
+                reclaimer.Reset();
             }
 
             unsigned long long previousBusy = 0;
@@ -3862,9 +4853,6 @@ try
 
             CpuIdleTracker idleTracker;
 
-            bool droppedThisIdlePeriod = false;
-            bool compactedThisIdlePeriod = false;
-
             for (;;)
             {
                 std::this_thread::sleep_for(c_pollInterval);
@@ -3893,8 +4881,7 @@ try
                     previousBusy = busy;
                     previousIdle = idle;
                     idleTracker.Reset();
-                    droppedThisIdlePeriod = false;
-                    compactedThisIdlePeriod = false;
+                    reclaimer.Reset();
                     continue;
                 }
 
@@ -3906,8 +4893,12 @@ try
                 const auto idleState = idleTracker.AddSample(busyDelta, totalDelta);
                 if (!idleState.WindowIdle)
                 {
-                    droppedThisIdlePeriod = false;
-                    compactedThisIdlePeriod = false;
+                    reclaimer.Reset();
+                    if (reclaimer.StepIdleCgroups() && !ReadCpuBusyIdle(previousBusy, previousIdle))
+                    {
+                        havePreviousSample = false;
+                    }
+
                     continue;
                 }
 
@@ -3921,65 +4912,17 @@ try
                 }
 
                 //
-                // The VM is idle: reclaim cold cache and compact.
-                //
-
-                bool reclaimed = false;
-                if (useReclaim)
-                {
-                    const long long cache = GetReclaimableCacheBytes();
-                    if (cache > c_floorBytes)
-                    {
-                        long long bytes = cache - c_floorBytes;
-                        if (bytes > reclaimStepBytes)
-                        {
-                            bytes = reclaimStepBytes;
-                        }
-
-                        reclaimed = RequestReclaim(bytes);
-                    }
-                }
-                else if (!droppedThisIdlePeriod)
-                {
-                    //
-                    // drop_caches=3 frees the page cache along with reclaimable slab (dentries and
-                    // inodes), matching the SReclaimable slab counted by GetReclaimableCacheBytes.
-                    //
-
-                    if (WriteToFile("/proc/sys/vm/drop_caches", "3\n") == 0)
-                    {
-                        droppedThisIdlePeriod = true;
-                        reclaimed = true;
-                    }
-                }
-
-                //
-                // Coalesce freed pages into larger blocks for efficient page reporting.
-                //
-
-                bool memoryOperation = reclaimed;
-                if (!compactedThisIdlePeriod || reclaimed)
-                {
-                    if (WriteToFile("/proc/sys/vm/compact_memory", "1\n") == 0)
-                    {
-                        compactedThisIdlePeriod = true;
-                        memoryOperation = true;
-                    }
-                }
-
-                //
-                // Exclude the reclaim/compaction work from the next utilization interval so it does not
-                // restart the grace period itself.
+                // The VM is idle: reclaim cold cache and compact. Exclude the reclaim/compaction work
+                // from the next utilization interval so it does not restart the grace period itself.
                 //
 
-                if (memoryOperation)
+                if (reclaimer.Step())
                 {
                     if (!ReadCpuBusyIdle(previousBusy, previousIdle))
                     {
                         havePreviousSample = false;
                         idleTracker.Reset();
-                        droppedThisIdlePeriod = false;
-                        compactedThisIdlePeriod = false;
+                        reclaimer.Reset();
                     }
                 }
             }
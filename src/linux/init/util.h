@@ -79,6 +79,8 @@ struct WslDistributionConfig;
 #define WSL_FEATURE_FLAGS_ENV "WSL_FEATURE_FLAGS"
 #define WSL_INTEROP_SOCKET "interop"
 #define WSL_INTEROP_SOCKET_FORMAT "{}/{}_{}"
+#define WSL_INTEROP_SESSION_CACHE "session"
+#define WSL_INTEROP_SESSION_CACHE_FORMAT "{}/{}_{}_{}_{}"
 #define WSL_TEMP_FOLDER RUN_FOLDER "/WSL"
 #define WSL_TEMP_FOLDER_MODE 0777
 #define WSL_INIT_INTEROP_SOCKET WSL_TEMP_FOLDER "/1_" WSL_INTEROP_SOCKET
@@ -340,7 +342,10 @@ uint16_t UtilWinAfToLinuxAf(uint16_t AddressFamily);
 int WriteToFile(const char* Path, const char* Content, int OpenFlags = O_WRONLY | O_CLOEXEC | O_CREAT, int Permissions = 0644);
 
 // Starts a background thread that performs memory compaction and optional cache reclaim when the VM is idle.
-void StartMemoryReductionThread(LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode);
+void StartMemoryReductionThread(
+    LX_MINI_INIT_MEMORY_RECLAIM_MODE Mode,
+    std::function<void(const LX_MINI_INIT_WORKING_SET_MESSAGE&)> ReportWorkingSet = {},
+    std::optional<std::chrono::seconds> ColdPageAge = {});
 
 int ProcessCreateProcessMessage(wsl::shared::Transaction& Transaction, gsl::span<gsl::byte> Buffer, const std::optional<std::string>& DistroCgroupPath);
 
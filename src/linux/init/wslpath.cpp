@@ -41,6 +41,8 @@ void Die(const char* Argv0, int Error, bool PrintUsage, const char* Message, ...
 
 std::string DosToCanonicalPath(char* Path, char* UnixCwd, size_t UnixCwdSize, bool* Relative);
 
+int TranslateStream(const char* Argv0, int Flags, char Mode, char Delimiter);
+
 std::string AbsolutePath(char* Path, char* Cwd, size_t CwdSize, bool* Relative)
 
 /*++
@@ -404,6 +406,131 @@ Return Value:
     return std::string(SuffixString);
 }
 
+int TranslateStream(const char* Argv0, int Flags, char Mode, char Delimiter)
+
+/*++
+
+Routine Description:
+
+    This routine translates the paths read from stdin, one per record, and
+    writes the translated paths to stdout in the same order, each followed by
+    the delimiter.
+
+    If a path can't be translated, an error is written to stderr and an empty
+    record is written to stdout, so the output stays aligned with the input.
+
+    N.B. The output is flushed whenever all the input read so far has been
+         translated, so a caller can also send one path at a time and wait for
+         the result.
+
+Arguments:
+
+    Argv0 - Supplies the name of the program.
+
+    Flags - Supplies flags for the translation.
+
+    Mode - Supplies the translation mode.
+
+    Delimiter - Supplies the character that terminates each record.
+
+Return Value:
+
+    0 if all paths were translated, 1 otherwise.
+
+--*/
+
+{
+    std::vector<char> Buffer(64 * 1024);
+    bool Failed = false;
+    size_t Length = 0;
+    std::string OriginalPath;
+    std::string OutputPath;
+
+    for (;;)
+    {
+        //
+        // Keep room for a terminator after the last record, which may not be
+        // followed by a delimiter.
+        //
+
+        if (Length + 1 >= Buffer.size())
+        {
+            Buffer.resize(Buffer.size() * 2);
+        }
+
+        auto BytesRead = TEMP_FAILURE_RETRY(read(STDIN_FILENO, Buffer.data() + Length, Buffer.size() - Length - 1));
+        if (BytesRead < 0)
+        {
+            Die(Argv0, errno, false, nullptr);
+        }
+
+        const bool EndOfFile = (BytesRead == 0);
+        Length += BytesRead;
+
+        size_t Offset = 0;
+        while (Offset < Length)
+        {
+            char* Path = Buffer.data() + Offset;
+            char* End = static_cast<char*>(memchr(Path, Delimiter, Length - Offset));
+            if (End == nullptr)
+            {
+                if (!EndOfFile)
+                {
+                    break;
+                }
+
+                End = Buffer.data() + Length;
+            }
+
+            *End = '\0';
+            Offset = (End - Buffer.data()) + 1;
+
+            //
+            // The translation modifies the path in place, so keep the original
+            // for the error message.
+            //
+
+            OriginalPath = Path;
+            errno = 0;
+            OutputPath = WslPathTranslate(Path, Flags, Mode);
+            if (OutputPath.empty())
+            {
+                fprintf(stderr, "%s: %s", Argv0, OriginalPath.c_str());
+                if (errno != 0)
+                {
+                    fprintf(stderr, ": %s", strerror(errno));
+                }
+
+                fputs("\n", stderr);
+                Failed = true;
+            }
+
+            fwrite(OutputPath.data(), 1, OutputPath.size(), stdout);
+            putc(Delimiter, stdout);
+        }
+
+        //
+        // Move the incomplete record, if any, to the start of the buffer.
+        //
+
+        Offset = std::min(Offset, Length);
+        memmove(Buffer.data(), Buffer.data() + Offset, Length - Offset);
+        Length -= Offset;
+
+        if (fflush(stdout) != 0)
+        {
+            Die(Argv0, errno, false, nullptr);
+        }
+
+        if (EndOfFile)
+        {
+            break;
+        }
+    }
+
+    return Failed ? 1 : 0;
+}
+
 int WslPathEntry(int Argc, char* Argv[])
 
 /*++
@@ -425,8 +552,10 @@ Return Value:
 --*/
 
 {
+    bool Batch = false;
     int Flags = TRANSLATE_FLAG_RESOLVE_SYMLINKS;
     std::optional<char> Mode;
+    bool NullDelimited = false;
     const char* OriginalPath{};
     std::string OutputPath;
     int Result{};
@@ -449,6 +578,8 @@ Return Value:
     parser.AddArgument(UniqueSetValue<char, TRANSLATE_MODE_WINDOWS>{Mode, Usage}, nullptr, TRANSLATE_MODE_WINDOWS);
     parser.AddArgument(UniqueSetValue<char, TRANSLATE_MODE_MIXED>{Mode, Usage}, nullptr, TRANSLATE_MODE_MIXED);
     parser.AddArgument(UniqueSetValue<char, TRANSLATE_MODE_HELP>{Mode, Usage}, "--help");
+    parser.AddArgument(Batch, nullptr, WSLPATH_OPTION_BATCH);
+    parser.AddArgument(NullDelimited, nullptr, WSLPATH_OPTION_NULL);
 
     try
     {
@@ -460,7 +591,26 @@ Return Value:
         return 1;
     }
 
-    if (OriginalPath == nullptr || Mode == TRANSLATE_MODE_HELP)
+    if (Mode == TRANSLATE_MODE_HELP || (NullDelimited && !Batch))
+    {
+        INVALID_USAGE();
+    }
+
+    //
+    // In batch mode, the paths are read from stdin instead of the command line.
+    //
+
+    if (Batch)
+    {
+        if (OriginalPath != nullptr)
+        {
+            INVALID_USAGE();
+        }
+
+        return TranslateStream(Argv[0], Flags, Mode.value_or(TRANSLATE_MODE_UNIX), NullDelimited ? '\0' : '\n');
+    }
+
+    if (OriginalPath == nullptr)
     {
         INVALID_USAGE();
     }
@@ -25,6 +25,9 @@ Abstract:
 #define TRANSLATE_MODE_MIXED 'm'
 #define TRANSLATE_MODE_HELP 'h'
 
+#define WSLPATH_OPTION_BATCH 'b'
+#define WSLPATH_OPTION_NULL 'z'
+
 int WslPathEntry(int Argc, char* Argv[]);
 
 std::string WslPathTranslate(char* Path, int Flags, char Mode);
@@ -0,0 +1,175 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include "precomp.h"
+#include "p9fairqueue.h"
+
+namespace p9fs {
+
+// The minimum number of requests that can be in flight across all connections.
+// N.B. Requests for files like FIFOs can stay outstanding for a long time, so this is kept well
+//      above the number of threads that can actually run requests.
+constexpr UINT32 c_minimumInFlightRequests = 64;
+
+FairQueue g_FairQueue;
+
+FairQueue::FairQueue() : m_MaxInFlight{std::max(c_minimumInFlightRequests, std::thread::hardware_concurrency() * 8)}
+{
+    InitializeListHead(&m_ActiveFlows);
+}
+
+// Enables or disables fair queuing and sets the maximum number of bytes of read and write
+// requests that can be in flight at once.
+void FairQueue::Configure(bool enabled, UINT64 ioBudget) noexcept
+{
+    std::lock_guard<std::mutex> lock{m_Lock};
+    m_Enabled = enabled;
+    m_IoBudget = ioBudget == 0 ? DefaultIoBudget : ioBudget;
+}
+
+// Checks whether a request with the specified cost fits in the remaining budget.
+// N.B. A request larger than the whole I/O budget is still admitted when nothing else is in
+//      flight, so it can't be blocked forever.
+bool FairQueue::TryAdmitLocked(UINT64 cost) const noexcept
+{
+    if (!m_Enabled)
+    {
+        return true;
+    }
+
+    return m_InFlight < m_MaxInFlight && (m_InFlightBytes == 0 || m_InFlightBytes + cost <= m_IoBudget);
+}
+
+// Queues a request on its flow, unless it can be admitted right away. Returns true if the request
+// was queued and the caller must suspend.
+bool FairQueue::Enqueue(AdmitTask& task) noexcept
+{
+    std::lock_guard<std::mutex> lock{m_Lock};
+    auto& flow = task.m_Flow;
+
+    // Only bypass the queue if this flow doesn't have older requests waiting, to preserve the
+    // order of requests within a connection.
+    if (IsListEmpty(&flow.m_Waiters) && TryAdmitLocked(task.m_Cost))
+    {
+        ++m_InFlight;
+        m_InFlightBytes += task.m_Cost;
+        return false;
+    }
+
+    InsertTailList(&flow.m_Waiters, &task.m_Link);
+    if (!flow.m_Active)
+    {
+        flow.m_Active = true;
+        flow.m_Deficit = 0;
+        InsertTailList(&m_ActiveFlows, &flow.m_Link);
+    }
+
+    return true;
+}
+
+// Returns the cost of a completed request to the budget, and admits waiting requests.
+void FairQueue::Release(UINT64 cost) noexcept
+{
+    std::lock_guard<std::mutex> lock{m_Lock};
+    WI_ASSERT(m_InFlight > 0 && m_InFlightBytes >= cost);
+
+    --m_InFlight;
+    m_InFlightBytes -= cost;
+    DispatchLocked();
+}
+
+// Admits as many waiting requests as the budget allows, visiting the active flows in round robin
+// order. A flow can only admit its next request once its deficit covers the request's cost.
+void FairQueue::DispatchLocked() noexcept
+{
+    while (!IsListEmpty(&m_ActiveFlows))
+    {
+        auto* flow = CONTAINING_RECORD(m_ActiveFlows.Flink, Flow, m_Link);
+        auto* task = CONTAINING_RECORD(flow->m_Waiters.Flink, AdmitTask, m_Link);
+        if (flow->m_Deficit < task->m_Cost)
+        {
+            // Give the flow another quantum and move it to the back of the list.
+            flow->m_Deficit += Quantum;
+            RemoveEntryList(&flow->m_Link);
+            InsertTailList(&m_ActiveFlows, &flow->m_Link);
+            continue;
+        }
+
+        if (!TryAdmitLocked(task->m_Cost))
+        {
+            break;
+        }
+
+        flow->m_Deficit -= task->m_Cost;
+        RemoveEntryList(&task->m_Link);
+        ++m_InFlight;
+        m_InFlightBytes += task->m_Cost;
+
+        // An idle flow doesn't get to accumulate credit.
+        if (IsListEmpty(&flow->m_Waiters))
+        {
+            RemoveEntryList(&flow->m_Link);
+            flow->m_Active = false;
+            flow->m_Deficit = 0;
+        }
+
+        g_Scheduler.Schedule(task->m_Awaiter);
+    }
+}
+
+FairQueue::Flow::Flow(FairQueue& queue) noexcept : m_Queue{queue}
+{
+    InitializeListHead(&m_Waiters);
+}
+
+FairQueue::Flow::~Flow()
+{
+    // All requests must have been admitted before the connection goes away.
+    WI_ASSERT(IsListEmpty(&m_Waiters) && !m_Active);
+}
+
+// Returns an awaitable that completes once a request with the specified cost is admitted.
+FairQueue::AdmitTask FairQueue::Flow::Admit(UINT64 cost) noexcept
+{
+    return AdmitTask{*this, cost};
+}
+
+bool FairQueue::AdmitTask::await_suspend(std::coroutine_handle<> awaiter) noexcept
+{
+    m_Awaiter = awaiter;
+    return m_Flow.m_Queue.Enqueue(*this);
+}
+
+FairQueue::Admission FairQueue::AdmitTask::await_resume() noexcept
+{
+    return Admission{&m_Flow.m_Queue, m_Cost};
+}
+
+FairQueue::Admission::Admission(Admission&& other) noexcept :
+    m_Queue{std::exchange(other.m_Queue, nullptr)}, m_Cost{std::exchange(other.m_Cost, 0)}
+{
+}
+
+FairQueue::Admission& FairQueue::Admission::operator=(Admission&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (m_Queue != nullptr)
+        {
+            m_Queue->Release(m_Cost);
+        }
+
+        m_Queue = std::exchange(other.m_Queue, nullptr);
+        m_Cost = std::exchange(other.m_Cost, 0);
+    }
+
+    return *this;
+}
+
+FairQueue::Admission::~Admission()
+{
+    if (m_Queue != nullptr)
+    {
+        m_Queue->Release(m_Cost);
+    }
+}
+
+} // namespace p9fs
@@ -0,0 +1,125 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#pragma once
+
+#include "p9await.h"
+#include "p9fs.h"
+
+namespace p9fs {
+
+// Deficit round robin admission control for requests from all connections.
+//
+// Each connection owns a Flow. Before a request is handed to the scheduler, it must be admitted
+// by the flow, which charges the request's cost (its I/O size, or a fixed cost for metadata
+// operations) against the flow's deficit. When the server is under its budget, requests are
+// admitted immediately; otherwise they are queued per flow and admitted in round robin order, so
+// a connection doing a large bulk transfer can't starve a connection doing interactive I/O.
+class FairQueue
+{
+public:
+    // The cost charged for requests that don't transfer file data.
+    static constexpr UINT64 MetadataCost = 4096;
+
+    // The amount added to a flow's deficit for each round.
+    static constexpr UINT64 Quantum = 64 * 1024;
+
+    static constexpr UINT64 DefaultIoBudget = 16 * 1024 * 1024;
+
+    class Flow;
+    class AdmitTask;
+
+    // RAII class that returns the cost of an admitted request to the queue on scope exit.
+    class Admission
+    {
+    public:
+        Admission() = default;
+        Admission(Admission&& other) noexcept;
+        Admission& operator=(Admission&& other) noexcept;
+        Admission(const Admission&) = delete;
+        Admission& operator=(const Admission&) = delete;
+        ~Admission();
+
+    private:
+        friend class AdmitTask;
+
+        Admission(FairQueue* queue, UINT64 cost) noexcept : m_Queue{queue}, m_Cost{cost}
+        {
+        }
+
+        FairQueue* m_Queue{};
+        UINT64 m_Cost{};
+    };
+
+    class AdmitTask
+    {
+    public:
+        static bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> awaiter) noexcept;
+
+        Admission await_resume() noexcept;
+
+    private:
+        friend class Flow;
+        friend class FairQueue;
+
+        AdmitTask(Flow& flow, UINT64 cost) noexcept : m_Flow{flow}, m_Cost{cost}
+        {
+        }
+
+        Flow& m_Flow;
+        UINT64 m_Cost;
+        std::coroutine_handle<> m_Awaiter{};
+        LIST_ENTRY m_Link{};
+    };
+
+    // Per-connection state for the fair queue.
+    class Flow
+    {
+    public:
+        Flow(FairQueue& queue) noexcept;
+        ~Flow();
+
+        Flow(const Flow&) = delete;
+        Flow& operator=(const Flow&) = delete;
+
+        AdmitTask Admit(UINT64 cost) noexcept;
+
+    private:
+        friend class FairQueue;
+        friend class AdmitTask;
+
+        FairQueue& m_Queue;
+        LIST_ENTRY m_Waiters{};
+        LIST_ENTRY m_Link{};
+        UINT64 m_Deficit{};
+        bool m_Active{};
+    };
+
+    FairQueue();
+
+    FairQueue(const FairQueue&) = delete;
+    FairQueue& operator=(const FairQueue&) = delete;
+
+    void Configure(bool enabled, UINT64 ioBudget) noexcept;
+
+private:
+    bool TryAdmitLocked(UINT64 cost) const noexcept;
+    bool Enqueue(AdmitTask& task) noexcept;
+    void Release(UINT64 cost) noexcept;
+    void DispatchLocked() noexcept;
+
+    std::mutex m_Lock;
+    LIST_ENTRY m_ActiveFlows{};
+    UINT64 m_IoBudget{DefaultIoBudget};
+    UINT64 m_InFlightBytes{};
+    UINT32 m_MaxInFlight{};
+    UINT32 m_InFlight{};
+    bool m_Enabled{true};
+};
+
+extern FairQueue g_FairQueue;
+
+} // namespace p9fs
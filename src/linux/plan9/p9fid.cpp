@@ -9,6 +9,11 @@ Expected<Qid> Fid::Walk(std::string_view)
     return LxError{LX_EINVAL};
 }
 
+Expected<Qid> Fid::WalkMany(gsl::span<const std::string_view>)
+{
+    return LxError{LX_ENOTSUP};
+}
+
 Expected<std::tuple<UINT64, Qid, StatResult>> Fid::GetAttr(UINT64)
 {
     return LxError{LX_EINVAL};
@@ -146,6 +151,11 @@ bool Fid::IsFile() const
     return false;
 }
 
+bool Fid::MayBlock() const
+{
+    return false;
+}
+
 Qid Fid::GetQid() const
 {
     THROW_INVALID();
@@ -17,6 +17,7 @@ public:
     virtual ~Fid() = default;
 
     virtual Expected<Qid> Walk(std::string_view Name);
+    virtual Expected<Qid> WalkMany(gsl::span<const std::string_view> Names);
     virtual Expected<std::tuple<UINT64, Qid, StatResult>> GetAttr(UINT64 Mask);
     virtual LX_INT SetAttr(UINT32 Valid, const StatResult& Stat);
     virtual Expected<Qid> Open(OpenFlags Flags);
@@ -48,6 +49,7 @@ public:
     virtual std::shared_ptr<Fid> Clone() const;
     virtual bool IsOnRoot(const std::shared_ptr<const IRoot>& root);
     virtual bool IsFile() const;
+    virtual bool MayBlock() const;
     virtual Qid GetQid() const;
 
 protected:
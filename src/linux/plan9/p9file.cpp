@@ -264,6 +264,54 @@ Expected<Qid> File::Walk(std::string_view name)
     return m_Qid;
 }
 
+// Updates the path to a descendant of a directory, resolving all the components with a single
+// openat2 call, and returns the qid of the final component. Must be called with a newly
+// constructed file, not one that has been opened.
+//
+// This only handles the common case where every component exists, no intermediate component is
+// a symlink and no mount point is crossed. On any error the file is left unchanged, and the
+// caller must fall back to walking one component at a time with Walk, which handles partial walks
+// and mount points.
+//
+// Only Twopen uses this. Twalk must return the qid of every component, and querying them one at
+// a time after the openat2 call costs more than walking the components with Walk.
+Expected<Qid> File::WalkMany(gsl::span<const std::string_view> names)
+{
+    if (names.empty() || !WI_IsFlagSet(m_Qid.Type, QidType::Directory))
+    {
+        return LxError{LX_EINVAL};
+    }
+
+    // No lock is taken here; see Walk.
+    std::string fileName = m_FileName;
+    for (const auto& name : names)
+    {
+        if (name.empty() || name == "." || name == ".." || name.find('/') != std::string_view::npos)
+        {
+            return LxError{LX_EINVAL};
+        }
+
+        AppendPath(fileName, name);
+    }
+
+    util::FsUserContext userContext{m_Root->Uid, m_Root->Gid, m_Root->Groups};
+    auto file = util::OpenBeneath(m_Root->RootFd, fileName, O_PATH | O_NOFOLLOW);
+    if (!file)
+    {
+        return file.Unexpected();
+    }
+
+    struct statx stx;
+    if (statx(file->get(), "", AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_INO, &stx) < 0)
+    {
+        return LxError{-errno};
+    }
+
+    m_FileName = std::move(fileName);
+    m_Qid = {stx.stx_ino, 0, ModeToQidType(stx.stx_mode)};
+    return m_Qid;
+}
+
 // Reads the attributes of a file or directory.
 Expected<std::tuple<UINT64, Qid, StatResult>> File::GetAttr(UINT64 mask)
 {
@@ -493,6 +541,10 @@ Expected<Qid> File::Open(OpenFlags flags)
         return file.Unexpected();
     }
 
+    // Reads and writes on anything but a regular file can wait for a peer indefinitely.
+    struct stat st;
+    m_MayBlock = fstat(file->get(), &st) < 0 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode));
+
     m_Io = CoroutineIoIssuer(file->get());
     m_File = std::move(file.Get());
     return m_Qid;
@@ -566,6 +618,28 @@ LX_INT File::ReadDir(UINT64 offset, SpanWriter& writer, bool includeAttributes)
 
     // Acquire an exclusive lock to protect enumerator state.
     std::lock_guard<std::shared_mutex> lock{m_Lock};
+
+    // A new enumeration can be served from a cached snapshot of the directory.
+    if (offset == 0 && g_DirectorySnapshotCache.Enabled())
+    {
+        StartSnapshotEnumeration(includeAttributes);
+    }
+
+    if (m_Snapshot)
+    {
+        if (!includeAttributes || m_Snapshot->HasAttributes)
+        {
+            const auto index = m_Snapshot->Find(offset, m_SnapshotIndex);
+            if (index)
+            {
+                return ReadDirFromSnapshot(*index, writer, includeAttributes);
+            }
+        }
+
+        // Fall back to enumerating the directory.
+        m_Snapshot.reset();
+    }
+
     if (!m_Enumerator)
     {
         m_Enumerator.reset(new DirectoryEnumerator(m_File.get()));
@@ -573,6 +647,16 @@ LX_INT File::ReadDir(UINT64 offset, SpanWriter& writer, bool includeAttributes)
         m_File.release();
     }
 
+    // A snapshot can only be built by a single sequential enumeration.
+    if (m_SnapshotBuilder)
+    {
+        const UINT64 expectedOffset = m_SnapshotBuilder->Entries.empty() ? 0 : m_SnapshotBuilder->Entries.back().Offset;
+        if (offset != expectedOffset || includeAttributes != m_SnapshotBuilder->HasAttributes)
+        {
+            m_SnapshotBuilder.reset();
+        }
+    }
+
     m_Enumerator->Seek(offset);
 
     bool dirEntriesWritten = false;
@@ -581,6 +665,12 @@ LX_INT File::ReadDir(UINT64 offset, SpanWriter& writer, bool includeAttributes)
         auto entry = m_Enumerator->Next();
         if (entry == nullptr)
         {
+            // The whole directory was enumerated, so the snapshot is complete.
+            if (m_SnapshotBuilder)
+            {
+                g_DirectorySnapshotCache.Insert(m_SnapshotKey, std::move(m_SnapshotBuilder));
+            }
+
             break;
         }
 
@@ -639,11 +729,80 @@ LX_INT File::ReadDir(UINT64 offset, SpanWriter& writer, bool includeAttributes)
         }
 
         dirEntriesWritten = true;
+        if (m_SnapshotBuilder)
+        {
+            if (m_SnapshotBuilder->Entries.size() < DirectorySnapshot::MaxEntries)
+            {
+                m_SnapshotBuilder->Entries.push_back(
+                    {entry->d_name,
+                     entry->d_ino,
+                     static_cast<UINT64>(entry->d_off),
+                     entry->d_type,
+                     includeAttributes ? attributes : StatResult{}});
+            }
+            else
+            {
+                m_SnapshotBuilder.reset();
+            }
+        }
     }
 
     return {};
 }
 
+// Looks up a cached snapshot for an enumeration starting at offset zero. If there is none,
+// prepares to build one from the live enumeration.
+// N.B. The caller must hold the lock exclusively.
+void File::StartSnapshotEnumeration(bool includeAttributes)
+{
+    m_Snapshot.reset();
+    m_SnapshotIndex = 0;
+    m_SnapshotBuilder.reset();
+
+    struct stat st;
+    const int fd = m_Enumerator ? m_Enumerator->Fd() : m_File.get();
+    if (fstat(fd, &st) < 0)
+    {
+        return;
+    }
+
+    m_SnapshotKey = {st.st_dev, st.st_ino, m_Root->Uid};
+    m_Snapshot = g_DirectorySnapshotCache.Lookup(m_SnapshotKey, st, includeAttributes);
+    if (!m_Snapshot)
+    {
+        m_SnapshotBuilder = g_DirectorySnapshotCache.CreateBuilder(st, includeAttributes);
+    }
+}
+
+// Reads directory entries from a cached snapshot, starting at the specified index.
+// N.B. The caller must hold the lock exclusively.
+LX_INT File::ReadDirFromSnapshot(size_t index, SpanWriter& writer, bool includeAttributes)
+{
+    bool dirEntriesWritten = false;
+    for (; index < m_Snapshot->Entries.size(); ++index)
+    {
+        const auto& entry = m_Snapshot->Entries[index];
+        Qid qid{};
+        qid.Path = entry.Inode;
+        qid.Type = util::DirEntryTypeToQidType(entry.Type);
+        if (!util::SpanWriteDirectoryEntry(
+                writer, entry.Name, qid, entry.Offset, entry.Type, includeAttributes ? &entry.Attributes : nullptr))
+        {
+            if (!dirEntriesWritten)
+            {
+                return LX_EINVAL;
+            }
+
+            break;
+        }
+
+        dirEntriesWritten = true;
+    }
+
+    m_SnapshotIndex = index;
+    return {};
+}
+
 // Reads the contents of an open file.
 Task<Expected<UINT32>> File::Read(UINT64 offset, gsl::span<gsl::byte> buffer)
 {
@@ -654,6 +813,7 @@ Task<Expected<UINT32>> File::Read(UINT64 offset, gsl::span<gsl::byte> buffer)
         co_return LxError{LX_EBADF};
     }
 
+    m_StreamingRead.Prepare(m_File.get(), offset, buffer.size());
     CancelToken token;
     auto result = co_await ReadAsync(m_Io, offset, buffer, token);
     if (result.Error != 0 && result.Error != LX_EOVERFLOW)
@@ -661,6 +821,7 @@ Task<Expected<UINT32>> File::Read(UINT64 offset, gsl::span<gsl::byte> buffer)
         co_return LxError{result.Error};
     }
 
+    m_StreamingRead.Track(m_File.get(), offset, result.BytesTransferred);
     co_return static_cast<UINT32>(result.BytesTransferred);
 }
 
@@ -1139,6 +1300,12 @@ bool File::IsFile() const
     return true;
 }
 
+bool File::MayBlock() const
+{
+    std::shared_lock<std::shared_mutex> lock{m_Lock};
+    return m_MayBlock;
+}
+
 Qid File::GetQid() const
 {
     return m_Qid;
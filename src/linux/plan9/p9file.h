@@ -4,6 +4,8 @@
 #include "p9io.h"
 #include "p9fid.h"
 #include "p9readdir.h"
+#include "p9fairqueue.h"
+#include "p9streamread.h"
 #include <pwd.h>
 #include <grp.h>
 
@@ -76,6 +78,7 @@ public:
 
     Expected<Qid> Initialize();
     Expected<Qid> Walk(std::string_view Name) override;
+    Expected<Qid> WalkMany(gsl::span<const std::string_view> Names) override;
     Expected<std::tuple<UINT64, Qid, StatResult>> GetAttr(UINT64 Mask) override;
     LX_INT SetAttr(UINT32 Valid, const StatResult& Stat) override;
     Expected<Qid> Open(OpenFlags Flags) override;
@@ -106,6 +109,7 @@ public:
     std::shared_ptr<Fid> Clone() const override;
     bool IsOnRoot(const std::shared_ptr<const IRoot>& root) override;
     bool IsFile() const override;
+    bool MayBlock() const override;
     Qid GetQid() const override;
     bool IsOpen() const;
 
@@ -117,6 +121,8 @@ private:
     std::string ChildPathWithLockHeld(std::string_view name);
     Expected<struct stat> Stat();
     LX_INT ReadDirHelper(UINT64 offset, SpanWriter& writer, bool extendedAttributes);
+    void StartSnapshotEnumeration(bool includeAttributes);
+    LX_INT ReadDirFromSnapshot(size_t index, SpanWriter& writer, bool includeAttributes);
 
     // This lock protects all state except:
     // - Read access to m_File: once non-NULL, this member never becomes NULL
@@ -125,10 +131,16 @@ private:
     mutable std::shared_mutex m_Lock;
     std::string m_FileName;
     std::unique_ptr<DirectoryEnumerator> m_Enumerator;
+    std::shared_ptr<const DirectorySnapshot> m_Snapshot;
+    size_t m_SnapshotIndex{};
+    std::shared_ptr<DirectorySnapshot> m_SnapshotBuilder;
+    DirectorySnapshotCache::Key m_SnapshotKey{};
     wil::unique_fd m_File;
     CoroutineIoIssuer m_Io;
+    StreamingReadState m_StreamingRead;
     const std::shared_ptr<const Root> m_Root;
     Qid m_Qid{};
     dev_t m_Device{};
+    bool m_MayBlock{};
 };
 } // namespace p9fs
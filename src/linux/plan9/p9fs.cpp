@@ -3,6 +3,8 @@
 #include "p9errors.h"
 #include "p9handler.h"
 #include "p9file.h"
+#include "p9fairqueue.h"
+#include "p9streamread.h"
 #include "p9fs.h"
 #include "p9lx.h"
 #include "p9util.h"
@@ -119,13 +121,17 @@ public:
     // Creates a new file system, using the specified socket to listen.
     // N.B. The socket must already be bound to an appropriate local address.
     // N.B. The file system class takes ownership of the socket.
-    FileSystem(int socket)
+    FileSystem(int socket, const FileSystemOptions& options)
     {
         if (!g_Watcher)
         {
             g_Watcher.Run();
         }
 
+        g_FairQueue.Configure(options.FairQueue, options.IoBudget);
+        g_DirectorySnapshotCache.Configure(options.ReadDirCache);
+        g_StreamingReads.Configure(options.StreamingReads, options.StreamingThreshold);
+
         m_Server.Reset(socket);
         THROW_LAST_ERROR_IF(listen(socket, 1) < 0);
     }
@@ -203,9 +209,9 @@ private:
     ShareList m_ShareList;
 };
 
-std::unique_ptr<IPlan9FileSystem> CreateFileSystem(int socket)
+std::unique_ptr<IPlan9FileSystem> CreateFileSystem(int socket, const FileSystemOptions& options)
 {
-    return std::make_unique<FileSystem>(socket);
+    return std::make_unique<FileSystem>(socket, options);
 }
 
 } // namespace p9fs
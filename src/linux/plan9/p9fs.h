@@ -3,6 +3,25 @@
 
 namespace p9fs {
 
+// Options that control how the server shares its resources between connections.
+struct FileSystemOptions
+{
+    // Admit requests from all connections in deficit round robin order.
+    bool FairQueue = true;
+
+    // Maximum number of bytes of read and write requests in flight (0 for the default).
+    uint64_t IoBudget = 0;
+
+    // Share snapshots of directory listings between enumerations of the same directory.
+    bool ReadDirCache = false;
+
+    // Drop the data of bulk sequential reads from the page cache.
+    bool StreamingReads = true;
+
+    // Number of bytes read sequentially before a file is treated as a bulk read (0 for the default).
+    uint64_t StreamingThreshold = 0;
+};
+
 // Interface for running the Plan 9 server.
 // N.B. The main reason this is an interface, despite not needing COM like the Windows equivalent,
 //      is so consumers can just include this header rather than needing most of the library's
@@ -20,6 +39,6 @@ public:
     virtual bool HasConnections() const noexcept = 0;
 };
 
-std::unique_ptr<IPlan9FileSystem> CreateFileSystem(int socket);
+std::unique_ptr<IPlan9FileSystem> CreateFileSystem(int socket, const FileSystemOptions& options);
 
 } // namespace p9fs
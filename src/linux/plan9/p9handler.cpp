@@ -11,6 +11,7 @@
 #include "p9fid.h"
 #include "p9handler.h"
 #include "p9commonutil.h"
+#include "p9fairqueue.h"
 
 namespace p9fs {
 
@@ -19,6 +20,60 @@ constexpr UINT32 c_staticBufferSize = 256;
 
 constexpr UINT32 c_createRetryCount = 3;
 
+// State shared by all connections that joined the same session. A client can open several
+// connections to one session, so large reads and writes can be striped across them.
+struct Session
+{
+    UINT64 Id{};
+    UINT32 Uid{};
+    std::shared_mutex FidsLock;
+    std::map<UINT32, std::shared_ptr<Fid>> Fids;
+};
+
+// Registry of sessions that connections can join with Tattach.
+class SessionList
+{
+public:
+    // Registers a session and assigns it a random ID, so other connections can't easily join a
+    // session they didn't create.
+    UINT64 Register(const std::shared_ptr<Session>& session)
+    {
+        std::lock_guard<std::mutex> lock{m_Lock};
+
+        // Drop sessions whose connections are all gone.
+        std::erase_if(m_Sessions, [](const auto& entry) { return entry.second.expired(); });
+
+        UINT64 id;
+        do
+        {
+            id = (static_cast<UINT64>(m_Random()) << 32) | m_Random();
+        } while (id == 0 || m_Sessions.contains(id));
+
+        session->Id = id;
+        m_Sessions.emplace(id, session);
+        return id;
+    }
+
+    std::shared_ptr<Session> Find(UINT64 id)
+    {
+        std::lock_guard<std::mutex> lock{m_Lock};
+        const auto it = m_Sessions.find(id);
+        if (it == m_Sessions.end())
+        {
+            return {};
+        }
+
+        return it->second.lock();
+    }
+
+private:
+    std::mutex m_Lock;
+    std::random_device m_Random;
+    std::map<UINT64, std::weak_ptr<Session>> m_Sessions;
+};
+
+SessionList g_Sessions;
+
 // Handler for 9pfs protocol messages.
 class Handler final : public IHandler
 {
@@ -347,6 +402,13 @@ private:
         auto aname = reader.String();
         auto uid = reader.U32();
 
+        // With 9P2000.W, the client can append a session ID to join the connection to a session.
+        ReadResult<UINT64> sessionId{};
+        if (m_Use9P2000W)
+        {
+            sessionId = reader.TryU64();
+        }
+
         auto root = m_ShareList.MakeRoot(std::string_view{aname.data(), gsl::narrow_cast<size_t>(aname.size())}, uid);
         if (!root)
         {
@@ -361,10 +423,81 @@ private:
 
         auto [file, qid] = result.Get();
 
+        const auto error = AttachSession(sessionId, uid);
+        if (error != 0)
+        {
+            return error;
+        }
+
         EmplaceFid(fid, file);
 
-        response.EnsureSize(MessageType::Rattach, 0, m_NegotiatedSize);
+        response.EnsureSize(MessageType::Rattach, sessionId.Success ? static_cast<UINT32>(sizeof(UINT64)) : 0, m_NegotiatedSize);
         response.Writer.Qid(qid);
+        if (sessionId.Success)
+        {
+            response.Writer.U64(CurrentSession()->Id);
+        }
+
+        return {};
+    }
+
+    // Handle the optional session ID of a 9P2000.W Tattach.
+    //
+    // A session ID of zero registers the connection's own session, owned by the attaching user, and
+    // returns its ID. Any other value joins the connection to that existing session, after which it
+    // shares all fids with the other connections in the session. A connection can only register or
+    // join a session before it has any fids of its own, and every attach to a session must use the
+    // uid that registered it, so a connection can't reach fids that another user attached.
+    LX_INT AttachSession(const ReadResult<UINT64>& sessionId, UINT32 uid)
+    {
+        std::lock_guard<std::shared_mutex> sessionLock{m_SessionLock};
+        if (m_Session->Id != 0)
+        {
+            if (sessionId.Success && sessionId.Result != 0 && sessionId.Result != m_Session->Id)
+            {
+                return LX_EBUSY;
+            }
+
+            if (m_Session->Uid != uid)
+            {
+                return LX_EPERM;
+            }
+
+            return {};
+        }
+
+        if (!sessionId.Success)
+        {
+            return {};
+        }
+
+        {
+            std::shared_lock<std::shared_mutex> fidsLock{m_Session->FidsLock};
+            if (!m_Session->Fids.empty())
+            {
+                return LX_EBUSY;
+            }
+        }
+
+        if (sessionId.Result == 0)
+        {
+            m_Session->Uid = uid;
+            g_Sessions.Register(m_Session);
+            return {};
+        }
+
+        auto session = g_Sessions.Find(sessionId.Result);
+        if (!session)
+        {
+            return LX_ENOENT;
+        }
+
+        if (session->Uid != uid)
+        {
+            return LX_EPERM;
+        }
+
+        m_Session = std::move(session);
         return {};
     }
 
@@ -458,16 +591,17 @@ private:
         std::shared_ptr<Fid> item;
 
         {
-            std::lock_guard<std::shared_mutex> lock{m_FidsLock};
-            const auto iterator = m_Fids.find(fid);
-            if (iterator == m_Fids.end())
+            const auto session = CurrentSession();
+            std::lock_guard<std::shared_mutex> lock{session->FidsLock};
+            const auto iterator = session->Fids.find(fid);
+            if (iterator == session->Fids.end())
             {
                 return LX_EINVAL;
             }
 
             item = std::move(iterator->second);
             // Erase regardless of whether the clunk call succeeded.
-            m_Fids.erase(iterator);
+            session->Fids.erase(iterator);
         }
 
         return item->Clunk();
@@ -826,9 +960,10 @@ private:
 
         // Unlike xattrwalk, xattrcreate updates the current fid, so replace
         // it.
-        std::lock_guard<std::shared_mutex> lock{m_FidsLock};
-        const auto iterator = m_Fids.find(fid);
-        THROW_UNEXPECTED_IF((iterator == m_Fids.end()) || (iterator->second != entry));
+        const auto session = CurrentSession();
+        std::lock_guard<std::shared_mutex> lock{session->FidsLock};
+        const auto iterator = session->Fids.find(fid);
+        THROW_UNEXPECTED_IF((iterator == session->Fids.end()) || (iterator->second != entry));
         iterator->second = xattr.Get();
         return {};
     }
@@ -888,23 +1023,33 @@ private:
         Qid entryQid = newFile->GetQid();
         if (nameCount > 0)
         {
-            // Step 1: Find the parent of the final item.
+            // Step 1: Find the parent of the final item. The qids of the intermediate components
+            // are not returned, so try to resolve them all at once first.
+            std::vector<std::string_view> parentNames;
             for (UINT16 i = 0; i < nameCount - 1; ++i)
             {
-                auto qid = newFile->Walk(reader.Name());
-                if (!qid)
+                parentNames.push_back(reader.Name());
+            }
+
+            if (parentNames.size() < 2 || !newFile->WalkMany(parentNames))
+            {
+                for (UINT16 i = 0; i < parentNames.size(); ++i)
                 {
-                    // For ENOENT and ENOTDIR, indicate how many components were processed.
-                    switch (qid.Error())
+                    auto qid = newFile->Walk(parentNames[i]);
+                    if (!qid)
                     {
-                    case LX_ENOENT:
-                        return WriteWOpenReply(WOpenStatus::ParentNotFound, i, *newFile, attrMask, response);
+                        // For ENOENT and ENOTDIR, indicate how many components were processed.
+                        switch (qid.Error())
+                        {
+                        case LX_ENOENT:
+                            return WriteWOpenReply(WOpenStatus::ParentNotFound, i, *newFile, attrMask, response);
 
-                    case LX_ENOTDIR:
-                        return WriteWOpenReply(WOpenStatus::Stopped, i, *newFile, attrMask, response);
+                        case LX_ENOTDIR:
+                            return WriteWOpenReply(WOpenStatus::Stopped, i, *newFile, attrMask, response);
 
-                    default:
-                        return qid.Error();
+                        default:
+                            return qid.Error();
+                        }
                     }
                 }
             }
@@ -1246,6 +1391,14 @@ private:
         LX_INT error;
         try
         {
+            // Wait until the fair queue admits the request. The admission is released once the
+            // response is ready, before it is sent.
+            FairQueue::Admission admission;
+            if (RequiresAdmission(static_cast<MessageType>(messageType), reader))
+            {
+                admission = co_await m_Flow.Admit(RequestCost(static_cast<MessageType>(messageType), reader));
+            }
+
             error = co_await HandleMessage(static_cast<MessageType>(messageType), reader, response);
         }
         catch (...)
@@ -1371,31 +1524,82 @@ public:
     }
 
 private:
+    std::shared_ptr<Session> CurrentSession()
+    {
+        std::shared_lock<std::shared_mutex> lock{m_SessionLock};
+        return m_Session;
+    }
+
     std::shared_ptr<Fid> LookupFid(UINT32 fid)
     {
-        std::shared_lock<std::shared_mutex> lock{m_FidsLock};
-        const auto it = m_Fids.find(fid);
-        THROW_UNEXPECTED_IF(it == m_Fids.end());
+        const auto session = CurrentSession();
+        std::shared_lock<std::shared_mutex> lock{session->FidsLock};
+        const auto it = session->Fids.find(fid);
+        THROW_UNEXPECTED_IF(it == session->Fids.end());
         return it->second;
     }
 
     std::pair<std::shared_ptr<Fid>, std::shared_ptr<Fid>> LookupFidPair(UINT32 fid1, UINT32 fid2)
     {
-        std::shared_lock<std::shared_mutex> lock{m_FidsLock};
-        const auto it1 = m_Fids.find(fid1);
-        THROW_UNEXPECTED_IF(it1 == m_Fids.end());
-        const auto it2 = m_Fids.find(fid2);
-        THROW_UNEXPECTED_IF(it2 == m_Fids.end());
+        const auto session = CurrentSession();
+        std::shared_lock<std::shared_mutex> lock{session->FidsLock};
+        const auto it1 = session->Fids.find(fid1);
+        THROW_UNEXPECTED_IF(it1 == session->Fids.end());
+        const auto it2 = session->Fids.find(fid2);
+        THROW_UNEXPECTED_IF(it2 == session->Fids.end());
         return {it1->second, it2->second};
     }
 
     void EmplaceFid(UINT32 fid, std::shared_ptr<Fid> item)
     {
-        std::lock_guard<std::shared_mutex> lock{m_FidsLock};
-        const auto result = m_Fids.try_emplace(fid, item);
+        const auto session = CurrentSession();
+        std::lock_guard<std::shared_mutex> lock{session->FidsLock};
+        const auto result = session->Fids.try_emplace(fid, item);
         THROW_INVALID_IF(!result.second);
     }
 
+    // Returns whether a request must be admitted by the fair queue before it runs.
+    // N.B. Tflush is not queued since it waits for other requests to complete. Requests that can
+    //      wait for a peer indefinitely (opening a FIFO, or reading and writing a FIFO, pipe,
+    //      socket or device) are not queued either: they would hold their admission while the
+    //      peer, possibly on another connection, waits to be admitted.
+    bool RequiresAdmission(MessageType messageType, const SpanReader& reader)
+    {
+        switch (messageType)
+        {
+        case MessageType::Tflush:
+        case MessageType::Tlopen:
+        case MessageType::Twopen:
+            return false;
+
+        case MessageType::Tread:
+        case MessageType::Twrite:
+        {
+            SpanReader ioReader{reader};
+            return !LookupFid(ioReader.U32())->MayBlock();
+        }
+
+        default:
+            return true;
+        }
+    }
+
+    // Returns the cost of a request for the fair queue, which is the amount of data it transfers for
+    // reads and writes.
+    static UINT64 RequestCost(MessageType messageType, const SpanReader& reader)
+    {
+        if (messageType != MessageType::Tread && messageType != MessageType::Twrite)
+        {
+            return FairQueue::MetadataCost;
+        }
+
+        // Both messages start with fid[4] offset[8] count[4].
+        SpanReader ioReader{reader};
+        ioReader.U32();
+        ioReader.U64();
+        return std::max<UINT64>(ioReader.U32(), FairQueue::MetadataCost);
+    }
+
     // Returns the maximum size of an IO request (0 for no limit).
     static UINT32 IoUnit()
     {
@@ -1408,8 +1612,8 @@ private:
 
     AsyncLock m_SocketLock;
     ISocket* m_Socket{};
-    std::shared_mutex m_FidsLock;
-    std::map<UINT32, std::shared_ptr<Fid>> m_Fids;
+    std::shared_mutex m_SessionLock;
+    std::shared_ptr<Session> m_Session{std::make_shared<Session>()};
     std::vector<gsl::byte> m_RequestBuffer{MaximumRequestBufferSize};
     gsl::span<gsl::byte> m_RequestData;
     std::shared_ptr<RequestList> m_Requests;
@@ -1418,6 +1622,7 @@ private:
     bool m_AllowRenegotiate{false};
     bool m_Use9P2000W{false};
     IShareList& m_ShareList;
+    FairQueue::Flow m_Flow{g_FairQueue};
 };
 
 AsyncTask HandleConnections(ISocket& listen, IShareList& shareList, CancelToken& token, WaitGroup& waitGroup)
@@ -221,7 +221,7 @@ inline void TraceLogMessage([[maybe_unused]] gsl::span<const gsl::byte> message)
 
     case MessageType::Tattach:
     {
-        // size[4] Tattach tag[2] fid[4] afid[4] uname[s] aname[s] n_uname[4]
+        // size[4] Tattach tag[2] fid[4] afid[4] uname[s] aname[s] n_uname[4] [session_id[8]]
         text.AddName(">>Tattach");
         text.AddField("tag", tag);
         auto fid = reader.U32();
@@ -234,16 +234,28 @@ inline void TraceLogMessage([[maybe_unused]] gsl::span<const gsl::byte> message)
         text.AddField("aname", aname);
         auto n_uname = reader.U32();
         text.AddField("n_uname", n_uname);
+        auto session_id = reader.TryU64();
+        if (session_id.Success)
+        {
+            text.AddField("session_id", session_id.Result);
+        }
+
         break;
     }
 
     case MessageType::Rattach:
     {
-        // size[4] Rattach tag[2] qid[13]
+        // size[4] Rattach tag[2] qid[13] [session_id[8]]
         text.AddName("<<Rattach");
         text.AddField("tag", tag);
         auto qid = reader.Qid();
         text.AddField("qid", qid);
+        auto session_id = reader.TryU64();
+        if (session_id.Success)
+        {
+            text.AddField("session_id", session_id.Result);
+        }
+
         break;
     }
 
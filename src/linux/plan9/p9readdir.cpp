@@ -63,4 +63,144 @@ int DirectoryEnumerator::Fd()
     return fd;
 }
 
+// Maximum number of entries in all cached snapshots together.
+constexpr size_t c_maxCachedEntries = 64 * 1024;
+
+// Attributes of the children can change without changing the directory, so snapshots that include
+// attributes are only used for a short time.
+constexpr auto c_attributeLifetime = std::chrono::seconds{2};
+
+// Directories modified this recently are not cached, because a change within the timestamp
+// granularity would not be detected.
+constexpr auto c_racyInterval = std::chrono::seconds{1};
+
+DirectorySnapshotCache g_DirectorySnapshotCache;
+
+DirectorySnapshot::DirectorySnapshot(const struct stat& st, bool includeAttributes) :
+    HasAttributes{includeAttributes}, m_Mtime{st.st_mtim}, m_Ctime{st.st_ctim}, m_Created{std::chrono::steady_clock::now()}
+{
+}
+
+// Checks whether the directory has changed since the snapshot was taken.
+bool DirectorySnapshot::IsCurrent(const struct stat& st) const noexcept
+{
+    return st.st_mtim.tv_sec == m_Mtime.tv_sec && st.st_mtim.tv_nsec == m_Mtime.tv_nsec && st.st_ctim.tv_sec == m_Ctime.tv_sec &&
+           st.st_ctim.tv_nsec == m_Ctime.tv_nsec;
+}
+
+// Finds the index of the entry following the one with the specified offset. The hint is checked
+// first, since enumeration is almost always sequential.
+std::optional<size_t> DirectorySnapshot::Find(UINT64 offset, size_t hint) const noexcept
+{
+    if (offset == 0)
+    {
+        return 0;
+    }
+
+    if (hint > 0 && hint <= Entries.size() && Entries[hint - 1].Offset == offset)
+    {
+        return hint;
+    }
+
+    for (size_t index = 0; index < Entries.size(); ++index)
+    {
+        if (Entries[index].Offset == offset)
+        {
+            return index + 1;
+        }
+    }
+
+    return {};
+}
+
+void DirectorySnapshotCache::Configure(bool enabled) noexcept
+{
+    m_Enabled = enabled;
+}
+
+bool DirectorySnapshotCache::Enabled() const noexcept
+{
+    return m_Enabled;
+}
+
+// Returns a snapshot of the directory if one is cached and the directory hasn't changed since.
+std::shared_ptr<const DirectorySnapshot> DirectorySnapshotCache::Lookup(
+    const Key& key, const struct stat& st, bool needAttributes)
+{
+    std::lock_guard<std::mutex> lock{m_Lock};
+    const auto it = m_Index.find(key);
+    if (it == m_Index.end())
+    {
+        return {};
+    }
+
+    const auto& snapshot = it->second->second;
+    if (!snapshot->IsCurrent(st))
+    {
+        EraseLocked(it->second);
+        return {};
+    }
+
+    if (needAttributes &&
+        (!snapshot->HasAttributes || std::chrono::steady_clock::now() - snapshot->m_Created > c_attributeLifetime))
+    {
+        return {};
+    }
+
+    // Move the entry to the front of the LRU list.
+    m_Lru.splice(m_Lru.begin(), m_Lru, it->second);
+    return snapshot;
+}
+
+// Creates a new, empty snapshot that can be filled by a live enumeration, or returns null if the
+// directory was modified too recently to be cached safely.
+std::shared_ptr<DirectorySnapshot> DirectorySnapshotCache::CreateBuilder(const struct stat& st, bool includeAttributes) const
+{
+    if (!Enabled())
+    {
+        return {};
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const auto latest = std::max(st.st_mtim.tv_sec, st.st_ctim.tv_sec);
+    if (now.tv_sec - latest <= std::chrono::duration_cast<std::chrono::seconds>(c_racyInterval).count())
+    {
+        return {};
+    }
+
+    return std::make_shared<DirectorySnapshot>(st, includeAttributes);
+}
+
+// Publishes a completed snapshot, evicting the least recently used snapshots if needed.
+void DirectorySnapshotCache::Insert(const Key& key, std::shared_ptr<const DirectorySnapshot> snapshot)
+{
+    if (snapshot->Entries.size() > DirectorySnapshot::MaxEntries)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{m_Lock};
+    const auto existing = m_Index.find(key);
+    if (existing != m_Index.end())
+    {
+        EraseLocked(existing->second);
+    }
+
+    m_EntryCount += snapshot->Entries.size();
+    m_Lru.emplace_front(key, std::move(snapshot));
+    m_Index.emplace(key, m_Lru.begin());
+    while (m_EntryCount > c_maxCachedEntries && !m_Lru.empty())
+    {
+        EraseLocked(std::prev(m_Lru.end()));
+    }
+}
+
+void DirectorySnapshotCache::EraseLocked(LruList::iterator entry) noexcept
+{
+    m_EntryCount -= entry->second->Entries.size();
+    m_Index.erase(entry->first);
+    m_Lru.erase(entry);
+}
+
 } // namespace p9fs
@@ -1,6 +1,8 @@
 // Copyright (C) Microsoft Corporation. All rights reserved.
 #pragma once
 
+#include "p9defs.h"
+
 namespace p9fs {
 
 class DirectoryEnumerator final
@@ -18,4 +20,71 @@ private:
     long m_LastOffset{};
 };
 
+struct DirectorySnapshotEntry
+{
+    std::string Name;
+    UINT64 Inode;
+    UINT64 Offset;
+    UCHAR Type;
+    StatResult Attributes;
+};
+
+// An immutable listing of a directory, which can be shared by all enumerations of that directory
+// as long as it doesn't change.
+class DirectorySnapshot final
+{
+public:
+    // Maximum number of entries in a snapshot; larger directories are always enumerated live.
+    static constexpr size_t MaxEntries = 16 * 1024;
+
+    DirectorySnapshot(const struct stat& st, bool includeAttributes);
+
+    bool IsCurrent(const struct stat& st) const noexcept;
+    std::optional<size_t> Find(UINT64 offset, size_t hint) const noexcept;
+
+    std::vector<DirectorySnapshotEntry> Entries;
+    const bool HasAttributes;
+
+private:
+    friend class DirectorySnapshotCache;
+
+    timespec m_Mtime;
+    timespec m_Ctime;
+    std::chrono::steady_clock::time_point m_Created;
+};
+
+// Process-wide cache of directory snapshots, keyed by device, inode and the uid that enumerated
+// the directory.
+class DirectorySnapshotCache final
+{
+public:
+    struct Key
+    {
+        dev_t Device;
+        ino_t Inode;
+        uid_t Uid;
+
+        auto operator<=>(const Key&) const = default;
+    };
+
+    void Configure(bool enabled) noexcept;
+    bool Enabled() const noexcept;
+    std::shared_ptr<const DirectorySnapshot> Lookup(const Key& key, const struct stat& st, bool needAttributes);
+    std::shared_ptr<DirectorySnapshot> CreateBuilder(const struct stat& st, bool includeAttributes) const;
+    void Insert(const Key& key, std::shared_ptr<const DirectorySnapshot> snapshot);
+
+private:
+    using LruList = std::list<std::pair<Key, std::shared_ptr<const DirectorySnapshot>>>;
+
+    void EraseLocked(LruList::iterator entry) noexcept;
+
+    std::mutex m_Lock;
+    LruList m_Lru;
+    std::map<Key, LruList::iterator> m_Index;
+    size_t m_EntryCount{};
+    std::atomic<bool> m_Enabled{false};
+};
+
+extern DirectorySnapshotCache g_DirectorySnapshotCache;
+
 } // namespace p9fs
@@ -0,0 +1,207 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#include "precomp.h"
+#include <sys/mman.h>
+#include "p9streamread.h"
+#include "p9tracelogging.h"
+
+namespace p9fs {
+
+StreamingReads g_StreamingReads;
+
+// Enables or disables streaming reads, and sets the number of bytes that must be read
+// sequentially from a file before it's treated as a bulk transfer.
+void StreamingReads::Configure(bool enabled, UINT64 threshold) noexcept
+{
+    m_Enabled = enabled;
+    m_Threshold = threshold == 0 ? DefaultThreshold : threshold;
+}
+
+bool StreamingReads::Enabled() const noexcept
+{
+    return m_Enabled.load(std::memory_order_relaxed);
+}
+
+UINT64 StreamingReads::Threshold() const noexcept
+{
+    return m_Threshold.load(std::memory_order_relaxed);
+}
+
+// Returns the total number of bytes that were dropped from the page cache by streaming reads.
+UINT64 StreamingReads::DroppedBytes() const noexcept
+{
+    return m_DroppedBytes.load(std::memory_order_relaxed);
+}
+
+// Reports how much data was kept out of the page cache when a streamed file is closed.
+// N.B. The last partial chunk is not dropped here because the file descriptor may already be
+//      closed; it's small compared to the threshold.
+StreamingReadState::~StreamingReadState()
+{
+    if (m_Streaming)
+    {
+        Plan9TraceLoggingProvider::LogMessage(
+            std::format(
+                "Streaming read dropped {} bytes from the page cache (total {} bytes in {} files)",
+                m_DroppedBytes,
+                g_StreamingReads.DroppedBytes(),
+                g_StreamingReads.m_StreamedFiles.load(std::memory_order_relaxed)),
+            TRACE_LEVEL_INFORMATION);
+    }
+}
+
+// Samples which pages of the file are in the page cache ahead of a read, if the read is part of a
+// bulk sequential read. The pages are sampled before the kernel reads them ahead for the stream,
+// so the pages that are already cached are the ones that something else is using.
+void StreamingReadState::Prepare(int fd, UINT64 offset, UINT64 length) noexcept
+try
+{
+    if (length == 0 || !g_StreamingReads.Enabled())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{m_Lock};
+    const bool sequential = offset + SequentialWindow >= m_NextOffset && offset <= m_NextOffset + SequentialWindow;
+    if (!sequential || m_SequentialBytes + length + SampleAhead < g_StreamingReads.Threshold())
+    {
+        return;
+    }
+
+    const UINT64 pageSize = sysconf(_SC_PAGESIZE);
+    UINT64 sampleEnd = m_SampleStart + m_ColdPages.size() * pageSize;
+    if (m_ColdPages.empty() || offset < m_SampleStart || offset > sampleEnd)
+    {
+        m_SampleStart = offset - (offset % pageSize);
+        m_ColdPages.clear();
+        sampleEnd = m_SampleStart;
+    }
+
+    const UINT64 targetEnd = offset + length + SampleAhead;
+    if (sampleEnd >= targetEnd)
+    {
+        return;
+    }
+
+    // mincore() needs a mapping of the range, which doesn't fault anything in.
+    const size_t mapLength = targetEnd - sampleEnd;
+    void* mapping = mmap(nullptr, mapLength, PROT_READ, MAP_SHARED, fd, sampleEnd);
+    if (mapping == MAP_FAILED)
+    {
+        return;
+    }
+
+    auto unmap = wil::scope_exit([&]() { munmap(mapping, mapLength); });
+    std::vector<unsigned char> pages((mapLength + pageSize - 1) / pageSize);
+    if (mincore(mapping, mapLength, pages.data()) < 0)
+    {
+        return;
+    }
+
+    for (const auto page : pages)
+    {
+        m_ColdPages.push_back((page & 1) == 0);
+    }
+}
+CATCH_LOG()
+
+// Records a completed read. Once more than the threshold has been read sequentially, the pages
+// that were not cached before the stream reached them are dropped in chunks.
+// N.B. Dirty pages are not affected by POSIX_FADV_DONTNEED, so this never loses data that was
+//      written through another file descriptor.
+void StreamingReadState::Track(int fd, UINT64 offset, UINT64 length) noexcept
+try
+{
+    if (length == 0 || !g_StreamingReads.Enabled())
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock{m_Lock};
+    if (offset + SequentialWindow >= m_NextOffset && offset <= m_NextOffset + SequentialWindow)
+    {
+        m_SequentialBytes += length;
+    }
+    else
+    {
+        // A random access pattern; start over, and don't drop anything read before the seek.
+        m_NextOffset = offset;
+        m_SequentialBytes = length;
+        m_ColdPages.clear();
+        m_DropRanges.clear();
+        m_PendingBytes = 0;
+    }
+
+    m_NextOffset = std::max(m_NextOffset, offset + length);
+    if (m_SequentialBytes < g_StreamingReads.Threshold())
+    {
+        return;
+    }
+
+    if (!m_Streaming)
+    {
+        m_Streaming = true;
+        g_StreamingReads.m_StreamedFiles.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Queue the pages of the read that weren't cached before the stream reached them. Only whole
+    // pages are queued, since POSIX_FADV_DONTNEED ignores partial pages: a page that the read only
+    // covers the start of is left for the read that reaches its end.
+    const UINT64 pageSize = sysconf(_SC_PAGESIZE);
+    const UINT64 end = offset + length;
+    for (UINT64 page = std::max(offset - (offset % pageSize), m_SampleStart); page + pageSize <= end; page += pageSize)
+    {
+        const UINT64 index = (page - m_SampleStart) / pageSize;
+        if (index >= m_ColdPages.size())
+        {
+            break;
+        }
+
+        if (m_ColdPages[index])
+        {
+            AddDropRange(page, page + pageSize);
+            m_ColdPages[index] = false;
+        }
+    }
+
+    // Forget the samples that the stream has moved past.
+    while (!m_ColdPages.empty() && m_SampleStart + pageSize + SequentialWindow <= m_NextOffset)
+    {
+        m_ColdPages.pop_front();
+        m_SampleStart += pageSize;
+    }
+
+    if (m_PendingBytes < DropChunkSize)
+    {
+        return;
+    }
+
+    for (const auto& [start, rangeEnd] : m_DropRanges)
+    {
+        if (posix_fadvise(fd, start, rangeEnd - start, POSIX_FADV_DONTNEED) == 0)
+        {
+            m_DroppedBytes += rangeEnd - start;
+            g_StreamingReads.m_DroppedBytes.fetch_add(rangeEnd - start, std::memory_order_relaxed);
+        }
+    }
+
+    m_DropRanges.clear();
+    m_PendingBytes = 0;
+}
+CATCH_LOG()
+
+// Adds a range to drop, merging it with the previous one if they're contiguous.
+void StreamingReadState::AddDropRange(UINT64 start, UINT64 end)
+{
+    if (!m_DropRanges.empty() && m_DropRanges.back().second == start)
+    {
+        m_DropRanges.back().second = end;
+    }
+    else
+    {
+        m_DropRanges.emplace_back(start, end);
+    }
+
+    m_PendingBytes += end - start;
+}
+
+} // namespace p9fs
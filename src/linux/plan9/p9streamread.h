@@ -0,0 +1,74 @@
+// Copyright (C) Microsoft Corporation. All rights reserved.
+#pragma once
+
+#include <deque>
+
+namespace p9fs {
+
+// Detects bulk sequential reads of a file (for example, a backup or copy of a large directory
+// from Windows) and drops the data that was read from the page cache once it has been sent to the
+// client, so the transfer doesn't evict the rest of the guest's working set.
+//
+// Only the pages that the stream brought in are dropped: the residency of the file is sampled
+// with mincore() ahead of the reads, further than the kernel reads ahead, and pages that were
+// already cached (for example, build inputs that the guest is using) are left alone.
+class StreamingReadState
+{
+public:
+    // Reads within this distance of the end of the previous read are still considered sequential,
+    // since a client can have several reads of the same file in flight at once.
+    static constexpr UINT64 SequentialWindow = 1024 * 1024;
+
+    // The minimum amount of data that is dropped from the page cache at once.
+    static constexpr UINT64 DropChunkSize = 4 * 1024 * 1024;
+
+    // How far ahead of the reads the residency of the file is sampled.
+    static constexpr UINT64 SampleAhead = 16 * 1024 * 1024;
+
+    StreamingReadState() = default;
+    ~StreamingReadState();
+
+    StreamingReadState(const StreamingReadState&) = delete;
+    StreamingReadState& operator=(const StreamingReadState&) = delete;
+
+    void Prepare(int fd, UINT64 offset, UINT64 length) noexcept;
+
+    void Track(int fd, UINT64 offset, UINT64 length) noexcept;
+
+private:
+    void AddDropRange(UINT64 start, UINT64 end);
+
+    std::mutex m_Lock;
+    UINT64 m_NextOffset{};
+    UINT64 m_SequentialBytes{};
+    UINT64 m_SampleStart{};
+    std::deque<bool> m_ColdPages;
+    std::vector<std::pair<UINT64, UINT64>> m_DropRanges;
+    UINT64 m_PendingBytes{};
+    UINT64 m_DroppedBytes{};
+    bool m_Streaming{};
+};
+
+// Global settings and statistics for streaming reads.
+class StreamingReads
+{
+public:
+    static constexpr UINT64 DefaultThreshold = 64 * 1024 * 1024;
+
+    void Configure(bool enabled, UINT64 threshold) noexcept;
+    bool Enabled() const noexcept;
+    UINT64 Threshold() const noexcept;
+    UINT64 DroppedBytes() const noexcept;
+
+private:
+    friend class StreamingReadState;
+
+    std::atomic<bool> m_Enabled{true};
+    std::atomic<UINT64> m_Threshold{DefaultThreshold};
+    std::atomic<UINT64> m_DroppedBytes{};
+    std::atomic<UINT64> m_StreamedFiles{};
+};
+
+extern StreamingReads g_StreamingReads;
+
+} // namespace p9fs
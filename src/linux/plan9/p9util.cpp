@@ -4,6 +4,7 @@
 #include <pwd.h>
 #include <grp.h>
 #include <syscall.h>
+#include <linux/openat2.h>
 
 #define _LINUX_CAPABILITY_VERSION_3 0x20080522
 #define CAP_FOWNER 3
@@ -43,6 +44,11 @@ inline int sys_setgroups(size_t size, const gid_t* list)
     return syscall(SYS_setgroups, size, list);
 }
 
+inline int sys_openat2(int dirFd, const char* pathName, open_how* how)
+{
+    return syscall(SYS_openat2, dirFd, pathName, how, sizeof(*how));
+}
+
 constexpr long c_PasswordFileBufferSize = 1024;
 
 namespace p9fs::util {
@@ -63,6 +69,36 @@ Expected<wil::unique_fd> OpenAt(int dirfd, const std::string& name, int openFlag
     return wil::unique_fd{fd};
 }
 
+// Opens a path relative to a directory in a single call, failing if resolving the path would
+// leave the directory, follow a symlink or cross a mount point. A symlink is only allowed as
+// the final component when O_PATH | O_NOFOLLOW is used.
+// N.B. Returns LX_ENOSYS if openat2 is not supported by the kernel, so the caller can fall
+//      back to resolving the path one component at a time.
+Expected<wil::unique_fd> OpenBeneath(int dirfd, const std::string& name, int openFlags)
+{
+    static std::atomic<bool> s_supported{true};
+    if (!s_supported.load(std::memory_order_relaxed))
+    {
+        return LxError{LX_ENOSYS};
+    }
+
+    open_how how{};
+    how.flags = openFlags | O_CLOEXEC;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS | RESOLVE_NO_SYMLINKS | RESOLVE_NO_XDEV;
+    int fd = sys_openat2(dirfd, name.c_str(), &how);
+    if (fd < 0)
+    {
+        if (errno == ENOSYS)
+        {
+            s_supported = false;
+        }
+
+        return LxError{-errno};
+    }
+
+    return wil::unique_fd{fd};
+}
+
 Expected<wil::unique_fd> Reopen(int fd, int openFlags)
 {
     const char* pathToOpen;
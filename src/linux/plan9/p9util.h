@@ -12,6 +12,8 @@ Expected<wil::unique_fd> Reopen(int fd, int openFlags);
 
 Expected<wil::unique_fd> OpenAt(int dirfd, const std::string& name, int openFlags, mode_t mode = 0600);
 
+Expected<wil::unique_fd> OpenBeneath(int dirfd, const std::string& name, int openFlags);
+
 std::string GetFdPath(int fd);
 
 LX_INT AccessHelper(int fd, const std::string& path, int mode);
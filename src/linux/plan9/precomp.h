@@ -39,6 +39,7 @@
 #include <string>
 #include <string_view>
 #include <filesystem>
+#include <random>
 
 // Guideline Support Library
 #include <gsl/gsl>
@@ -163,6 +163,11 @@ Abstract:
 
 #define LX_INIT_DEFAULT_PLAN9_MOUNT_OPTIONS ";uid=1000;gid=1000;symlinkroot=/mnt/"
 
+//
+// N.B. If LxInitCreateProcessFlagMultiplexStdio is set, a single connection is
+//      made instead and the streams are carried over it (see stdiomux.h).
+//
+
 #define LX_INIT_UTILITY_VM_CREATE_PROCESS_SOCKET_COUNT (5)
 
 #define LX_INIT_NO_CONSOLE (LXBUS_IPC_CONSOLE_ID_INVALID)
@@ -195,6 +200,18 @@ Abstract:
 
 #define WSL_DEBUG_ENV "WSL_DEBUG"
 
+#define WSL_BOOT_TRACE_ENV "WSL_BOOT_TRACE"
+
+#define WSL_BOOT_TRACE_FILE "boot-trace.json"
+
+#define WSL_MEMORY_RECLAIM_FILE "memory-reclaim"
+
+#define WSL_WORKING_SET_FILE "working-set"
+
+#define WSL_SERIAL_BOOT_ENV "WSL_SERIAL_BOOT"
+
+#define WSL_COLD_PAGE_AGE_ENV "WSL_COLD_PAGE_AGE"
+
 #define WSL_DISTRIBUTION_CONF "/etc/wsl-distribution.conf"
 
 //
@@ -234,6 +251,11 @@ Abstract:
 #define LX_INIT_PLAN9_LOG_LEVEL_ARG "--log-level"
 #define LX_INIT_PLAN9_PIPE_FD_ARG "--pipe-fd"
 #define LX_INIT_PLAN9_TRUNCATE_LOG_ARG "--log-truncate"
+#define LX_INIT_PLAN9_NO_FAIR_QUEUE_ARG "--no-fair-queue"
+#define LX_INIT_PLAN9_IO_BUDGET_ARG "--io-budget"
+#define LX_INIT_PLAN9_READDIR_CACHE_ARG "--readdir-cache"
+#define LX_INIT_PLAN9_NO_STREAMING_READS_ARG "--no-streaming-reads"
+#define LX_INIT_PLAN9_STREAMING_THRESHOLD_ARG "--streaming-threshold"
 
 //
 // wsl-capture-crash
@@ -273,6 +295,7 @@ Abstract:
 #define LX_WSL2_DISTRO_READ_ONLY_ENV "WSL_DISTRO_READ_ONLY"
 #define LX_WSL2_NETWORKING_MODE_ENV "WSL2_NETWORKING_MODE"
 #define LX_WSL2_DISTRO_INIT_PID "WSL2_DISTRO_INIT_PID"
+#define LX_WSL2_BOOT_TRACE_FD_ENV "WSL2_BOOT_TRACE_FD"
 #define LX_WSL2_DISTRO_CGROUP_PATH "WSL2_DISTRO_CGROUP_PATH"
 
 //
@@ -415,6 +438,8 @@ typedef enum _LX_MESSAGE_TYPE
     LxMessageWSLCListDirResult,
     LxMessageWSLCMountVirtioFs,
     LxMessageWSLCWriteFile,
+    LxMiniInitMessageWorkingSet,
+    LxMiniInitMessageImportDelta,
 } LX_MESSAGE_TYPE,
     *PLX_MESSAGE_TYPE;
 
@@ -531,6 +556,8 @@ inline auto ToString(LX_MESSAGE_TYPE messageType)
         X(LxMessageWSLCListDirResult)
         X(LxMessageWSLCMountVirtioFs)
         X(LxMessageWSLCWriteFile)
+        X(LxMiniInitMessageWorkingSet)
+        X(LxMiniInitMessageImportDelta)
 
     default:
         return "<unexpected LX_MESSAGE_TYPE>";
@@ -962,6 +989,7 @@ typedef enum _LX_INIT_FEATURE_FLAGS
     LxInitFeatureRootfsCompressed = 0x8,
     LxInitFeatureSystemDistro = 0x10,
     LxInitFeatureDnsTunneling = 0x20,
+    LxInitFeatureMultiplexStdio = 0x40,
 } LX_INIT_FEATURE_FLAGS,
     *PLX_INIT_FEATURE_FLAGS;
 
@@ -1055,6 +1083,7 @@ typedef enum _LX_INIT_CREATE_PROCESS_FLAGS
     LxInitCreateProcessFlagsElevated = 0x8,
     LxInitCreateProcessFlagsInteropEnabled = 0x10,
     LxInitCreateProcessFlagAllowOOBE = 0x20,
+    LxInitCreateProcessFlagMultiplexStdio = 0x40,
 } LX_INIT_CREATE_PROCESS_FLAGS,
     *PLX_INIT_CREATE_PROCESS_FLAGS;
 
@@ -1211,6 +1240,9 @@ typedef enum _LX_MINI_INIT_MESSAGE_FLAGS
     LxMiniInitMessageFlagExportCompressGzip = 0x8,
     LxMiniInitMessageFlagExportCompressXzip = 0x10,
     LxMiniInitMessageFlagVerbose = 0x20,
+    LxMiniInitMessageFlagExportCompressZstd = 0x40,
+    LxMiniInitMessageFlagExportIncremental = 0x80,
+    LxMiniInitMessageFlagDigest = 0x100,
 } LX_MINI_INIT_MESSAGE_FLAGS,
     *PLX_MINI_INIT_MESSAGE_FLAGS;
 
@@ -1261,10 +1293,19 @@ typedef enum _LX_MINI_INIT_MEMORY_RECLAIM_MODE
 {
     LxMiniInitMemoryReclaimModeDisabled,
     LxMiniInitMemoryReclaimModeGradual,
-    LxMiniInitMemoryReclaimModeDropCache
+    LxMiniInitMemoryReclaimModeDropCache,
+    LxMiniInitMemoryReclaimModeWorkingSet
 } LX_MINI_INIT_MEMORY_RECLAIM_MODE,
     *PLX_MINI_INIT_MEMORY_RECLAIM_MODE;
 
+typedef enum _LX_MINI_INIT_COMPRESSED_SWAP_MODE
+{
+    LxMiniInitCompressedSwapModeDisabled,
+    LxMiniInitCompressedSwapModeZswap,
+    LxMiniInitCompressedSwapModeZram
+} LX_MINI_INIT_COMPRESSED_SWAP_MODE,
+    *PLX_MINI_INIT_COMPRESSED_SWAP_MODE;
+
 typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
 {
     static inline auto Type = LxMiniInitMessageEarlyConfig;
@@ -1274,6 +1315,9 @@ typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
     LX_MINI_INIT_MOUNT_DEVICE_TYPE SystemDistroDeviceType;
     unsigned int SystemDistroDeviceId;
     LX_MINI_INIT_MEMORY_RECLAIM_MODE MemoryReclaimMode;
+    LX_MINI_INIT_COMPRESSED_SWAP_MODE CompressedSwapMode;
+    // Size of the zram device, or of the zswap pool. 0 selects the default.
+    uint64_t CompressedSwapSizeBytes;
     // IPv4 address stored in network byte order
     uint32_t DnsTunnelingIpAddress = 0;
     bool EnableDebugShell;
@@ -1284,6 +1328,7 @@ typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
     unsigned int KernelModulesDeviceId;
     unsigned int HostnameOffset;
     unsigned int KernelModulesListOffset;
+    unsigned int CompressedSwapCompressorOffset;
     char Buffer[];
 
     PRETTY_PRINT(
@@ -1292,6 +1337,8 @@ typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
         FIELD(SystemDistroDeviceType),
         FIELD(SystemDistroDeviceId),
         FIELD(MemoryReclaimMode),
+        FIELD(CompressedSwapMode),
+        FIELD(CompressedSwapSizeBytes),
         FIELD(DnsTunnelingIpAddress),
         FIELD(EnableDebugShell),
         FIELD(EnableDnsTunneling),
@@ -1300,7 +1347,8 @@ typedef struct _LX_MINI_INIT_EARLY_CONFIG_MESSAGE
         FIELD(IsolateDistroCgroup),
         FIELD(KernelModulesDeviceId),
         STRING_FIELD(HostnameOffset),
-        STRING_FIELD(KernelModulesListOffset));
+        STRING_FIELD(KernelModulesListOffset),
+        STRING_FIELD(CompressedSwapCompressorOffset));
 } LX_MINI_INIT_EARLY_CONFIG_MESSAGE, *PLX_MINI_INIT_EARLY_CONFIG_MESSAGE;
 
 using PCLX_MINI_INIT_EARLY_CONFIG_MESSAGE = const LX_MINI_INIT_EARLY_CONFIG_MESSAGE*;
@@ -1479,6 +1527,20 @@ typedef struct _LX_MINI_INIT_CHILD_EXIT_MESSAGE
     PRETTY_PRINT(FIELD(Header), FIELD(ChildPid));
 } LX_MINI_INIT_CHILD_EXIT_MESSAGE, *PLX_MINI_INIT_CHILD_EXIT_MESSAGE;
 
+typedef struct _LX_MINI_INIT_WORKING_SET_MESSAGE
+{
+    static inline auto Type = LxMiniInitMessageWorkingSet;
+
+    MESSAGE_HEADER Header;
+    // Memory on the LRU lists that was accessed recently.
+    uint64_t WorkingSetBytes;
+    uint64_t ColdAnonymousBytes;
+    uint64_t ColdFileBytes;
+    uint64_t ReclaimedBytes;
+
+    PRETTY_PRINT(FIELD(Header), FIELD(WorkingSetBytes), FIELD(ColdAnonymousBytes), FIELD(ColdFileBytes), FIELD(ReclaimedBytes));
+} LX_MINI_INIT_WORKING_SET_MESSAGE, *PLX_MINI_INIT_WORKING_SET_MESSAGE;
+
 typedef struct _LX_MINI_INIT_MOUNT_FOLDER_MESSAGE
 {
     static inline auto Type = LxMiniInitMountFolder;
@@ -1962,9 +2024,18 @@ typedef struct _LX_MINI_INIT_IMPORT_RESULT
     unsigned int TerminalProfileSize;
     bool GenerateTerminalProfile;
     bool GenerateShortcut;
+    unsigned int Sha256Index;
     char Buffer[];
 
-    PRETTY_PRINT(FIELD(Header), FIELD(Result), STRING_FIELD(FlavorIndex), STRING_FIELD(VersionIndex), STRING_FIELD(DefaultNameIndex), FIELD(ShortcutIconIndex), FIELD(TerminalProfileIndex));
+    PRETTY_PRINT(
+        FIELD(Header),
+        FIELD(Result),
+        STRING_FIELD(FlavorIndex),
+        STRING_FIELD(VersionIndex),
+        STRING_FIELD(DefaultNameIndex),
+        FIELD(ShortcutIconIndex),
+        FIELD(TerminalProfileIndex),
+        STRING_FIELD(Sha256Index));
 } LX_MINI_INIT_IMPORT_RESULT, *PLX_MINI_INIT_IMPORT_RESULT;
 
 typedef struct _LX_INIT_OOBE_RESULT
@@ -0,0 +1,506 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    stdiomux.h
+
+Abstract:
+
+    This file contains the stdio multiplexer, which carries the standard
+    handles and control channels of a process over a single stream socket.
+
+    Each stream is bridged to a local socket. Data is sent in frames tagged
+    with the stream index, and each stream has its own flow control window so
+    a stream that isn't being read can't block the other ones. Both ends run
+    the same code.
+
+--*/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+#include <cstring>
+
+#if defined(__GNUC__)
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#endif
+
+namespace wsl::shared {
+
+class StdioMux
+{
+public:
+#if defined(_MSC_VER)
+    using TSocket = SOCKET;
+#elif defined(__GNUC__)
+    using TSocket = int;
+#endif
+
+    // Bridges Streams[i] to stream i of the multiplexed socket until every stream is closed in
+    // both directions, or the multiplexed socket is closed.
+    // N.B. The caller keeps ownership of all sockets. They are made non-blocking.
+    StdioMux(TSocket Mux, std::vector<TSocket> Streams) : m_mux(Mux)
+    {
+        SetNonBlocking(m_mux);
+        for (auto Socket : Streams)
+        {
+            SetNonBlocking(Socket);
+            m_streams.emplace_back(Stream{Socket});
+        }
+    }
+
+    void Run()
+    {
+        std::vector<PollDescriptor> PollDescriptors(m_streams.size() + 1);
+        for (;;)
+        {
+            //
+            // Apply pending shutdowns, and exit once every local socket has been closed and
+            // everything read from them has been sent. If the peer is gone, what it sent is still
+            // written out before its local socket is shut down.
+            //
+            // N.B. A local socket only reaches end of file once its owner is done with it, so
+            //      once all of them have, nothing is left to read what the peer still sends.
+            //
+
+            bool Done = m_sendBuffer.Empty();
+            for (auto& Stream : m_streams)
+            {
+                if ((Stream.PeerEof || m_muxEof) && Stream.Inbound.Empty() && !Stream.LocalShutdown)
+                {
+                    shutdown(Stream.Socket, c_shutdownWrite);
+                    Stream.LocalShutdown = true;
+                }
+
+                Done = Done && (Stream.LocalEof || (m_muxEof && Stream.LocalShutdown));
+            }
+
+            if (Done || (m_muxEof && m_muxBroken))
+            {
+                if (!m_muxEof)
+                {
+                    shutdown(m_mux, c_shutdownWrite);
+                }
+
+                return;
+            }
+
+            //
+            // N.B. Descriptors with no events are ignored so a hung up socket doesn't cause a
+            //      busy loop.
+            //
+
+            PollDescriptors[0].events = (m_muxEof ? 0 : POLLIN) | (m_sendBuffer.Empty() ? 0 : POLLOUT);
+            PollDescriptors[0].fd = PollDescriptors[0].events == 0 ? c_ignoredSocket : m_mux;
+            PollDescriptors[0].revents = 0;
+            for (size_t Index = 0; Index < m_streams.size(); Index += 1)
+            {
+                auto& Stream = m_streams[Index];
+                auto& Descriptor = PollDescriptors[Index + 1];
+                Descriptor.events = 0;
+                Descriptor.revents = 0;
+
+                //
+                // Only read from a local socket if the peer has room for the data, and the send
+                // buffer isn't backed up.
+                //
+
+                if (!Stream.LocalEof && !m_muxEof && Stream.SendCredit > 0 && m_sendBuffer.Size() < c_maxFrameSize * 2)
+                {
+                    Descriptor.events |= POLLIN;
+                }
+
+                if (!Stream.Inbound.Empty())
+                {
+                    Descriptor.events |= POLLOUT;
+                }
+
+                Descriptor.fd = Descriptor.events == 0 ? c_ignoredSocket : Stream.Socket;
+            }
+
+            if (Poll(PollDescriptors.data(), PollDescriptors.size()) < 0)
+            {
+                return;
+            }
+
+            if ((PollDescriptors[0].events & POLLIN) && (PollDescriptors[0].revents & (POLLIN | POLLHUP | POLLERR)))
+            {
+                ReceiveFrames();
+            }
+
+            //
+            // Streams are serviced in order, so data queued on a lower stream (stdout) is sent
+            // before data queued on a higher stream (control) in the same iteration.
+            //
+
+            for (size_t Index = 0; Index < m_streams.size(); Index += 1)
+            {
+                const auto& Descriptor = PollDescriptors[Index + 1];
+                if ((Descriptor.events & POLLOUT) && (Descriptor.revents & (POLLOUT | POLLHUP | POLLERR)))
+                {
+                    WriteInbound(Index);
+                }
+
+                if ((Descriptor.events & POLLIN) && (Descriptor.revents & (POLLIN | POLLHUP | POLLERR)))
+                {
+                    ReadOutbound(Index);
+                }
+            }
+
+            if (!m_sendBuffer.Empty() && !m_muxBroken)
+            {
+                SendFrames();
+            }
+        }
+    }
+
+private:
+    enum FrameType : uint8_t
+    {
+        FrameData = 0,
+        FrameCredit = 1,
+        FrameShutdown = 2,
+    };
+
+#pragma pack(push, 1)
+    struct FrameHeader
+    {
+        uint8_t Type;
+        uint8_t Stream;
+        uint16_t Reserved;
+        uint32_t Length;
+    };
+#pragma pack(pop)
+
+    // A byte queue that is consumed from the front by advancing an offset. The unconsumed data is
+    // only moved back to the start of the storage when more room is needed at the end.
+    class Buffer
+    {
+    public:
+        const char* Data() const
+        {
+            return m_data.data() + m_begin;
+        }
+
+        size_t Size() const
+        {
+            return m_end - m_begin;
+        }
+
+        bool Empty() const
+        {
+            return m_begin == m_end;
+        }
+
+        // Returns room for at least Size bytes at the end; Commit() then appends what was written.
+        char* Reserve(size_t Size)
+        {
+            if (m_data.size() - m_end < Size)
+            {
+                //
+                // Grow the storage so the next move is at least as many bytes away as the data
+                // being moved, which keeps the cost of moving linear in the data queued.
+                //
+
+                const auto Live = this->Size();
+                if (Live > 0)
+                {
+                    memmove(m_data.data(), Data(), Live);
+                }
+
+                m_begin = 0;
+                m_end = Live;
+                m_data.resize(std::max(m_data.size(), (2 * Live) + Size));
+            }
+
+            return m_data.data() + m_end;
+        }
+
+        void Commit(size_t Size)
+        {
+            m_end += Size;
+        }
+
+        void Append(const char* Source, size_t Size)
+        {
+            memcpy(Reserve(Size), Source, Size);
+            Commit(Size);
+        }
+
+        void Consume(size_t Size)
+        {
+            m_begin += Size;
+            if (m_begin == m_end)
+            {
+                Clear();
+            }
+        }
+
+        void Clear()
+        {
+            m_begin = 0;
+            m_end = 0;
+        }
+
+    private:
+        std::vector<char> m_data;
+        size_t m_begin = 0;
+        size_t m_end = 0;
+    };
+
+    struct Stream
+    {
+        TSocket Socket;
+        Buffer Inbound{};
+        uint32_t SendCredit = c_window;
+        uint32_t PendingCredit = 0;
+        bool LocalEof = false;
+        bool LocalShutdown = false;
+        bool PeerEof = false;
+    };
+
+#if defined(_MSC_VER)
+    using PollDescriptor = WSAPOLLFD;
+    static constexpr int c_shutdownWrite = SD_SEND;
+#elif defined(__GNUC__)
+    using PollDescriptor = pollfd;
+    static constexpr int c_shutdownWrite = SHUT_WR;
+#endif
+
+    // The number of bytes that can be sent on a stream before the peer returns credit.
+    static constexpr uint32_t c_window = 256 * 1024;
+
+    static constexpr size_t c_maxFrameSize = 64 * 1024;
+
+    static constexpr TSocket c_ignoredSocket = static_cast<TSocket>(-1);
+
+    static void SetNonBlocking(TSocket Socket)
+    {
+#if defined(_MSC_VER)
+        u_long NonBlocking = 1;
+        THROW_LAST_ERROR_IF(ioctlsocket(Socket, FIONBIO, &NonBlocking) == SOCKET_ERROR);
+#elif defined(__GNUC__)
+        const int Flags = fcntl(Socket, F_GETFL);
+        THROW_LAST_ERROR_IF(Flags < 0 || fcntl(Socket, F_SETFL, Flags | O_NONBLOCK) < 0);
+#endif
+    }
+
+    static int Poll(PollDescriptor* Descriptors, size_t Count)
+    {
+#if defined(_MSC_VER)
+        return WSAPoll(Descriptors, static_cast<ULONG>(Count), -1);
+#elif defined(__GNUC__)
+        return TEMP_FAILURE_RETRY(poll(Descriptors, Count, -1));
+#endif
+    }
+
+    static bool WouldBlock()
+    {
+#if defined(_MSC_VER)
+        return WSAGetLastError() == WSAEWOULDBLOCK;
+#elif defined(__GNUC__)
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    static int Recv(TSocket Socket, char* Buffer, size_t Size)
+    {
+#if defined(_MSC_VER)
+        return ::recv(Socket, Buffer, static_cast<int>(Size), 0);
+#elif defined(__GNUC__)
+        return TEMP_FAILURE_RETRY(::recv(Socket, Buffer, Size, 0));
+#endif
+    }
+
+    static int Send(TSocket Socket, const char* Buffer, size_t Size)
+    {
+#if defined(_MSC_VER)
+        return ::send(Socket, Buffer, static_cast<int>(Size), 0);
+#elif defined(__GNUC__)
+        return TEMP_FAILURE_RETRY(::send(Socket, Buffer, Size, MSG_NOSIGNAL));
+#endif
+    }
+
+    void QueueFrame(FrameType Type, size_t Stream, const char* Data, uint32_t Length)
+    {
+        FrameHeader Header{};
+        Header.Type = Type;
+        Header.Stream = static_cast<uint8_t>(Stream);
+        Header.Length = Length;
+        m_sendBuffer.Append(reinterpret_cast<const char*>(&Header), sizeof(Header));
+        if (Type == FrameData)
+        {
+            m_sendBuffer.Append(Data, Length);
+        }
+    }
+
+    void SendFrames()
+    {
+        while (!m_sendBuffer.Empty())
+        {
+            const auto BytesSent = Send(m_mux, m_sendBuffer.Data(), m_sendBuffer.Size());
+            if (BytesSent < 0)
+            {
+                if (!WouldBlock())
+                {
+                    m_muxBroken = true;
+                    m_muxEof = true;
+                    m_sendBuffer.Clear();
+                }
+
+                return;
+            }
+
+            m_sendBuffer.Consume(BytesSent);
+        }
+    }
+
+    void ReceiveFrames()
+    {
+        constexpr size_t ReceiveSize = c_maxFrameSize + sizeof(FrameHeader);
+        const auto BytesRead = Recv(m_mux, m_receiveBuffer.Reserve(ReceiveSize), ReceiveSize);
+        if (BytesRead <= 0)
+        {
+            if (BytesRead < 0 && WouldBlock())
+            {
+                return;
+            }
+
+            //
+            // The peer is gone; there is no one left to send data or credit to.
+            //
+
+            m_muxEof = true;
+            m_muxBroken = BytesRead < 0;
+            m_sendBuffer.Clear();
+            return;
+        }
+
+        m_receiveBuffer.Commit(BytesRead);
+        while (m_receiveBuffer.Size() >= sizeof(FrameHeader))
+        {
+            FrameHeader Header;
+            memcpy(&Header, m_receiveBuffer.Data(), sizeof(Header));
+            const size_t FrameSize = sizeof(Header) + (Header.Type == FrameData ? Header.Length : 0);
+            if (Header.Stream >= m_streams.size() || Header.Length > c_window)
+            {
+                m_muxEof = true;
+                m_muxBroken = true;
+                return;
+            }
+
+            if (m_receiveBuffer.Size() < FrameSize)
+            {
+                break;
+            }
+
+            auto& Stream = m_streams[Header.Stream];
+            const auto* Data = m_receiveBuffer.Data() + sizeof(Header);
+            switch (Header.Type)
+            {
+            case FrameData:
+                if (Stream.LocalShutdown)
+                {
+                    // The local reader is gone; drop the data but return the credit.
+                    Stream.PendingCredit += Header.Length;
+                    FlushCredit(Header.Stream, true);
+                }
+                else
+                {
+                    Stream.Inbound.Append(Data, Header.Length);
+                }
+
+                break;
+
+            case FrameCredit:
+                Stream.SendCredit += Header.Length;
+                break;
+
+            case FrameShutdown:
+                Stream.PeerEof = true;
+                break;
+            }
+
+            m_receiveBuffer.Consume(FrameSize);
+        }
+    }
+
+    // Returns credit to the peer once a quarter of the window has been consumed, or when the
+    // stream has nothing left buffered.
+    void FlushCredit(size_t Index, bool Force)
+    {
+        auto& Stream = m_streams[Index];
+        if (Stream.PendingCredit > 0 && (Force || Stream.PendingCredit >= c_window / 4))
+        {
+            QueueFrame(FrameCredit, Index, nullptr, Stream.PendingCredit);
+            Stream.PendingCredit = 0;
+        }
+    }
+
+    void WriteInbound(size_t Index)
+    {
+        auto& Stream = m_streams[Index];
+        while (!Stream.Inbound.Empty())
+        {
+            const auto BytesWritten = Send(Stream.Socket, Stream.Inbound.Data(), Stream.Inbound.Size());
+            if (BytesWritten < 0)
+            {
+                if (WouldBlock())
+                {
+                    break;
+                }
+
+                //
+                // The local end is closed for reading; discard what's left.
+                //
+
+                Stream.PendingCredit += static_cast<uint32_t>(Stream.Inbound.Size());
+                Stream.Inbound.Clear();
+                Stream.LocalShutdown = true;
+                break;
+            }
+
+            Stream.PendingCredit += BytesWritten;
+            Stream.Inbound.Consume(BytesWritten);
+        }
+
+        FlushCredit(Index, Stream.Inbound.Empty());
+    }
+
+    void ReadOutbound(size_t Index)
+    {
+        auto& Stream = m_streams[Index];
+        const size_t Size = std::min<size_t>(Stream.SendCredit, c_maxFrameSize);
+        m_readBuffer.resize(Size);
+        const auto BytesRead = Recv(Stream.Socket, m_readBuffer.data(), Size);
+        if (BytesRead < 0 && WouldBlock())
+        {
+            return;
+        }
+
+        if (BytesRead <= 0)
+        {
+            Stream.LocalEof = true;
+            QueueFrame(FrameShutdown, Index, nullptr, 0);
+            return;
+        }
+
+        Stream.SendCredit -= BytesRead;
+        QueueFrame(FrameData, Index, m_readBuffer.data(), static_cast<uint32_t>(BytesRead));
+    }
+
+    TSocket m_mux;
+    std::vector<Stream> m_streams;
+    Buffer m_sendBuffer;
+    Buffer m_receiveBuffer;
+    std::vector<char> m_readBuffer;
+    bool m_muxEof = false;
+    bool m_muxBroken = false;
+};
+
+} // namespace wsl::shared
@@ -238,6 +238,10 @@ int ExportDistribution(_In_ std::wstring_view commandLine)
         {
             WI_SetFlag(flags, LXSS_EXPORT_DISTRO_FLAGS_XZIP);
         }
+        else if (wsl::shared::string::IsEqual(L"tar.zst", Value))
+        {
+            WI_SetFlag(flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD);
+        }
         else if (wsl::shared::string::IsEqual(L"vhd", Value))
         {
             WI_SetFlag(flags, LXSS_EXPORT_DISTRO_FLAGS_VHD);
@@ -254,11 +258,18 @@ int ExportDistribution(_In_ std::wstring_view commandLine)
     parser.AddPositionalArgument(filePath, 1);
     parser.AddArgument(SetFlag<LXSS_EXPORT_DISTRO_FLAGS_VHD, ULONG>(flags), WSL_EXPORT_ARG_VHD_OPTION);
     parser.AddArgument(parseFormat, WSL_EXPORT_ARG_FORMAT_OPTION);
+    parser.AddArgument(SetFlag<LXSS_EXPORT_DISTRO_FLAGS_INCREMENTAL, ULONG>(flags), WSL_EXPORT_ARG_INCREMENTAL_OPTION);
+    parser.AddArgument(SetFlag<LXSS_EXPORT_DISTRO_FLAGS_DIGEST, ULONG>(flags), WSL_EXPORT_ARG_SHA256_OPTION);
     parser.Parse();
 
     THROW_HR_IF(
         WSL_E_INVALID_USAGE,
-        filePath.empty() || (WI_IsFlagSet(flags, LXSS_EXPORT_DISTRO_FLAGS_GZIP) && WI_IsFlagSet(flags, LXSS_EXPORT_DISTRO_FLAGS_VHD)));
+        filePath.empty() ||
+            (WI_IsAnyFlagSet(
+                 flags,
+                 LXSS_EXPORT_DISTRO_FLAGS_GZIP | LXSS_EXPORT_DISTRO_FLAGS_XZIP | LXSS_EXPORT_DISTRO_FLAGS_ZSTD |
+                     LXSS_EXPORT_DISTRO_FLAGS_INCREMENTAL | LXSS_EXPORT_DISTRO_FLAGS_DIGEST) &&
+             WI_IsFlagSet(flags, LXSS_EXPORT_DISTRO_FLAGS_VHD)));
 
     // Determine if the target is stdout, or an on-disk file.
     wil::unique_hfile file;
@@ -319,6 +330,7 @@ int ImportDistribution(_In_ std::wstring_view commandLine)
     parser.AddPositionalArgument(filePath, 2);
     parser.AddArgument(WslVersion(version), WSL_IMPORT_ARG_VERSION);
     parser.AddArgument(SetFlag<LXSS_IMPORT_DISTRO_FLAGS_VHD, ULONG>{flags}, WSL_IMPORT_ARG_VHD);
+    parser.AddArgument(SetFlag<LXSS_IMPORT_DISTRO_FLAGS_DIGEST, ULONG>{flags}, WSL_IMPORT_ARG_SHA256);
 
     parser.Parse();
 
@@ -387,6 +399,54 @@ int ImportDistribution(_In_ std::wstring_view commandLine)
     return 0;
 }
 
+int ImportDistributionDelta(_In_ std::wstring_view commandLine)
+{
+    ArgumentParser parser(std::wstring{commandLine}, WSL_BINARY_NAME);
+    LPCWSTR name{};
+    std::filesystem::path filePath;
+
+    parser.AddPositionalArgument(name, 0);
+    parser.AddPositionalArgument(filePath, 1);
+    parser.Parse();
+
+    THROW_HR_IF(WSL_E_INVALID_USAGE, name == nullptr || filePath.empty());
+
+    // Determine if the source of the tar file is stdin, or an on-disk file.
+    wil::unique_hfile file;
+    HANDLE fileHandle;
+    if (filePath.wstring() == WSL_IMPORT_ARG_STDIN)
+    {
+        fileHandle = GetStdHandle(STD_INPUT_HANDLE);
+    }
+    else
+    {
+        file.reset(CreateFileW(
+            filePath.c_str(),
+            GENERIC_READ,
+            (FILE_SHARE_READ | FILE_SHARE_DELETE),
+            nullptr,
+            OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL,
+            nullptr));
+
+        THROW_LAST_ERROR_IF(!file);
+
+        fileHandle = file.get();
+    }
+
+    // Apply the layer to the distribution.
+    {
+        wsl::windows::common::SvcComm service;
+        const GUID distroId = service.GetDistributionId(name);
+
+        wsl::windows::common::HandleConsoleProgressBar progressBar(fileHandle, Localization::MessageImportProgress());
+        service.ImportDistributionDelta(distroId, fileHandle);
+    }
+
+    wsl::windows::common::wslutil::PrintSystemError(ERROR_SUCCESS);
+    return 0;
+}
+
 int ImportDistributionInplace(_In_ std::wstring_view commandLine)
 {
     // Parse the command line.
@@ -1651,6 +1711,10 @@ int WslMain(_In_ std::wstring_view commandLine)
         {
             return ImportDistribution(commandLine);
         }
+        else if (argument == WSL_IMPORT_DELTA_ARG)
+        {
+            return ImportDistributionDelta(commandLine);
+        }
         else if (argument == WSL_IMPORT_INPLACE_ARG)
         {
             commandLine = wsl::windows::common::helpers::ConsumeArgument(commandLine, argument);
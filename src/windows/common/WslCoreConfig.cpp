@@ -128,7 +128,11 @@ void wsl::core::Config::ParseConfigFile(_In_opt_ LPCWSTR ConfigFilePath, _In_opt
         ConfigKey(ConfigSetting::Experimental::HostAddressLoopback, EnableHostAddressLoopback),
         ConfigKey(ConfigSetting::Experimental::SetVersionDebug, SetVersionDebug),
         ConfigKey(ConfigSetting::Experimental::Swiotlb, MemoryString(SwiotlbSizeBytes)),
-        ConfigKey(ConfigSetting::Experimental::VirtioFsAggregateShares, EnableVirtioFsAggregateShares)};
+        ConfigKey(ConfigSetting::Experimental::VirtioFsAggregateShares, EnableVirtioFsAggregateShares),
+        ConfigKey(ConfigSetting::Experimental::MultiplexStdio, EnableMultiplexStdio),
+        ConfigKey(ConfigSetting::Experimental::CompressedSwap, wsl::core::CompressedSwapModes, CompressedSwap),
+        ConfigKey(ConfigSetting::Experimental::CompressedSwapCompressor, CompressedSwapCompressor),
+        ConfigKey(ConfigSetting::Experimental::CompressedSwapSize, MemoryString(CompressedSwapSizeBytes))};
 
     wil::unique_file ConfigFile;
     if (ConfigFilePath != nullptr)
@@ -21,11 +21,12 @@ Abstract:
 #define T_VALUE(c, n) TraceLoggingValue((c).n, #n)
 
 #define CONFIG_TELEMETRY(c) \
-    T_VALUE(c, BestEffortDnsParsing), T_VALUE(c, DhcpTimeout), T_VALUE(c, EnableAutoProxy), T_VALUE(c, EnableDebugConsole), \
-        T_VALUE(c, EnableDebugShell), T_VALUE(c, EnableDhcp), T_VALUE(c, EnableDnsProxy), T_VALUE(c, EnableDnsTunneling), \
-        T_VALUE(c, EnableGpuSupport), T_VALUE(c, EnableGuiApps), T_VALUE(c, EnableHardwarePerformanceCounters), \
-        T_VALUE(c, EnableHostAddressLoopback), T_VALUE(c, EnableHostFileSystemAccess), T_VALUE(c, EnableIpv6), \
-        T_VALUE(c, EnableLocalhostRelay), T_VALUE(c, EnableNestedVirtualization), T_VALUE(c, EnableSafeMode), \
+    T_VALUE(c, BestEffortDnsParsing), T_ENUM(c, CompressedSwap), T_VALUE(c, CompressedSwapSizeBytes), T_VALUE(c, DhcpTimeout), \
+        T_VALUE(c, EnableAutoProxy), T_VALUE(c, EnableDebugConsole), T_VALUE(c, EnableDebugShell), T_VALUE(c, EnableDhcp), \
+        T_VALUE(c, EnableDnsProxy), T_VALUE(c, EnableDnsTunneling), T_VALUE(c, EnableGpuSupport), T_VALUE(c, EnableGuiApps), \
+        T_VALUE(c, EnableHardwarePerformanceCounters), T_VALUE(c, EnableHostAddressLoopback), \
+        T_VALUE(c, EnableHostFileSystemAccess), T_VALUE(c, EnableIpv6), T_VALUE(c, EnableLocalhostRelay), \
+        T_VALUE(c, EnableMultiplexStdio), T_VALUE(c, EnableNestedVirtualization), T_VALUE(c, EnableSafeMode), \
         T_VALUE(c, EnableSparseVhd), T_VALUE(c, EnableVirtio), T_VALUE(c, EnableVirtio9p), T_VALUE(c, EnableVirtioFs), \
         T_VALUE(c, EnableVirtioFsAggregateShares), T_ENUM(c, FirewallConfigPresence), T_VALUE(c, IsolateDistroCgroup), \
         T_VALUE(c, KernelBootTimeout), T_SET(c, KernelCommandLine), T_VALUE(c, KernelDebugPort), T_STRING(c, KernelModulesList), \
@@ -53,13 +54,15 @@ enum class MemoryReclaimMode
 {
     Disabled,
     Gradual,
-    DropCache
+    DropCache,
+    WorkingSet
 };
 
 // Ensure the WslCoreConfig versions of the enum match the version that's used in mini init.
 static_assert(static_cast<ULONG>(MemoryReclaimMode::Disabled) == LxMiniInitMemoryReclaimModeDisabled);
 static_assert(static_cast<ULONG>(MemoryReclaimMode::Gradual) == LxMiniInitMemoryReclaimModeGradual);
 static_assert(static_cast<ULONG>(MemoryReclaimMode::DropCache) == LxMiniInitMemoryReclaimModeDropCache);
+static_assert(static_cast<ULONG>(MemoryReclaimMode::WorkingSet) == LxMiniInitMemoryReclaimModeWorkingSet);
 
 constexpr auto ToString(MemoryReclaimMode mode)
 {
@@ -71,6 +74,8 @@ constexpr auto ToString(MemoryReclaimMode mode)
         return "Gradual";
     case MemoryReclaimMode::DropCache:
         return "DropCache";
+    case MemoryReclaimMode::WorkingSet:
+        return "WorkingSet";
     default:
         return "Invalid";
     }
@@ -79,8 +84,41 @@ constexpr auto ToString(MemoryReclaimMode mode)
 const std::map<std::string, MemoryReclaimMode, shared::string::CaseInsensitiveCompare> MemoryReclaimModes = {
     {ToString(MemoryReclaimMode::Gradual), MemoryReclaimMode::Gradual},
     {ToString(MemoryReclaimMode::DropCache), MemoryReclaimMode::DropCache},
+    {ToString(MemoryReclaimMode::WorkingSet), MemoryReclaimMode::WorkingSet},
     {ToString(MemoryReclaimMode::Disabled), MemoryReclaimMode::Disabled}};
 
+enum class CompressedSwapMode
+{
+    Disabled,
+    Zswap,
+    Zram
+};
+
+// Ensure the WslCoreConfig versions of the enum match the version that's used in mini init.
+static_assert(static_cast<ULONG>(CompressedSwapMode::Disabled) == LxMiniInitCompressedSwapModeDisabled);
+static_assert(static_cast<ULONG>(CompressedSwapMode::Zswap) == LxMiniInitCompressedSwapModeZswap);
+static_assert(static_cast<ULONG>(CompressedSwapMode::Zram) == LxMiniInitCompressedSwapModeZram);
+
+constexpr auto ToString(CompressedSwapMode mode)
+{
+    switch (mode)
+    {
+    case CompressedSwapMode::Disabled:
+        return "Disabled";
+    case CompressedSwapMode::Zswap:
+        return "Zswap";
+    case CompressedSwapMode::Zram:
+        return "Zram";
+    default:
+        return "Invalid";
+    }
+}
+
+const std::map<std::string, CompressedSwapMode, shared::string::CaseInsensitiveCompare> CompressedSwapModes = {
+    {ToString(CompressedSwapMode::Disabled), CompressedSwapMode::Disabled},
+    {ToString(CompressedSwapMode::Zswap), CompressedSwapMode::Zswap},
+    {ToString(CompressedSwapMode::Zram), CompressedSwapMode::Zram}};
+
 // N.B. These enum values are also used in InTune ADMX templates, if entries are added or removed ensure that existing
 //      values are not changed.
 enum NetworkingMode
@@ -295,6 +333,10 @@ namespace ConfigSetting {
         static constexpr auto SetVersionDebug = "experimental.setVersionDebug";
         static constexpr auto Swiotlb = "experimental.swiotlb";
         static constexpr auto VirtioFsAggregateShares = "experimental.virtioFsAggregateShares";
+        static constexpr auto MultiplexStdio = "experimental.multiplexStdio";
+        static constexpr auto CompressedSwap = "experimental.compressedSwap";
+        static constexpr auto CompressedSwapCompressor = "experimental.compressedSwapCompressor";
+        static constexpr auto CompressedSwapSize = "experimental.compressedSwapSize";
 
     } // namespace Experimental
 } // namespace ConfigSetting
@@ -331,6 +373,7 @@ struct Config
     bool EnableVirtio = !shared::Arm64 || windows::common::helpers::IsWindows11OrAbove();
     bool EnableVirtioFs = false;
     bool EnableVirtioFsAggregateShares = true;
+    bool EnableMultiplexStdio = false;
     int KernelDebugPort = 0;
     bool EnableGpuSupport = true;
     bool EnableGuiApps = true;
@@ -368,6 +411,9 @@ struct Config
     bool EnableAutoProxy = true;
     int InitialAutoProxyTimeout = 1000;
     MemoryReclaimMode MemoryReclaim = MemoryReclaimMode::DropCache;
+    CompressedSwapMode CompressedSwap = CompressedSwapMode::Disabled;
+    std::wstring CompressedSwapCompressor = L"zstd";
+    UINT64 CompressedSwapSizeBytes = 0;
     bool EnableSparseVhd = false;
     UINT64 VhdSizeBytes = 0x10000000000; // 1TB
 
@@ -14,6 +14,7 @@ Abstract:
 
 #include "precomp.h"
 #include <mutex>
+#include <afunix.h>
 #include "socket.hpp"
 #pragma hdrstop
 
@@ -201,3 +202,73 @@ int wsl::windows::common::socket::Send(
 
     return Offset;
 }
+
+std::vector<std::pair<wil::unique_socket, wil::unique_socket>> wsl::windows::common::socket::CreateUnixSocketPairs(size_t Count)
+{
+    const auto createSocket = []() {
+        wil::unique_socket socket{
+            WSASocketW(AF_UNIX, SOCK_STREAM, 0, nullptr, 0, WSA_FLAG_OVERLAPPED | WSA_FLAG_NO_HANDLE_INHERIT)};
+        THROW_LAST_ERROR_IF(!socket);
+        return socket;
+    };
+
+    // Windows has no socketpair(), so the pairs are connected through a listening socket bound
+    // to a uniquely named file, which is deleted once all the pairs are connected.
+    CHAR tempPath[MAX_PATH + 1];
+    THROW_LAST_ERROR_IF(GetTempPathA(ARRAYSIZE(tempPath), tempPath) == 0);
+
+    GUID id;
+    THROW_IF_FAILED(CoCreateGuid(&id));
+
+    SOCKADDR_UN address{};
+    address.sun_family = AF_UNIX;
+    const auto name = wsl::shared::string::GuidToString<char>(id, wsl::shared::string::GuidToStringFlags::None);
+    const auto path = std::format("{}wsl-stdio-{}.sock", tempPath, name);
+
+    THROW_HR_IF(HRESULT_FROM_WIN32(ERROR_FILENAME_EXCED_RANGE), path.size() >= sizeof(address.sun_path));
+    strcpy_s(address.sun_path, path.c_str());
+
+    const auto listenSocket = createSocket();
+    THROW_LAST_ERROR_IF(
+        bind(listenSocket.get(), reinterpret_cast<const SOCKADDR*>(&address), sizeof(address)) == SOCKET_ERROR);
+
+    auto deleteFile = wil::scope_exit([&]() { LOG_IF_WIN32_BOOL_FALSE(DeleteFileA(path.c_str())); });
+    THROW_LAST_ERROR_IF(listen(listenSocket.get(), 1) == SOCKET_ERROR);
+
+    // Connect the pairs one at a time. Another local process could connect to the listening socket
+    // too, so only accept connections that come from this process.
+    std::vector<std::pair<wil::unique_socket, wil::unique_socket>> pairs;
+    while (pairs.size() < Count)
+    {
+        auto client = createSocket();
+        THROW_LAST_ERROR_IF(connect(client.get(), reinterpret_cast<const SOCKADDR*>(&address), sizeof(address)) == SOCKET_ERROR);
+
+        for (;;)
+        {
+            wil::unique_socket server{accept(listenSocket.get(), nullptr, nullptr)};
+            THROW_LAST_ERROR_IF(!server);
+
+            ULONG peerPid{};
+            DWORD bytesReturned{};
+            THROW_LAST_ERROR_IF(
+                WSAIoctl(
+                    server.get(),
+                    SIO_AF_UNIX_GETPEERPID,
+                    nullptr,
+                    0,
+                    &peerPid,
+                    sizeof(peerPid),
+                    &bytesReturned,
+                    nullptr,
+                    nullptr) == SOCKET_ERROR);
+
+            if (peerPid == GetCurrentProcessId())
+            {
+                pairs.emplace_back(std::move(server), std::move(client));
+                break;
+            }
+        }
+    }
+
+    return pairs;
+}
@@ -58,4 +58,7 @@ int Send(
     _In_opt_ HANDLE ExitHandle = nullptr,
     _In_ const std::source_location& Location = std::source_location::current());
 
+// Creates pairs of connected AF_UNIX sockets, only reachable from the calling process.
+std::vector<std::pair<wil::unique_socket, wil::unique_socket>> CreateUnixSocketPairs(size_t Count);
+
 } // namespace wsl::windows::common::socket
@@ -551,6 +551,26 @@ GUID wsl::windows::common::SvcComm::ImportDistributionInplace(_In_ LPCWSTR Name,
     return DistroGuid;
 }
 
+void wsl::windows::common::SvcComm::ImportDistributionDelta(_In_ const GUID& DistroGuid, _In_ HANDLE FileHandle) const
+{
+    ClientExecutionContext context;
+
+    // Create a pipe for reading errors from bsdtar.
+    wil::unique_handle stdErrRead;
+    wil::unique_handle stdErrWrite;
+    THROW_IF_WIN32_BOOL_FALSE(CreatePipe(&stdErrRead, &stdErrWrite, nullptr, 0));
+
+    relay::ScopedRelay stdErrRelay(
+        std::move(stdErrRead), GetStdHandle(STD_ERROR_HANDLE), LX_RELAY_BUFFER_SIZE, [&stdErrWrite]() { stdErrWrite.reset(); });
+
+    const auto result = m_userSession->ImportDistributionDelta(&DistroGuid, FileHandle, stdErrWrite.get(), context.OutError());
+
+    stdErrWrite.reset();
+    stdErrRelay.Sync();
+
+    THROW_IF_FAILED(result);
+}
+
 void wsl::windows::common::SvcComm::MoveDistribution(_In_ const GUID& DistroGuid, _In_ LPCWSTR Location) const
 {
     ClientExecutionContext context;
@@ -75,6 +75,8 @@ public:
 
     GUID ImportDistributionInplace(_In_ LPCWSTR Name, _In_ LPCWSTR VhdPath) const;
 
+    void ImportDistributionDelta(_In_ const GUID& DistroGuid, _In_ HANDLE FileHandle) const;
+
     MountResult MountDisk(_In_ LPCWSTR Disk, _In_ ULONG Flags, _In_ ULONG PartitionIndex, _In_opt_ LPCWSTR Name, _In_opt_ LPCWSTR Type, _In_opt_ LPCWSTR Options) const;
 
     std::pair<GUID, wil::unique_cotaskmem_string> RegisterDistribution(
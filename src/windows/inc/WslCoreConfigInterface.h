@@ -63,7 +63,8 @@ enum MemoryReclaimConfiguration
 {
     Disabled = 0,
     Gradual = 1,
-    DropCache = 2
+    DropCache = 2,
+    WorkingSet = 3
 };
 
 typedef struct WslConfig* WslConfig_t;
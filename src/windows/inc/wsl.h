@@ -26,12 +26,16 @@ Abstract:
 #define WSL_EXPORT_ARG L"--export"
 #define WSL_EXPORT_ARG_STDOUT L"-"
 #define WSL_EXPORT_ARG_FORMAT_OPTION L"--format"
+#define WSL_EXPORT_ARG_INCREMENTAL_OPTION L"--incremental"
+#define WSL_EXPORT_ARG_SHA256_OPTION L"--sha256"
 #define WSL_EXPORT_ARG_VHD_OPTION L"--vhd"
 #define WSL_HELP_ARG L"--help"
 #define WSL_IMPORT_ARG L"--import"
 #define WSL_IMPORT_ARG_STDIN L"-"
+#define WSL_IMPORT_ARG_SHA256 L"--sha256"
 #define WSL_IMPORT_ARG_VERSION L"--version"
 #define WSL_IMPORT_ARG_VHD L"--vhd"
+#define WSL_IMPORT_DELTA_ARG L"--import-delta"
 #define WSL_IMPORT_INPLACE_ARG L"--import-in-place"
 #define WSL_INSTALL_ARG L"--install"
 #define WSL_INSTALL_ARG_DIST_OPTION L'd'
@@ -28,6 +28,7 @@ static_assert(NetworkingConfiguration::Consomme == static_cast<int32_t>(wsl::cor
 static_assert(MemoryReclaimConfiguration::Disabled == static_cast<int32_t>(wsl::core::MemoryReclaimMode::Disabled));
 static_assert(MemoryReclaimConfiguration::Gradual == static_cast<int32_t>(wsl::core::MemoryReclaimMode::Gradual));
 static_assert(MemoryReclaimConfiguration::DropCache == static_cast<int32_t>(wsl::core::MemoryReclaimMode::DropCache));
+static_assert(MemoryReclaimConfiguration::WorkingSet == static_cast<int32_t>(wsl::core::MemoryReclaimMode::WorkingSet));
 
 struct WslConfig
 {
@@ -30,6 +30,7 @@ Abstract:
 #define LXSS_BSDTAR_CREATE_ARGS " -c --one-file-system --xattrs -f - ."
 #define LXSS_BSDTAR_CREATE_ARGS_GZIP " -cz --one-file-system --xattrs -f - ."
 #define LXSS_BSDTAR_CREATE_ARGS_XZIP " -cJ --one-file-system --xattrs -f - ."
+#define LXSS_BSDTAR_CREATE_ARGS_ZSTD " -c --zstd --one-file-system --xattrs -f - ."
 #define LXSS_BSDTAR_EXTRACT_ARGS " -x -p --xattrs --no-acls -f -"
 #define LXSS_ROOTFS_MOUNT "/rootfs"
 #define LXSS_TOOLS_MOUNT "/tools"
@@ -48,6 +49,42 @@ using wsl::windows::common::Context;
 using wsl::windows::common::ExecutionContext;
 using wsl::windows::common::ServiceExecutionContext;
 
+namespace {
+
+// Reports the SHA-256 digest of an archive that the utility VM computed, on request, while exporting or
+// importing it. The digest is logged and written to the output handle, so the caller can verify the archive.
+void ReportArchiveDigest(
+    LPCSTR Operation,
+    const LXSS_DISTRO_CONFIGURATION& Configuration,
+    const LX_MINI_INIT_IMPORT_RESULT& Message,
+    gsl::span<gsl::byte> Span,
+    HANDLE OutputHandle)
+{
+    THROW_HR_WITH_USER_ERROR_IF(
+        HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED),
+        wsl::shared::Localization::MessageArchiveDigestUnavailable(),
+        Message.Sha256Index == 0);
+
+    const auto* Digest = wsl::shared::string::FromSpan(Span, Message.Sha256Index);
+    WSL_LOG(
+        "ArchiveDigest",
+        TraceLoggingValue(Operation, "operation"),
+        TraceLoggingValue(Configuration.Name.c_str(), "distroName"),
+        TraceLoggingValue(Digest, "sha256"));
+
+    if (OutputHandle != nullptr)
+    {
+        auto Output = wsl::shared::string::WideToMultiByte(wsl::shared::Localization::MessageArchiveDigest(Digest));
+        Output += '\n';
+
+        DWORD Written{};
+        LOG_IF_WIN32_BOOL_FALSE(
+            WriteFile(OutputHandle, Output.data(), gsl::narrow_cast<DWORD>(Output.size()), &Written, nullptr));
+    }
+}
+
+} // namespace
+
 LxssUserSession::LxssUserSession(_In_ const std::weak_ptr<LxssUserSessionImpl>& Session) : m_session(Session)
 {
     return;
@@ -312,6 +349,19 @@ try
 }
 CATCH_RETURN()
 
+HRESULT STDMETHODCALLTYPE LxssUserSession::ImportDistributionDelta(
+    _In_ LPCGUID DistroGuid, _In_ HANDLE FileHandle, _In_ HANDLE ErrorHandle, _Out_ LXSS_ERROR_INFO* Error)
+try
+{
+    ServiceExecutionContext context(Error);
+
+    const auto session = m_session.lock();
+    RETURN_HR_IF(RPC_E_DISCONNECTED, !session);
+
+    return session->ImportDistributionDelta(DistroGuid, FileHandle, ErrorHandle);
+}
+CATCH_RETURN()
+
 HRESULT STDMETHODCALLTYPE LxssUserSession::ListDistributions(_Out_ ULONG* Count, _Out_ LPWSTR** Distributions)
 try
 {
@@ -1084,8 +1134,16 @@ HRESULT LxssUserSessionImpl::ExportDistribution(_In_opt_ LPCGUID DistroGuid, _In
         configuration = s_GetDistributionConfiguration(registration);
         RETURN_HR_IF(E_ILLEGAL_STATE_CHANGE, (configuration.State != LxssDistributionStateInstalled));
 
-        // Exporting a WSL1 distro is not possible if the VHD flag is specified.
-        RETURN_HR_IF(WSL_E_WSL2_NEEDED, WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_VHD) && WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE));
+        // Exporting a WSL1 distro is not possible if the VHD, incremental or digest flag is specified.
+        RETURN_HR_IF(
+            WSL_E_WSL2_NEEDED,
+            WI_IsAnyFlagSet(
+                Flags, LXSS_EXPORT_DISTRO_FLAGS_VHD | LXSS_EXPORT_DISTRO_FLAGS_INCREMENTAL | LXSS_EXPORT_DISTRO_FLAGS_DIGEST) &&
+                WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE));
+
+        // Incremental exports are tar files, and digests are only computed for tar files.
+        RETURN_HR_IF(E_INVALIDARG, WI_AreAllFlagsSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_VHD | LXSS_EXPORT_DISTRO_FLAGS_INCREMENTAL));
+        RETURN_HR_IF(E_INVALIDARG, WI_AreAllFlagsSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_VHD | LXSS_EXPORT_DISTRO_FLAGS_DIGEST));
 
         // Exporting a WSL1 distro is not possible if the lxcore driver is not present.
         RETURN_HR_IF(WSL_E_WSL1_NOT_SUPPORTED, WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE) && !g_lxcoreInitialized);
@@ -1159,15 +1217,33 @@ HRESULT LxssUserSessionImpl::ExportDistribution(_In_opt_ LPCGUID DistroGuid, _In
                 wsl::windows::common::relay::InterruptableRelay(
                     reinterpret_cast<HANDLE>(vmContext.tarSocket.get()), FileHandle, clientProcess.get(), LXSS_RELAY_BUFFER_SIZE);
 
-                // Wait for the utility VM to finish expanding the tar and ensure that
+                // Wait for the utility VM to finish creating the tar and ensure that
                 // the operation was successful.
-                ULONG exitCode = 1;
-                vmContext.instance->GetInitPort()->Receive(&exitCode, sizeof(exitCode), clientProcess.get());
+                auto* channel = dynamic_cast<WslCoreInstance::WslCorePort*>(vmContext.instance->GetInitPort().get());
+
+                gsl::span<gsl::byte> span;
+                const auto& message = channel->GetChannel().ReceiveMessage<LX_MINI_INIT_IMPORT_RESULT>(&span);
 
                 // Flush any pending IO on the error relay before exiting.
                 stdErrRelay.Sync();
 
-                THROW_HR_IF(WSL_E_EXPORT_FAILED, (exitCode != 0));
+                THROW_HR_IF(WSL_E_EXPORT_FAILED, (message.Result != 0));
+
+                if (WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_DIGEST))
+                {
+                    ReportArchiveDigest("Export", configuration, message, span, ErrorHandle);
+                }
+
+                // Confirm that the archive was stored, so the distribution saves the manifest of the incremental export.
+                if (WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_INCREMENTAL))
+                {
+                    if (GetFileType(FileHandle) == FILE_TYPE_DISK)
+                    {
+                        THROW_IF_WIN32_BOOL_FALSE(FlushFileBuffers(FileHandle));
+                    }
+
+                    channel->GetChannel().SendResultMessage<int32_t>(0);
+                }
             }
         }
         else
@@ -1178,14 +1254,20 @@ HRESULT LxssUserSessionImpl::ExportDistribution(_In_opt_ LPCGUID DistroGuid, _In
 
             if (WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_GZIP))
             {
-                THROW_HR_IF(E_INVALIDARG, WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_XZIP));
+                THROW_HR_IF(E_INVALIDARG, WI_IsAnyFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_XZIP | LXSS_EXPORT_DISTRO_FLAGS_ZSTD));
 
                 formatArgs = LXSS_BSDTAR_CREATE_ARGS_GZIP;
             }
             else if (WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_XZIP))
             {
+                THROW_HR_IF(E_INVALIDARG, WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD));
+
                 formatArgs = LXSS_BSDTAR_CREATE_ARGS_XZIP;
             }
+            else if (WI_IsFlagSet(Flags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD))
+            {
+                formatArgs = LXSS_BSDTAR_CREATE_ARGS_ZSTD;
+            }
             else
             {
                 formatArgs = LXSS_BSDTAR_CREATE_ARGS;
@@ -1391,6 +1473,72 @@ LxssUserSessionImpl::ImportDistributionInplace(_In_ LPCWSTR DistributionName, _I
     return S_OK;
 }
 
+HRESULT LxssUserSessionImpl::ImportDistributionDelta(_In_ LPCGUID DistroGuid, _In_ HANDLE FileHandle, _In_ HANDLE ErrorHandle)
+{
+    LXSS_DISTRO_CONFIGURATION configuration;
+    try
+    {
+        const auto userToken = wsl::windows::common::security::GetUserToken(TokenImpersonation);
+        const wil::unique_hkey lxssKey = s_OpenLxssUserKey(userToken.get());
+        std::lock_guard lock(m_instanceLock);
+
+        const auto registration = DistributionRegistration::Open(lxssKey.get(), *DistroGuid);
+
+        // Ensure the distribution is installed and not running.
+        configuration = s_GetDistributionConfiguration(registration);
+        RETURN_HR_IF(E_ILLEGAL_STATE_CHANGE, (configuration.State != LxssDistributionStateInstalled));
+        RETURN_HR_IF(WSL_E_DISTRO_NOT_STOPPED, m_runningInstances.contains(configuration.DistroId));
+
+        // Incremental exports are only supported for WSL2 distributions.
+        RETURN_HR_IF(WSL_E_WSL2_NEEDED, WI_IsFlagClear(configuration.Flags, LXSS_DISTRO_FLAGS_VM_MODE));
+
+        // Add the distribution to the list of converting distributions.
+        _ConversionBegin(configuration.DistroId, LxssDistributionStateInstalling);
+    }
+    CATCH_RETURN()
+
+    // Set up a scope exit member to remove the distribution from the converting list.
+    auto importComplete = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [&] { _ConversionComplete(configuration.DistroId); });
+
+    HRESULT result;
+    auto logExit = wil::scope_exit([&] {
+        WSL_LOG_TELEMETRY(
+            "ImportDistributionDelta",
+            PDT_ProductAndServiceUsage,
+            TraceLoggingValue(configuration.Name.c_str(), "distroName"),
+            TraceLoggingValue(result, "result"));
+    });
+
+    try
+    {
+        // Extract the layer in the utility VM and apply it to the distribution.
+        auto vmContext = _RunUtilityVmSetup(configuration, LxMiniInitMessageImportDelta);
+
+        wsl::windows::common::relay::ScopedRelay errorRelay(std::move(vmContext.errorSocket), ErrorHandle);
+        wsl::windows::common::relay::ScopedRelay dataRelay(FileHandle, std::move(vmContext.tarSocket));
+
+        auto* channel = dynamic_cast<WslCoreInstance::WslCorePort*>(vmContext.instance->GetInitPort().get());
+
+        gsl::span<gsl::byte> span;
+        const auto& message = channel->GetChannel().ReceiveMessage<LX_MINI_INIT_IMPORT_RESULT>(&span);
+
+        // Flush any pending IO on the error relay before exiting.
+        errorRelay.Sync();
+
+        THROW_HR_IF(WSL_E_IMPORT_FAILED, (message.Result != 0));
+
+        LogArchiveDigest("ImportDelta", configuration, message, span);
+
+        result = S_OK;
+    }
+    catch (...)
+    {
+        result = wil::ResultFromCaughtException();
+    }
+
+    return result;
+}
+
 HRESULT LxssUserSessionImpl::RegisterDistribution(
     _In_ LPCWSTR DistributionName,
     _In_ ULONG Version,
@@ -1458,15 +1606,18 @@ HRESULT LxssUserSessionImpl::RegisterDistribution(
 
         RETURN_HR_IF(E_INVALIDARG, ((Version != LXSS_WSL_VERSION_1) && (Version != LXSS_WSL_VERSION_2)));
 
-        // Registering a WSL1 distro is not possible if any VHD flags are specified.
+        // Registering a WSL1 distro is not possible if any VHD flags or the digest flag are specified.
         RETURN_HR_IF(
             WSL_E_WSL2_NEEDED,
-            WI_IsAnyFlagSet(Flags, LXSS_IMPORT_DISTRO_FLAGS_VHD | LXSS_IMPORT_DISTRO_FLAGS_FIXED_VHD) && (Version == LXSS_WSL_VERSION_1));
+            WI_IsAnyFlagSet(
+                Flags, LXSS_IMPORT_DISTRO_FLAGS_VHD | LXSS_IMPORT_DISTRO_FLAGS_FIXED_VHD | LXSS_IMPORT_DISTRO_FLAGS_DIGEST) &&
+                (Version == LXSS_WSL_VERSION_1));
 
-        // Registering a vhd with the fixed vhd flag is not allowed.
+        // Registering a vhd with the fixed vhd flag is not allowed, and digests are only computed for tar files.
         if (WI_IsFlagSet(Flags, LXSS_IMPORT_DISTRO_FLAGS_VHD))
         {
-            RETURN_HR_IF(E_INVALIDARG, WI_IsFlagSet(Flags, LXSS_IMPORT_DISTRO_FLAGS_FIXED_VHD));
+            RETURN_HR_IF(
+                E_INVALIDARG, WI_IsAnyFlagSet(Flags, LXSS_IMPORT_DISTRO_FLAGS_FIXED_VHD | LXSS_IMPORT_DISTRO_FLAGS_DIGEST));
         }
 
         // Registering a distro with a fixed VHD is only allowed if a size is specified.
@@ -1593,8 +1744,12 @@ HRESULT LxssUserSessionImpl::RegisterDistribution(
                     deleteFlags = LXSS_DELETE_DISTRO_FLAGS_VHD;
                 }
 
-                // Create a process in the utility VM to expand the tar file from a socket.
-                auto vmContext = _RunUtilityVmSetup(configuration, LxMiniInitMessageImport);
+                // Create a process in the utility VM to expand the tar file from a socket. The utility VM takes
+                // export flags, so the digest flag is translated.
+                auto vmContext = _RunUtilityVmSetup(
+                    configuration,
+                    LxMiniInitMessageImport,
+                    WI_IsFlagSet(Flags, LXSS_IMPORT_DISTRO_FLAGS_DIGEST) ? LXSS_EXPORT_DISTRO_FLAGS_DIGEST : 0);
 
                 std::optional<wsl::windows::common::relay::ScopedRelay> errorRelay;
                 if (ErrorHandle != nullptr)
@@ -1623,6 +1778,11 @@ HRESULT LxssUserSessionImpl::RegisterDistribution(
                 // Process the import result message.
                 THROW_HR_IF(WSL_E_IMPORT_FAILED, (message.Result != 0));
 
+                if (WI_IsFlagSet(Flags, LXSS_IMPORT_DISTRO_FLAGS_DIGEST))
+                {
+                    ReportArchiveDigest("Import", configuration, message, span, ErrorHandle);
+                }
+
                 _ProcessImportResultMessage(message, span, lxssKey.get(), configuration, registration);
             }
         }
@@ -2041,8 +2201,9 @@ HRESULT LxssUserSessionImpl::SetVersion(_In_ LPCGUID DistroGuid, _In_ ULONG Vers
 
             // Wait for the utility VM to finish creating the tar and ensure that
             // the export was successful.
-            LONG exitStatus = 1;
-            vmContext.instance->GetInitPort()->Receive(&exitStatus, sizeof(exitStatus), clientProcess.get());
+            auto* channel = dynamic_cast<WslCoreInstance::WslCorePort*>(vmContext.instance->GetInitPort().get());
+            const auto& exportResult = channel->GetChannel().ReceiveMessage<LX_MINI_INIT_IMPORT_RESULT>();
+            LONG exitStatus = exportResult.Result;
             THROW_HR_IF(WSL_E_EXPORT_FAILED, (exitStatus != 0));
 
             // Wait for the elf binary to finish expanding the tar and ensure
@@ -3577,7 +3738,10 @@ std::shared_ptr<LxssRunningInstance> LxssUserSessionImpl::_RunningInstance(_In_
 LXSS_VM_MODE_SETUP_CONTEXT
 LxssUserSessionImpl::_RunUtilityVmSetup(_In_ const LXSS_DISTRO_CONFIGURATION& Configuration, _In_ LX_MESSAGE_TYPE MessageType, ULONG ExportFlags, bool SetVersion)
 {
-    THROW_HR_IF(E_INVALIDARG, ((MessageType != LxMiniInitMessageImport) && (MessageType != LxMiniInitMessageExport) && (MessageType != LxMiniInitMessageImportInplace)));
+    THROW_HR_IF(
+        E_INVALIDARG,
+        ((MessageType != LxMiniInitMessageImport) && (MessageType != LxMiniInitMessageExport) &&
+         (MessageType != LxMiniInitMessageImportInplace) && (MessageType != LxMiniInitMessageImportDelta)));
 
     // Open the client process so the operation can be aborted if client exits.
     wil::unique_handle clientProcess = wsl::windows::common::wslutil::OpenCallingProcess(GENERIC_READ | SYNCHRONIZE);
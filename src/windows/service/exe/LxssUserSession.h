@@ -246,6 +246,12 @@ public:
     /// </summary>
     IFACEMETHOD(ImportDistributionInplace)(_In_ LPCWSTR DistributionName, _In_ LPCWSTR VhdPath, _Out_ LXSS_ERROR_INFO* Error, _Out_ GUID* pDistroGuid) override;
 
+    /// <summary>
+    /// Applies a layer of an incremental export to a distribution.
+    /// </summary>
+    IFACEMETHOD(ImportDistributionDelta)(
+        _In_ LPCGUID DistroGuid, _In_ HANDLE FileHandle, _In_ HANDLE ErrorHandle, _Out_ LXSS_ERROR_INFO* Error) override;
+
     /// <summary>
     /// Terminates a distribution by it's client identifier.
     /// </summary>
@@ -427,6 +433,12 @@ public:
     HRESULT
     ImportDistributionInplace(_In_ LPCWSTR DistributionName, _In_ LPCWSTR VhdPath, _Out_ GUID* pDistroGuid);
 
+    /// <summary>
+    /// Applies a layer of an incremental export to a distribution.
+    /// </summary>
+    HRESULT
+    ImportDistributionDelta(_In_ LPCGUID DistroGuid, _In_ HANDLE FileHandle, _In_ HANDLE ErrorHandle);
+
     /// <summary>
     /// Mount a disk.
     /// </summary>
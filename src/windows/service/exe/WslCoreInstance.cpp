@@ -14,6 +14,7 @@ Abstract:
 
 #include "precomp.h"
 #include "WslCoreInstance.h"
+#include "stdiomux.h"
 
 WslCoreInstance::WslCoreInstance(
     _In_ HANDLE UserToken,
@@ -146,6 +147,18 @@ WslCoreInstance::~WslCoreInstance()
         m_destroyingEvent.SetEvent();
         m_oobeThread.join();
     }
+
+    // Shutting down the multiplexed connections makes their relays exit.
+    std::lock_guard lock(m_stdioMuxLock);
+    for (auto& worker : m_stdioMuxWorkers)
+    {
+        shutdown(worker.Socket.get(), SD_BOTH);
+    }
+
+    for (auto& worker : m_stdioMuxWorkers)
+    {
+        worker.Thread.join();
+    }
 }
 
 void WslCoreInstance::CreateLxProcess(
@@ -208,6 +221,8 @@ void WslCoreInstance::CreateLxProcess(
     WI_SetFlagIf(message->Common.Flags, LxInitCreateProcessFlagsStdErrConsole, (StdHandles->StdErr.HandleType == LxssHandleConsole));
     WI_SetFlagIf(message->Common.Flags, LxInitCreateProcessFlagsElevated, (drvfsMount == LxInitDrvfsMountElevated));
     WI_SetFlagIf(message->Common.Flags, LxInitCreateProcessFlagsInteropEnabled, LXSS_INTEROP_ENABLED(CreateProcessContext.Flags));
+    WI_SetFlagIf(
+        message->Common.Flags, LxInitCreateProcessFlagMultiplexStdio, WI_IsFlagSet(m_featureFlags, LxInitFeatureMultiplexStdio));
 
     if (m_configuration.RunOOBE && CreateProcessData.Filename.empty() && CreateProcessData.CommandLine.empty())
     {
@@ -235,9 +250,27 @@ void WslCoreInstance::CreateLxProcess(
         sockets.emplace_back();
     }
 
-    for (auto& socket : sockets)
+    if (WI_IsFlagSet(message->Common.Flags, LxInitCreateProcessFlagMultiplexStdio))
     {
-        socket = wsl::windows::common::hvsocket::Connect(m_runtimeId, port);
+        // All the streams are carried over a single connection. Hand out local sockets to the
+        // client, and relay them over the connection until the process is done with them.
+        auto muxSocket = wsl::windows::common::hvsocket::Connect(m_runtimeId, port);
+        auto pairs = wsl::windows::common::socket::CreateUnixSocketPairs(sockets.size());
+        std::vector<wil::unique_socket> muxStreams;
+        for (size_t index = 0; index < sockets.size(); index += 1)
+        {
+            sockets[index] = std::move(pairs[index].second);
+            muxStreams.emplace_back(std::move(pairs[index].first));
+        }
+
+        StartStdioMux(std::move(muxSocket), std::move(muxStreams));
+    }
+    else
+    {
+        for (auto& socket : sockets)
+        {
+            socket = wsl::windows::common::hvsocket::Connect(m_runtimeId, port);
+        }
     }
 
     *InstanceId = m_runtimeId;
@@ -277,6 +310,42 @@ void WslCoreInstance::CreateLxProcess(
     }
 }
 
+void WslCoreInstance::StartStdioMux(wil::unique_socket&& MuxSocket, std::vector<wil::unique_socket>&& Streams)
+{
+    std::lock_guard lock(m_stdioMuxLock);
+
+    // Join the relays of processes that are done.
+    std::erase_if(m_stdioMuxWorkers, [](StdioMuxWorker& worker) {
+        if (!worker.Done)
+        {
+            return false;
+        }
+
+        worker.Thread.join();
+        return true;
+    });
+
+    auto& worker = m_stdioMuxWorkers.emplace_back();
+    worker.Socket = std::move(MuxSocket);
+    worker.Thread = std::thread([&worker, streams = std::move(Streams)]() {
+        try
+        {
+            wsl::windows::common::wslutil::SetThreadDescription(L"StdioMux");
+
+            std::vector<SOCKET> streamSockets;
+            for (const auto& stream : streams)
+            {
+                streamSockets.push_back(stream.get());
+            }
+
+            wsl::shared::StdioMux(worker.Socket.get(), std::move(streamSockets)).Run();
+        }
+        CATCH_LOG()
+
+        worker.Done = true;
+    });
+}
+
 void WslCoreInstance::ReadOOBEResult(wil::unique_socket&& Socket, wsl::windows::service::DistributionRegistration&& registration)
 {
     wsl::shared::SocketChannel channel(std::move(Socket), "OOBE", {m_destroyingEvent.get()});
@@ -117,6 +117,16 @@ private:
 
     void ReadOOBEResult(wil::unique_socket&& Socket, wsl::windows::service::DistributionRegistration&& registration);
 
+    void StartStdioMux(wil::unique_socket&& MuxSocket, std::vector<wil::unique_socket>&& Streams);
+
+    // The relay of a process whose stdio is multiplexed over a single connection.
+    struct StdioMuxWorker
+    {
+        wil::unique_socket Socket;
+        std::thread Thread;
+        std::atomic<bool> Done{false};
+    };
+
     std::recursive_mutex m_lock;
     wil::unique_handle m_userToken;
     bool m_initialized = false;
@@ -139,6 +149,8 @@ private:
     DWORD m_socketTimeout{};
     HANDLE m_jobObject{};
     std::thread m_oobeThread;
+    std::mutex m_stdioMuxLock;
+    _Guarded_by_(m_stdioMuxLock) std::list<StdioMuxWorker> m_stdioMuxWorkers;
     wil::unique_event m_destroyingEvent{wil::EventOptions::ManualReset};
     wil::unique_event m_oobeCompleteEvent;
 };
@@ -543,6 +543,8 @@ void WslCoreVm::Initialize(const GUID& VmId, const wil::shared_handle& UserToken
     message->SystemDistroDeviceType = m_systemDistroDeviceType;
     message->SystemDistroDeviceId = m_systemDistroDeviceId;
     message->MemoryReclaimMode = static_cast<LX_MINI_INIT_MEMORY_RECLAIM_MODE>(m_vmConfig.MemoryReclaim);
+    message->CompressedSwapMode = static_cast<LX_MINI_INIT_COMPRESSED_SWAP_MODE>(m_vmConfig.CompressedSwap);
+    message->CompressedSwapSizeBytes = m_vmConfig.CompressedSwapSizeBytes;
     message->EnableDebugShell = m_vmConfig.EnableDebugShell;
     message->EnableSafeMode = m_vmConfig.EnableSafeMode;
     // Consomme forwards DNS via the host proxy, so the dedicated DNS hvsocket is only used by NAT and Mirrored modes.
@@ -552,6 +554,7 @@ void WslCoreVm::Initialize(const GUID& VmId, const wil::shared_handle& UserToken
     message->KernelModulesDeviceId = m_kernelModulesDeviceId;
     message.WriteString(message->HostnameOffset, wsl::windows::common::filesystem::GetLinuxHostName());
     message.WriteString(message->KernelModulesListOffset, m_vmConfig.KernelModulesList);
+    message.WriteString(message->CompressedSwapCompressorOffset, m_vmConfig.CompressedSwapCompressor);
     message->DnsTunnelingIpAddress = m_vmConfig.DnsTunnelingIpAddress.value_or(0);
 
     auto transaction = m_miniInitChannel.StartTransaction();
@@ -1216,7 +1219,10 @@ std::shared_ptr<LxssRunningInstance> WslCoreVm::CreateInstance(
 
     WI_SetFlagIf(flags, LxMiniInitMessageFlagExportCompressGzip, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_GZIP));
     WI_SetFlagIf(flags, LxMiniInitMessageFlagExportCompressXzip, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_XZIP));
+    WI_SetFlagIf(flags, LxMiniInitMessageFlagExportCompressZstd, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_ZSTD));
+    WI_SetFlagIf(flags, LxMiniInitMessageFlagExportIncremental, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_INCREMENTAL));
     WI_SetFlagIf(flags, LxMiniInitMessageFlagVerbose, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_VERBOSE));
+    WI_SetFlagIf(flags, LxMiniInitMessageFlagDigest, WI_IsFlagSet(ExportFlags, LXSS_EXPORT_DISTRO_FLAGS_DIGEST));
 
     wsl::shared::MessageWriter<LX_MINI_INIT_MESSAGE> message(MessageType);
     message->MountDeviceType = LxMiniInitMountDeviceTypeLun;
@@ -1270,6 +1276,7 @@ std::shared_ptr<LxssRunningInstance> WslCoreVm::CreateInstanceInternal(
     WI_SetFlagIf(featureFlags, LxInitFeatureVirtIo9p, m_vmConfig.EnableVirtio9p);
     WI_SetFlagIf(featureFlags, LxInitFeatureVirtIoFs, m_vmConfig.EnableVirtioFs);
     WI_SetFlagIf(featureFlags, LxInitFeatureDnsTunneling, m_vmConfig.EnableDnsTunneling);
+    WI_SetFlagIf(featureFlags, LxInitFeatureMultiplexStdio, m_vmConfig.EnableMultiplexStdio);
 
     // Create an instance, this takes ownership of the sockets.
     auto instance = std::make_shared<WslCoreInstance>(
@@ -2427,6 +2434,19 @@ void WslCoreVm::RegisterCallbacks(_In_ const std::function<void(ULONG)>& DistroE
                             exitCallback(exitMessage->ChildPid);
                         }
                     }
+                    else if (header->MessageType == LxMiniInitMessageWorkingSet)
+                    {
+                        const auto* workingSetMessage = gslhelpers::try_get_struct<LX_MINI_INIT_WORKING_SET_MESSAGE>(message);
+                        if (workingSetMessage)
+                        {
+                            WSL_LOG(
+                                "GuestWorkingSet",
+                                TraceLoggingValue(workingSetMessage->WorkingSetBytes, "workingSetBytes"),
+                                TraceLoggingValue(workingSetMessage->ColdAnonymousBytes, "coldAnonymousBytes"),
+                                TraceLoggingValue(workingSetMessage->ColdFileBytes, "coldFileBytes"),
+                                TraceLoggingValue(workingSetMessage->ReclaimedBytes, "reclaimedBytes"));
+                        }
+                    }
                     else
                     {
                         LOG_HR_MSG(E_UNEXPECTED, "Unexpected MessageType %d", header->MessageType);
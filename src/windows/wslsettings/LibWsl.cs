@@ -60,7 +60,8 @@ namespace LibWsl
     {
         Disabled = 0,
         Gradual = 1,
-        DropCache = 2
+        DropCache = 2,
+        WorkingSet = 3
     }
 
     public unsafe partial class WslConfig
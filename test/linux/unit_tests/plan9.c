@@ -0,0 +1,1400 @@
+/*++
+
+Copyright (c) Microsoft. All rights reserved.
+
+Module Name:
+
+    plan9.c
+
+Abstract:
+
+    This file contains tests for the plan9 file server. Each variation starts a
+    private instance of the server on a unix socket and speaks 9P2000.W to it
+    directly.
+
+--*/
+
+#include "lxtcommon.h"
+#include "unittests.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define LXT_NAME "plan9"
+
+#define PLAN9_INIT_PATH "/init"
+#define PLAN9_SOCKET_PATH "/tmp/plan9_test_socket"
+#define PLAN9_TEST_DIR "data"
+#define PLAN9_TEST_FILE_NAME "plan9_test_file"
+#define PLAN9_TEST_FILE "/" PLAN9_TEST_DIR "/" PLAN9_TEST_FILE_NAME
+#define PLAN9_TEST_CONTENT "plan9 session test"
+#define PLAN9_STREAM_FILE_NAME "plan9_stream_file"
+#define PLAN9_STREAM_FILE "/" PLAN9_TEST_DIR "/" PLAN9_STREAM_FILE_NAME
+#define PLAN9_STREAM_FILE_SIZE (32 * 1024 * 1024)
+#define PLAN9_STREAM_THRESHOLD "1048576"
+#define PLAN9_WALK_DIR_NAME "plan9_walk_test"
+#define PLAN9_WALK_DIR "/" PLAN9_TEST_DIR "/" PLAN9_WALK_DIR_NAME
+#define PLAN9_WALK_DEPTH 16
+#define PLAN9_WALK_ITERATIONS 2000
+#define PLAN9_TEST_UID 1000
+#define PLAN9_NO_FID 0xFFFFFFFF
+
+#define PLAN9_HEADER_SIZE 7
+#define PLAN9_MESSAGE_SIZE 0x11000
+#define PLAN9_MAX_READ_SIZE 0x10000
+
+#define PLAN9_RLERROR 7
+#define PLAN9_TLOPEN 12
+#define PLAN9_TVERSION 100
+#define PLAN9_TATTACH 104
+#define PLAN9_TWALK 110
+#define PLAN9_TREAD 116
+#define PLAN9_TCLUNK 120
+#define PLAN9_TWOPEN 132
+
+#define PLAN9_OPEN_NO_ACCESS 03
+
+typedef struct _PLAN9_SERVER
+{
+    pid_t Pid;
+    int ControlSocket;
+} PLAN9_SERVER, *PPLAN9_SERVER;
+
+typedef struct _PLAN9_MESSAGE
+{
+    unsigned char Buffer[PLAN9_MESSAGE_SIZE];
+    size_t Offset;
+    size_t Size;
+} PLAN9_MESSAGE, *PPLAN9_MESSAGE;
+
+int Plan9SessionJoin(PLXT_ARGS Args);
+
+int Plan9SessionOtherUser(PLXT_ARGS Args);
+
+int Plan9SessionInvalid(PLXT_ARGS Args);
+
+int Plan9StreamingRead(PLXT_ARGS Args);
+
+int Plan9StreamingReadUnaligned(PLXT_ARGS Args);
+
+int Plan9WalkBenchmark(PLXT_ARGS Args);
+
+static int Plan9Attach(int Socket, uint32_t Fid, uint32_t Uid, uint64_t* SessionId);
+
+static int Plan9Clunk(int Socket, uint32_t Fid);
+
+static int Plan9Connect(int* Socket);
+
+static int Plan9CountCachedPages(const char* Path, size_t* CachedPages);
+
+static int Plan9Open(int Socket, uint32_t Fid);
+
+static int Plan9Read(int Socket, uint32_t Fid, uint64_t Offset, void* Buffer, uint32_t Count, uint32_t* BytesRead);
+
+static int Plan9StartServer(PPLAN9_SERVER Server, const char* StreamingThreshold);
+
+static int Plan9StopServer(PPLAN9_SERVER Server);
+
+static int Plan9StreamFile(uint32_t ReadSize);
+
+static int Plan9TimeWalks(int Socket, int Type, const char* const* Names, uint16_t NameCount, uint64_t* Nanoseconds);
+
+static int Plan9Walk(int Socket, uint32_t Fid, uint32_t NewFid, const char* Name);
+
+static int Plan9WalkPath(int Socket, uint32_t Fid, uint32_t NewFid, const char* const* Names, uint16_t NameCount);
+
+static int Plan9WOpen(int Socket, uint32_t Fid, uint32_t NewFid, const char* const* Names, uint16_t NameCount);
+
+static const LXT_VARIATION g_LxtVariations[] = {
+    {"Plan9 - session join and fid sharing", Plan9SessionJoin},
+    {"Plan9 - session join by another user", Plan9SessionOtherUser},
+    {"Plan9 - invalid session join", Plan9SessionInvalid},
+    {"Plan9 - streaming read", Plan9StreamingRead},
+    {"Plan9 - streaming read with unaligned reads", Plan9StreamingReadUnaligned},
+    {"Plan9 - walk benchmark", Plan9WalkBenchmark}};
+
+int Plan9TestEntry(int Argc, char* Argv[])
+{
+
+    LXT_ARGS Args;
+    int Result;
+
+    LxtCheckResult(LxtInitialize(Argc, Argv, &Args, LXT_NAME));
+    LxtCheckResult(LxtRunVariations(&Args, g_LxtVariations, LXT_COUNT_OF(g_LxtVariations)));
+
+ErrorExit:
+    LxtUninitialize();
+    return !LXT_SUCCESS(Result);
+}
+
+static void Plan9Begin(PPLAN9_MESSAGE Message, unsigned char Type)
+
+/*++
+
+Description:
+
+    This routine starts a request message. The size is filled in when the
+    message is sent; the tag is always zero since requests are sent one at a
+    time.
+
+Arguments:
+
+    Message - Supplies the message.
+
+    Type - Supplies the message type.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    memset(Message->Buffer, 0, PLAN9_HEADER_SIZE);
+    Message->Buffer[4] = Type;
+    Message->Offset = PLAN9_HEADER_SIZE;
+    return;
+}
+
+static void Plan9Put(PPLAN9_MESSAGE Message, const void* Value, size_t Size)
+
+{
+
+    memcpy(Message->Buffer + Message->Offset, Value, Size);
+    Message->Offset += Size;
+    return;
+}
+
+static void Plan9PutString(PPLAN9_MESSAGE Message, const char* Value)
+
+{
+
+    uint16_t Length;
+
+    Length = strlen(Value);
+    Plan9Put(Message, &Length, sizeof(Length));
+    Plan9Put(Message, Value, Length);
+    return;
+}
+
+static void Plan9Get(PPLAN9_MESSAGE Message, void* Value, size_t Size)
+
+{
+
+    if (Message->Offset + Size > Message->Size)
+    {
+        memset(Value, 0, Size);
+        return;
+    }
+
+    memcpy(Value, Message->Buffer + Message->Offset, Size);
+    Message->Offset += Size;
+    return;
+}
+
+static int Plan9Transact(int Socket, PPLAN9_MESSAGE Message)
+
+/*++
+
+Description:
+
+    This routine sends a request and receives its response into the same
+    message.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Message - Supplies the request, and receives the response.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    ssize_t BytesTransferred;
+    uint32_t Error;
+    int Result;
+    uint32_t Size;
+
+    Size = Message->Offset;
+    memcpy(Message->Buffer, &Size, sizeof(Size));
+    LxtCheckErrno(BytesTransferred = send(Socket, Message->Buffer, Size, 0));
+    LxtCheckEqual(BytesTransferred, (ssize_t)Size, "%zd");
+    LxtCheckErrno(BytesTransferred = recv(Socket, &Size, sizeof(Size), MSG_WAITALL));
+    LxtCheckEqual(BytesTransferred, (ssize_t)sizeof(Size), "%zd");
+    LxtCheckTrue(Size >= PLAN9_HEADER_SIZE && Size <= sizeof(Message->Buffer));
+    memcpy(Message->Buffer, &Size, sizeof(Size));
+    LxtCheckErrno(BytesTransferred = recv(Socket, Message->Buffer + sizeof(Size), Size - sizeof(Size), MSG_WAITALL));
+    LxtCheckEqual(BytesTransferred, (ssize_t)(Size - sizeof(Size)), "%zd");
+    Message->Size = Size;
+    Message->Offset = PLAN9_HEADER_SIZE;
+    if (Message->Buffer[4] == PLAN9_RLERROR)
+    {
+        Plan9Get(Message, &Error, sizeof(Error));
+        errno = Error;
+        Result = LXT_RESULT_FAILURE;
+        goto ErrorExit;
+    }
+
+    Result = 0;
+
+ErrorExit:
+    return Result;
+}
+
+static int Plan9Attach(int Socket, uint32_t Fid, uint32_t Uid, uint64_t* SessionId)
+
+/*++
+
+Description:
+
+    This routine attaches a fid to the root of the server.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the fid to attach.
+
+    Uid - Supplies the user to attach as.
+
+    SessionId - Supplies an optional session ID to register (zero) or join, and
+        receives the ID of the session. If NULL, no session is specified.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    uint32_t NoFid;
+    PLAN9_MESSAGE Message;
+    unsigned char Qid[13];
+    int Result;
+
+    NoFid = PLAN9_NO_FID;
+    Plan9Begin(&Message, PLAN9_TATTACH);
+    Plan9Put(&Message, &Fid, sizeof(Fid));
+    Plan9Put(&Message, &NoFid, sizeof(NoFid));
+    Plan9PutString(&Message, "");
+    Plan9PutString(&Message, "");
+    Plan9Put(&Message, &Uid, sizeof(Uid));
+    if (SessionId != NULL)
+    {
+        Plan9Put(&Message, SessionId, sizeof(*SessionId));
+    }
+
+    Result = Plan9Transact(Socket, &Message);
+    if (Result < 0)
+    {
+        goto ErrorExit;
+    }
+
+    //
+    // The session ID is only returned if the request included one.
+    //
+
+    Plan9Get(&Message, Qid, sizeof(Qid));
+    if (SessionId != NULL)
+    {
+        LxtCheckEqual(Message.Size, PLAN9_HEADER_SIZE + sizeof(Qid) + sizeof(*SessionId), "%zu");
+        Plan9Get(&Message, SessionId, sizeof(*SessionId));
+    }
+    else
+    {
+        LxtCheckEqual(Message.Size, PLAN9_HEADER_SIZE + sizeof(Qid), "%zu");
+    }
+
+ErrorExit:
+    return Result;
+}
+
+static int Plan9Clunk(int Socket, uint32_t Fid)
+
+/*++
+
+Description:
+
+    This routine releases a fid.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the fid to release.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    PLAN9_MESSAGE Message;
+
+    Plan9Begin(&Message, PLAN9_TCLUNK);
+    Plan9Put(&Message, &Fid, sizeof(Fid));
+    return Plan9Transact(Socket, &Message);
+}
+
+static int Plan9Connect(int* Socket)
+
+/*++
+
+Description:
+
+    This routine connects to the server and negotiates 9P2000.W.
+
+Arguments:
+
+    Socket - Receives the connection.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    struct sockaddr_un Address;
+    PLAN9_MESSAGE Message;
+    uint32_t MessageSize;
+    int Result;
+
+    *Socket = -1;
+    memset(&Address, 0, sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path, PLAN9_SOCKET_PATH);
+    LxtCheckErrno(*Socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    LxtCheckErrno(connect(*Socket, (struct sockaddr*)&Address, sizeof(Address)));
+    MessageSize = PLAN9_MESSAGE_SIZE;
+    Plan9Begin(&Message, PLAN9_TVERSION);
+    Plan9Put(&Message, &MessageSize, sizeof(MessageSize));
+    Plan9PutString(&Message, "9P2000.W");
+    LxtCheckErrnoZeroSuccess(Plan9Transact(*Socket, &Message));
+
+ErrorExit:
+    return Result;
+}
+
+static int Plan9CountCachedPages(const char* Path, size_t* CachedPages)
+
+/*++
+
+Description:
+
+    This routine counts the pages of a file that are in the page cache.
+
+Arguments:
+
+    Path - Supplies the path of the file.
+
+    CachedPages - Receives the number of cached pages.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    int Fd;
+    size_t Index;
+    void* MapResult;
+    size_t PageCount;
+    size_t PageSize;
+    unsigned char* Pages;
+    int Result;
+    struct stat Stat;
+
+    Fd = -1;
+    MapResult = MAP_FAILED;
+    Pages = NULL;
+    *CachedPages = 0;
+    LxtCheckErrno(Fd = open(Path, O_RDONLY | O_CLOEXEC));
+    LxtCheckErrno(fstat(Fd, &Stat));
+    PageSize = sysconf(_SC_PAGESIZE);
+    PageCount = (Stat.st_size + PageSize - 1) / PageSize;
+    Pages = malloc(PageCount);
+    LxtCheckTrue(Pages != NULL);
+
+    //
+    // The mapping doesn't fault anything in, so it doesn't change the result.
+    //
+
+    LxtCheckMapErrno(mmap(NULL, Stat.st_size, PROT_READ, MAP_SHARED, Fd, 0));
+    LxtCheckErrno(mincore(MapResult, Stat.st_size, Pages));
+    for (Index = 0; Index < PageCount; Index += 1)
+    {
+        if ((Pages[Index] & 1) != 0)
+        {
+            *CachedPages += 1;
+        }
+    }
+
+ErrorExit:
+    if (MapResult != MAP_FAILED)
+    {
+        munmap(MapResult, Stat.st_size);
+    }
+
+    if (Fd >= 0)
+    {
+        LxtClose(Fd);
+    }
+
+    free(Pages);
+    return Result;
+}
+
+static int Plan9Open(int Socket, uint32_t Fid)
+
+/*++
+
+Description:
+
+    This routine opens a walked fid for reading.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the fid to open.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    uint32_t Flags;
+    PLAN9_MESSAGE Message;
+
+    Flags = O_RDONLY;
+    Plan9Begin(&Message, PLAN9_TLOPEN);
+    Plan9Put(&Message, &Fid, sizeof(Fid));
+    Plan9Put(&Message, &Flags, sizeof(Flags));
+    return Plan9Transact(Socket, &Message);
+}
+
+static int Plan9Read(int Socket, uint32_t Fid, uint64_t Offset, void* Buffer, uint32_t Count, uint32_t* BytesRead)
+
+/*++
+
+Description:
+
+    This routine reads from an open fid.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the fid to read from.
+
+    Offset - Supplies the file offset.
+
+    Buffer - Supplies the buffer that receives the data.
+
+    Count - Supplies the number of bytes to read.
+
+    BytesRead - Receives the number of bytes read.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    PLAN9_MESSAGE Message;
+    int Result;
+
+    Plan9Begin(&Message, PLAN9_TREAD);
+    Plan9Put(&Message, &Fid, sizeof(Fid));
+    Plan9Put(&Message, &Offset, sizeof(Offset));
+    Plan9Put(&Message, &Count, sizeof(Count));
+    Result = Plan9Transact(Socket, &Message);
+    if (Result < 0)
+    {
+        goto ErrorExit;
+    }
+
+    Plan9Get(&Message, BytesRead, sizeof(*BytesRead));
+    LxtCheckTrue(*BytesRead <= Count);
+    Plan9Get(&Message, Buffer, *BytesRead);
+
+ErrorExit:
+    return Result;
+}
+
+static int Plan9Walk(int Socket, uint32_t Fid, uint32_t NewFid, const char* Name)
+
+/*++
+
+Description:
+
+    This routine walks from a root fid to a file in the test directory.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the root fid.
+
+    NewFid - Supplies the fid for the file.
+
+    Name - Supplies the name of the file.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    const char* Names[] = {PLAN9_TEST_DIR, Name};
+
+    return Plan9WalkPath(Socket, Fid, NewFid, Names, LXT_COUNT_OF(Names));
+}
+
+static int Plan9WalkPath(int Socket, uint32_t Fid, uint32_t NewFid, const char* const* Names, uint16_t NameCount)
+
+/*++
+
+Description:
+
+    This routine walks a fid with Twalk.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the fid to walk from.
+
+    NewFid - Supplies the fid for the result of the walk.
+
+    Names - Supplies the path components.
+
+    NameCount - Supplies the number of path components.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    uint16_t Index;
+    PLAN9_MESSAGE Message;
+    uint16_t QidCount;
+    int Result;
+
+    Plan9Begin(&Message, PLAN9_TWALK);
+    Plan9Put(&Message, &Fid, sizeof(Fid));
+    Plan9Put(&Message, &NewFid, sizeof(NewFid));
+    Plan9Put(&Message, &NameCount, sizeof(NameCount));
+    for (Index = 0; Index < NameCount; Index += 1)
+    {
+        Plan9PutString(&Message, Names[Index]);
+    }
+
+    Result = Plan9Transact(Socket, &Message);
+    if (Result < 0)
+    {
+        goto ErrorExit;
+    }
+
+    Plan9Get(&Message, &QidCount, sizeof(QidCount));
+    LxtCheckEqual(QidCount, NameCount, "%u");
+
+ErrorExit:
+    return Result;
+}
+
+static int Plan9WOpen(int Socket, uint32_t Fid, uint32_t NewFid, const char* const* Names, uint16_t NameCount)
+
+/*++
+
+Description:
+
+    This routine looks up an existing file with the 9P2000.W Twopen message,
+    without opening it.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Fid - Supplies the fid to walk from.
+
+    NewFid - Supplies the fid for the file.
+
+    Names - Supplies the path components.
+
+    NameCount - Supplies the number of path components.
+
+Return Value:
+
+    0 on success, -1 on failure with errno set to the error from an Rlerror
+    response, or to the error of the failed socket operation.
+
+--*/
+
+{
+
+    uint64_t AttributeMask;
+    uint32_t Flags;
+    uint16_t Index;
+    PLAN9_MESSAGE Message;
+    int Result;
+    unsigned char Status;
+    uint32_t Zero;
+
+    AttributeMask = 0;
+    Flags = PLAN9_OPEN_NO_ACCESS;
+    Zero = 0;
+    Plan9Begin(&Message, PLAN9_TWOPEN);
+    Plan9Put(&Message, &Fid, sizeof(Fid));
+    Plan9Put(&Message, &NewFid, sizeof(NewFid));
+    Plan9Put(&Message, &Flags, sizeof(Flags));
+
+    //
+    // The wflags, mode and gid aren't used.
+    //
+
+    Plan9Put(&Message, &Zero, sizeof(Zero));
+    Plan9Put(&Message, &Zero, sizeof(Zero));
+    Plan9Put(&Message, &Zero, sizeof(Zero));
+    Plan9Put(&Message, &AttributeMask, sizeof(AttributeMask));
+    Plan9Put(&Message, &NameCount, sizeof(NameCount));
+    for (Index = 0; Index < NameCount; Index += 1)
+    {
+        Plan9PutString(&Message, Names[Index]);
+    }
+
+    Result = Plan9Transact(Socket, &Message);
+    if (Result < 0)
+    {
+        goto ErrorExit;
+    }
+
+    //
+    // A status of zero means the file was found.
+    //
+
+    Plan9Get(&Message, &Status, sizeof(Status));
+    LxtCheckEqual(Status, 0, "%u");
+
+ErrorExit:
+    return Result;
+}
+
+static int Plan9StartServer(PPLAN9_SERVER Server, const char* StreamingThreshold)
+
+/*++
+
+Description:
+
+    This routine starts a plan9 server listening on PLAN9_SOCKET_PATH, and
+    creates the test file.
+
+Arguments:
+
+    Server - Receives the server state.
+
+    StreamingThreshold - Supplies an optional value for the streaming read
+        threshold of the server.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    struct sockaddr_un Address;
+    const char* Arguments[12];
+    int ArgumentCount;
+    char Buffer;
+    char ControlArgument[16];
+    int ControlSockets[2] = {-1, -1};
+    int Fd;
+    int ListenSocket;
+    int Pipe[2] = {-1, -1};
+    char PipeArgument[16];
+    int Result;
+    char ServerArgument[16];
+
+    Server->Pid = -1;
+    Server->ControlSocket = -1;
+    ListenSocket = -1;
+    Fd = -1;
+    LxtCheckErrno(Fd = open(PLAN9_TEST_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    LxtCheckErrno(write(Fd, PLAN9_TEST_CONTENT, sizeof(PLAN9_TEST_CONTENT) - 1));
+    unlink(PLAN9_SOCKET_PATH);
+    memset(&Address, 0, sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path, PLAN9_SOCKET_PATH);
+    LxtCheckErrno(ListenSocket = socket(AF_UNIX, SOCK_STREAM, 0));
+    LxtCheckErrno(bind(ListenSocket, (struct sockaddr*)&Address, sizeof(Address)));
+    LxtCheckErrno(listen(ListenSocket, 16));
+    LxtCheckErrno(socketpair(AF_UNIX, SOCK_STREAM, 0, ControlSockets));
+    LxtCheckErrno(pipe(Pipe));
+    LxtCheckErrno(Server->Pid = fork());
+    if (Server->Pid == 0)
+    {
+        close(ControlSockets[0]);
+        close(Pipe[0]);
+        snprintf(ControlArgument, sizeof(ControlArgument), "%d", ControlSockets[1]);
+        snprintf(ServerArgument, sizeof(ServerArgument), "%d", ListenSocket);
+        snprintf(PipeArgument, sizeof(PipeArgument), "%d", Pipe[1]);
+        ArgumentCount = 0;
+        Arguments[ArgumentCount++] = "plan9";
+        Arguments[ArgumentCount++] = "--control-socket";
+        Arguments[ArgumentCount++] = ControlArgument;
+        Arguments[ArgumentCount++] = "--server-fd";
+        Arguments[ArgumentCount++] = ServerArgument;
+        Arguments[ArgumentCount++] = "--pipe-fd";
+        Arguments[ArgumentCount++] = PipeArgument;
+        if (StreamingThreshold != NULL)
+        {
+            Arguments[ArgumentCount++] = "--streaming-threshold";
+            Arguments[ArgumentCount++] = StreamingThreshold;
+        }
+
+        Arguments[ArgumentCount] = NULL;
+        execv(PLAN9_INIT_PATH, (char* const*)Arguments);
+        LxtLogError("execv failed %d", errno);
+        _exit(1);
+    }
+
+    //
+    // The server closes its end of the pipe once it's accepting connections.
+    //
+
+    LxtClose(Pipe[1]);
+    Pipe[1] = -1;
+    LxtCheckErrno(read(Pipe[0], &Buffer, sizeof(Buffer)));
+    LxtCheckEqual(Result, 0, "%d");
+    Server->ControlSocket = ControlSockets[0];
+    ControlSockets[0] = -1;
+
+ErrorExit:
+    if (Fd >= 0)
+    {
+        LxtClose(Fd);
+    }
+
+    if (ListenSocket >= 0)
+    {
+        LxtClose(ListenSocket);
+    }
+
+    for (int Index = 0; Index < 2; Index += 1)
+    {
+        if (ControlSockets[Index] >= 0)
+        {
+            LxtClose(ControlSockets[Index]);
+        }
+
+        if (Pipe[Index] >= 0)
+        {
+            LxtClose(Pipe[Index]);
+        }
+    }
+
+    return Result;
+}
+
+static int Plan9StopServer(PPLAN9_SERVER Server)
+
+/*++
+
+Description:
+
+    This routine stops a server started by Plan9StartServer.
+
+Arguments:
+
+    Server - Supplies the server state.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    int Result;
+
+    Result = 0;
+
+    //
+    // The server exits when its control socket is closed.
+    //
+
+    if (Server->ControlSocket >= 0)
+    {
+        LxtClose(Server->ControlSocket);
+        Server->ControlSocket = -1;
+    }
+
+    if (Server->Pid > 0)
+    {
+        LxtCheckResult(LxtWaitPidPoll(Server->Pid, 0));
+        Server->Pid = -1;
+    }
+
+ErrorExit:
+    unlink(PLAN9_SOCKET_PATH);
+    unlink(PLAN9_TEST_FILE);
+    return Result;
+}
+
+static int Plan9StreamFile(uint32_t ReadSize)
+
+/*++
+
+Description:
+
+    This routine reads a file that isn't in the page cache sequentially through
+    the server, and checks that the server dropped the data it read from the
+    page cache.
+
+Arguments:
+
+    ReadSize - Supplies the size of each read.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    char* Buffer;
+    uint32_t BytesRead;
+    size_t CachedPages;
+    int Fd;
+    uint64_t Offset;
+    size_t PageCount;
+    int Result;
+    PLAN9_SERVER Server;
+    int Socket;
+
+    Buffer = NULL;
+    Fd = -1;
+    Socket = -1;
+    Server.Pid = -1;
+    Server.ControlSocket = -1;
+    if (LxtWslVersion() == 1)
+    {
+        LxtLogInfo("Test skipped on WSL1.");
+        Result = 0;
+        goto ErrorExit;
+    }
+
+    //
+    // Write the file and drop it from the page cache, so all of its pages are
+    // brought in by the reads below.
+    //
+
+    Buffer = malloc(PLAN9_MAX_READ_SIZE);
+    LxtCheckTrue(Buffer != NULL);
+    memset(Buffer, 'a', PLAN9_MAX_READ_SIZE);
+    LxtCheckErrno(Fd = open(PLAN9_STREAM_FILE, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644));
+    for (Offset = 0; Offset < PLAN9_STREAM_FILE_SIZE; Offset += PLAN9_MAX_READ_SIZE)
+    {
+        LxtCheckErrno(write(Fd, Buffer, PLAN9_MAX_READ_SIZE));
+    }
+
+    LxtCheckErrno(fsync(Fd));
+    LxtCheckResultError(posix_fadvise(Fd, 0, 0, POSIX_FADV_DONTNEED));
+    LxtClose(Fd);
+    Fd = -1;
+    LxtCheckResult(Plan9StartServer(&Server, PLAN9_STREAM_THRESHOLD));
+    LxtCheckResult(Plan9Connect(&Socket));
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket, 1, 0, NULL));
+    LxtCheckErrnoZeroSuccess(Plan9Walk(Socket, 1, 2, PLAN9_STREAM_FILE_NAME));
+    LxtCheckErrnoZeroSuccess(Plan9Open(Socket, 2));
+    Offset = 0;
+    do
+    {
+        LxtCheckErrnoZeroSuccess(Plan9Read(Socket, 2, Offset, Buffer, ReadSize, &BytesRead));
+        Offset += BytesRead;
+    } while (BytesRead != 0);
+
+    LxtCheckTrue(Offset == PLAN9_STREAM_FILE_SIZE);
+
+    //
+    // The server drops what it read once the threshold is reached, except for
+    // the last few megabytes which it drops in chunks. Most of the file should
+    // no longer be cached.
+    //
+
+    PageCount = PLAN9_STREAM_FILE_SIZE / sysconf(_SC_PAGESIZE);
+    LxtCheckResult(Plan9CountCachedPages(PLAN9_STREAM_FILE, &CachedPages));
+    LxtLogInfo("%zu of %zu pages cached", CachedPages, PageCount);
+    LxtCheckTrue(CachedPages < PageCount / 4);
+
+ErrorExit:
+    if (Socket >= 0)
+    {
+        LxtClose(Socket);
+    }
+
+    if (Fd >= 0)
+    {
+        LxtClose(Fd);
+    }
+
+    Plan9StopServer(&Server);
+    unlink(PLAN9_STREAM_FILE);
+    free(Buffer);
+    return Result;
+}
+
+static int Plan9TimeWalks(int Socket, int Type, const char* const* Names, uint16_t NameCount, uint64_t* Nanoseconds)
+
+/*++
+
+Description:
+
+    This routine measures the average time to look up a file, and release its
+    fid, from the root fid 1.
+
+Arguments:
+
+    Socket - Supplies the connection.
+
+    Type - Supplies the message used for the lookup, PLAN9_TWALK or
+        PLAN9_TWOPEN.
+
+    Names - Supplies the path components.
+
+    NameCount - Supplies the number of path components.
+
+    Nanoseconds - Receives the average time of a lookup.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    int Index;
+    int Result;
+    struct timespec Start;
+    struct timespec End;
+
+    LxtCheckErrnoZeroSuccess(clock_gettime(CLOCK_MONOTONIC, &Start));
+    for (Index = 0; Index < PLAN9_WALK_ITERATIONS; Index += 1)
+    {
+        if (Type == PLAN9_TWALK)
+        {
+            LxtCheckErrnoZeroSuccess(Plan9WalkPath(Socket, 1, 2, Names, NameCount));
+        }
+        else
+        {
+            LxtCheckErrnoZeroSuccess(Plan9WOpen(Socket, 1, 2, Names, NameCount));
+        }
+
+        LxtCheckErrnoZeroSuccess(Plan9Clunk(Socket, 2));
+    }
+
+    LxtCheckErrnoZeroSuccess(clock_gettime(CLOCK_MONOTONIC, &End));
+    *Nanoseconds = ((End.tv_sec - Start.tv_sec) * 1000000000ull + End.tv_nsec - Start.tv_nsec) / PLAN9_WALK_ITERATIONS;
+
+ErrorExit:
+    return Result;
+}
+
+int Plan9SessionJoin(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine tests that a connection that joins a session can use the fids
+    of the connection that registered it, and the other way around.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    char Buffer[64];
+    uint32_t BytesRead;
+    uint64_t JoinedSessionId;
+    int Result;
+    PLAN9_SERVER Server;
+    uint64_t SessionId;
+    int Socket1;
+    int Socket2;
+
+    Socket1 = -1;
+    Socket2 = -1;
+    LxtCheckResult(Plan9StartServer(&Server, NULL));
+    LxtCheckResult(Plan9Connect(&Socket1));
+    LxtCheckResult(Plan9Connect(&Socket2));
+
+    //
+    // Register a session on the first connection, and join it from the second.
+    //
+
+    SessionId = 0;
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket1, 1, 0, &SessionId));
+    LxtCheckTrue(SessionId != 0);
+    JoinedSessionId = SessionId;
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket2, 2, 0, &JoinedSessionId));
+    LxtCheckTrue(JoinedSessionId == SessionId);
+
+    //
+    // Walk and open the root fid attached by the first connection from the
+    // second, then read the file from both.
+    //
+
+    LxtCheckErrnoZeroSuccess(Plan9Walk(Socket2, 1, 3, PLAN9_TEST_FILE_NAME));
+    LxtCheckErrnoZeroSuccess(Plan9Open(Socket2, 3));
+    LxtCheckErrnoZeroSuccess(Plan9Read(Socket1, 3, 0, Buffer, sizeof(Buffer), &BytesRead));
+    LxtCheckEqual(BytesRead, (uint32_t)(sizeof(PLAN9_TEST_CONTENT) - 1), "%u");
+    LxtCheckMemoryEqual(Buffer, PLAN9_TEST_CONTENT, BytesRead);
+    LxtCheckErrnoZeroSuccess(Plan9Read(Socket2, 3, 6, Buffer, sizeof(Buffer), &BytesRead));
+    LxtCheckEqual(BytesRead, (uint32_t)(sizeof(PLAN9_TEST_CONTENT) - 7), "%u");
+    LxtCheckMemoryEqual(Buffer, PLAN9_TEST_CONTENT + 6, BytesRead);
+
+    //
+    // Fids of the session are shared, so the second connection can't reuse a
+    // fid the first one attached.
+    //
+
+    LxtCheckErrnoFailure(Plan9Walk(Socket2, 2, 1, PLAN9_TEST_FILE_NAME), EINVAL);
+
+ErrorExit:
+    if (Socket1 >= 0)
+    {
+        LxtClose(Socket1);
+    }
+
+    if (Socket2 >= 0)
+    {
+        LxtClose(Socket2);
+    }
+
+    Plan9StopServer(&Server);
+    return Result;
+}
+
+int Plan9SessionOtherUser(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine tests that a session can't be joined, or attached to, as a
+    different user than the one that registered it.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    uint64_t JoinedSessionId;
+    int Result;
+    PLAN9_SERVER Server;
+    uint64_t SessionId;
+    int Socket1;
+    int Socket2;
+
+    Socket1 = -1;
+    Socket2 = -1;
+    LxtCheckResult(Plan9StartServer(&Server, NULL));
+    LxtCheckResult(Plan9Connect(&Socket1));
+    LxtCheckResult(Plan9Connect(&Socket2));
+    SessionId = 0;
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket1, 1, 0, &SessionId));
+
+    //
+    // Another user can't join the session, so it can't use fid 1.
+    //
+
+    JoinedSessionId = SessionId;
+    LxtCheckErrnoFailure(Plan9Attach(Socket2, 2, PLAN9_TEST_UID, &JoinedSessionId), EPERM);
+    LxtCheckErrnoFailure(Plan9Walk(Socket2, 1, 3, PLAN9_TEST_FILE_NAME), EINVAL);
+
+    //
+    // A connection in the session can't attach as another user either, with or
+    // without the session ID.
+    //
+
+    JoinedSessionId = SessionId;
+    LxtCheckErrnoFailure(Plan9Attach(Socket1, 4, PLAN9_TEST_UID, &JoinedSessionId), EPERM);
+    LxtCheckErrnoFailure(Plan9Attach(Socket1, 4, PLAN9_TEST_UID, NULL), EPERM);
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket1, 4, 0, NULL));
+
+ErrorExit:
+    if (Socket1 >= 0)
+    {
+        LxtClose(Socket1);
+    }
+
+    if (Socket2 >= 0)
+    {
+        LxtClose(Socket2);
+    }
+
+    Plan9StopServer(&Server);
+    return Result;
+}
+
+int Plan9SessionInvalid(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine tests joining a session that doesn't exist, and joining a
+    session from a connection that already has fids.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    uint64_t JoinedSessionId;
+    int Result;
+    PLAN9_SERVER Server;
+    uint64_t SessionId;
+    int Socket1;
+    int Socket2;
+
+    Socket1 = -1;
+    Socket2 = -1;
+    LxtCheckResult(Plan9StartServer(&Server, NULL));
+    LxtCheckResult(Plan9Connect(&Socket1));
+    LxtCheckResult(Plan9Connect(&Socket2));
+    SessionId = 0;
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket1, 1, 0, &SessionId));
+    JoinedSessionId = SessionId + 1;
+    LxtCheckErrnoFailure(Plan9Attach(Socket2, 2, 0, &JoinedSessionId), ENOENT);
+
+    //
+    // Once a connection has fids of its own, it can neither join a session nor
+    // register one.
+    //
+
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket2, 2, 0, NULL));
+    JoinedSessionId = SessionId;
+    LxtCheckErrnoFailure(Plan9Attach(Socket2, 3, 0, &JoinedSessionId), EBUSY);
+    JoinedSessionId = 0;
+    LxtCheckErrnoFailure(Plan9Attach(Socket2, 3, 0, &JoinedSessionId), EBUSY);
+
+ErrorExit:
+    if (Socket1 >= 0)
+    {
+        LxtClose(Socket1);
+    }
+
+    if (Socket2 >= 0)
+    {
+        LxtClose(Socket2);
+    }
+
+    Plan9StopServer(&Server);
+    return Result;
+}
+
+int Plan9StreamingRead(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine tests that a bulk sequential read doesn't leave the file in the
+    page cache.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    return Plan9StreamFile(PLAN9_MAX_READ_SIZE);
+}
+
+int Plan9StreamingReadUnaligned(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine tests that a bulk sequential read with reads that aren't
+    page-aligned doesn't leave the file in the page cache. Almost every page is
+    split between two reads.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    return Plan9StreamFile(3000);
+}
+
+int Plan9WalkBenchmark(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine compares the cost of each additional path component for Twalk,
+    which looks up the components one at a time, and for Twopen, which resolves
+    them with a single openat2 call.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    0 on success, LXT_RESULT_FAILURE on failure.
+
+--*/
+
+{
+
+    const char* DeepNames[PLAN9_WALK_DEPTH + 1];
+    uint64_t DeepTime;
+    int Fd;
+    int Index;
+    char Path[256];
+    int PathLength;
+    int Result;
+    PLAN9_SERVER Server;
+    const char* ShallowNames[] = {PLAN9_TEST_DIR, PLAN9_WALK_DIR_NAME, "f"};
+    uint64_t ShallowTime;
+    int Socket;
+    const int Types[] = {PLAN9_TWALK, PLAN9_TWOPEN};
+
+    Socket = -1;
+    Server.Pid = -1;
+    Server.ControlSocket = -1;
+
+    //
+    // Create PLAN9_WALK_DIR/f and a file PLAN9_WALK_DEPTH components deep.
+    //
+
+    LxtCheckErrno(system("rm -rf " PLAN9_WALK_DIR));
+    DeepNames[0] = PLAN9_TEST_DIR;
+    DeepNames[1] = PLAN9_WALK_DIR_NAME;
+    PathLength = snprintf(Path, sizeof(Path), "%s", PLAN9_WALK_DIR);
+    LxtCheckErrnoZeroSuccess(mkdir(Path, 0755));
+    for (Index = 2; Index < PLAN9_WALK_DEPTH; Index += 1)
+    {
+        DeepNames[Index] = "d";
+        PathLength += snprintf(Path + PathLength, sizeof(Path) - PathLength, "/d");
+        LxtCheckErrnoZeroSuccess(mkdir(Path, 0755));
+    }
+
+    DeepNames[PLAN9_WALK_DEPTH] = "f";
+    snprintf(Path + PathLength, sizeof(Path) - PathLength, "/f");
+    LxtCheckErrno(Fd = creat(Path, 0644));
+    LxtClose(Fd);
+    LxtCheckErrno(Fd = creat(PLAN9_WALK_DIR "/f", 0644));
+    LxtClose(Fd);
+    LxtCheckResult(Plan9StartServer(&Server, NULL));
+    LxtCheckResult(Plan9Connect(&Socket));
+    LxtCheckErrnoZeroSuccess(Plan9Attach(Socket, 1, 0, NULL));
+    for (Index = 0; Index < LXT_COUNT_OF(Types); Index += 1)
+    {
+        LxtCheckResult(Plan9TimeWalks(Socket, Types[Index], ShallowNames, LXT_COUNT_OF(ShallowNames), &ShallowTime));
+        LxtCheckResult(Plan9TimeWalks(Socket, Types[Index], DeepNames, LXT_COUNT_OF(DeepNames), &DeepTime));
+        LxtLogInfo(
+            "%s: %llu ns for %zu components, %llu ns for %zu components, %lld ns per additional component",
+            Types[Index] == PLAN9_TWALK ? "Twalk" : "Twopen",
+            (unsigned long long)ShallowTime,
+            LXT_COUNT_OF(ShallowNames),
+            (unsigned long long)DeepTime,
+            LXT_COUNT_OF(DeepNames),
+            ((long long)DeepTime - (long long)ShallowTime) / (long long)(LXT_COUNT_OF(DeepNames) - LXT_COUNT_OF(ShallowNames)));
+    }
+
+ErrorExit:
+    if (Socket >= 0)
+    {
+        LxtClose(Socket);
+    }
+
+    Plan9StopServer(&Server);
+    if (system("rm -rf " PLAN9_WALK_DIR) < 0)
+    {
+        LxtLogError("Failed to delete %s", PLAN9_WALK_DIR);
+    }
+
+    return Result;
+}
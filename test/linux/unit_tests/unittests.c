@@ -46,6 +46,7 @@ static const LXT_TEST LxtTests[] = {
     {"netlink", false, NetlinkTestEntry},
     {"overlayfs", false, OverlayFsTestEntry},
     {"pipe", false, PipeTestEntry},
+    {"plan9", false, Plan9TestEntry},
     {"poll", false, PollTestEntry},
     {"random", false, RandomTestEntry},
     {"resourcelimits", false, ResourceLimitsTestEntry},
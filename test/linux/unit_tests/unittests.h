@@ -48,6 +48,7 @@ Abstract:
 #define NETLINK_TESTNAME "netlink"
 #define OVERLAYFS_TESTNAME "overlayfs"
 #define PIPE_TESTNAME "pipe"
+#define PLAN9_TESTNAME "plan9"
 #define POLL_TESTNAME "poll"
 #define PTRACE_TESTNAME "ptrace"
 #define RANDOM_TESTNAME "random"
@@ -141,6 +142,8 @@ int OverlayFsTestEntry(int Argc, char* Argv[]);
 
 int PipeTestEntry(int Argc, char* Argv[]);
 
+int Plan9TestEntry(int Argc, char* Argv[]);
+
 int PollTestEntry(int Argc, char* Argv[]);
 
 int RandomTestEntry(int Argc, char* Argv[]);
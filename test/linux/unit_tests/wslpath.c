@@ -36,6 +36,8 @@ Abstract:
 #define WSLPATH_ESCAPE_LX_DIR "/data/" WSLPATH_ESCAPE_NAME
 #define WSLPATH_ESCAPE_LX_DIR_WIN WSLPATH_DISTRO_PREFIX "\\data\\" WSLPATH_ESCAPE_NAME_ESCAPED
 #define WSLPATH_MOUNT_POINT "/data/wslpath_mount"
+#define WSLPATH_NESTED_MOUNT_POINT "/mnt/c/wslpath_nested"
+#define WSLPATH_NESTED_MOUNT_POINT_WIN "C:\\wslpath_nested"
 
 LXT_VARIATION_HANDLER WslPathTestDrvFsEscaped;
 
@@ -53,6 +55,8 @@ LXT_VARIATION_HANDLER WslPathTestLxFromWinPath;
 
 LXT_VARIATION_HANDLER WslPathTestLxToWinPath;
 
+LXT_VARIATION_HANDLER WslPathTestNestedMount;
+
 static const LXT_VARIATION g_LxtVariations[] = {
     {"WslPath - Windows to DrvFs", WslPathTestDrvFsFromWinPath},
     {"WslPath - DrvFs to Windows", WslPathTestDrvFsToWinPath},
@@ -62,6 +66,7 @@ static const LXT_VARIATION g_LxtVariations[] = {
     {"WslPath - Linux to \\\\wsl.localhost", WslPathTestLxToWinPath},
     {"WslPath - \\\\wsl.localhost escaped characters", WslPathTestLxEscaped},
     {"WslPath - Invalid mountinfo line", WslPathTestInvalidMountInfo},
+    {"WslPath - Mount nested in DrvFs", WslPathTestNestedMount},
 };
 
 int WslPathTestEntry(int Argc, char* Argv[])
@@ -424,3 +429,52 @@ Return Value:
 ErrorExit:
     return Result;
 }
+
+int WslPathTestNestedMount(PLXT_ARGS Args)
+
+/*++
+
+Description:
+
+    This routine tests wslpath on a path that is shadowed by a mount nested
+    inside a DrvFs mount, before and after the nested mount is removed.
+
+Arguments:
+
+    Args - Supplies the command line arguments.
+
+Return Value:
+
+    Returns 0 on success, -1 on failure.
+
+--*/
+
+{
+
+    int Result;
+
+    LxtCheckErrnoZeroSuccess(mkdir(WSLPATH_NESTED_MOUNT_POINT, 0777));
+    LxtCheckResult(LxtCheckWslPathTranslation(WSLPATH_NESTED_MOUNT_POINT "/foo", WSLPATH_NESTED_MOUNT_POINT_WIN "\\foo", false));
+
+    //
+    // Paths under the nested mount are not on the DrvFs mount anymore.
+    //
+
+    LxtCheckErrnoZeroSuccess(mount("none", WSLPATH_NESTED_MOUNT_POINT, "tmpfs", 0, NULL));
+    LxtCheckResult(LxtCheckWslPathTranslation(
+        WSLPATH_NESTED_MOUNT_POINT "/foo", WSLPATH_DISTRO_PREFIX "\\mnt\\c\\wslpath_nested\\foo", false));
+
+    LxtCheckResult(LxtCheckWslPathTranslation("/mnt/c/Users", "C:\\Users", false));
+
+    //
+    // Once the nested mount is removed, the path translates to DrvFs again.
+    //
+
+    LxtCheckErrnoZeroSuccess(umount(WSLPATH_NESTED_MOUNT_POINT));
+    LxtCheckResult(LxtCheckWslPathTranslation(WSLPATH_NESTED_MOUNT_POINT "/foo", WSLPATH_NESTED_MOUNT_POINT_WIN "\\foo", false));
+
+ErrorExit:
+    umount(WSLPATH_NESTED_MOUNT_POINT);
+    rmdir(WSLPATH_NESTED_MOUNT_POINT);
+    return Result;
+}
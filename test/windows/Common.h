@@ -61,6 +61,17 @@ using namespace std::chrono_literals;
     TAEF_END_TEST_METHOD_PROPERTIES_IN_CLASS_SCOPE() \
     TEST_METHOD(_name)
 
+//
+// Benchmarks only log measurements, so they are ignored by default and don't slow down the functional runs.
+// Run them with: te.exe /runIgnoredTests /select:"@Category='Benchmark'"
+//
+#define BENCHMARK_TEST_METHOD(_name) \
+    TAEF_BEGIN_TEST_METHOD_PROPERTIES_IN_CLASS_SCOPE(_name) \
+    TEST_METHOD_PROPERTY(L"Ignore", L"true") \
+    TEST_METHOD_PROPERTY(L"Category", L"Benchmark") \
+    TAEF_END_TEST_METHOD_PROPERTIES_IN_CLASS_SCOPE() \
+    TEST_METHOD(_name)
+
 // macro for skipping tests that are currently failing due to not yet being fully implemented
 #define SKIP_TEST_NOT_IMPL() \
     { \
@@ -577,6 +588,7 @@ struct TestConfigDefaults
     int crashDumpCount = 100;
     std::optional<std::wstring> CrashDumpFolder;
     std::optional<bool> isolateDistroCgroup;
+    std::optional<bool> multiplexStdio;
 };
 
 std::wstring LxssGenerateTestConfig(TestConfigDefaults Default = {});
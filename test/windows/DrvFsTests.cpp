@@ -371,6 +371,84 @@ public:
 
         testWslPath(L"wslpath-test-dir");
         testWslPath(L"wslpath-测试目录-テスト");
+
+        // Validate that batch mode translates the paths in order, and reports failures without stopping.
+        auto [out, err] = LxsstuLaunchWslAndCaptureOutput(L"printf '/mnt/c\\nrelative\\n/mnt/c/Users\\n' | wslpath -b -w");
+        VERIFY_ARE_EQUAL(out, L"C:\\\nrelative\nC:\\Users\n");
+
+        std::tie(out, err) =
+            LxsstuLaunchWslAndCaptureOutput(L"printf '/mnt/c/Users\\n/etc/passwd/foo\\n/mnt/c/Windows\\n' | wslpath -b -w", 1);
+        VERIFY_ARE_EQUAL(out, L"C:\\Users\n\nC:\\Windows\n");
+        VERIFY_IS_TRUE(err.find(L"/etc/passwd/foo") != std::wstring::npos);
+
+        std::tie(out, err) = LxsstuLaunchWslAndCaptureOutput(L"printf 'C:\\\\Users\\nC:\\\\Windows' | wslpath -b -u");
+        VERIFY_ARE_EQUAL(out, L"/mnt/c/Users\n/mnt/c/Windows\n");
+
+        std::tie(out, err) =
+            LxsstuLaunchWslAndCaptureOutput(L"printf '/mnt/c/Users\\0/mnt/c/Windows\\0' | wslpath -b -z -w | tr '\\0' '|'");
+        VERIFY_ARE_EQUAL(out, L"C:\\Users|C:\\Windows|");
+
+        // Validate that a large number of paths are all translated by a single process.
+        constexpr auto pathCount = 10000;
+        std::tie(out, err) = LxsstuLaunchWslAndCaptureOutput(
+            std::format(L"seq {} | sed 's|^|/mnt/c/Windows/|' | wslpath -b -w | grep -c '^C:'", pathCount));
+
+        VERIFY_ARE_EQUAL(out, std::format(L"{}\n", pathCount));
+
+        // Validate that characters that are illegal in NT paths are escaped.
+        std::tie(out, err) =
+            LxsstuLaunchWslAndCaptureOutput(L"printf '/mnt/c/wslpath-escape/a:b*c?d|e<f>g/h\\n' | wslpath -b -w");
+        VERIFY_ARE_EQUAL(out, L"C:\\wslpath-escape\\a\uf03ab\uf02ac\uf03fd\uf07ce\uf03cf\uf03eg\\h\n");
+    }
+
+    // This benchmark logs the time it takes to translate a large number of paths in a single process.
+    static void WslPathBatchBenchmark()
+    {
+        if (!LxsstuVmMode())
+        {
+            LogSkipped("This test is only applicable to WSL2");
+            return;
+        }
+
+        constexpr auto pathCount = 100000;
+        const auto start = std::chrono::steady_clock::now();
+        auto [out, err] = LxsstuLaunchWslAndCaptureOutput(
+            std::format(L"seq {} | sed 's|^|/mnt/c/Windows/|' | wslpath -b -w | grep -c '^C:'", pathCount));
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        VERIFY_ARE_EQUAL(out, std::format(L"{}\n", pathCount));
+        LogInfo("Translated %d paths in %lldms", pathCount, static_cast<long long>(elapsed.count()));
+    }
+
+    // This benchmark logs the time it takes to escape a large number of paths with the vectorized
+    // implementation and with the scalar reference implementation.
+    static void WslPathEscapeBenchmark()
+    {
+        if (!LxsstuVmMode())
+        {
+            LogSkipped("This test is only applicable to WSL2");
+            return;
+        }
+
+        constexpr auto pathCount = 100000;
+        const auto escape = [&](LPCWSTR Environment) {
+            const auto start = std::chrono::steady_clock::now();
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(std::format(
+                L"seq {} | sed 's#^#/mnt/c/wslpath-escape/a:b*c?d|e<f>g/#' | {} wslpath -b -w | md5sum", pathCount, Environment));
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            LogInfo("Escaped %d paths in %lldms (%ls)", pathCount, static_cast<long long>(elapsed.count()), Environment);
+            return out;
+        };
+
+        const auto vectorized = escape(L"env");
+        const auto scalar = escape(L"env WSL_PATH_ESCAPE_SCALAR=1");
+        VERIFY_ARE_EQUAL(vectorized, scalar);
+
+        auto [out, err] = LxsstuLaunchWslAndCaptureOutput(std::format(
+            L"seq {} | sed 's#^#/mnt/c/wslpath-escape/a:b*c?d|e<f>g/#' | wslpath -b -w | grep -c '^C:'", pathCount));
+
+        VERIFY_ARE_EQUAL(out, std::format(L"{}\n", pathCount));
     }
 
     void DrvFsMountUnicodePath(DrvFsMode Mode)
@@ -1395,6 +1473,16 @@ class WSL1 : public DrvFsTests
         { \
             DrvFsTests::WslPath(DrvFsMode::##_mode##); \
         } \
+\
+        BENCHMARK_TEST_METHOD(WslPathBatch) \
+        { \
+            DrvFsTests::WslPathBatchBenchmark(); \
+        } \
+\
+        BENCHMARK_TEST_METHOD(WslPathEscape) \
+        { \
+            DrvFsTests::WslPathEscapeBenchmark(); \
+        } \
 \
         WSL2_TEST_METHOD(DrvFsMountUnicodePath) \
         { \
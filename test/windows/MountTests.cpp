@@ -19,6 +19,7 @@ Abstract:
 #define TEST_MOUNT_VHD L"TestVhd.vhd"
 #define TEST_UNMOUNT_VHD_DNE L"TestVhdNotHere.vhd"
 #define TEST_MOUNT_NAME L"testmount"
+#define TEST_PROBE_VHD L"TestProbeVhd.vhd"
 
 #define SKIP_UNSUPPORTED_ARM64_MOUNT_TEST() \
     if constexpr (wsl::shared::Arm64) \
@@ -290,6 +291,38 @@ class MountTests
         TestFilesystemDetectionFailImpl(true);
     }
 
+    // Validate that the superblock probe identifies ext4, xfs and vfat volumes without falling back
+    // to blkid, and that it rejects a zeroed volume.
+    WSL2_TEST_METHOD(TestFilesystemProbe)
+    {
+        SKIP_UNSUPPORTED_ARM64_MOUNT_TEST();
+
+        TestFilesystemProbeImpl();
+    }
+
+    // Validate that init finds a disk that is hot-added again after being removed, so the block
+    // device monitor doesn't return the device name recorded by the first add event.
+    WSL2_TEST_METHOD(TestHotAddedDiskFoundAfterRemoval)
+    {
+        SKIP_UNSUPPORTED_ARM64_MOUNT_TEST();
+
+        WslKeepAlive keepAlive;
+
+        // Create a MBR disk with 1 ext4 partition
+        FormatDisk({L"ext4"}, true);
+
+        for (auto i = 0; i < 2; i++)
+        {
+            // Attach and mount the disk, which makes init wait for the disk to appear.
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--mount " + VhdDevice + L" --vhd --partition 1"), (DWORD)0);
+            const auto disk = GetBlockDeviceInWsl();
+            VERIFY_IS_TRUE(IsBlockDevicePresent(disk));
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--unmount " + VhdDevice), (DWORD)0);
+            WaitForDiskReady();
+        }
+    }
+
     // Test specifying a mount name for a vhd
     WSL2_TEST_METHOD(SpecifyMountName)
     {
@@ -1540,6 +1573,59 @@ class MountTests
         }
     }
 
+    void TestFilesystemProbeImpl()
+    {
+        // mkfs.xfs refuses to create volumes smaller than 300MB, so use a dedicated (dynamic) vhd.
+        const auto vhdPath = wsl::windows::common::filesystem::GetFullPath(TEST_PROBE_VHD);
+        DeleteFileW(TEST_PROBE_VHD);
+        LxsstuLaunchPowershellAndCaptureOutput(L"New-Vhd -Path " TEST_PROBE_VHD " -SizeBytes 512MB");
+        auto deleteVhd = wil::scope_exit([&]() {
+            LxsstuLaunchWsl(L"--unmount " + vhdPath);
+            DeleteFileW(TEST_PROBE_VHD);
+        });
+
+        WslKeepAlive keepAlive;
+
+        const std::vector<std::pair<std::wstring, std::wstring>> filesystems{
+            {L"ext4", L"mkfs.ext4 -F"}, {L"xfs", L"mkfs.xfs -f"}, {L"vfat", L"mkfs.fat --mbr=no -I"}};
+
+        for (const auto& [type, format] : filesystems)
+        {
+            LogInfo("Probing %ls", type.c_str());
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--mount " + vhdPath + L" --vhd --bare"), (DWORD)0);
+            const auto disk = GetBlockDeviceInWsl();
+            VERIFY_IS_TRUE(IsBlockDevicePresent(disk));
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(format + L" " + disk), (DWORD)0);
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--unmount " + vhdPath), (DWORD)0);
+
+            // Mount it without a type, and validate that the superblock probe picked the filesystem.
+            const auto probeCommand = L"dmesg | grep -c 'Detected " + type + L" filesystem from superblock' || true";
+            const auto probesBefore = std::stoi(LxsstuLaunchWslAndCaptureOutput(probeCommand).first);
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--mount " + vhdPath + L" --vhd"), (DWORD)0);
+            std::wstring trimmedDiskName(vhdPath);
+            Trim(trimmedDiskName);
+            ValidateMountPoint(GetBlockDeviceInWsl(), L"/mnt/wsl/" + trimmedDiskName, {}, type);
+
+            const auto probesAfter = std::stoi(LxsstuLaunchWslAndCaptureOutput(probeCommand).first);
+            VERIFY_ARE_EQUAL(probesAfter, probesBefore + 1);
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--unmount " + vhdPath), (DWORD)0);
+        }
+
+        // A zeroed volume has no signature, so neither the probe nor blkid should identify it.
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"--mount " + vhdPath + L" --vhd --bare"), (DWORD)0);
+        const auto disk = GetBlockDeviceInWsl();
+        VERIFY_IS_TRUE(IsBlockDevicePresent(disk));
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"dd bs=4M count=4 if=/dev/zero of=" + disk), (DWORD)0);
+
+        wsl::windows::common::SvcComm service;
+        const auto result = service.MountDisk(vhdPath.c_str(), LXSS_ATTACH_MOUNT_FLAGS_VHD, 0, nullptr, nullptr, nullptr);
+        VERIFY_ARE_EQUAL(result.Result, -1); //-EINVAL
+        VERIFY_ARE_EQUAL(result.Step, 6);    // LxMiniInitMountStepDetectFilesystem
+    }
+
     void TestFilesystemDetectionFailImpl(bool isVhd)
     {
         const auto deviceName = (isVhd) ? VhdDevice : DiskDevice;
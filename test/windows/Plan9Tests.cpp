@@ -261,6 +261,47 @@ class Plan9Tests
         }
     }
 
+    // Tests that cached directory listings are invalidated when the directory changes.
+    TEST_METHOD(TestReadDirCacheInvalidation)
+    {
+        LxssWriteWslDistroConfig("[fileServer]\nreadDirCache=true\n");
+        TerminateDistribution();
+
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [] {
+            LxsstuLaunchWsl(L"rm -f /etc/wsl.conf");
+            TerminateDistribution();
+        });
+
+        VERIFY_WIN32_BOOL_SUCCEEDED(CreateDirectory(LXSST_P9_TEST_DIR L"\\readdircachetest", nullptr));
+        CreateNewTestFile(L"\\readdircachetest\\a", "a");
+        VERIFY_ARE_EQUAL(ListDirectory(L"\\readdircachetest"), L"a");
+
+        // Create a file in the cached directory.
+        CreateNewTestFile(L"\\readdircachetest\\b", "b");
+        VERIFY_ARE_EQUAL(ListDirectory(L"\\readdircachetest"), L"a,b");
+
+        // Rename a file in the cached directory.
+        VERIFY_WIN32_BOOL_SUCCEEDED(
+            MoveFile(LXSST_P9_TEST_DIR L"\\readdircachetest\\a", LXSST_P9_TEST_DIR L"\\readdircachetest\\c"));
+        VERIFY_ARE_EQUAL(ListDirectory(L"\\readdircachetest"), L"b,c");
+
+        // Delete a file from the cached directory.
+        VERIFY_WIN32_BOOL_SUCCEEDED(DeleteFileW(LXSST_P9_TEST_DIR L"\\readdircachetest\\b"));
+        VERIFY_ARE_EQUAL(ListDirectory(L"\\readdircachetest"), L"c");
+
+        // Change the directory from inside the distribution, without going through the file server.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                L"touch /data/p9_test/readdircachetest/d && "
+                L"mv /data/p9_test/readdircachetest/c /data/p9_test/readdircachetest/e"),
+            0u);
+
+        VERIFY_ARE_EQUAL(ListDirectory(L"\\readdircachetest"), L"d,e");
+
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"rm /data/p9_test/readdircachetest/d"), 0u);
+        VERIFY_ARE_EQUAL(ListDirectory(L"\\readdircachetest"), L"e");
+    }
+
     // Tests using mount points inside the WSL instance.
     TEST_METHOD(TestMounts)
     {
@@ -375,6 +416,105 @@ class Plan9Tests
         VERIFY_ARE_EQUAL(STATUS_NOT_A_DIRECTORY, status);
     }
 
+    // Tests that a connection doing large reads can't starve the small requests of another connection.
+    TEST_METHOD(TestFairQueue)
+    {
+        // Lower the in-flight I/O budget so the large reads alone exceed it and requests get queued.
+        LxssWriteWslDistroConfig("[fileServer]\nioBudget=1MB\n");
+        TerminateDistribution();
+
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [] {
+            LxsstuLaunchWsl(L"rm -f /etc/wsl.conf /data/p9_test/fairqueuelarge");
+            TerminateDistribution();
+        });
+
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"head -c 256M /dev/urandom > /data/p9_test/fairqueuelarge"), 0u);
+        CreateNewTestFile(L"\\fairqueuesmall", "0123456789");
+
+        // Read the large file through another server name, so the reads arrive on a separate connection.
+        constexpr size_t bufferSize = 1024 * 1024;
+        std::atomic<bool> stop{false};
+        std::atomic<ULONGLONG> bulkBytes{0};
+        std::thread bulk([&]() {
+            const wil::unique_virtualalloc_ptr<char> buffer{
+                static_cast<char*>(VirtualAlloc(nullptr, bufferSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE))};
+
+            while (buffer && !stop)
+            {
+                const wil::unique_hfile file{CreateFile(
+                    L"\\\\wsl$\\" LXSS_DISTRO_NAME_TEST_L L"\\data\\p9_test\\fairqueuelarge",
+                    GENERIC_READ,
+                    FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                    nullptr,
+                    OPEN_EXISTING,
+                    FILE_FLAG_NO_BUFFERING,
+                    nullptr)};
+
+                if (!file)
+                {
+                    return;
+                }
+
+                DWORD bytes{};
+                while (!stop && ReadFile(file.get(), buffer.get(), static_cast<DWORD>(bufferSize), &bytes, nullptr) && bytes > 0)
+                {
+                    bulkBytes += bytes;
+                }
+            }
+        });
+
+        auto stopBulk = wil::scope_exit([&]() {
+            stop = true;
+            bulk.join();
+        });
+
+        wsl::shared::retry::RetryWithTimeout<void>(
+            [&]() { THROW_HR_IF(E_ABORT, bulkBytes == 0); }, std::chrono::milliseconds(100), std::chrono::seconds(30));
+
+        // Validate that the small requests keep completing while the large reads are in flight.
+        for (int i = 0; i < 20; ++i)
+        {
+            const auto start = std::chrono::steady_clock::now();
+            const auto file = CreateTestFile(L"\\fairqueuesmall", FILE_GENERIC_READ);
+            char buffer[16];
+            DWORD bytes;
+            VERIFY_WIN32_BOOL_SUCCEEDED(ReadFile(file.get(), buffer, sizeof(buffer), &bytes, nullptr));
+            VERIFY_ARE_EQUAL(10u, bytes);
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            VERIFY_IS_LESS_THAN(elapsed.count(), 2000ll);
+        }
+
+        // Validate that the large reads were still running.
+        const auto bulkBytesBefore = bulkBytes.load();
+        wsl::shared::retry::RetryWithTimeout<void>(
+            [&]() { THROW_HR_IF(E_ABORT, bulkBytes == bulkBytesBefore); },
+            std::chrono::milliseconds(100),
+            std::chrono::seconds(30));
+    }
+
+    // Connections that share a session share their fids, and a session can only be joined by
+    // the user that registered it. The test speaks 9P to a private instance of the server, see
+    // test/linux/unit_tests/plan9.c.
+    TEST_METHOD(TestSessions)
+    {
+        VERIFY_NO_THROW(LxsstuRunTest(L"/data/test/wsl_unit_tests plan9 -v 7", L"Plan9"));
+    }
+
+    // A bulk sequential read of a file that wasn't cached must not leave it in the page cache, with
+    // page-aligned reads and with reads that split almost every page between two requests.
+    WSL2_TEST_METHOD(TestStreamingReads)
+    {
+        VERIFY_NO_THROW(LxsstuRunTest(L"/data/test/wsl_unit_tests plan9 -v 24", L"Plan9StreamingReads"));
+    }
+
+    // Logs the cost of each additional path component for Twalk, which looks the components up
+    // one at a time, and for Twopen, which resolves them with a single openat2 call.
+    BENCHMARK_TEST_METHOD(WalkBenchmark)
+    {
+        VERIFY_NO_THROW(LxsstuRunTest(L"/data/test/wsl_unit_tests plan9 -v 32", L"Plan9WalkBenchmark"));
+    }
+
     static auto EnablePlan9Logging()
     {
         LxssWriteWslDistroConfig("[fileServer]\nlogFile=/plan9-logs.txt\nlogTruncate=false\nlogLevel=5");
@@ -559,6 +699,37 @@ class Plan9Tests
         return true;
     }
 
+    // Returns the sorted, comma separated names of the files in a directory.
+    static std::wstring ListDirectory(std::wstring_view path)
+    {
+        std::wstring pattern{LXSST_P9_TEST_DIR};
+        pattern += path;
+        pattern += L"\\*";
+
+        WIN32_FIND_DATA findData{};
+        const wil::unique_hfind find{FindFirstFile(pattern.c_str(), &findData)};
+        VERIFY_WIN32_BOOL_SUCCEEDED(static_cast<bool>(find));
+
+        std::set<std::wstring> names;
+        do
+        {
+            if (wcscmp(findData.cFileName, L".") != 0 && wcscmp(findData.cFileName, L"..") != 0)
+            {
+                names.emplace(findData.cFileName);
+            }
+        } while (FindNextFile(find.get(), &findData));
+
+        VERIFY_LAST_ERROR(ERROR_NO_MORE_FILES);
+
+        std::wstring list;
+        for (const auto& name : names)
+        {
+            list += list.empty() ? name : L"," + name;
+        }
+
+        return list;
+    }
+
     ULONGLONG GetFileId(std::wstring_view path)
     {
         BY_HANDLE_FILE_INFORMATION info;
@@ -147,6 +147,22 @@ class UnitTests
             VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"xz -t {}", tarPath)), 0L);
         }
 
+        // Verify that zstd compression works, and that the archive can be imported
+        {
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(
+                std::format(L"--export {} {} --format tar.zst", LXSS_DISTRO_NAME_TEST_L, tarPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+
+            auto unregister = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, []() { LxsstuLaunchWsl(L"--unregister test-zstd"); });
+            VERIFY_ARE_EQUAL(
+                LxsstuLaunchWsl(std::format(L"--import test-zstd . {} --version {}", tarPath, LxsstuVmMode() ? 2 : 1)), 0L);
+
+            auto [bashrc, _] = LxsstuLaunchWslAndCaptureOutput(L"-d test-zstd ls /root/.bashrc");
+            VERIFY_ARE_EQUAL(bashrc, L"/root/.bashrc\n");
+        }
+
         // Validate that exporting as vhd works
         if (LxsstuVmMode())
         {
@@ -171,6 +187,124 @@ class UnitTests
         }
     }
 
+    WSL2_TEST_METHOD(IncrementalExport)
+    {
+        constexpr auto fullPath = L"incremental-full.tar";
+        constexpr auto deltaPath = L"incremental-delta.tar";
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, []() {
+            LxsstuLaunchWsl(L"--unregister test-delta");
+            LxsstuLaunchWsl(L"--unregister test-delta-2");
+            LxsstuLaunchWsl(L"rm -rf /var/lib/wsl /root/incremental-created /root/incremental-deleted");
+            DeleteFile(fullPath);
+            DeleteFile(deltaPath);
+        });
+
+        // The first incremental export contains the whole distribution.
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"touch /root/incremental-deleted"), 0L);
+
+        {
+            auto [out, err] =
+                LxsstuLaunchWslAndCaptureOutput(std::format(L"--export {} {} --incremental", LXSS_DISTRO_NAME_TEST_L, fullPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+        }
+
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"--import test-delta . {} --version 2", fullPath)), 0L);
+
+        // The next one only contains what changed.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(L"bash -c 'rm /root/incremental-deleted && echo delta > /root/incremental-created'"), 0L);
+
+        {
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(
+                std::format(L"--export {} {} --incremental", LXSS_DISTRO_NAME_TEST_L, deltaPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+        }
+
+        {
+            auto [out, _] =
+                LxsstuLaunchWslAndCaptureOutput(std::format(L"bash -c 'tar tf {} | grep -c /usr/bin/'", deltaPath), 1);
+            VERIFY_ARE_EQUAL(out, L"0\n");
+        }
+
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"--import-delta test-delta {}", deltaPath)), 0L);
+
+        {
+            auto [out, _] = LxsstuLaunchWslAndCaptureOutput(L"-d test-delta cat /root/incremental-created");
+            VERIFY_ARE_EQUAL(out, L"delta\n");
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"-d test-delta test -e /root/incremental-deleted"), 1L);
+        }
+
+        // Validate that a layer can't be applied twice, or imported as a new distribution.
+        LxsstuLaunchWsl(L"--terminate test-delta");
+
+        {
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(std::format(L"--import-delta test-delta {}", deltaPath), -1);
+            VERIFY_IS_TRUE(err.find(L"is based on") != std::wstring::npos);
+        }
+
+        {
+            auto [out, err] =
+                LxsstuLaunchWslAndCaptureOutput(std::format(L"--import test-delta-2 . {} --version 2", deltaPath), -1);
+            VERIFY_IS_TRUE(err.find(L"--import-delta") != std::wstring::npos);
+        }
+    }
+
+    WSL2_TEST_METHOD(ArchiveDigest)
+    {
+        constexpr auto tarPath = L"digest.tar.gz";
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [&]() {
+            LxsstuLaunchWsl(L"--unregister test-digest");
+            DeleteFile(tarPath);
+        });
+
+        // Exporting relays the archive from the bsdtar pipe, which hashes it on the splice path.
+        std::wstring expectedDigest;
+        {
+            auto [out, err] = LxsstuLaunchWslAndCaptureOutput(
+                std::format(L"--export {} {} --format tar.gz --sha256", LXSS_DISTRO_NAME_TEST_L, tarPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+
+            auto [sha256sum, _] = LxsstuLaunchWslAndCaptureOutput(std::format(L"sha256sum {}", tarPath));
+            VERIFY_IS_TRUE(sha256sum.size() >= 64);
+            expectedDigest = std::format(L"SHA-256 digest: {}\n", sha256sum.substr(0, 64));
+
+            VERIFY_ARE_EQUAL(err, expectedDigest);
+        }
+
+        // Importing relays the archive from a socket, which hashes it on the buffer copy path.
+        {
+            auto [out, err] =
+                LxsstuLaunchWslAndCaptureOutput(std::format(L"--import test-digest . {} --version 2 --sha256", tarPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, expectedDigest);
+        }
+
+        // The digest is only printed when requested.
+        {
+            auto [out, err] =
+                LxsstuLaunchWslAndCaptureOutput(std::format(L"--export {} {} --format tar.gz", LXSS_DISTRO_NAME_TEST_L, tarPath));
+
+            VERIFY_ARE_EQUAL(out, L"The operation completed successfully. \r\n");
+            VERIFY_ARE_EQUAL(err, L"");
+        }
+
+        // The digest is only available for tar files, so it can't be requested for a vhd or an incremental layer.
+        VERIFY_ARE_NOT_EQUAL(
+            LxsstuLaunchWsl(std::format(L"--export {} digest.vhdx --format vhd --sha256", LXSS_DISTRO_NAME_TEST_L)), 0L);
+
+        {
+            auto [out, _] = LxsstuLaunchWslAndCaptureOutput(std::format(L"--import-delta test-digest {} --sha256", tarPath), -1);
+            VERIFY_IS_TRUE(out.find(L"--sha256") != std::wstring::npos);
+        }
+    }
+
     WSL2_TEST_METHOD(SystemdSafeMode)
     {
         SKIP_TEST_UNSTABLE(); // TODO: Re-enable when this issue is solved in main.
@@ -560,6 +694,125 @@ class UnitTests
         validate("/wsl-test-mount");
     }
 
+    WSL2_TEST_METHOD(MultiplexStdio)
+    {
+        WslConfigChange config(LxssGenerateTestConfig({.multiplexStdio = true}));
+
+        // Validate that all the streams and the exit code are relayed.
+        auto cmd = LxssGenerateWslCommandLine(L"cat; echo error >&2");
+        auto [out, err] = LxsstuLaunchCommandAndCaptureOutput(cmd.data(), "input\n");
+        VERIFY_ARE_EQUAL(out, L"input\n");
+        VERIFY_ARE_EQUAL(err, L"error\n");
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"exit 3"), 3u);
+
+        // Validate that a large output isn't truncated by the flow control.
+        std::tie(out, err) = LxsstuLaunchWslAndCaptureOutput(L"head -c 4000000 /dev/zero | tr '\\0' a");
+        VERIFY_ARE_EQUAL(out.size(), size_t{4000000});
+        VERIFY_ARE_EQUAL(out.find_first_not_of(L'a'), std::wstring::npos);
+    }
+
+    // This benchmark logs the launch latency of short commands with one connection per stream and with all the
+    // streams multiplexed over a single connection (experimental.multiplexStdio).
+    BENCHMARK_TEST_METHOD(MultiplexStdioLaunchLatency)
+    {
+        if (!LxsstuVmMode())
+        {
+            LogSkipped("This test is only applicable to WSL2");
+            return;
+        }
+
+        constexpr auto iterations = 50;
+        const auto measureLaunchLatency = []() {
+            // Make sure the distribution is running before measuring.
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"true"), 0u);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (auto i = 0; i < iterations; i++)
+            {
+                VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"true"), 0u);
+            }
+
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start) / iterations;
+        };
+
+        const auto separateLatency = measureLaunchLatency();
+
+        WslConfigChange config(LxssGenerateTestConfig({.multiplexStdio = true}));
+        const auto multiplexedLatency = measureLaunchLatency();
+
+        LogInfo(
+            "Average launch latency: %lld us with separate connections, %lld us multiplexed",
+            static_cast<long long>(separateLatency.count()),
+            static_cast<long long>(multiplexedLatency.count()));
+    }
+
+    WSL2_TEST_METHOD(UserLookupCache)
+    {
+        DistroFileChange wslConf(L"/etc/wsl.conf", false);
+        wslConf.SetContent(L"[user]\nlookupCache=true\n");
+        TerminateDistribution();
+
+        // Validate that the user, groups and environment are the same as without the cache.
+        const auto expectedUser = LxsstuLaunchWslAndCaptureOutput(L"id -un").first;
+        VERIFY_ARE_EQUAL(LxsstuLaunchWslAndCaptureOutput(L"-u root id -un").first, L"root\n");
+        VERIFY_ARE_EQUAL(LxsstuLaunchWslAndCaptureOutput(L"id -un").first, expectedUser);
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWslAndCaptureOutput(L"id -G").first, LxsstuLaunchWslAndCaptureOutput(L"id -G $(id -un)").first);
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWslAndCaptureOutput(L"echo $HOME").first,
+            LxsstuLaunchWslAndCaptureOutput(L"getent passwd $(id -un) | cut -d: -f6").first);
+
+        // Validate that the cache is discarded when /etc/passwd or /etc/group change.
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"-u root useradd -m lookup-cache-test"), 0u);
+        auto cleanup = wil::scope_exit([]() { LxsstuLaunchWsl(L"-u root userdel -r lookup-cache-test"); });
+
+        VERIFY_ARE_EQUAL(LxsstuLaunchWslAndCaptureOutput(L"-u lookup-cache-test id -un").first, L"lookup-cache-test\n");
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(L"-u root groupadd lookup-cache-group && usermod -aG lookup-cache-group lookup-cache-test"), 0u);
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWslAndCaptureOutput(L"-u lookup-cache-test id -Gn | grep -ow lookup-cache-group").first,
+            L"lookup-cache-group\n");
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"-u root groupdel lookup-cache-group"), 0u);
+    }
+
+    // This benchmark logs the launch latency of short commands with and without the passwd and group lookups
+    // cached by the session leader (user.lookupCache in /etc/wsl.conf).
+    BENCHMARK_TEST_METHOD(UserLookupCacheLaunchLatency)
+    {
+        if (!LxsstuVmMode())
+        {
+            LogSkipped("This test is only applicable to WSL2");
+            return;
+        }
+
+        constexpr auto iterations = 50;
+        const auto measureLaunchLatency = []() {
+            // Make sure the distribution is running before measuring.
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"true"), 0u);
+
+            const auto start = std::chrono::steady_clock::now();
+            for (auto i = 0; i < iterations; i++)
+            {
+                VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"true"), 0u);
+            }
+
+            return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start) / iterations;
+        };
+
+        const auto defaultLatency = measureLaunchLatency();
+
+        DistroFileChange wslConf(L"/etc/wsl.conf", false);
+        wslConf.SetContent(L"[user]\nlookupCache=true\n");
+        TerminateDistribution();
+
+        const auto cachedLatency = measureLaunchLatency();
+
+        LogInfo(
+            "Average launch latency: %lld us by default, %lld us with user.lookupCache",
+            static_cast<long long>(defaultLatency.count()),
+            static_cast<long long>(cachedLatency.count()));
+    }
+
     WSL2_TEST_METHOD(ConfigUpdateLanguage)
     {
         // Validates that init populates $LANG from the distro locale configuration file.
@@ -1835,7 +2088,14 @@ Arguments for managing distributions in Windows Subsystem for Linux:
 
         Options:
             --format <Format>
-                Specifies the export format. Supported values: tar, tar.gz, tar.xz, vhd.
+                Specifies the export format. Supported values: tar, tar.gz, tar.xz, tar.zst, vhd.
+
+            --incremental
+                Only exports the files that changed since the previous incremental export.
+                The first incremental export contains the whole distribution.
+
+            --sha256
+                Prints the SHA-256 digest of the exported tar file.
 
     --import <Distro> <InstallLocation> <FileName> [Options]
         Imports the specified tar file as a new distribution.
@@ -1849,6 +2109,14 @@ Arguments for managing distributions in Windows Subsystem for Linux:
                 Specifies that the provided file is a .vhd or .vhdx file, not a tar file.
                 This operation makes a copy of the VHD file at the specified install location.
 
+            --sha256
+                Prints the SHA-256 digest of the imported tar file.
+
+    --import-delta <Distro> <FileName>
+        Applies an incremental export to a distribution.
+        The distribution must have been imported from the previous incremental export.
+        The filename can be - for stdin.
+
     --import-in-place <Distro> <FileName>
         Imports the specified VHD file as a new distribution.
         This virtual hard disk must be formatted with the ext4 filesystem type.
@@ -1990,6 +2258,126 @@ Error code: Wsl/InstallDistro/WSL_E_DISTRO_NOT_FOUND
         validateSwapSize(L"200M");
     }
 
+    WSL2_TEST_METHOD(CompressedSwap)
+    {
+        // Validate that a zram device is used as swap, before the swap vhd.
+        WslConfigChange configChange(
+            LxssGenerateTestConfig() + L"\nswap=256MB\n[experimental]\ncompressedSwap=zram\ncompressedSwapSize=128MB\n");
+
+        auto [output, _] = LxsstuLaunchWslAndCaptureOutput(L"swapon --show=NAME,SIZE,PRIO --noheadings --raw | grep zram");
+        VERIFY_ARE_EQUAL(L"/dev/zram0 128M 100\n", output);
+
+        // Validate that zswap is enabled in front of the swap vhd.
+        configChange.Update(LxssGenerateTestConfig() + L"\nswap=256MB\n[experimental]\ncompressedSwap=zswap\n");
+
+        std::tie(output, std::ignore) = LxsstuLaunchWslAndCaptureOutput(L"cat /sys/module/zswap/parameters/enabled");
+        VERIFY_ARE_EQUAL(L"Y\n", output);
+
+        std::tie(output, std::ignore) =
+            LxsstuLaunchWslAndCaptureOutput(L"swapon --show=NAME --noheadings | grep -c zram || true");
+        VERIFY_ARE_EQUAL(L"0\n", output);
+    }
+
+    WSL2_TEST_METHOD(WorkingSetMemoryReclaim)
+    {
+        // Shorten the cold page age so that a scan happens during the test.
+        WslConfigChange configChange(
+            LxssGenerateTestConfig({.kernelCommandLine = L"WSL_COLD_PAGE_AGE=10"}) +
+            L"\n[experimental]\nautoMemoryReclaim=WorkingSet\n");
+
+        WslKeepAlive keepAlive;
+
+        std::wstring backend;
+        VERIFY_NO_THROW(wsl::shared::retry::RetryWithTimeout<void>(
+            [&]() {
+                backend = LxsstuLaunchWslAndCaptureOutput(
+                              L"dmesg | grep -o -e 'Tracking cold pages with .*' -e 'Cold page tracking is unavailable' || true")
+                              .first;
+                THROW_HR_IF(E_UNEXPECTED, backend.empty());
+            },
+            std::chrono::seconds(1),
+            std::chrono::minutes(1)));
+
+        if (backend.find(L"unavailable") != std::wstring::npos)
+        {
+            LogSkipped("Neither DAMON nor idle page tracking is available in this kernel, skipping test");
+            return;
+        }
+
+        LogInfo("%ls", backend.c_str());
+
+        // Read a file once so that its page cache goes cold, then validate that a later scan reports it.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                L"dd if=/dev/urandom of=/var/tmp/cold-pages bs=1M count=64 status=none && cat /var/tmp/cold-pages > /dev/null"),
+            0u);
+
+        auto cleanup = wil::scope_exit([]() { LxsstuLaunchWsl(L"rm -f /var/tmp/cold-pages"); });
+
+        VERIFY_NO_THROW(wsl::shared::retry::RetryWithTimeout<void>(
+            [&]() {
+                const auto output =
+                    LxsstuLaunchWslAndCaptureOutput(L"grep -c 'cold_file_bytes=[1-9]' /mnt/wsl/working-set || true").first;
+                THROW_HR_IF(E_UNEXPECTED, std::stoi(output) == 0);
+            },
+            std::chrono::seconds(5),
+            std::chrono::minutes(1)));
+    }
+
+    WSL2_TEST_METHOD(IdleCgroupsReclaimedFirst)
+    {
+        // Without a per-distro cgroup, the distribution can create cgroups where init tracks containers.
+        WslConfigChange configChange(
+            LxssGenerateTestConfig({.isolateDistroCgroup = false}) + L"\n[experimental]\nautoMemoryReclaim=Gradual\n");
+
+        WslKeepAlive keepAlive;
+
+        auto cleanup = wil::scope_exit([]() {
+            LxsstuLaunchWsl(
+                L"pkill -f 'reclaim-bus[y]'; sleep 1; rmdir /sys/fs/cgroup/docker/idle /sys/fs/cgroup/docker/busy; "
+                L"rm -f /var/tmp/reclaim-idle /var/tmp/reclaim-busy");
+        });
+
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                L"echo '+memory +cpu' > /sys/fs/cgroup/cgroup.subtree_control && mkdir -p /sys/fs/cgroup/docker && "
+                L"echo '+memory +cpu' > /sys/fs/cgroup/docker/cgroup.subtree_control && "
+                L"mkdir -p /sys/fs/cgroup/docker/idle /sys/fs/cgroup/docker/busy"),
+            0u);
+
+        // Fill the page cache of the idle cgroup once, and keep the busy cgroup reading its file.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                L"sh -c 'echo $$ > /sys/fs/cgroup/docker/idle/cgroup.procs && "
+                L"dd if=/dev/urandom of=/var/tmp/reclaim-idle bs=1M count=256 status=none && "
+                L"cat /var/tmp/reclaim-idle > /dev/null'"),
+            0u);
+
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                L"dd if=/dev/urandom of=/var/tmp/reclaim-busy bs=1M count=256 status=none && "
+                L"setsid sh -c 'echo $$ > /sys/fs/cgroup/docker/busy/cgroup.procs && "
+                L"while true; do cat /var/tmp/reclaim-busy > /dev/null; done' < /dev/null > /dev/null 2>&1 &"),
+            0u);
+
+        // The idle cgroup should be reclaimed after the idle window, even though the busy cgroup keeps the VM busy.
+        auto reclaimedBytes = [](LPCWSTR cgroup) {
+            const auto command = std::format(
+                L"grep -o '^/sys/fs/cgroup/docker/{} .*reclaimed_bytes=[0-9]*' /mnt/wsl/memory-reclaim | "
+                L"grep -o '[0-9]*$' || echo 0",
+                cgroup);
+
+            return std::stoll(LxsstuLaunchWslAndCaptureOutput(command).first);
+        };
+
+        VERIFY_NO_THROW(wsl::shared::retry::RetryWithTimeout<void>(
+            [&]() { THROW_HR_IF(E_UNEXPECTED, reclaimedBytes(L"idle") == 0); },
+            std::chrono::seconds(10),
+            std::chrono::minutes(6)));
+
+        VERIFY_ARE_EQUAL(reclaimedBytes(L"busy"), 0ll);
+    }
+
     TEST_METHOD(InitDoesntBlockSignals)
     {
         auto [output, _] = LxsstuLaunchWslAndCaptureOutput(L"grep -iF SigBlk < /proc/1/status");
@@ -2075,6 +2463,78 @@ Error code: Wsl/InstallDistro/WSL_E_DISTRO_NOT_FOUND
         VERIFY_ARE_EQUAL(output, L"ok\r\n");
     }
 
+    // This test case validates that a stale WSL_INTEROP makes launches look up the interop server of the session, and cache
+    // it per user.
+    TEST_METHOD(InteropSessionCache)
+    {
+        auto cleanup = wil::scope_exit_log(
+            WI_DIAGNOSTICS_INFO, []() { LxsstuLaunchWsl(L"rm -f /run/WSL/1_1_* /run/WSL/0_killed"); });
+
+        const std::wstring stale = L"export WSL_INTEROP=/run/WSL/0_interop; ";
+
+        // Validate that the interop server of the session is cached for the effective user.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                stale + L"cmd.exe /c exit 0 && find /run/WSL -maxdepth 1 -type l -name \"*_$(id -u)_session\" | grep -q ."),
+            0L);
+
+        // Validate that the caches of sessions whose interop server is gone, and temporary links left by processes that
+        // exited, are removed when the next session is cached.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                L"ln -s /run/WSL/0_interop /run/WSL/1_1_$(id -u)_session && "
+                L"ln -s /run/WSL/0_interop /run/WSL/1_1_$(id -u)_session.4194304"),
+            0L);
+
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                stale + L"cmd.exe /c exit 0 && test ! -L /run/WSL/1_1_$(id -u)_session && "
+                        L"test ! -L /run/WSL/1_1_$(id -u)_session.4194304"),
+            0L);
+
+        // Validate that a cache linked to a server that can't be reached, like the socket file left by a killed server, is
+        // replaced by the interop server of the session.
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(
+                stale + L"touch /run/WSL/0_killed && cmd.exe /c exit 0 && "
+                        L"cache=$(echo /run/WSL/$(cut -d' ' -f6 /proc/$$/stat)_*_$(id -u)_session) && "
+                        L"ln -sfn /run/WSL/0_killed \"$cache\" && cmd.exe /c exit 0 && "
+                        L"test \"$(readlink \"$cache\")\" != /run/WSL/0_killed"),
+            0L);
+    }
+
+    // This benchmark logs the rate of Windows process launches, sequential and parallel, with a valid WSL_INTEROP and
+    // with a stale one that makes the launches look up the interop server of the session.
+    BENCHMARK_TEST_METHOD(InteropLaunchRate)
+    {
+        constexpr int launches = 50;
+        const std::wstring sequential = std::format(L"for i in $(seq {}); do cmd.exe /c exit 0 || exit 1; done", launches);
+        const std::wstring parallel = std::format(
+            L"pids=; for i in $(seq {}); do cmd.exe /c exit 0 & pids=\"$pids $!\"; done; "
+            L"for pid in $pids; do wait $pid || exit 1; done",
+            launches);
+
+        auto measure = [&](LPCWSTR description, const std::wstring& commandLine) {
+            const auto start = std::chrono::steady_clock::now();
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(commandLine), 0L);
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            LogInfo(
+                "%ls: %d launches in %lldms (%lld launches/s)",
+                description,
+                launches,
+                elapsed.count(),
+                launches * 1000LL / std::max(elapsed.count(), 1LL));
+        };
+
+        measure(L"Sequential", sequential);
+        measure(L"Parallel", parallel);
+
+        const std::wstring stale = L"export WSL_INTEROP=/run/WSL/0_interop; ";
+        measure(L"Sequential, stale WSL_INTEROP", stale + sequential);
+        measure(L"Parallel, stale WSL_INTEROP", stale + parallel);
+    }
+
     TEST_METHOD(Hostname)
     {
         auto cleanup = wil::scope_exit([] {
@@ -2975,6 +3435,15 @@ Error code: Wsl/InstallDistro/WSL_E_DISTRO_NOT_FOUND
         configChange.Update(LxssGenerateTestConfig({.loadKernelModules = L"usb_storage,dm_crypt"}));
         ValidateOutput(L"grep -iE '^(usb_storage|dm_crypt)' /proc/modules  | wc -l", L"2\n", L"", 0);
 
+        // Validate that the modules are loaded in process, and that the time it took to load each of them is logged.
+        ValidateOutput(L"dmesg | grep -cE 'Loaded module (usb_storage|dm_crypt) in [0-9]+us'", L"2\n", L"", 0);
+
+        // Validate that <module>.<parameter>=<value> entries on the kernel command line are passed to modules loaded in process.
+        configChange.Update(
+            LxssGenerateTestConfig({.kernelCommandLine = L"usb-storage.delay_use=7", .loadKernelModules = L"usb_storage"}));
+        ValidateOutput(L"cat /sys/module/usb_storage/parameters/delay_use", L"7\n", L"", 0);
+        ValidateOutput(L"dmesg | grep -cE 'Loaded module usb_storage in [0-9]+us'", L"1\n", L"", 0);
+
         // Validate that failing to load a module shows a warning in dmesg.
         configChange.Update(LxssGenerateTestConfig({.loadKernelModules = L"not-found"}));
         ValidateOutput(L"dmesg | grep -iF \"failed to load module 'not-found'\" | wc -l", L"1\n", L"", 0);
@@ -3750,6 +4219,7 @@ Error code: Wsl/InstallDistro/WSL_E_DISTRO_NOT_FOUND
                 {MemoryReclaimConfiguration::Disabled, MemoryReclaimConfiguration::Disabled},
                 {MemoryReclaimConfiguration::Gradual, MemoryReclaimConfiguration::Gradual},
                 {MemoryReclaimConfiguration::DropCache, MemoryReclaimConfiguration::DropCache},
+                {MemoryReclaimConfiguration::WorkingSet, MemoryReclaimConfiguration::WorkingSet},
             };
 
             // tuple: WslConfigSetting, expectedValue, actualValue
@@ -6516,6 +6986,37 @@ Error code: Wsl/InstallDistro/WSL_E_INVALID_JSON\r\n",
         VERIFY_ARE_EQUAL(out, L"/mnt/c is a mountpoint\n");
     }
 
+    TEST_METHOD(AutomountParallel)
+    {
+        // Validates that the same DrvFs volumes are mounted one at a time and concurrently (automount.mountThreads in
+        // /etc/wsl.conf), and when the mounts are deferred.
+        const auto listMounts = []() {
+            return LxsstuLaunchWslAndCaptureOutput(L"findmnt -rn -o TARGET | grep -E '^/mnt/[a-z]$' | sort -u").first;
+        };
+
+        DistroFileChange distributionconf(L"/etc/wsl.conf", false);
+        const auto start = [&](const wchar_t* config) {
+            distributionconf.SetContent(config);
+            TerminateDistribution();
+
+            VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"true"), 0u);
+        };
+
+        start(L"[automount]\nmountThreads=1\n");
+        const auto expectedMounts = listMounts();
+        VERIFY_IS_TRUE(expectedMounts.find(L"/mnt/c\n") != std::wstring::npos);
+
+        start(L"[automount]\nmountThreads=8\n");
+        VERIFY_ARE_EQUAL(listMounts(), expectedMounts);
+
+        // Validate that deferred mounts complete after the distribution has started.
+        start(L"[automount]\ndeferTimeout=1\n");
+        wsl::shared::retry::RetryWithTimeout<void>(
+            [&]() { THROW_HR_IF(E_ABORT, listMounts() != expectedMounts); },
+            std::chrono::milliseconds(100),
+            std::chrono::seconds(60));
+    }
+
     // This test case validates that the pipeline doesn't get stuck when both stdout & stdin are a pipe.
     // See: https://github.com/microsoft/WSL/issues/12523
     TEST_METHOD(DualPipeRelay)
@@ -6540,6 +7041,67 @@ Error code: Wsl/InstallDistro/WSL_E_INVALID_JSON\r\n",
         VERIFY_ARE_EQUAL(expandedHash, expectedHash);
     }
 
+    // This test case validates that large streams are relayed intact in both directions, through both the interop
+    // relay (binfmt) and the process relay (init).
+    TEST_METHOD(LargeStreamRelay)
+    {
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [&]() { LxsstuLaunchWsl(L"rm -f /tmp/relay-input"); });
+
+        constexpr size_t size = 64 * 1024 * 1024;
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"head -c {} /dev/urandom > /tmp/relay-input", size)), 0L);
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(L"cat /tmp/relay-input | \"/mnt/c/Program Files/WSL/wsl.exe\" -e cat | cmp - /tmp/relay-input"), 0L);
+    }
+
+    // This benchmark logs the throughput of a large stream relayed in both directions.
+    BENCHMARK_TEST_METHOD(StreamRelayThroughput)
+    {
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, [&]() { LxsstuLaunchWsl(L"rm -f /tmp/relay-input"); });
+
+        constexpr size_t size = 256 * 1024 * 1024;
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(std::format(L"head -c {} /dev/urandom > /tmp/relay-input", size)), 0L);
+
+        const auto start = std::chrono::steady_clock::now();
+        VERIFY_ARE_EQUAL(
+            LxsstuLaunchWsl(L"cat /tmp/relay-input | \"/mnt/c/Program Files/WSL/wsl.exe\" -e cat > /dev/null"), 0L);
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+        LogInfo(
+            "Relayed %zu bytes in %lldms (%lld MB/s)",
+            size,
+            elapsed.count(),
+            (size / (1024 * 1024)) * 1000 / std::max(elapsed.count(), 1LL));
+    }
+
+    // This benchmark logs the export throughput of each archive format. The tar.zst round trip is validated by the
+    // export test.
+    BENCHMARK_TEST_METHOD(ExportThroughput)
+    {
+        constexpr auto tarPath = L"export-throughput.tar";
+        auto cleanup = wil::scope_exit_log(WI_DIAGNOSTICS_INFO, []() { std::filesystem::remove(tarPath); });
+
+        auto [processors, _] = LxsstuLaunchWslAndCaptureOutput(L"nproc");
+        auto [used, __] = LxsstuLaunchWslAndCaptureOutput(L"df --output=used -B1 --one-file-system / | tail -n 1");
+        const auto size = std::stoull(used);
+
+        for (const auto* format : {L"tar", L"tar.gz", L"tar.xz", L"tar.zst"})
+        {
+            const auto start = std::chrono::steady_clock::now();
+            VERIFY_ARE_EQUAL(
+                LxsstuLaunchWsl(std::format(L"--export {} {} --format {}", LXSS_DISTRO_NAME_TEST_L, tarPath, format)), 0L);
+
+            const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+            LogInfo(
+                "Exported %llu bytes as %ls in %lldms (%lld MB/s, %ls processors, %llu bytes written)",
+                size,
+                format,
+                elapsed.count(),
+                (size / (1024 * 1024)) * 1000 / std::max(elapsed.count(), 1LL),
+                processors.substr(0, processors.find(L'\n')).c_str(),
+                std::filesystem::file_size(tarPath));
+        }
+    }
+
     TEST_METHOD(EtcHosts)
     {
         {
@@ -6931,6 +7493,33 @@ Error code: Wsl/InstallDistro/WSL_E_INVALID_JSON\r\n",
         VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"dmesg | grep -iF 'vmbus_send_tl_connect_request'"), 0L);
     }
 
+    WSL2_TEST_METHOD(BootTrace)
+    {
+        // Verify that the boot timeline is written when enabled, and that it contains the spans of mini_init and of the
+        // distro init.
+        WslConfigChange config(LxssGenerateTestConfig({.kernelCommandLine = L"WSL_BOOT_TRACE=1"}));
+        for (const auto* span : {L"EarlyConfig", L"Initialize", L"MountDevice", L"ConfigInitializeInstance", L"StartPlan9Server"})
+        {
+            VERIFY_ARE_EQUAL(
+                LxsstuLaunchWsl(std::format(L"grep -qF '{{\"name\":\"{}\",\"ph\":\"X\"' /mnt/wsl/boot-trace.json", span)), 0L);
+        }
+
+        // Verify that no temporary file is left behind by the writers.
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"ls /mnt/wsl/boot-trace.json.*"), 2L);
+
+        // Verify that nothing is recorded by default.
+        config.Update(LxssGenerateTestConfig());
+        VERIFY_ARE_EQUAL(LxsstuLaunchWsl(L"test -e /mnt/wsl/boot-trace.json"), 1L);
+    }
+
+    WSL2_TEST_METHOD(SerialBoot)
+    {
+        // Verify that the VM boots when the boot steps run one at a time.
+        WslConfigChange config(LxssGenerateTestConfig({.kernelCommandLine = L"WSL_SERIAL_BOOT=1"}));
+        auto [out, _] = LxsstuLaunchWslAndCaptureOutput(L"cat /proc/sys/fs/inotify/max_user_watches");
+        VERIFY_ARE_EQUAL(out, L"524288\n");
+    }
+
     WSL2_TEST_METHOD(CGroupv1)
     {
         // cgroupv1 conflicts with the per-distro cgroup hierarchy